@@ -0,0 +1,210 @@
+#include "BatchRenderer.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+
+namespace LearningGLES {
+
+namespace {
+
+const char* vertexShader =
+    "attribute vec2 position;\n"
+    "attribute vec2 uv;\n"
+    "attribute vec4 color;\n"
+    "uniform vec2 targetSize;\n"
+    "varying vec2 vUV;\n"
+    "varying vec4 vColor;\n"
+    "void main() {\n"
+    "    vUV = uv;\n"
+    "    vColor = color;\n"
+    "    vec2 clip = position / targetSize * 2.0 - 1.0;\n"
+    "    gl_Position = vec4(clip.x, -clip.y, 0.0, 1.0);\n"
+    "}\n";
+
+const char* fragmentShader =
+    "precision mediump float;\n"
+    "uniform sampler2D image;\n"
+    "varying vec2 vUV;\n"
+    "varying vec4 vColor;\n"
+    "void main() {\n"
+    "    gl_FragColor = texture2D(image, vUV) * vColor;\n"
+    "}\n";
+
+// Below this many free quads, wrapping around is cheaper than splitting a batch in two.
+const size_t minQuadsPerUpload = 1024;
+
+} // namespace
+
+const std::vector<const char*> BatchRenderer::attributes = { "position", "uv", "color" };
+
+BatchRenderer::BatchRenderer(GLState& state, ShaderCache& shaderCache, size_t ringSize)
+    : m_state(state)
+    , m_ringSize(ringSize)
+{
+    m_program = shaderCache.program(vertexShader, fragmentShader, attributes);
+    if (!m_program)
+        exit(1);
+
+    const uint8_t white[] = { 255, 255, 255, 255 };
+    glGenTextures(1, &m_whiteTexture);
+    m_state.activeTexture(GL_TEXTURE0);
+    m_state.bindTexture(GL_TEXTURE_2D, m_whiteTexture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, white);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+    // Every quad uses the same two triangles, so one index buffer serves all draws.
+    std::vector<GLushort> indices(maxQuadsPerDraw * 6);
+    for (unsigned i = 0; i < maxQuadsPerDraw; ++i) {
+        const GLushort quad[] = { 0, 1, 2, 2, 1, 3 };
+        for (unsigned j = 0; j < 6; ++j)
+            indices[i * 6 + j] = i * 4 + quad[j];
+    }
+    glGenBuffers(1, &m_indexBuffer);
+    m_state.bindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_indexBuffer);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLushort), indices.data(), GL_STATIC_DRAW);
+
+    glGenBuffers(1, &m_vertexBuffer);
+    m_state.bindBuffer(GL_ARRAY_BUFFER, m_vertexBuffer);
+    glBufferData(GL_ARRAY_BUFFER, m_ringSize, nullptr, GL_STREAM_DRAW);
+}
+
+BatchRenderer::~BatchRenderer()
+{
+    m_state.deleteBuffer(m_vertexBuffer);
+    m_state.deleteBuffer(m_indexBuffer);
+    m_state.deleteTexture(m_whiteTexture);
+}
+
+void BatchRenderer::begin(unsigned targetWidth, unsigned targetHeight)
+{
+    m_targetWidth = targetWidth;
+    m_targetHeight = targetHeight;
+    m_quads.clear();
+}
+
+void BatchRenderer::writeQuad(Vertex* vertices, const Quad& quad)
+{
+    const float x[] = { quad.x, quad.x + quad.width };
+    const float y[] = { quad.y, quad.y + quad.height };
+    const float u[] = { quad.u0, quad.u1 };
+    const float v[] = { quad.v0, quad.v1 };
+    for (unsigned i = 0; i < 4; ++i) {
+        Vertex& vertex = vertices[i];
+        vertex.x = x[i & 1];
+        vertex.y = y[i >> 1];
+        vertex.u = u[i & 1];
+        vertex.v = v[i >> 1];
+        for (unsigned channel = 0; channel < 4; ++channel)
+            vertex.color[channel] = quad.color[channel];
+    }
+}
+
+void BatchRenderer::end()
+{
+    if (m_quads.empty())
+        return;
+
+    // Sorting indices keeps the quads themselves in place, and the index breaks ties, so the
+    // order within a batch is the submission order.
+    m_order.resize(m_quads.size());
+    for (size_t i = 0; i < m_quads.size(); ++i) {
+        const Quad& quad = m_quads[i];
+        uint64_t program = quad.program ? quad.program : m_program;
+        uint64_t key = static_cast<uint64_t>(quad.layer) << 48 | (program & 0xffff) << 32 | quad.texture;
+        m_order[i] = std::make_pair(key, static_cast<uint32_t>(i));
+    }
+    std::sort(m_order.begin(), m_order.end());
+
+    m_state.viewport(0, 0, m_targetWidth, m_targetHeight);
+    m_state.enable(GL_BLEND);
+    m_state.blendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+    m_state.activeTexture(GL_TEXTURE0);
+    m_state.bindBuffer(GL_ARRAY_BUFFER, m_vertexBuffer);
+    m_state.bindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_indexBuffer);
+    for (GLuint i = 0; i < attributes.size(); ++i)
+        glEnableVertexAttribArray(i);
+
+    const size_t quadSize = 4 * sizeof(Vertex);
+    std::vector<Draw> draws;
+    for (size_t first = 0; first < m_order.size(); ) {
+        size_t remaining = m_order.size() - first;
+        size_t space = (m_ringSize - m_ringOffset) / quadSize;
+        if (space < std::min(remaining, minQuadsPerUpload)) {
+            glBufferData(GL_ARRAY_BUFFER, m_ringSize, nullptr, GL_STREAM_DRAW);
+            m_ringOffset = 0;
+            space = m_ringSize / quadSize;
+            m_stats.orphans++;
+        }
+
+        size_t count = std::min(space, remaining);
+        m_vertices.resize(count * 4);
+        draws.clear();
+        for (size_t i = 0; i < count; ++i) {
+            const Quad& quad = m_quads[m_order[first + i].second];
+            GLuint program = quad.program ? quad.program : m_program;
+            GLuint texture = quad.texture ? quad.texture : m_whiteTexture;
+            writeQuad(&m_vertices[i * 4], quad);
+
+            if (draws.empty() || draws.back().program != program || draws.back().texture != texture
+                || draws.back().quadCount == maxQuadsPerDraw)
+                draws.push_back({ program, texture, m_ringOffset + i * quadSize, 0 });
+            draws.back().quadCount++;
+        }
+
+        glBufferSubData(GL_ARRAY_BUFFER, m_ringOffset, count * quadSize, m_vertices.data());
+        m_ringOffset += count * quadSize;
+        m_stats.bytesUploaded += count * quadSize;
+        flush(draws);
+        first += count;
+    }
+
+    m_stats.quads += m_quads.size();
+    m_quads.clear();
+}
+
+void BatchRenderer::flush(const std::vector<Draw>& draws)
+{
+    GLuint currentProgram = 0;
+    for (auto& draw : draws) {
+        m_state.useProgram(draw.program);
+        if (draw.program != currentProgram) {
+            const ProgramUniforms& uniforms = this->uniforms(draw.program);
+            glUniform2f(uniforms.targetSize, m_targetWidth, m_targetHeight);
+            glUniform1i(uniforms.image, 0);
+            currentProgram = draw.program;
+        }
+        m_state.bindTexture(GL_TEXTURE_2D, draw.texture);
+
+        // No base vertex in GLES2: the attributes point at the first vertex of the draw instead.
+        const char* base = reinterpret_cast<const char*>(draw.offset);
+        glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), base + offsetof(Vertex, x));
+        glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), base + offsetof(Vertex, u));
+        glVertexAttribPointer(2, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(Vertex), base + offsetof(Vertex, color));
+        glDrawElements(GL_TRIANGLES, draw.quadCount * 6, GL_UNSIGNED_SHORT, nullptr);
+        m_stats.drawCalls++;
+    }
+}
+
+const BatchRenderer::ProgramUniforms& BatchRenderer::uniforms(GLuint program)
+{
+    auto found = m_uniforms.find(program);
+    if (found != m_uniforms.end())
+        return found->second;
+
+    ProgramUniforms& uniforms = m_uniforms[program];
+    uniforms.targetSize = glGetUniformLocation(program, "targetSize");
+    uniforms.image = glGetUniformLocation(program, "image");
+    return uniforms;
+}
+
+BatchStats BatchRenderer::takeStats()
+{
+    BatchStats stats = m_stats;
+    m_stats = BatchStats();
+    return stats;
+}
+
+} // namespace LearningGLES
@@ -0,0 +1,111 @@
+#pragma once
+
+#include "GLState.h"
+#include "ShaderCache.h"
+#include <GLES2/gl2.h>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+namespace LearningGLES {
+
+// An axis aligned rectangle in window pixels, origin at the top left.
+struct Quad {
+    float x { 0 };
+    float y { 0 };
+    float width { 0 };
+    float height { 0 };
+    // Texture coordinates of the top left and bottom right corners.
+    float u0 { 0 };
+    float v0 { 0 };
+    float u1 { 1 };
+    float v1 { 1 };
+    // Premultiplied RGBA, multiplied with the texture.
+    uint8_t color[4] { 255, 255, 255, 255 };
+    // 0 draws the color alone.
+    GLuint texture { 0 };
+    // 0 for the built-in program. Custom programs must be built with BatchRenderer::attributes
+    // and take the same uniforms as the built-in one.
+    GLuint program { 0 };
+    // Quads are drawn in increasing layer order. Within a layer they are reordered to group
+    // textures and programs, so overlapping translucent quads need distinct layers.
+    uint16_t layer { 0 };
+};
+
+// Draws since the last BatchRenderer::takeStats().
+struct BatchStats {
+    uint64_t quads { 0 };
+    uint64_t drawCalls { 0 };
+    uint64_t bytesUploaded { 0 };
+    // Times the vertex ring wrapped around and its storage was orphaned.
+    uint64_t orphans { 0 };
+};
+
+// Collects quads over a frame and draws them with as few indexed draw calls as possible: one
+// per run of quads sharing a program and texture once sorted.
+//
+// Vertices stream through a single ring buffer. Each upload goes after the previous one, into
+// a range no pending draw reads from, so the driver never has to wait for the GPU; when the
+// ring is full, its storage is orphaned with glBufferData() and filling restarts at the
+// beginning while the GPU keeps reading the old storage.
+class BatchRenderer {
+public:
+    // Attribute bindings of the built-in program.
+    static const std::vector<const char*> attributes;
+    // Indices are 16 bits, as GLES2 only guarantees GL_UNSIGNED_SHORT.
+    static const unsigned maxQuadsPerDraw = 65536 / 4;
+
+    BatchRenderer(GLState&, ShaderCache&, size_t ringSize = 4 << 20);
+    ~BatchRenderer();
+
+    // The viewport is set to the whole target.
+    void begin(unsigned targetWidth, unsigned targetHeight);
+    void drawQuad(const Quad& quad) { m_quads.push_back(quad); }
+    // Sorts, uploads and draws the quads of the frame.
+    void end();
+
+    BatchStats takeStats();
+
+private:
+    struct Vertex {
+        float x, y;
+        float u, v;
+        uint8_t color[4];
+    };
+
+    struct Draw {
+        GLuint program;
+        GLuint texture;
+        // Offset of the first vertex in the ring.
+        size_t offset;
+        unsigned quadCount;
+    };
+
+    struct ProgramUniforms {
+        GLint targetSize { -1 };
+        GLint image { -1 };
+    };
+
+    void writeQuad(Vertex*, const Quad&);
+    void flush(const std::vector<Draw>&);
+    const ProgramUniforms& uniforms(GLuint program);
+
+    GLState& m_state;
+    GLuint m_program { 0 };
+    GLuint m_whiteTexture { 0 };
+    GLuint m_vertexBuffer { 0 };
+    GLuint m_indexBuffer { 0 };
+    size_t m_ringSize { 0 };
+    size_t m_ringOffset { 0 };
+
+    unsigned m_targetWidth { 0 };
+    unsigned m_targetHeight { 0 };
+    std::vector<Quad> m_quads;
+    // Sort key and index in m_quads.
+    std::vector<std::pair<uint64_t, uint32_t>> m_order;
+    std::vector<Vertex> m_vertices;
+    std::unordered_map<GLuint, ProgramUniforms> m_uniforms;
+    BatchStats m_stats;
+};
+
+} // namespace LearningGLES
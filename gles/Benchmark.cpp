@@ -0,0 +1,138 @@
+#include "Benchmark.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <ctime>
+
+namespace LearningGLES {
+
+namespace {
+
+struct Summary {
+    double min { 0 };
+    double max { 0 };
+    double mean { 0 };
+    double stddev { 0 };
+    double p50 { 0 };
+    double p90 { 0 };
+    double p99 { 0 };
+};
+
+Summary summarize(const std::vector<double>& samples)
+{
+    Summary summary;
+    if (samples.empty())
+        return summary;
+
+    std::vector<double> sorted = samples;
+    std::sort(sorted.begin(), sorted.end());
+
+    double sum = 0;
+    for (double sample : sorted)
+        sum += sample;
+    summary.mean = sum / sorted.size();
+
+    double variance = 0;
+    for (double sample : sorted)
+        variance += (sample - summary.mean) * (sample - summary.mean);
+    summary.stddev = std::sqrt(variance / sorted.size());
+
+    summary.min = sorted.front();
+    summary.max = sorted.back();
+    summary.p50 = BenchmarkSuite::percentile(sorted, 50);
+    summary.p90 = BenchmarkSuite::percentile(sorted, 90);
+    summary.p99 = BenchmarkSuite::percentile(sorted, 99);
+    return summary;
+}
+
+void writeString(FILE* file, const std::string& string)
+{
+    fputc('"', file);
+    for (char c : string) {
+        if (c == '"' || c == '\\')
+            fputc('\\', file);
+        if (static_cast<unsigned char>(c) >= 0x20)
+            fputc(c, file);
+    }
+    fputc('"', file);
+}
+
+} // namespace
+
+BenchmarkSuite::BenchmarkSuite(const char* name)
+    : m_name(name)
+{
+    char timestamp[32];
+    time_t now = time(nullptr);
+    strftime(timestamp, sizeof(timestamp), "%Y-%m-%dT%H:%M:%SZ", gmtime(&now));
+    setContext("date", timestamp);
+}
+
+bool BenchmarkSuite::shouldRun(const char* name) const
+{
+    return m_filter.empty() || strstr(name, m_filter.c_str());
+}
+
+BenchmarkResult& BenchmarkSuite::add(const char* name)
+{
+    m_results.emplace_back();
+    m_results.back().name = name;
+    return m_results.back();
+}
+
+double BenchmarkSuite::percentile(const std::vector<double>& sorted, double p)
+{
+    if (sorted.empty())
+        return 0;
+    size_t rank = static_cast<size_t>(std::ceil(p / 100 * sorted.size()));
+    return sorted[rank ? std::min(rank, sorted.size()) - 1 : 0];
+}
+
+void BenchmarkSuite::printSummary(FILE* file) const
+{
+    for (auto& result : m_results) {
+        Summary summary = summarize(result.samples);
+        fprintf(file, "%-32s p50 %12.1f %s  p99 %12.1f %s", result.name.c_str(), summary.p50, result.unit.c_str(), summary.p99, result.unit.c_str());
+        for (auto& metric : result.metrics)
+            fprintf(file, "  %s %.2f", metric.first.c_str(), metric.second);
+        fputc('\n', file);
+    }
+}
+
+void BenchmarkSuite::writeJSON(FILE* file) const
+{
+    fprintf(file, "{\n  \"suite\": ");
+    writeString(file, m_name);
+    fprintf(file, ",\n  \"context\": {");
+    for (size_t i = 0; i < m_context.size(); ++i) {
+        fprintf(file, "%s\n    ", i ? "," : "");
+        writeString(file, m_context[i].first);
+        fprintf(file, ": ");
+        writeString(file, m_context[i].second);
+    }
+    fprintf(file, "\n  },\n  \"benchmarks\": [");
+
+    for (size_t i = 0; i < m_results.size(); ++i) {
+        const BenchmarkResult& result = m_results[i];
+        Summary summary = summarize(result.samples);
+
+        fprintf(file, "%s\n    {\n      \"name\": ", i ? "," : "");
+        writeString(file, result.name);
+        fprintf(file, ",\n      \"unit\": ");
+        writeString(file, result.unit);
+        fprintf(file, ",\n      \"count\": %zu", result.samples.size());
+        fprintf(file, ",\n      \"min\": %.3f,\n      \"mean\": %.3f,\n      \"p50\": %.3f,\n      \"p90\": %.3f,\n      \"p99\": %.3f,\n      \"max\": %.3f,\n      \"stddev\": %.3f",
+            summary.min, summary.mean, summary.p50, summary.p90, summary.p99, summary.max, summary.stddev);
+        for (auto& metric : result.metrics) {
+            fprintf(file, ",\n      ");
+            writeString(file, metric.first);
+            fprintf(file, ": %.3f", metric.second);
+        }
+        fprintf(file, "\n    }");
+    }
+
+    fprintf(file, "\n  ]\n}\n");
+}
+
+} // namespace LearningGLES
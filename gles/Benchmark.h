@@ -0,0 +1,77 @@
+#pragma once
+
+#include <chrono>
+#include <cstdio>
+#include <deque>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace LearningGLES {
+
+struct BenchmarkResult {
+    std::string name;
+    // Unit of the samples; timings are always in nanoseconds.
+    std::string unit { "ns" };
+    std::vector<double> samples;
+    // Derived numbers, such as a throughput, reported next to the percentiles.
+    std::vector<std::pair<std::string, double>> metrics;
+
+    void addMetric(const char* name, double value) { metrics.emplace_back(name, value); }
+};
+
+// Collects benchmark samples and writes them as JSON with percentiles, so runs on different
+// commits can be compared by a script:
+//
+// { "suite": ..., "context": { ... }, "benchmarks": [ { "name": ..., "unit": "ns",
+//   "count": ..., "min": ..., "mean": ..., "p50": ..., "p90": ..., "p99": ..., "max": ...,
+//   "stddev": ..., <metrics> }, ... ] }
+class BenchmarkSuite {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    explicit BenchmarkSuite(const char* name);
+
+    void setContext(const char* key, const std::string& value) { m_context.emplace_back(key, value); }
+    // Only benchmarks whose name contains the filter run. An empty filter runs everything.
+    void setFilter(const std::string& filter) { m_filter = filter; }
+    bool shouldRun(const char* name) const;
+
+    // Runs `body` `iterations` times after a single warm-up call and records each duration.
+    template<typename Function>
+    BenchmarkResult& measure(const char* name, unsigned iterations, Function body)
+    {
+        BenchmarkResult& result = add(name);
+        body();
+        result.samples.reserve(iterations);
+        for (unsigned i = 0; i < iterations; ++i) {
+            auto start = Clock::now();
+            body();
+            result.samples.push_back(nanosecondsSince(start));
+        }
+        return result;
+    }
+
+    BenchmarkResult& add(const char* name);
+
+    static double nanosecondsSince(Clock::time_point start)
+    {
+        return std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+    }
+
+    // Nearest-rank percentile, `p` in [0, 100].
+    static double percentile(const std::vector<double>& sorted, double p);
+
+    // One line per benchmark, for humans.
+    void printSummary(FILE*) const;
+    void writeJSON(FILE*) const;
+
+private:
+    std::string m_name;
+    std::string m_filter;
+    std::vector<std::pair<std::string, std::string>> m_context;
+    // A deque, so references returned by add() stay valid.
+    std::deque<BenchmarkResult> m_results;
+};
+
+} // namespace LearningGLES
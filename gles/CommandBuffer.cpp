@@ -0,0 +1,137 @@
+#include "CommandBuffer.h"
+
+#include "Window.h"
+#include <cstring>
+
+namespace LearningGLES {
+
+CommandBuffer::CommandBuffer(size_t initialCapacity)
+{
+    m_bytes.reserve(initialCapacity);
+}
+
+void CommandBuffer::reset()
+{
+    m_bytes.clear();
+    m_commandCount = 0;
+}
+
+template<typename T>
+void CommandBuffer::append(Type type, const T& payload)
+{
+    size_t offset = m_bytes.size();
+    size_t capacity = m_bytes.capacity();
+    m_bytes.resize(offset + 1 + sizeof(T));
+    if (m_bytes.capacity() != capacity)
+        ++m_growths;
+    m_bytes[offset] = static_cast<uint8_t>(type);
+    memcpy(&m_bytes[offset + 1], &payload, sizeof(T));
+    ++m_commandCount;
+}
+
+void CommandBuffer::addDamage(const Rect& rect)
+{
+    append(Type::Damage, rect);
+}
+
+void CommandBuffer::fill(const Rect& rect, float red, float green, float blue, float alpha)
+{
+    Fill fill = { rect, { red, green, blue, alpha } };
+    append(Type::Fill, fill);
+}
+
+void CommandBuffer::drawQuad(const Quad& quad)
+{
+    append(Type::Quad, quad);
+}
+
+static uint32_t packColor(const float color[4])
+{
+    auto channel = [](float value, int shift) {
+        return static_cast<uint32_t>(value * 255 + 0.5f) << shift;
+    };
+    return channel(color[3], 24) | channel(color[0], 16) | channel(color[1], 8) | channel(color[2], 0);
+}
+
+void CommandBuffer::replay(Window& window, BatchRenderer* renderer) const
+{
+    // Commands are read with memcpy, as they are packed without any alignment.
+    const uint8_t* end = m_bytes.data() + m_bytes.size();
+    for (const uint8_t* command = m_bytes.data(); command < end;) {
+        Type type = static_cast<Type>(*command++);
+        if (type == Type::Damage) {
+            Rect rect;
+            memcpy(&rect, command, sizeof(rect));
+            window.addDamage(rect);
+        }
+        command += type == Type::Damage ? sizeof(Rect) : type == Type::Fill ? sizeof(Fill) : sizeof(Quad);
+    }
+
+    DamageRegion repaint = window.repaintRegion();
+    PixelBuffer pixels = window.pixelBuffer();
+    GLState& state = window.glState();
+    int height = window.height();
+    if (!pixels.data)
+        state.enable(GL_SCISSOR_TEST);
+
+    for (auto& clip : repaint) {
+        bool batching = false;
+        for (const uint8_t* command = m_bytes.data(); command < end;) {
+            Type type = static_cast<Type>(*command++);
+            switch (type) {
+            case Type::Damage:
+                command += sizeof(Rect);
+                break;
+            case Type::Fill: {
+                Fill fill;
+                memcpy(&fill, command, sizeof(fill));
+                command += sizeof(fill);
+                Rect rect = intersection(clip, fill.rect);
+                if (rect.isEmpty())
+                    break;
+                if (pixels.data) {
+                    fillRect(pixels, rect, packColor(fill.color));
+                    break;
+                }
+                // Quads recorded before the fill must be drawn under it.
+                if (batching) {
+                    renderer->end();
+                    batching = false;
+                }
+                state.scissor(rect.x, height - rect.y - rect.height, rect.width, rect.height);
+                state.clearColor(fill.color[0], fill.color[1], fill.color[2], fill.color[3]);
+                glClear(GL_COLOR_BUFFER_BIT);
+                break;
+            }
+            case Type::Quad: {
+                Quad quad;
+                memcpy(&quad, command, sizeof(quad));
+                command += sizeof(quad);
+                if (pixels.data) {
+                    Rect rect = { static_cast<int>(quad.x), static_cast<int>(quad.y), static_cast<int>(quad.width), static_cast<int>(quad.height) };
+                    uint32_t color = quad.color[3] << 24 | quad.color[0] << 16 | quad.color[1] << 8 | quad.color[2];
+                    if (!quad.texture)
+                        blendRect(pixels, intersection(clip, rect), color);
+                    break;
+                }
+                if (!renderer)
+                    break;
+                if (!batching) {
+                    state.scissor(clip.x, height - clip.y - clip.height, clip.width, clip.height);
+                    renderer->begin(window.width(), window.height());
+                    batching = true;
+                }
+                renderer->drawQuad(quad);
+                break;
+            }
+            }
+        }
+        if (batching)
+            renderer->end();
+    }
+
+    if (!pixels.data)
+        state.disable(GL_SCISSOR_TEST);
+}
+
+} // namespace LearningGLES
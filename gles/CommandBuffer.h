@@ -0,0 +1,57 @@
+#pragma once
+
+#include "BatchRenderer.h"
+#include "DamageRegion.h"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace LearningGLES {
+
+class Window;
+
+// A frame's drawing, recorded without touching GL so it can be built on another thread than the
+// one that replays it. Commands are packed back to back in a byte array kept across frames:
+// once it has grown to the size of the largest frame, recording allocates nothing.
+//
+// Damage is part of the recording. Replaying adds it to the window, then draws every command
+// clipped to each rectangle of the window's repaint region, so recorders always describe the
+// whole frame and never need the buffer age.
+class CommandBuffer {
+public:
+    explicit CommandBuffer(size_t initialCapacity = 64 << 10);
+
+    // Starts a new frame, keeping the storage.
+    void reset();
+
+    void addDamage(const Rect&);
+    // Replaces the pixels of `rect` with a premultiplied RGBA color, like a scissored glClear().
+    void fill(const Rect&, float red, float green, float blue, float alpha);
+    // Blended over what's underneath, in BatchRenderer order.
+    void drawQuad(const Quad&);
+
+    // Draws the frame into the window's back buffer, after waitForNextFrame(). GL backends need
+    // a renderer for quads. CPU backends only draw fills and untextured quads.
+    void replay(Window&, BatchRenderer*) const;
+
+    unsigned commandCount() const { return m_commandCount; }
+    size_t size() const { return m_bytes.size(); }
+    // Times the storage had to grow, since the buffer was created.
+    unsigned growths() const { return m_growths; }
+
+private:
+    enum class Type : uint8_t { Damage, Fill, Quad };
+
+    struct Fill {
+        Rect rect;
+        float color[4];
+    };
+
+    template<typename T> void append(Type, const T&);
+
+    std::vector<uint8_t> m_bytes;
+    unsigned m_commandCount { 0 };
+    unsigned m_growths { 0 };
+};
+
+} // namespace LearningGLES
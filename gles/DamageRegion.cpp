@@ -0,0 +1,112 @@
+#include "DamageRegion.h"
+
+#include <algorithm>
+
+namespace LearningGLES {
+
+Rect intersection(const Rect& a, const Rect& b)
+{
+    Rect r;
+    r.x = std::max(a.x, b.x);
+    r.y = std::max(a.y, b.y);
+    r.width = std::min(a.x + a.width, b.x + b.width) - r.x;
+    r.height = std::min(a.y + a.height, b.y + b.height) - r.y;
+    return r;
+}
+
+Rect unite(const Rect& a, const Rect& b)
+{
+    Rect r;
+    r.x = std::min(a.x, b.x);
+    r.y = std::min(a.y, b.y);
+    r.width = std::max(a.x + a.width, b.x + b.width) - r.x;
+    r.height = std::max(a.y + a.height, b.y + b.height) - r.y;
+    return r;
+}
+
+// Touching rectangles count too. Merging takes the bounding box, so it may over-approximate the
+// damage, which only costs repainting a few pixels that did not change.
+static bool touches(const Rect& a, const Rect& b)
+{
+    return a.x <= b.x + b.width && b.x <= a.x + a.width
+        && a.y <= b.y + b.height && b.y <= a.y + a.height;
+}
+
+void DamageRegion::add(const Rect& newRect)
+{
+    if (newRect.isEmpty())
+        return;
+
+    // Merging may make the result overlap other rectangles, so keep going until it doesn't.
+    Rect rect = newRect;
+    for (unsigned i = 0; i < m_count;) {
+        if (touches(m_rects[i], rect)) {
+            rect = unite(m_rects[i], rect);
+            remove(i);
+            i = 0;
+        } else
+            ++i;
+    }
+
+    if (m_count < maxRects) {
+        m_rects[m_count++] = rect;
+        return;
+    }
+
+    unsigned best = 0;
+    long bestGrowth = -1;
+    for (unsigned i = 0; i < m_count; ++i) {
+        long growth = unite(m_rects[i], rect).area() - m_rects[i].area() - rect.area();
+        if (bestGrowth < 0 || growth < bestGrowth) {
+            bestGrowth = growth;
+            best = i;
+        }
+    }
+    rect = unite(m_rects[best], rect);
+    remove(best);
+    add(rect);
+}
+
+void DamageRegion::add(const DamageRegion& other)
+{
+    for (auto& rect : other)
+        add(rect);
+}
+
+void DamageRegion::setFull(int width, int height)
+{
+    m_count = 1;
+    m_rects[0] = Rect { 0, 0, width, height };
+}
+
+long DamageRegion::area() const
+{
+    long area = 0;
+    for (auto& rect : *this)
+        area += rect.area();
+    return area;
+}
+
+void DamageHistory::push(const DamageRegion& region)
+{
+    m_regions[m_frames % maxFrames] = region;
+    ++m_frames;
+}
+
+DamageRegion DamageHistory::repaintRegion(unsigned age, const DamageRegion& damage, int width, int height) const
+{
+    DamageRegion region;
+
+    // A buffer that is `age` frames old misses the damage of the last age - 1 frames.
+    if (!age || age > maxFrames || age - 1 > m_frames) {
+        region.setFull(width, height);
+        return region;
+    }
+
+    region = damage;
+    for (unsigned i = 1; i < age; ++i)
+        region.add(m_regions[(m_frames - i) % maxFrames]);
+    return region;
+}
+
+} // namespace LearningGLES
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <cstdint>
+
+namespace LearningGLES {
+
+// Rectangle in surface coordinates, origin at the top-left corner.
+struct Rect {
+    int x;
+    int y;
+    int width;
+    int height;
+
+    bool isEmpty() const { return width <= 0 || height <= 0; }
+    long area() const { return isEmpty() ? 0 : static_cast<long>(width) * height; }
+};
+
+Rect intersection(const Rect&, const Rect&);
+Rect unite(const Rect&, const Rect&);
+
+// A small set of non-overlapping rectangles. Overlapping or touching rectangles are merged on
+// insertion, and once maxRects is reached new ones are merged into the one that grows the least.
+class DamageRegion {
+public:
+    static const unsigned maxRects = 8;
+
+    void clear() { m_count = 0; }
+    void add(const Rect&);
+    void add(const DamageRegion&);
+    void setFull(int width, int height);
+
+    bool isEmpty() const { return !m_count; }
+    unsigned size() const { return m_count; }
+    long area() const;
+
+    const Rect* begin() const { return m_rects; }
+    const Rect* end() const { return m_rects + m_count; }
+
+private:
+    void remove(unsigned index) { m_rects[index] = m_rects[--m_count]; }
+
+    unsigned m_count { 0 };
+    Rect m_rects[maxRects];
+};
+
+// Damage of the last few frames, to bring an older back buffer up to date.
+class DamageHistory {
+public:
+    static const unsigned maxFrames = 8;
+
+    void push(const DamageRegion&);
+    void reset() { m_frames = 0; }
+
+    // Region to repaint in a buffer that is `age` frames old (as reported by EGL_EXT_buffer_age)
+    // so it matches the latest frame, `damage` being what changes in the frame drawn now.
+    // Age 0 means the contents are undefined.
+    DamageRegion repaintRegion(unsigned age, const DamageRegion& damage, int width, int height) const;
+
+private:
+    uint64_t m_frames { 0 };
+    DamageRegion m_regions[maxFrames];
+};
+
+} // namespace LearningGLES
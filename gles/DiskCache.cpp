@@ -0,0 +1,57 @@
+#include "DiskCache.h"
+
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <sys/stat.h>
+
+namespace LearningGLES {
+
+std::string cacheDirectory(const char* name)
+{
+    const char* cache = getenv("XDG_CACHE_HOME");
+    if (cache && *cache)
+        return std::string(cache) + "/learning-gles/" + name;
+    const char* home = getenv("HOME");
+    if (home && *home)
+        return std::string(home) + "/.cache/learning-gles/" + name;
+    return std::string();
+}
+
+bool makeDirectories(const std::string& path)
+{
+    for (size_t slash = path.find('/', 1); ; slash = path.find('/', slash + 1)) {
+        std::string prefix = path.substr(0, slash);
+        if (mkdir(prefix.c_str(), 0755) && errno != EEXIST)
+            return false;
+        if (slash == std::string::npos)
+            return true;
+    }
+}
+
+uint64_t hash(uint64_t value, const void* data, size_t size)
+{
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+    for (size_t i = 0; i < size; ++i) {
+        value ^= bytes[i];
+        value *= 0x100000001b3ull;
+    }
+    return value;
+}
+
+uint64_t hash(uint64_t value, const char* string)
+{
+    if (!string)
+        string = "";
+    return hash(value, string, strlen(string) + 1);
+}
+
+std::string hashName(uint64_t value)
+{
+    char name[17];
+    snprintf(name, sizeof(name), "%016llx", static_cast<unsigned long long>(value));
+    return name;
+}
+
+} // namespace LearningGLES
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace LearningGLES {
+
+// Helpers shared by the caches kept on disk across runs.
+
+// $XDG_CACHE_HOME/learning-gles/<name>, or ~/.cache/learning-gles/<name>. Empty if neither
+// variable is set, which callers take as the disk cache being disabled.
+std::string cacheDirectory(const char* name);
+
+// mkdir -p. Returns false if a component can't be created.
+bool makeDirectories(const std::string& path);
+
+// 64 bit FNV-1a. Not meant to resist collisions on purpose, only to key cache files.
+const uint64_t hashSeed = 0xcbf29ce484222325ull;
+uint64_t hash(uint64_t value, const void* data, size_t size);
+// Strings are hashed with their terminator, so ("ab", "c") and ("a", "bc") differ. A null
+// string hashes as an empty one.
+uint64_t hash(uint64_t value, const char* string);
+
+// The hash as 16 hexadecimal digits, for file names.
+std::string hashName(uint64_t);
+
+} // namespace LearningGLES
@@ -0,0 +1,209 @@
+#include "Display.h"
+
+#include "DiskCache.h"
+#include "FrameProfiler.h"
+#include "HeadlessDisplay.h"
+#include "RendererProbe.h"
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <unistd.h>
+
+#if LEARNING_GLES_WAYLAND
+#include "WaylandDisplay.h"
+#endif
+
+namespace LearningGLES {
+
+// Attributes taking a bitmask the config must include. The others used here are minimum sizes.
+static bool isBitmaskAttribute(EGLint attribute)
+{
+    return attribute == EGL_RENDERABLE_TYPE || attribute == EGL_SURFACE_TYPE || attribute == EGL_CONFORMANT;
+}
+
+static bool configMatches(EGLDisplay display, EGLConfig config, const EGLint* attributes)
+{
+    for (; *attributes != EGL_NONE; attributes += 2) {
+        EGLint value;
+        if (attributes[1] == EGL_DONT_CARE)
+            continue;
+        if (!eglGetConfigAttrib(display, config, attributes[0], &value))
+            return false;
+        if (isBitmaskAttribute(attributes[0]) ? (value & attributes[1]) != attributes[1] : value < attributes[1])
+            return false;
+    }
+    return true;
+}
+
+static WindowBackend defaultBackend()
+{
+    const char* name = getenv("LEARNING_GLES_BACKEND");
+    if (name && !strcmp(name, "wayland"))
+        return WindowBackend::Wayland;
+    if (name && !strcmp(name, "wayland-shm"))
+        return WindowBackend::WaylandShm;
+    if (name && !strcmp(name, "headless"))
+        return WindowBackend::Headless;
+    if (name && !strcmp(name, "auto"))
+        return WindowBackend::Auto;
+    if (name)
+        fprintf(stderr, "Unknown LEARNING_GLES_BACKEND '%s', ignoring it.\n", name);
+
+#if LEARNING_GLES_WAYLAND
+    if (getenv("WAYLAND_DISPLAY"))
+        return WindowBackend::Wayland;
+#endif
+    return WindowBackend::Headless;
+}
+
+std::shared_ptr<Display> Display::create(WindowBackend backend)
+{
+    if (backend == WindowBackend::Default)
+        backend = defaultBackend();
+
+    if (backend == WindowBackend::Auto) {
+#if LEARNING_GLES_WAYLAND
+        if (getenv("WAYLAND_DISPLAY")) {
+            int64_t start = FrameProfiler::now();
+            RendererProbe probe = probeRenderers(1280, 720);
+            std::shared_ptr<Display> display = create(probe.preferCPU() ? WindowBackend::WaylandShm : WindowBackend::Wayland);
+            if (display)
+                display->recordStartupPhase("renderer_probe", start);
+            return display;
+        }
+#endif
+        backend = WindowBackend::Headless;
+    }
+
+    switch (backend) {
+    case WindowBackend::Wayland:
+#if LEARNING_GLES_WAYLAND
+        return std::make_shared<WaylandDisplay>();
+#else
+        fprintf(stderr, "LearningGLES was built without the Wayland backend.\n");
+        return nullptr;
+#endif
+    case WindowBackend::WaylandShm:
+#if LEARNING_GLES_WAYLAND
+        return std::make_shared<WaylandDisplay>(WaylandRendering::Shm);
+#else
+        fprintf(stderr, "LearningGLES was built without the Wayland backend.\n");
+        return nullptr;
+#endif
+    case WindowBackend::Headless: {
+        auto display = std::make_shared<HeadlessDisplay>();
+        if (!display->isValid())
+            return nullptr;
+        return display;
+    }
+    case WindowBackend::Default:
+    case WindowBackend::Auto:
+        break;
+    }
+    return nullptr;
+}
+
+Display::~Display()
+{
+}
+
+bool Display::chooseConfig(const EGLint* attributes)
+{
+    int64_t start = FrameProfiler::now();
+    size_t attributeCount = 0;
+    while (attributes[attributeCount] != EGL_NONE)
+        attributeCount += 2;
+
+    uint64_t key = hash(hashSeed, eglQueryString(m_eglDisplay, EGL_VENDOR));
+    key = hash(key, eglQueryString(m_eglDisplay, EGL_VERSION));
+    key = hash(key, eglQueryString(m_eglDisplay, EGL_CLIENT_APIS));
+    key = hash(key, eglQueryString(m_eglDisplay, EGL_EXTENSIONS));
+    key = hash(key, attributes, attributeCount * sizeof(EGLint));
+    std::string directory = cacheDirectory("egl-configs");
+    std::string path = directory.empty() ? directory : directory + "/" + hashName(key);
+
+    EGLint numConfigs = 0;
+    EGLint configID = 0;
+    FILE* file = path.empty() ? nullptr : fopen(path.c_str(), "r");
+    if (file) {
+        if (fscanf(file, "%d", &configID) != 1)
+            configID = 0;
+        fclose(file);
+    }
+    if (configID > 0) {
+        EGLint idAttributes[] = { EGL_CONFIG_ID, configID, EGL_NONE };
+        if (eglChooseConfig(m_eglDisplay, idAttributes, &m_eglConfig, 1, &numConfigs) && numConfigs
+            && configMatches(m_eglDisplay, m_eglConfig, attributes)) {
+            recordStartupPhase("egl_config_cached", start);
+            return true;
+        }
+        // Most likely another GPU behind the same driver, which numbers its configs differently.
+        unlink(path.c_str());
+    }
+
+    if (!eglChooseConfig(m_eglDisplay, attributes, &m_eglConfig, 1, &numConfigs) || !numConfigs) {
+        m_eglConfig = nullptr;
+        return false;
+    }
+    recordStartupPhase("egl_config", start);
+
+    // Written aside and renamed, so concurrent runs never see a partial file.
+    if (path.empty() || !eglGetConfigAttrib(m_eglDisplay, m_eglConfig, EGL_CONFIG_ID, &configID) || !makeDirectories(directory))
+        return true;
+    std::string temporaryPath = path + "." + std::to_string(getpid());
+    file = fopen(temporaryPath.c_str(), "w");
+    if (!file)
+        return true;
+    bool written = fprintf(file, "%d\n", configID) > 0;
+    if (fclose(file) || !written || rename(temporaryPath.c_str(), path.c_str()))
+        unlink(temporaryPath.c_str());
+    return true;
+}
+
+bool Display::initShareContext()
+{
+    int64_t start = FrameProfiler::now();
+    m_shareContext = createContext();
+    recordStartupPhase("share_context", start);
+    return m_shareContext != EGL_NO_CONTEXT;
+}
+
+EGLContext Display::createContext()
+{
+    EGLint contextAttributes[] = {
+        EGL_CONTEXT_CLIENT_VERSION, 2,
+        EGL_NONE
+    };
+    return eglCreateContext(m_eglDisplay, m_eglConfig, m_shareContext, contextAttributes);
+}
+
+void Display::recordStartupPhase(const char* name, int64_t start)
+{
+    StartupPhase phase = { name, start, FrameProfiler::now() };
+    std::lock_guard<std::mutex> lock(m_startupPhasesMutex);
+    m_startupPhases.push_back(phase);
+}
+
+std::vector<StartupPhase> Display::startupPhases()
+{
+    std::lock_guard<std::mutex> lock(m_startupPhasesMutex);
+    return m_startupPhases;
+}
+
+void Display::printStartupPhases(FILE* file)
+{
+    std::vector<StartupPhase> phases = startupPhases();
+    if (phases.empty())
+        return;
+    std::stable_sort(phases.begin(), phases.end(), [](const StartupPhase& a, const StartupPhase& b) {
+        return a.start < b.start;
+    });
+
+    for (auto& phase : phases) {
+        fprintf(file, "  %-22s at %7.2f ms, took %7.2f ms\n", phase.name,
+            (phase.start - phases.front().start) / 1e6, (phase.end - phase.start) / 1e6);
+    }
+}
+
+} // namespace LearningGLES
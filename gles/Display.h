@@ -0,0 +1,87 @@
+#pragma once
+
+#include <EGL/egl.h>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace LearningGLES {
+
+class Window;
+
+enum class WindowBackend {
+    // Picked at runtime: LEARNING_GLES_BACKEND=wayland|wayland-shm|headless|auto, otherwise
+    // Wayland when a compositor is advertised through WAYLAND_DISPLAY and headless if not.
+    Default,
+    Wayland,
+    // Wayland windows drawn by the CPU into wl_shm buffers, without EGL: see ShmWindow.
+    WaylandShm,
+    // Wayland or WaylandShm, whichever draws a test frame faster on this machine, or headless
+    // without a compositor. Only for render code that handles both, see Window::pixelBuffer().
+    Auto,
+    // Offscreen EGL pbuffer or surfaceless context, for machines without a compositor.
+    Headless,
+};
+
+// One step of bringing a display or its windows up, timed with FrameProfiler::now(). Steps run
+// on different threads overlap.
+struct StartupPhase {
+    const char* name;
+    int64_t start;
+    int64_t end;
+};
+
+// What windows of one backend have in common: the connection to the window system, with its
+// globals and event thread, the initialized EGL display and config, and a context that every
+// window's context shares objects with. Creating it once and attaching many windows to it
+// leaves each window with the cost of its surface and context alone.
+//
+// Windows keep their display alive, so it may be released as soon as they are created.
+class Display : public std::enable_shared_from_this<Display> {
+public:
+    // Returns nullptr if the backend is not available in this build or on this machine.
+    static std::shared_ptr<Display> create(WindowBackend = WindowBackend::Default);
+
+    virtual ~Display();
+
+    virtual std::unique_ptr<Window> createWindow(const char* title, unsigned width, unsigned height) = 0;
+
+    EGLDisplay eglDisplay() const { return m_eglDisplay; }
+    EGLConfig eglConfig() const { return m_eglConfig; }
+    // Never current, it only anchors the share group: textures, buffers and programs created in
+    // one window can be used from all of them.
+    EGLContext shareContext() const { return m_shareContext; }
+
+    // A new GLES2 context in the share group.
+    EGLContext createContext();
+
+    // Thread safe. Ends the phase now; `name` must outlive the display.
+    void recordStartupPhase(const char* name, int64_t start);
+    std::vector<StartupPhase> startupPhases();
+    // One line per phase, relative to the earliest one, in the order they started.
+    void printStartupPhases(FILE*);
+
+protected:
+    Display() = default;
+
+    // eglChooseConfig(), remembering the config picked for the attributes on disk, keyed by the
+    // EGL vendor, version and client APIs. Later runs ask for that config by its ID and only
+    // check it still matches, instead of having EGL filter and sort every config of the
+    // display. Sets m_eglConfig, returns false if no config matches.
+    bool chooseConfig(const EGLint* attributes);
+
+    // Creates the share context once m_eglDisplay and m_eglConfig are set. Returns false on failure.
+    bool initShareContext();
+
+    EGLDisplay m_eglDisplay { EGL_NO_DISPLAY };
+    EGLConfig m_eglConfig { nullptr };
+    EGLContext m_shareContext { EGL_NO_CONTEXT };
+
+private:
+    std::mutex m_startupPhasesMutex;
+    std::vector<StartupPhase> m_startupPhases;
+};
+
+} // namespace LearningGLES
@@ -0,0 +1,238 @@
+#include "FrameCapture.h"
+
+#include "FrameProfiler.h"
+#include <algorithm>
+#include <cstring>
+
+namespace LearningGLES {
+
+namespace {
+
+uint8_t clampByte(int value)
+{
+    return value < 0 ? 0 : value > 255 ? 255 : value;
+}
+
+// BT.601 limited range, in 8.8 fixed point.
+uint8_t luma(const uint8_t* rgba)
+{
+    return clampByte(((66 * rgba[0] + 129 * rgba[1] + 25 * rgba[2] + 128) >> 8) + 16);
+}
+
+void chroma(int r, int g, int b, uint8_t& u, uint8_t& v)
+{
+    u = clampByte(((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128);
+    v = clampByte(((112 * r - 94 * g - 18 * b + 128) >> 8) + 128);
+}
+
+} // namespace
+
+std::unique_ptr<FrameCapture> FrameCapture::create(const char* path, unsigned width, unsigned height, unsigned fps)
+{
+    FILE* file = fopen(path, "wb");
+    if (!file)
+        return nullptr;
+    fprintf(file, "YUV4MPEG2 W%u H%u F%u:1 Ip A1:1 C420jpeg\n", width, height, fps ? fps : 60);
+    return std::unique_ptr<FrameCapture>(new FrameCapture(file, width, height));
+}
+
+FrameCapture::FrameCapture(FILE* file, unsigned width, unsigned height)
+    : m_width(width)
+    , m_height(height)
+    , m_file(file)
+{
+    // Pixel buffer objects are core in GLES 3. Drivers asked for a GLES 2 context usually give
+    // a later version, which is still compatible.
+    const char* version = reinterpret_cast<const char*>(glGetString(GL_VERSION));
+    int major = 0;
+    m_usesPixelBuffers = version && sscanf(version, "OpenGL ES %d", &major) == 1 && major >= 3;
+
+    size_t frameSize = static_cast<size_t>(width) * height * 4;
+    if (m_usesPixelBuffers) {
+        for (auto& readback : m_readbacks) {
+            glGenBuffers(1, &readback.buffer);
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, readback.buffer);
+            glBufferData(GL_PIXEL_PACK_BUFFER, frameSize, nullptr, GL_STREAM_READ);
+        }
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    }
+
+    m_encodeBuffers.resize(encodeBuffers);
+    for (unsigned i = 0; i < encodeBuffers; ++i) {
+        m_encodeBuffers[i].resize(frameSize);
+        m_freeEncodeBuffers.push_back(i);
+    }
+    m_yuv.resize(static_cast<size_t>(width) * height + 2 * ((width + 1) / 2) * ((height + 1) / 2));
+    m_encoder = std::thread([this] { runEncoder(); });
+}
+
+FrameCapture::~FrameCapture()
+{
+    while (m_readbackCount)
+        finishReadback(true);
+    for (auto& readback : m_readbacks)
+        glDeleteBuffers(1, &readback.buffer);
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopEncoder = true;
+    }
+    m_condition.notify_all();
+    m_encoder.join();
+    fclose(m_file);
+}
+
+void FrameCapture::captureFrame(unsigned width, unsigned height)
+{
+    int64_t start = FrameProfiler::now();
+    m_stats.frames++;
+
+    if (width != m_width || height != m_height)
+        m_stats.dropped++;
+    else if (m_usesPixelBuffers) {
+        while (m_readbackCount && finishReadback(false)) { }
+        if (m_readbackCount == readbackBuffers)
+            m_stats.dropped++;
+        else {
+            // Only queues the copy: glReadPixels returns as soon as it is recorded.
+            Readback& readback = m_readbacks[(m_readbackHead + m_readbackCount++) % readbackBuffers];
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, readback.buffer);
+            glReadPixels(0, 0, m_width, m_height, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+            readback.sync = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        }
+    } else {
+        int index = acquireEncodeBuffer();
+        if (index < 0)
+            m_stats.dropped++;
+        else {
+            glReadPixels(0, 0, m_width, m_height, GL_RGBA, GL_UNSIGNED_BYTE, m_encodeBuffers[index].data());
+            submitEncodeBuffer(index);
+        }
+    }
+
+    m_stats.captureSeconds += (FrameProfiler::now() - start) / 1e9;
+}
+
+bool FrameCapture::finishReadback(bool wait)
+{
+    Readback& readback = m_readbacks[m_readbackHead];
+    GLenum status = glClientWaitSync(readback.sync, wait ? GL_SYNC_FLUSH_COMMANDS_BIT : 0, wait ? ~GLuint64(0) : 0);
+    if (status == GL_TIMEOUT_EXPIRED)
+        return false;
+
+    glDeleteSync(readback.sync);
+    readback.sync = nullptr;
+    m_readbackHead = (m_readbackHead + 1) % readbackBuffers;
+    m_readbackCount--;
+
+    int index = acquireEncodeBuffer();
+    if (index < 0) {
+        m_stats.dropped++;
+        return true;
+    }
+    size_t frameSize = m_encodeBuffers[index].size();
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, readback.buffer);
+    if (void* pixels = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, frameSize, GL_MAP_READ_BIT)) {
+        memcpy(m_encodeBuffers[index].data(), pixels, frameSize);
+        glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+        submitEncodeBuffer(index);
+    } else {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_freeEncodeBuffers.push_back(index);
+        m_stats.dropped++;
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    return true;
+}
+
+int FrameCapture::acquireEncodeBuffer()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_freeEncodeBuffers.empty())
+        return -1;
+    int index = m_freeEncodeBuffers.back();
+    m_freeEncodeBuffers.pop_back();
+    return index;
+}
+
+void FrameCapture::submitEncodeBuffer(int index)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_encodeQueue.push_back(index);
+    }
+    m_stats.captured++;
+    m_condition.notify_one();
+}
+
+void FrameCapture::runEncoder()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (true) {
+        m_condition.wait(lock, [this] { return m_stopEncoder || !m_encodeQueue.empty(); });
+        // Frames already captured are still written when stopping.
+        if (m_encodeQueue.empty())
+            return;
+        int index = m_encodeQueue.front();
+        m_encodeQueue.pop_front();
+
+        lock.unlock();
+        int64_t start = FrameProfiler::now();
+        encode(m_encodeBuffers[index].data());
+        double seconds = (FrameProfiler::now() - start) / 1e9;
+        lock.lock();
+
+        m_freeEncodeBuffers.push_back(index);
+        m_encoded++;
+        m_encodeSeconds += seconds;
+    }
+}
+
+void FrameCapture::encode(const uint8_t* pixels)
+{
+    unsigned chromaWidth = (m_width + 1) / 2;
+    unsigned chromaHeight = (m_height + 1) / 2;
+    uint8_t* yPlane = m_yuv.data();
+    uint8_t* uPlane = yPlane + static_cast<size_t>(m_width) * m_height;
+    uint8_t* vPlane = uPlane + static_cast<size_t>(chromaWidth) * chromaHeight;
+    size_t stride = static_cast<size_t>(m_width) * 4;
+
+    // glReadPixels returns the bottom row first, Y4M wants the top one.
+    auto row = [&](unsigned y) { return pixels + (m_height - 1 - y) * stride; };
+    for (unsigned y = 0; y < m_height; ++y) {
+        const uint8_t* source = row(y);
+        for (unsigned x = 0; x < m_width; ++x)
+            yPlane[static_cast<size_t>(y) * m_width + x] = luma(source + x * 4);
+    }
+    // Each chroma sample averages a 2x2 block, clamped at odd edges.
+    for (unsigned y = 0; y < chromaHeight; ++y) {
+        const uint8_t* top = row(2 * y);
+        const uint8_t* bottom = row(std::min(2 * y + 1, m_height - 1));
+        for (unsigned x = 0; x < chromaWidth; ++x) {
+            unsigned left = 2 * x * 4;
+            unsigned right = std::min(2 * x + 1, m_width - 1) * 4;
+            int r = (top[left] + top[right] + bottom[left] + bottom[right] + 2) / 4;
+            int g = (top[left + 1] + top[right + 1] + bottom[left + 1] + bottom[right + 1] + 2) / 4;
+            int b = (top[left + 2] + top[right + 2] + bottom[left + 2] + bottom[right + 2] + 2) / 4;
+            chroma(r, g, b, uPlane[y * chromaWidth + x], vPlane[y * chromaWidth + x]);
+        }
+    }
+
+    fputs("FRAME\n", m_file);
+    fwrite(m_yuv.data(), 1, m_yuv.size(), m_file);
+}
+
+FrameCaptureStats FrameCapture::takeStats()
+{
+    FrameCaptureStats stats = m_stats;
+    m_stats = FrameCaptureStats();
+    std::lock_guard<std::mutex> lock(m_mutex);
+    stats.encoded = m_encoded;
+    stats.encodeSeconds = m_encodeSeconds;
+    m_encoded = 0;
+    m_encodeSeconds = 0;
+    return stats;
+}
+
+} // namespace LearningGLES
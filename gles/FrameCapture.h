@@ -0,0 +1,101 @@
+#pragma once
+
+#include <GLES3/gl3.h>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace LearningGLES {
+
+// Activity of a FrameCapture since the last FrameCapture::takeStats().
+struct FrameCaptureStats {
+    // Frames offered to captureFrame().
+    uint64_t frames { 0 };
+    // Frames read back and handed over to the encoder.
+    uint64_t captured { 0 };
+    // Frames skipped because every readback or encoder buffer was busy, or because the window
+    // no longer had the size of the recording.
+    uint64_t dropped { 0 };
+    uint64_t encoded { 0 };
+    // Time captureFrame() took on the rendering thread, which is what capturing costs a frame.
+    double captureSeconds { 0 };
+    // Time the encoder thread spent converting and writing frames.
+    double encodeSeconds { 0 };
+};
+
+// Records the frames of a window to a Y4M file without making them wait on the readback. On
+// GLES 3 each frame is read into the next of a ring of pixel buffer objects, with a fence, and
+// only copied out a frame or more later, once the fence has signaled. GLES 2 has no pixel
+// buffers, so there the readback is synchronous. Conversion to YUV 4:2:0 and writing happen on
+// an encoder thread. When the GPU or the encoder falls behind, frames are dropped rather than
+// waited for, so the recording may skip but rendering never stalls on it.
+class FrameCapture {
+public:
+    static const unsigned readbackBuffers = 3;
+    static const unsigned encodeBuffers = 4;
+
+    // Records `width` x `height` frames. `fps` is only the rate written in the file header.
+    // The context must be current. Returns nullptr if the file can't be created.
+    static std::unique_ptr<FrameCapture> create(const char* path, unsigned width, unsigned height, unsigned fps);
+    // Waits for the frames still pending and closes the file. The context must be current.
+    ~FrameCapture();
+
+    bool usesPixelBuffers() const { return m_usesPixelBuffers; }
+
+    // Reads back the frame just drawn, right before it is swapped. The context must be current.
+    void captureFrame(unsigned width, unsigned height);
+
+    FrameCaptureStats takeStats();
+
+private:
+    struct Readback {
+        GLuint buffer { 0 };
+        GLsync sync { nullptr };
+    };
+
+    FrameCapture(FILE*, unsigned width, unsigned height);
+
+    // Copies the oldest readback to the encoder, waiting for it if `wait` is set. Returns false
+    // if it is still in flight.
+    bool finishReadback(bool wait);
+    // Returns the index of a free encoder buffer, or -1 if the encoder is behind.
+    int acquireEncodeBuffer();
+    void submitEncodeBuffer(int index);
+
+    void runEncoder();
+    void encode(const uint8_t* pixels);
+
+    unsigned m_width;
+    unsigned m_height;
+    bool m_usesPixelBuffers { false };
+
+    // Oldest first, starting at m_readbackHead. Rendering thread only.
+    Readback m_readbacks[readbackBuffers];
+    unsigned m_readbackHead { 0 };
+    unsigned m_readbackCount { 0 };
+
+    // RGBA frames, bottom row first as glReadPixels returns them.
+    std::vector<std::vector<uint8_t>> m_encodeBuffers;
+    std::mutex m_mutex;
+    std::condition_variable m_condition;
+    std::vector<int> m_freeEncodeBuffers;
+    std::deque<int> m_encodeQueue;
+    bool m_stopEncoder { false };
+    std::thread m_encoder;
+
+    // Encoder thread only.
+    FILE* m_file;
+    std::vector<uint8_t> m_yuv;
+
+    // Rendering thread counters, and the encoder's under m_mutex.
+    FrameCaptureStats m_stats;
+    uint64_t m_encoded { 0 };
+    double m_encodeSeconds { 0 };
+};
+
+} // namespace LearningGLES
@@ -0,0 +1,120 @@
+#include "FramePipeline.h"
+
+#include "FrameProfiler.h"
+#include <algorithm>
+
+namespace LearningGLES {
+
+FramePipeline::FramePipeline(Recorder recorder, unsigned framesAhead)
+    : m_recorder(std::move(recorder))
+    , m_buffers(std::max(1u, std::min(framesAhead, static_cast<unsigned>(maxFramesAhead))) + 1)
+{
+    m_thread = std::thread([this] { runRecorder(); });
+}
+
+FramePipeline::~FramePipeline()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopRecorder = true;
+    }
+    m_condition.notify_all();
+    m_thread.join();
+}
+
+void FramePipeline::update(unsigned width, unsigned height, const std::vector<InputEvent>& inputs)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (width != m_pendingWidth || height != m_pendingHeight) {
+            // Nothing is being replayed between release() and acquire().
+            m_queued = 0;
+            ++m_sizeGeneration;
+        }
+        m_pendingWidth = width;
+        m_pendingHeight = height;
+        m_pendingInputs.insert(m_pendingInputs.end(), inputs.begin(), inputs.end());
+    }
+    m_condition.notify_all();
+}
+
+const CommandBuffer& FramePipeline::acquire()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    if (!m_queued) {
+        int64_t start = FrameProfiler::now();
+        m_condition.wait(lock, [this] { return m_queued > 0; });
+        ++m_stats.replayStalls;
+        m_stats.replayStallSeconds += (FrameProfiler::now() - start) / 1e9;
+    }
+    return m_buffers[m_replayIndex];
+}
+
+void FramePipeline::release()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_replayIndex = (m_replayIndex + 1) % m_buffers.size();
+        --m_queued;
+        ++m_stats.frames;
+    }
+    m_condition.notify_all();
+}
+
+FramePipelineStats FramePipeline::takeStats()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    FramePipelineStats stats = m_stats;
+    m_stats = FramePipelineStats();
+    return stats;
+}
+
+void FramePipeline::runRecorder()
+{
+    FrameInfo info;
+    unsigned recordIndex;
+    uint64_t sizeGeneration;
+    for (;;) {
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            // The frame being replayed stays queued until released, so this leaves framesAhead
+            // buffers to record into.
+            auto canRecord = [this] { return m_stopRecorder || (m_pendingWidth && m_queued < m_buffers.size()); };
+            if (!canRecord()) {
+                int64_t start = FrameProfiler::now();
+                m_condition.wait(lock, canRecord);
+                if (m_pendingWidth) {
+                    ++m_stats.recorderStalls;
+                    m_stats.recorderStallSeconds += (FrameProfiler::now() - start) / 1e9;
+                }
+            }
+            if (m_stopRecorder)
+                return;
+            // Past the frames queued, the one being replayed included.
+            recordIndex = (m_replayIndex + m_queued) % m_buffers.size();
+            sizeGeneration = m_sizeGeneration;
+            info.width = m_pendingWidth;
+            info.height = m_pendingHeight;
+            // Swapped rather than copied, so both vectors keep their storage.
+            info.inputs.clear();
+            info.inputs.swap(m_pendingInputs);
+        }
+
+        int64_t start = FrameProfiler::now();
+        CommandBuffer& buffer = m_buffers[recordIndex];
+        buffer.reset();
+        m_recorder(buffer, info);
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stats.recordSeconds += (FrameProfiler::now() - start) / 1e9;
+            if (sizeGeneration != m_sizeGeneration)
+                continue;
+            ++m_queued;
+            ++info.frame;
+        }
+        m_condition.notify_all();
+    }
+}
+
+} // namespace LearningGLES
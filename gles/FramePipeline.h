@@ -0,0 +1,92 @@
+#pragma once
+
+#include "CommandBuffer.h"
+#include "InputEvent.h"
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace LearningGLES {
+
+// What a recorder knows of the frame it records.
+struct FrameInfo {
+    uint64_t frame { 0 };
+    // Window size to draw at. Frames recorded for an earlier size are dropped instead of replayed.
+    unsigned width { 0 };
+    unsigned height { 0 };
+    // Received since the previous frame was recorded.
+    std::vector<InputEvent> inputs;
+};
+
+// Activity of a FramePipeline since the last FramePipeline::takeStats().
+struct FramePipelineStats {
+    uint64_t frames { 0 };
+    // Time the recorder spent building frames.
+    double recordSeconds { 0 };
+    // Times the recorder was `framesAhead` frames ahead and waited for the GL thread, which is
+    // then the bottleneck.
+    uint64_t recorderStalls { 0 };
+    double recorderStallSeconds { 0 };
+    // Times acquire() found no frame ready, the recorder being the bottleneck.
+    uint64_t replayStalls { 0 };
+    double replayStallSeconds { 0 };
+};
+
+// Two-stage frame loop: a recorder thread builds each frame into a CommandBuffer while the GL
+// thread replays and swaps the previous one, so CPU-heavy scenes overlap with the driver and
+// the swap. The recorder runs at most `framesAhead` frames ahead of the frame being replayed,
+// then blocks until the GL thread releases one; more frames ahead absorb uneven frame times
+// at the cost of as many frames of input latency.
+//
+// Command buffers are recycled in a ring, so once they have grown to fit the scene a frame
+// allocates nothing on either thread. When the window's size changes, the frames recorded ahead
+// for the old one are dropped, so the first frames at the new size aren't drawn with a stale
+// viewport or scissor; the GL thread then waits for one recorded at the new size.
+class FramePipeline {
+public:
+    static const unsigned maxFramesAhead = 4;
+
+    using Recorder = std::function<void(CommandBuffer&, const FrameInfo&)>;
+
+    // `recorder` runs on the pipeline's thread, into a buffer reset beforehand.
+    explicit FramePipeline(Recorder, unsigned framesAhead = 1);
+    ~FramePipeline();
+
+    unsigned framesAhead() const { return static_cast<unsigned>(m_buffers.size()) - 1; }
+
+    // GL thread. Hands the window's size and the frame's input over to the next frame recorded.
+    // The recorder waits for the first call. A new size drops the frames not replayed yet, and
+    // the input they carried.
+    void update(unsigned width, unsigned height, const std::vector<InputEvent>& inputs);
+    // Blocks until the oldest frame not replayed yet is recorded, and returns it. It stays
+    // untouched until release().
+    const CommandBuffer& acquire();
+    void release();
+
+    FramePipelineStats takeStats();
+
+private:
+    void runRecorder();
+
+    Recorder m_recorder;
+    std::vector<CommandBuffer> m_buffers;
+
+    std::mutex m_mutex;
+    std::condition_variable m_condition;
+    // Frames recorded and not released yet, oldest at m_replayIndex.
+    unsigned m_queued { 0 };
+    unsigned m_replayIndex { 0 };
+    unsigned m_pendingWidth { 0 };
+    unsigned m_pendingHeight { 0 };
+    // Bumped with every new size, so a frame recorded for the previous one is dropped.
+    uint64_t m_sizeGeneration { 0 };
+    std::vector<InputEvent> m_pendingInputs;
+    bool m_stopRecorder { false };
+    FramePipelineStats m_stats;
+    std::thread m_thread;
+};
+
+} // namespace LearningGLES
@@ -0,0 +1,276 @@
+#include "FrameProfiler.h"
+
+#include <EGL/egl.h>
+#include <algorithm>
+#include <cstring>
+#include <ctime>
+
+namespace LearningGLES {
+
+FrameProfiler::FrameProfiler()
+{
+    initGPUTimer();
+}
+
+FrameProfiler::~FrameProfiler()
+{
+    for (auto& pending : m_pending) {
+        if (pending.query)
+            m_glDeleteQueries(1, &pending.query);
+    }
+}
+
+void FrameProfiler::initGPUTimer()
+{
+    const char* extensions = reinterpret_cast<const char*>(glGetString(GL_EXTENSIONS));
+    if (!extensions || !strstr(extensions, "GL_EXT_disjoint_timer_query"))
+        return;
+
+    m_glGenQueries = reinterpret_cast<PFNGLGENQUERIESEXTPROC>(eglGetProcAddress("glGenQueriesEXT"));
+    m_glDeleteQueries = reinterpret_cast<PFNGLDELETEQUERIESEXTPROC>(eglGetProcAddress("glDeleteQueriesEXT"));
+    m_glBeginQuery = reinterpret_cast<PFNGLBEGINQUERYEXTPROC>(eglGetProcAddress("glBeginQueryEXT"));
+    m_glEndQuery = reinterpret_cast<PFNGLENDQUERYEXTPROC>(eglGetProcAddress("glEndQueryEXT"));
+    m_glGetQueryObjectuiv = reinterpret_cast<PFNGLGETQUERYOBJECTUIVEXTPROC>(eglGetProcAddress("glGetQueryObjectuivEXT"));
+    m_glGetQueryObjectui64v = reinterpret_cast<PFNGLGETQUERYOBJECTUI64VEXTPROC>(eglGetProcAddress("glGetQueryObjectui64vEXT"));
+    m_hasGPUTimer = m_glGenQueries && m_glDeleteQueries && m_glBeginQuery && m_glEndQuery && m_glGetQueryObjectuiv && m_glGetQueryObjectui64v;
+    if (!m_hasGPUTimer)
+        return;
+
+    for (auto& pending : m_pending)
+        m_glGenQueries(1, &pending.query);
+    // Reading the flag clears it, so only disjoint events from now on are reported.
+    GLint disjoint;
+    glGetIntegerv(GL_GPU_DISJOINT_EXT, &disjoint);
+}
+
+int64_t FrameProfiler::now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<int64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+FrameProfiler::PendingFrame* FrameProfiler::pendingFrame(uint64_t frame)
+{
+    PendingFrame& pending = m_pending[frame % maxFramesInFlight];
+    if (!pending.used || pending.record.frame != frame)
+        return nullptr;
+    return &pending;
+}
+
+void FrameProfiler::frameStarted()
+{
+    collectGPUResults();
+
+    PendingFrame& pending = m_pending[++m_frame % maxFramesInFlight];
+    // Whatever did not arrive within maxFramesInFlight frames never will.
+    if (pending.used)
+        retire(pending);
+
+    pending.used = true;
+    pending.queryPending = false;
+    pending.presentationPending = false;
+    pending.record = FrameRecord();
+    pending.record.frame = m_frame;
+    pending.record.frameStart = now();
+
+    if (m_hasGPUTimer)
+        m_glBeginQuery(GL_TIME_ELAPSED_EXT, pending.query);
+}
+
+void FrameProfiler::swapStarted()
+{
+    PendingFrame* pending = pendingFrame(m_frame);
+    if (!pending)
+        return;
+
+    if (m_hasGPUTimer) {
+        m_glEndQuery(GL_TIME_ELAPSED_EXT);
+        pending->queryPending = true;
+    }
+    pending->record.swapStart = now();
+}
+
+void FrameProfiler::swapFinished(bool expectPresentation)
+{
+    PendingFrame* pending = pendingFrame(m_frame);
+    if (!pending)
+        return;
+
+    pending->record.swapEnd = now();
+    pending->presentationPending = expectPresentation;
+    retireIfComplete(*pending);
+}
+
+void FrameProfiler::inputConsumed(int64_t time)
+{
+    PendingFrame* pending = pendingFrame(m_frame);
+    if (!pending)
+        return;
+
+    FrameRecord& record = pending->record;
+    if (!record.inputTime || time < record.inputTime)
+        record.inputTime = time;
+    record.inputEvents++;
+}
+
+void FrameProfiler::framePresented(uint64_t frame, int64_t presentTime, uint32_t refreshPeriod, uint32_t flags)
+{
+    PendingFrame* pending = pendingFrame(frame);
+    if (!pending)
+        return;
+
+    pending->record.presentTime = presentTime;
+    pending->record.refreshPeriod = refreshPeriod;
+    pending->record.presentFlags = flags;
+    pending->presentationPending = false;
+    retireIfComplete(*pending);
+}
+
+void FrameProfiler::frameDiscarded(uint64_t frame)
+{
+    PendingFrame* pending = pendingFrame(frame);
+    if (!pending)
+        return;
+
+    pending->record.discarded = true;
+    pending->presentationPending = false;
+    retireIfComplete(*pending);
+}
+
+void FrameProfiler::collectGPUResults()
+{
+    if (!m_hasGPUTimer)
+        return;
+
+    // A disjoint event (GPU reset, clock change, ...) makes every result in flight meaningless.
+    GLint disjoint = 0;
+    glGetIntegerv(GL_GPU_DISJOINT_EXT, &disjoint);
+
+    for (uint64_t frame = m_frame >= maxFramesInFlight ? m_frame - maxFramesInFlight + 1 : 1; frame <= m_frame; ++frame) {
+        PendingFrame* pending = pendingFrame(frame);
+        if (!pending || !pending->queryPending)
+            continue;
+
+        GLuint available = 0;
+        m_glGetQueryObjectuiv(pending->query, GL_QUERY_RESULT_AVAILABLE_EXT, &available);
+        // Queries complete in order, so later ones won't be available either.
+        if (!available)
+            break;
+
+        GLuint64 elapsed = 0;
+        m_glGetQueryObjectui64v(pending->query, GL_QUERY_RESULT_EXT, &elapsed);
+        // Some drivers (llvmpipe) report garbage for the very first query; the GPU cannot have
+        // been busy longer than the wall time since the frame started.
+        bool plausible = static_cast<int64_t>(elapsed) <= now() - pending->record.frameStart;
+        pending->record.gpuTime = disjoint || !plausible ? -1 : static_cast<int64_t>(elapsed);
+        pending->queryPending = false;
+        retireIfComplete(*pending);
+    }
+}
+
+void FrameProfiler::retireIfComplete(PendingFrame& pending)
+{
+    if (pending.record.swapEnd && !pending.queryPending && !pending.presentationPending)
+        retire(pending);
+}
+
+void FrameProfiler::retire(PendingFrame& pending)
+{
+    if (!m_completed.push(pending.record))
+        ++m_droppedRecords;
+    pending.used = false;
+}
+
+namespace {
+
+struct Metric {
+    const char* name;
+    int64_t (*value)(const FrameRecord&);
+};
+
+const Metric metrics[] = {
+    { "draw (CPU)", [](const FrameRecord& r) -> int64_t { return r.swapStart - r.frameStart; } },
+    { "swap (CPU)", [](const FrameRecord& r) -> int64_t { return r.swapEnd - r.swapStart; } },
+    { "GPU", [](const FrameRecord& r) -> int64_t { return r.gpuTime; } },
+    { "swap to present", [](const FrameRecord& r) -> int64_t { return r.presentTime ? r.presentTime - r.swapStart : -1; } },
+    { "input to swap", [](const FrameRecord& r) -> int64_t { return r.inputTime ? r.swapEnd - r.inputTime : -1; } },
+    { "input to present", [](const FrameRecord& r) -> int64_t { return r.inputTime && r.presentTime ? r.presentTime - r.inputTime : -1; } },
+};
+
+} // namespace
+
+void FrameProfiler::printHistogram(FILE* file, const std::vector<FrameRecord>& records)
+{
+    // Bucket upper bounds in milliseconds, roughly doubling, with 16.6 and 33.3 for 60Hz.
+    static const double bounds[] = { 0.25, 0.5, 1, 2, 4, 8, 16.6, 33.3, 66.6 };
+    static const unsigned numBuckets = sizeof(bounds) / sizeof(bounds[0]) + 1;
+
+    for (auto& metric : metrics) {
+        std::vector<double> values;
+        for (auto& record : records) {
+            int64_t value = metric.value(record);
+            if (value >= 0)
+                values.push_back(value / 1e6);
+        }
+        if (values.empty())
+            continue;
+
+        std::sort(values.begin(), values.end());
+        fprintf(file, "%s: %zu frames, p50 %.3f ms, p99 %.3f ms, max %.3f ms\n", metric.name, values.size(),
+            values[values.size() / 2], values[std::min(values.size() - 1, values.size() * 99 / 100)], values.back());
+
+        unsigned counts[numBuckets] = { };
+        for (double value : values)
+            ++counts[std::upper_bound(bounds, bounds + numBuckets - 1, value) - bounds];
+
+        for (unsigned i = 0; i < numBuckets; ++i) {
+            if (!counts[i])
+                continue;
+            if (i < numBuckets - 1)
+                fprintf(file, "  < %5.2f ms %8u ", bounds[i], counts[i]);
+            else
+                fprintf(file, " >= %5.2f ms %8u ", bounds[numBuckets - 2], counts[i]);
+            unsigned width = static_cast<unsigned>(50.0 * counts[i] / values.size() + 0.5);
+            for (unsigned j = 0; j < width; ++j)
+                fputc('#', file);
+            fputc('\n', file);
+        }
+    }
+}
+
+void FrameProfiler::writeChromeTrace(FILE* file, const std::vector<FrameRecord>& records)
+{
+    fprintf(file, "{\"traceEvents\":[\n");
+    fprintf(file, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":1,\"args\":{\"name\":\"CPU\"}},\n");
+    fprintf(file, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":2,\"args\":{\"name\":\"GPU\"}},\n");
+    fprintf(file, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":3,\"args\":{\"name\":\"Compositor\"}}");
+
+    // Trace timestamps are in microseconds.
+    for (auto& r : records) {
+        fprintf(file, ",\n{\"name\":\"draw\",\"ph\":\"X\",\"pid\":1,\"tid\":1,\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"frame\":%llu}}",
+            r.frameStart / 1e3, (r.swapStart - r.frameStart) / 1e3, static_cast<unsigned long long>(r.frame));
+        fprintf(file, ",\n{\"name\":\"swap\",\"ph\":\"X\",\"pid\":1,\"tid\":1,\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"frame\":%llu}}",
+            r.swapStart / 1e3, (r.swapEnd - r.swapStart) / 1e3, static_cast<unsigned long long>(r.frame));
+        if (r.inputTime) {
+            fprintf(file, ",\n{\"name\":\"input\",\"ph\":\"i\",\"s\":\"t\",\"pid\":1,\"tid\":1,\"ts\":%.3f,\"args\":{\"frame\":%llu,\"events\":%u}}",
+                r.inputTime / 1e3, static_cast<unsigned long long>(r.frame), r.inputEvents);
+        }
+        // Only the duration of GPU work is known, so it is drawn from the start of the frame.
+        if (r.gpuTime >= 0) {
+            fprintf(file, ",\n{\"name\":\"gpu\",\"ph\":\"X\",\"pid\":1,\"tid\":2,\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"frame\":%llu}}",
+                r.frameStart / 1e3, r.gpuTime / 1e3, static_cast<unsigned long long>(r.frame));
+        }
+        if (r.presentTime) {
+            fprintf(file, ",\n{\"name\":\"present\",\"ph\":\"i\",\"s\":\"t\",\"pid\":1,\"tid\":3,\"ts\":%.3f,\"args\":{\"frame\":%llu,\"refresh_ns\":%u}}",
+                r.presentTime / 1e3, static_cast<unsigned long long>(r.frame), r.refreshPeriod);
+        } else if (r.discarded) {
+            fprintf(file, ",\n{\"name\":\"discarded\",\"ph\":\"i\",\"s\":\"t\",\"pid\":1,\"tid\":3,\"ts\":%.3f,\"args\":{\"frame\":%llu}}",
+                r.swapEnd / 1e3, static_cast<unsigned long long>(r.frame));
+        }
+    }
+
+    fprintf(file, "\n]}\n");
+}
+
+} // namespace LearningGLES
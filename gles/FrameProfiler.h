@@ -0,0 +1,100 @@
+#pragma once
+
+#include "RingBuffer.h"
+#include <GLES2/gl2.h>
+#include <GLES2/gl2ext.h>
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+namespace LearningGLES {
+
+// Timeline of one frame. Timestamps are CLOCK_MONOTONIC nanoseconds.
+struct FrameRecord {
+    uint64_t frame { 0 };
+    // The window let the frame start: draw() runs from here until swapStart.
+    int64_t frameStart { 0 };
+    int64_t swapStart { 0 };
+    int64_t swapEnd { 0 };
+    // GPU time spent between frameStart and swapStart, -1 if unknown.
+    int64_t gpuTime { -1 };
+    // When the compositor showed the frame, 0 if unknown, and the output refresh period.
+    int64_t presentTime { 0 };
+    uint32_t refreshPeriod { 0 };
+    // wp_presentation_feedback kind flags.
+    uint32_t presentFlags { 0 };
+    bool discarded { false };
+    // Timestamp of the oldest input event the frame consumed, 0 if none, and how many it did.
+    int64_t inputTime { 0 };
+    uint32_t inputEvents { 0 };
+};
+
+// Per-frame instrumentation: CPU timestamps around draw() and the swap, GPU time through
+// GL_EXT_disjoint_timer_query, presentation times reported by the backend and the timestamp of
+// the input each frame consumed, which makes for input-to-present latency. GPU and
+// presentation results arrive a few frames late, so frames are kept pending until complete and
+// then published to a lock-free ring buffer that another thread may drain.
+//
+// Everything but pop() must be called from the rendering thread, with the context current.
+class FrameProfiler {
+public:
+    static const unsigned maxFramesInFlight = 16;
+
+    FrameProfiler();
+    ~FrameProfiler();
+
+    void frameStarted();
+    void swapStarted();
+    void swapFinished(bool expectPresentation);
+    // The frame being drawn consumed an input event timestamped `time`.
+    void inputConsumed(int64_t time);
+
+    // Number of the frame being drawn, to match presentation feedback with.
+    uint64_t currentFrame() const { return m_frame; }
+
+    void framePresented(uint64_t frame, int64_t presentTime, uint32_t refreshPeriod, uint32_t flags);
+    void frameDiscarded(uint64_t frame);
+
+    bool hasGPUTimer() const { return m_hasGPUTimer; }
+
+    // Completed frames, oldest first. Safe to call from one other thread.
+    bool pop(FrameRecord& record) { return m_completed.pop(record); }
+    // Records lost because nobody drained the ring buffer in time.
+    uint64_t droppedRecords() const { return m_droppedRecords; }
+
+    static int64_t now();
+
+    static void printHistogram(FILE*, const std::vector<FrameRecord>&);
+    // Chrome's trace event format, viewable in chrome://tracing or Perfetto.
+    static void writeChromeTrace(FILE*, const std::vector<FrameRecord>&);
+
+private:
+    struct PendingFrame {
+        FrameRecord record;
+        GLuint query { 0 };
+        bool used { false };
+        bool queryPending { false };
+        bool presentationPending { false };
+    };
+
+    void initGPUTimer();
+    void collectGPUResults();
+    void retireIfComplete(PendingFrame&);
+    void retire(PendingFrame&);
+    PendingFrame* pendingFrame(uint64_t frame);
+
+    uint64_t m_frame { 0 };
+    PendingFrame m_pending[maxFramesInFlight];
+    SPSCRingBuffer<FrameRecord, 4096> m_completed;
+    uint64_t m_droppedRecords { 0 };
+
+    bool m_hasGPUTimer { false };
+    PFNGLGENQUERIESEXTPROC m_glGenQueries { nullptr };
+    PFNGLDELETEQUERIESEXTPROC m_glDeleteQueries { nullptr };
+    PFNGLBEGINQUERYEXTPROC m_glBeginQuery { nullptr };
+    PFNGLENDQUERYEXTPROC m_glEndQuery { nullptr };
+    PFNGLGETQUERYOBJECTUIVEXTPROC m_glGetQueryObjectuiv { nullptr };
+    PFNGLGETQUERYOBJECTUI64VEXTPROC m_glGetQueryObjectui64v { nullptr };
+};
+
+} // namespace LearningGLES
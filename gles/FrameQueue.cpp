@@ -0,0 +1,134 @@
+#include "FrameQueue.h"
+
+#include "FrameProfiler.h"
+#include <GLES2/gl2.h>
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <thread>
+
+namespace LearningGLES {
+
+FrameQueue::FrameQueue(EGLDisplay display)
+    : m_eglDisplay(display)
+{
+    const char* extensions = eglQueryString(display, EGL_EXTENSIONS);
+    if (!extensions || !strstr(extensions, "EGL_KHR_fence_sync"))
+        return;
+
+    m_eglCreateSync = reinterpret_cast<PFNEGLCREATESYNCKHRPROC>(eglGetProcAddress("eglCreateSyncKHR"));
+    m_eglDestroySync = reinterpret_cast<PFNEGLDESTROYSYNCKHRPROC>(eglGetProcAddress("eglDestroySyncKHR"));
+    m_eglClientWaitSync = reinterpret_cast<PFNEGLCLIENTWAITSYNCKHRPROC>(eglGetProcAddress("eglClientWaitSyncKHR"));
+    m_hasFences = m_eglCreateSync && m_eglDestroySync && m_eglClientWaitSync;
+}
+
+FrameQueue::~FrameQueue()
+{
+    // Fences only need the display, which the window keeps alive past its context.
+    for (; m_count; --m_count, m_head = (m_head + 1) % maxFramesInFlight) {
+        if (!m_simulatedFrameTime)
+            m_eglDestroySync(m_eglDisplay, m_fences[m_head].sync);
+    }
+}
+
+void FrameQueue::simulateGPU(double frameSeconds)
+{
+    m_simulatedFrameTime = static_cast<int64_t>(frameSeconds * 1e9);
+    m_simulatedEnd = 0;
+}
+
+void FrameQueue::frameStarted(unsigned framesInFlight)
+{
+    if (framesInFlight > maxFramesInFlight)
+        framesInFlight = maxFramesInFlight;
+    framesInFlight = std::max(1u, framesInFlight);
+    m_frameStart = FrameProfiler::now();
+
+    while (m_count && retireOldest(0)) { }
+    m_stats.frames++;
+    m_stats.depthSum += m_count;
+    m_stats.maxDepth = std::max(m_stats.maxDepth, m_count);
+
+    if (m_count < framesInFlight)
+        return;
+    m_stats.waits++;
+    while (m_count >= framesInFlight)
+        retireOldest(EGL_FOREVER_KHR);
+    m_stats.waitSeconds += (FrameProfiler::now() - m_frameStart) / 1e9;
+}
+
+void FrameQueue::frameSubmitted()
+{
+    if (!m_hasFences && !m_simulatedFrameTime) {
+        glFinish();
+        m_stats.completed++;
+        double latency = (FrameProfiler::now() - m_frameStart) / 1e9;
+        m_stats.latencySum += latency;
+        m_stats.maxLatency = std::max(m_stats.maxLatency, latency);
+        return;
+    }
+
+    // Can't happen as long as frameStarted() keeps the count below the cap.
+    if (m_count == maxFramesInFlight)
+        retireOldest(EGL_FOREVER_KHR);
+
+    if (m_simulatedFrameTime) {
+        // The GPU starts on a frame once it is submitted and the previous one is done.
+        m_simulatedEnd = std::max(m_simulatedEnd, FrameProfiler::now()) + m_simulatedFrameTime;
+        Fence& fence = m_fences[(m_head + m_count++) % maxFramesInFlight];
+        fence.simulatedEnd = m_simulatedEnd;
+        fence.frameStart = m_frameStart;
+        return;
+    }
+
+    EGLSyncKHR sync = m_eglCreateSync(m_eglDisplay, EGL_SYNC_FENCE_KHR, nullptr);
+    if (sync == EGL_NO_SYNC_KHR) {
+        glFinish();
+        return;
+    }
+    Fence& fence = m_fences[(m_head + m_count++) % maxFramesInFlight];
+    fence.sync = sync;
+    fence.frameStart = m_frameStart;
+}
+
+bool FrameQueue::retireOldest(EGLTimeKHR timeout)
+{
+    Fence& fence = m_fences[m_head];
+    EGLint status = EGL_CONDITION_SATISFIED_KHR;
+    if (m_simulatedFrameTime) {
+        int64_t remaining = fence.simulatedEnd - FrameProfiler::now();
+        if (remaining > 0 && !timeout)
+            return false;
+        if (remaining > 0)
+            std::this_thread::sleep_for(std::chrono::nanoseconds(remaining));
+    } else {
+        // The flush makes sure a fence we block on was actually submitted.
+        EGLint flags = timeout ? EGL_SYNC_FLUSH_COMMANDS_BIT_KHR : 0;
+        status = m_eglClientWaitSync(m_eglDisplay, fence.sync, flags, timeout);
+        if (status == EGL_TIMEOUT_EXPIRED_KHR)
+            return false;
+    }
+
+    // Errors are treated as signaled, so a lost context can't block the window forever.
+    if (status == EGL_CONDITION_SATISFIED_KHR) {
+        double latency = (FrameProfiler::now() - fence.frameStart) / 1e9;
+        m_stats.completed++;
+        m_stats.latencySum += latency;
+        m_stats.maxLatency = std::max(m_stats.maxLatency, latency);
+    }
+    if (!m_simulatedFrameTime)
+        m_eglDestroySync(m_eglDisplay, fence.sync);
+    fence.sync = EGL_NO_SYNC_KHR;
+    m_head = (m_head + 1) % maxFramesInFlight;
+    m_count--;
+    return true;
+}
+
+FrameQueueStats FrameQueue::takeStats()
+{
+    FrameQueueStats stats = m_stats;
+    m_stats = FrameQueueStats();
+    return stats;
+}
+
+} // namespace LearningGLES
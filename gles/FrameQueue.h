@@ -0,0 +1,83 @@
+#pragma once
+
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#include <cstdint>
+
+namespace LearningGLES {
+
+// Activity of a FrameQueue since the last FrameQueue::takeStats().
+struct FrameQueueStats {
+    uint64_t frames { 0 };
+    // Frames the GPU had not finished yet when each frame started, summed over `frames`.
+    uint64_t depthSum { 0 };
+    unsigned maxDepth { 0 };
+    // Frames that blocked on the GPU to respect the cap, and the time they spent blocked.
+    uint64_t waits { 0 };
+    double waitSeconds { 0 };
+    // From the start of a frame until its fence was seen signaled, for `completed` frames. Fences
+    // are polled when frames start, so this overestimates by up to a frame unless we waited.
+    uint64_t completed { 0 };
+    double latencySum { 0 };
+    double maxLatency { 0 };
+};
+
+// Bounds how many frames may be queued on the GPU, with an EGL_KHR_fence_sync fence after each
+// one. Combined with a zero swap interval and no waiting for frame callbacks, the window draws
+// as often as the GPU keeps up while the compositor picks the latest frame at each repaint, like
+// a mailbox swapchain, and input is never more than a few frames old when it reaches the screen.
+//
+// Without the extension, every frame is finished before the next starts.
+class FrameQueue {
+public:
+    static const unsigned maxFramesInFlight = 8;
+
+    explicit FrameQueue(EGLDisplay);
+    ~FrameQueue();
+
+    bool hasFences() const { return m_hasFences; }
+
+    // Replaces the EGL fences with ones signaled as if the GPU took `frameSeconds` to run each
+    // frame, one after the other, so the cap engages on drivers that finish frames by the time
+    // they are flushed, such as llvmpipe. For benchmarks; 0 goes back to EGL fences, and must
+    // only be set with no frame in flight.
+    void simulateGPU(double frameSeconds);
+
+    // Blocks until fewer than `framesInFlight` frames are on the GPU. The context must be current.
+    void frameStarted(unsigned framesInFlight);
+    // Fences the frame just drawn, right before it is swapped.
+    void frameSubmitted();
+
+    FrameQueueStats takeStats();
+
+private:
+    struct Fence {
+        EGLSyncKHR sync { EGL_NO_SYNC_KHR };
+        int64_t frameStart { 0 };
+        // When a simulated fence is signaled.
+        int64_t simulatedEnd { 0 };
+    };
+
+    // Pops the oldest fence, waiting for it at most `timeout` nanoseconds. Returns false if it
+    // is still pending.
+    bool retireOldest(EGLTimeKHR timeout);
+
+    EGLDisplay m_eglDisplay;
+    bool m_hasFences { false };
+    PFNEGLCREATESYNCKHRPROC m_eglCreateSync { nullptr };
+    PFNEGLDESTROYSYNCKHRPROC m_eglDestroySync { nullptr };
+    PFNEGLCLIENTWAITSYNCKHRPROC m_eglClientWaitSync { nullptr };
+
+    // Oldest first, starting at m_head.
+    Fence m_fences[maxFramesInFlight];
+    unsigned m_head { 0 };
+    unsigned m_count { 0 };
+    int64_t m_frameStart { 0 };
+    // Set by simulateGPU(), with when its last frame ends.
+    int64_t m_simulatedFrameTime { 0 };
+    int64_t m_simulatedEnd { 0 };
+
+    FrameQueueStats m_stats;
+};
+
+} // namespace LearningGLES
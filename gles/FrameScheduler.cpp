@@ -0,0 +1,69 @@
+#include "FrameScheduler.h"
+
+namespace LearningGLES {
+
+FrameScheduler::FrameScheduler()
+    : m_frameInterval(std::chrono::nanoseconds(1000000000 / m_targetFPS))
+    , m_nextFrame(Clock::now())
+    , m_statsStart(Clock::now())
+    , m_statsCPUStart(processCPUSeconds())
+{
+}
+
+void FrameScheduler::setPacing(FramePacing pacing, unsigned targetFPS)
+{
+    m_pacing = pacing;
+    m_targetFPS = targetFPS ? targetFPS : 60;
+    m_frameInterval = std::chrono::nanoseconds(1000000000 / m_targetFPS);
+    m_nextFrame = Clock::now();
+}
+
+FrameScheduler::Clock::duration FrameScheduler::timeUntilNextFrame() const
+{
+    if (!isTimerPaced())
+        return Clock::duration::zero();
+
+    auto now = Clock::now();
+    if (now >= m_nextFrame)
+        return Clock::duration::zero();
+    return m_nextFrame - now;
+}
+
+void FrameScheduler::frameStarted()
+{
+    if (!isTimerPaced())
+        return;
+
+    // Keep a steady cadence, but don't try to catch up after a long stall.
+    auto now = Clock::now();
+    m_nextFrame += m_frameInterval;
+    if (m_nextFrame < now)
+        m_nextFrame = now + m_frameInterval;
+}
+
+FrameStats FrameScheduler::takeStats()
+{
+    auto now = Clock::now();
+    double cpu = processCPUSeconds();
+
+    FrameStats stats;
+    stats.elapsedSeconds = std::chrono::duration<double>(now - m_statsStart).count();
+    stats.framesRendered = m_framesRendered - m_statsRenderedStart;
+    stats.framesPresented = m_framesPresented - m_statsPresentedStart;
+    stats.cpuSeconds = cpu - m_statsCPUStart;
+
+    m_statsStart = now;
+    m_statsCPUStart = cpu;
+    m_statsRenderedStart = m_framesRendered;
+    m_statsPresentedStart = m_framesPresented;
+    return stats;
+}
+
+double FrameScheduler::processCPUSeconds()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+} // namespace LearningGLES
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <ctime>
+
+namespace LearningGLES {
+
+enum class FramePacing {
+    // Draw once per compositor frame callback.
+    VSync,
+    // Draw at a fixed rate, independent of the compositor.
+    CappedFPS,
+    // Draw as fast as possible. Only useful for benchmarking.
+    Unthrottled,
+    // Draw as soon as fewer than maxFramesInFlight() frames are left on the GPU, without waiting
+    // for frame callbacks. The compositor shows the latest frame, like a mailbox swapchain.
+    LowLatency,
+};
+
+struct FrameStats {
+    double elapsedSeconds { 0 };
+    uint64_t framesRendered { 0 };
+    uint64_t framesPresented { 0 };
+    // Process CPU time spent during the interval, in seconds.
+    double cpuSeconds { 0 };
+};
+
+class FrameScheduler {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    FrameScheduler();
+
+    void setPacing(FramePacing, unsigned targetFPS = 60);
+    FramePacing pacing() const { return m_pacing; }
+    unsigned targetFPS() const { return m_targetFPS; }
+
+    // Cap on frames queued on the GPU in FramePacing::LowLatency, at most FrameQueue::maxFramesInFlight.
+    void setMaxFramesInFlight(unsigned maxFramesInFlight) { m_maxFramesInFlight = maxFramesInFlight; }
+    unsigned maxFramesInFlight() const { return m_maxFramesInFlight; }
+
+    // Backends without a compositor to follow emulate VSync with a timer at the target rate.
+    void setHasVSyncSource(bool hasVSyncSource) { m_hasVSyncSource = hasVSyncSource; }
+    bool isTimerPaced() const { return m_pacing == FramePacing::CappedFPS || (m_pacing == FramePacing::VSync && !m_hasVSyncSource); }
+
+    // Time left until the next frame should start. Zero when it is already due.
+    Clock::duration timeUntilNextFrame() const;
+    void frameStarted();
+
+    void frameRendered() { ++m_framesRendered; }
+    void framePresented() { ++m_framesPresented; }
+
+    uint64_t framesRendered() const { return m_framesRendered; }
+    uint64_t framesPresented() const { return m_framesPresented; }
+
+    // Returns the counters accumulated since the previous call.
+    FrameStats takeStats();
+
+private:
+    static double processCPUSeconds();
+
+    FramePacing m_pacing { FramePacing::VSync };
+    unsigned m_targetFPS { 60 };
+    unsigned m_maxFramesInFlight { 1 };
+    bool m_hasVSyncSource { true };
+    Clock::duration m_frameInterval;
+    Clock::time_point m_nextFrame;
+
+    uint64_t m_framesRendered { 0 };
+    uint64_t m_framesPresented { 0 };
+
+    Clock::time_point m_statsStart;
+    double m_statsCPUStart { 0 };
+    uint64_t m_statsRenderedStart { 0 };
+    uint64_t m_statsPresentedStart { 0 };
+};
+
+} // namespace LearningGLES
@@ -0,0 +1,213 @@
+#include "GLState.h"
+
+namespace LearningGLES {
+
+GLState::GLState()
+{
+    reset(m_clearColor, { { 0, 0, 0, 0 } });
+    reset(m_blend, false);
+    reset(m_cullFace, false);
+    reset(m_depthTest, false);
+    reset(m_scissorTest, false);
+    reset(m_stencilTest, false);
+    reset(m_blendFunc, { { GL_ONE, GL_ZERO } });
+    reset(m_program, 0u);
+    reset(m_arrayBuffer, 0u);
+    reset(m_elementArrayBuffer, 0u);
+    reset(m_activeTexture, static_cast<GLenum>(GL_TEXTURE0));
+    for (unsigned i = 0; i < maxTextureUnits; ++i) {
+        reset(m_texture2D[i], 0u);
+        reset(m_textureCubeMap[i], 0u);
+    }
+}
+
+void GLState::invalidate()
+{
+    forget(m_clearColor);
+    forget(m_blend);
+    forget(m_cullFace);
+    forget(m_depthTest);
+    forget(m_scissorTest);
+    forget(m_stencilTest);
+    forget(m_blendFunc);
+    forget(m_viewport);
+    forget(m_scissor);
+    forget(m_program);
+    forget(m_arrayBuffer);
+    forget(m_elementArrayBuffer);
+    forget(m_activeTexture);
+    for (unsigned i = 0; i < maxTextureUnits; ++i) {
+        forget(m_texture2D[i]);
+        forget(m_textureCubeMap[i]);
+    }
+}
+
+template<typename T>
+bool GLState::update(Cached<T>& cached, const T& value)
+{
+    if (cached.known && cached.value == value) {
+        m_stats.filtered++;
+        return false;
+    }
+    cached.value = value;
+    cached.known = true;
+    m_stats.issued++;
+    return true;
+}
+
+void GLState::clearColor(GLfloat red, GLfloat green, GLfloat blue, GLfloat alpha)
+{
+    if (update(m_clearColor, { { red, green, blue, alpha } }))
+        glClearColor(red, green, blue, alpha);
+}
+
+GLState::Cached<bool>* GLState::capability(GLenum capability)
+{
+    switch (capability) {
+    case GL_BLEND:
+        return &m_blend;
+    case GL_CULL_FACE:
+        return &m_cullFace;
+    case GL_DEPTH_TEST:
+        return &m_depthTest;
+    case GL_SCISSOR_TEST:
+        return &m_scissorTest;
+    case GL_STENCIL_TEST:
+        return &m_stencilTest;
+    }
+    return nullptr;
+}
+
+void GLState::setCapability(GLenum capability, bool enabled)
+{
+    Cached<bool>* cached = this->capability(capability);
+    if (cached && !update(*cached, enabled))
+        return;
+    if (!cached)
+        m_stats.issued++;
+
+    if (enabled)
+        glEnable(capability);
+    else
+        glDisable(capability);
+}
+
+void GLState::enable(GLenum capability)
+{
+    setCapability(capability, true);
+}
+
+void GLState::disable(GLenum capability)
+{
+    setCapability(capability, false);
+}
+
+void GLState::blendFunc(GLenum source, GLenum destination)
+{
+    if (update(m_blendFunc, { { source, destination } }))
+        glBlendFunc(source, destination);
+}
+
+void GLState::viewport(GLint x, GLint y, GLsizei width, GLsizei height)
+{
+    if (update(m_viewport, { { x, y, width, height } }))
+        glViewport(x, y, width, height);
+}
+
+void GLState::scissor(GLint x, GLint y, GLsizei width, GLsizei height)
+{
+    if (update(m_scissor, { { x, y, width, height } }))
+        glScissor(x, y, width, height);
+}
+
+void GLState::useProgram(GLuint program)
+{
+    if (update(m_program, program))
+        glUseProgram(program);
+}
+
+void GLState::bindBuffer(GLenum target, GLuint buffer)
+{
+    Cached<GLuint>* cached = nullptr;
+    if (target == GL_ARRAY_BUFFER)
+        cached = &m_arrayBuffer;
+    else if (target == GL_ELEMENT_ARRAY_BUFFER)
+        cached = &m_elementArrayBuffer;
+
+    if (cached && !update(*cached, buffer))
+        return;
+    if (!cached)
+        m_stats.issued++;
+    glBindBuffer(target, buffer);
+}
+
+void GLState::activeTexture(GLenum unit)
+{
+    if (unit < GL_TEXTURE0 || unit >= GL_TEXTURE0 + maxTextureUnits) {
+        forget(m_activeTexture);
+        m_stats.issued++;
+        glActiveTexture(unit);
+        return;
+    }
+    if (update(m_activeTexture, unit))
+        glActiveTexture(unit);
+}
+
+void GLState::bindTexture(GLenum target, GLuint texture)
+{
+    Cached<GLuint>* cached = nullptr;
+    if (m_activeTexture.known) {
+        unsigned unit = m_activeTexture.value - GL_TEXTURE0;
+        if (target == GL_TEXTURE_2D)
+            cached = &m_texture2D[unit];
+        else if (target == GL_TEXTURE_CUBE_MAP)
+            cached = &m_textureCubeMap[unit];
+    }
+
+    if (cached && !update(*cached, texture))
+        return;
+    if (!cached)
+        m_stats.issued++;
+    glBindTexture(target, texture);
+}
+
+void GLState::deleteProgram(GLuint program)
+{
+    // A program in use is only flagged for deletion, and stays current until replaced.
+    glDeleteProgram(program);
+}
+
+void GLState::deleteBuffer(GLuint buffer)
+{
+    if (!buffer)
+        return;
+    if (m_arrayBuffer.known && m_arrayBuffer.value == buffer)
+        m_arrayBuffer.value = 0;
+    if (m_elementArrayBuffer.known && m_elementArrayBuffer.value == buffer)
+        m_elementArrayBuffer.value = 0;
+    glDeleteBuffers(1, &buffer);
+}
+
+void GLState::deleteTexture(GLuint texture)
+{
+    if (!texture)
+        return;
+    // Whether bindings on units other than the active one revert to 0 varies between drivers,
+    // so those are forgotten instead.
+    for (unsigned i = 0; i < maxTextureUnits; ++i) {
+        if (m_texture2D[i].known && m_texture2D[i].value == texture)
+            forget(m_texture2D[i]);
+        if (m_textureCubeMap[i].known && m_textureCubeMap[i].value == texture)
+            forget(m_textureCubeMap[i]);
+    }
+    glDeleteTextures(1, &texture);
+}
+
+GLStateStats GLState::takeStats()
+{
+    GLStateStats stats = m_stats;
+    m_stats = GLStateStats();
+    return stats;
+}
+
+} // namespace LearningGLES
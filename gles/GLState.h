@@ -0,0 +1,100 @@
+#pragma once
+
+#include <GLES2/gl2.h>
+#include <array>
+#include <cstdint>
+
+namespace LearningGLES {
+
+// State setting calls since the last GLState::takeStats().
+struct GLStateStats {
+    // Calls forwarded to GL.
+    uint64_t issued { 0 };
+    // Calls dropped because they would not have changed anything.
+    uint64_t filtered { 0 };
+};
+
+// Shadow copy of the GL state that render code sets most often, so calls setting a value that
+// is already current never reach the driver, where even a no-op costs a validation pass.
+//
+// Render code must go through it for the state it covers: a call made behind its back leaves
+// the shadow copy stale, and invalidate() must then be called before using it again. Values
+// start as the GL defaults of a new context, except the viewport and scissor box, which EGL
+// sets to the surface size, so they are unknown until first set.
+class GLState {
+public:
+    static const unsigned maxTextureUnits = 16;
+
+    GLState();
+
+    // Forgets everything, so the next call of each kind reaches GL.
+    void invalidate();
+
+    void clearColor(GLfloat red, GLfloat green, GLfloat blue, GLfloat alpha);
+
+    // Capabilities other than GL_BLEND, GL_CULL_FACE, GL_DEPTH_TEST, GL_SCISSOR_TEST and
+    // GL_STENCIL_TEST are not tracked, and always forwarded.
+    void enable(GLenum capability);
+    void disable(GLenum capability);
+    void blendFunc(GLenum source, GLenum destination);
+
+    void viewport(GLint x, GLint y, GLsizei width, GLsizei height);
+    void scissor(GLint x, GLint y, GLsizei width, GLsizei height);
+
+    void useProgram(GLuint);
+    // GL_ARRAY_BUFFER or GL_ELEMENT_ARRAY_BUFFER.
+    void bindBuffer(GLenum target, GLuint);
+    // GL_TEXTURE0 to GL_TEXTURE0 + maxTextureUnits - 1, other units are not tracked.
+    void activeTexture(GLenum unit);
+    // GL_TEXTURE_2D or GL_TEXTURE_CUBE_MAP, on the active unit.
+    void bindTexture(GLenum target, GLuint);
+
+    // Deleting an object unbinds it, so these delete through the cache to keep it in sync.
+    void deleteProgram(GLuint);
+    void deleteBuffer(GLuint);
+    void deleteTexture(GLuint);
+
+    GLStateStats takeStats();
+
+private:
+    template<typename T>
+    struct Cached {
+        T value {};
+        bool known { false };
+    };
+
+    // Records `value` as current and returns whether GL must be told.
+    template<typename T>
+    bool update(Cached<T>&, const T& value);
+    template<typename T>
+    void forget(Cached<T>& cached) { cached.known = false; }
+    template<typename T>
+    void reset(Cached<T>& cached, const T& value)
+    {
+        cached.value = value;
+        cached.known = true;
+    }
+
+    void setCapability(GLenum, bool enabled);
+    Cached<bool>* capability(GLenum);
+
+    Cached<std::array<GLfloat, 4>> m_clearColor;
+    Cached<bool> m_blend;
+    Cached<bool> m_cullFace;
+    Cached<bool> m_depthTest;
+    Cached<bool> m_scissorTest;
+    Cached<bool> m_stencilTest;
+    Cached<std::array<GLenum, 2>> m_blendFunc;
+    Cached<std::array<GLint, 4>> m_viewport;
+    Cached<std::array<GLint, 4>> m_scissor;
+    Cached<GLuint> m_program;
+    Cached<GLuint> m_arrayBuffer;
+    Cached<GLuint> m_elementArrayBuffer;
+    Cached<GLenum> m_activeTexture;
+    Cached<GLuint> m_texture2D[maxTextureUnits];
+    Cached<GLuint> m_textureCubeMap[maxTextureUnits];
+
+    GLStateStats m_stats;
+};
+
+} // namespace LearningGLES
@@ -0,0 +1,121 @@
+#include "HeadlessDisplay.h"
+
+#include "FrameProfiler.h"
+#include "HeadlessWindow.h"
+#include <EGL/eglext.h>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <mutex>
+
+namespace LearningGLES {
+
+static bool hasExtension(const char* extensions, const char* name)
+{
+    return extensions && strstr(extensions, name);
+}
+
+// Prefers displays that need neither a window system nor a GPU, so this works on CI machines.
+static EGLDisplay getHeadlessDisplay()
+{
+    const char* clientExtensions = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+    auto getPlatformDisplay = reinterpret_cast<PFNEGLGETPLATFORMDISPLAYEXTPROC>(eglGetProcAddress("eglGetPlatformDisplayEXT"));
+
+    if (getPlatformDisplay && hasExtension(clientExtensions, "EGL_MESA_platform_surfaceless")) {
+        EGLDisplay display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+        if (display != EGL_NO_DISPLAY && eglInitialize(display, nullptr, nullptr))
+            return display;
+    }
+
+    if (getPlatformDisplay && hasExtension(clientExtensions, "EGL_EXT_platform_device")) {
+        auto queryDevices = reinterpret_cast<PFNEGLQUERYDEVICESEXTPROC>(eglGetProcAddress("eglQueryDevicesEXT"));
+        EGLDeviceEXT device;
+        EGLint numDevices = 0;
+        if (queryDevices && queryDevices(1, &device, &numDevices) && numDevices) {
+            EGLDisplay display = getPlatformDisplay(EGL_PLATFORM_DEVICE_EXT, device, nullptr);
+            if (display != EGL_NO_DISPLAY && eglInitialize(display, nullptr, nullptr))
+                return display;
+        }
+    }
+
+    EGLDisplay display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+    if (display != EGL_NO_DISPLAY && eglInitialize(display, nullptr, nullptr))
+        return display;
+    return EGL_NO_DISPLAY;
+}
+
+// HeadlessDisplays using each EGLDisplay.
+static std::mutex s_referencesMutex;
+static std::map<EGLDisplay, unsigned> s_references;
+
+HeadlessDisplay::HeadlessDisplay()
+{
+    int64_t start = FrameProfiler::now();
+    m_eglDisplay = getHeadlessDisplay();
+    recordStartupPhase("egl_initialize", start);
+    if (m_eglDisplay == EGL_NO_DISPLAY) {
+        fprintf(stderr, "No headless EGL display available.\n");
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(s_referencesMutex);
+        s_references[m_eglDisplay]++;
+    }
+    eglBindAPI(EGL_OPENGL_ES_API);
+    m_hasSurfacelessContext = hasExtension(eglQueryString(m_eglDisplay, EGL_EXTENSIONS), "EGL_KHR_surfaceless_context");
+
+    EGLint pbufferAttributes[] = {
+        EGL_RENDERABLE_TYPE, EGL_OPENGL_ES2_BIT,
+        EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+        EGL_RED_SIZE, 8,
+        EGL_GREEN_SIZE, 8,
+        EGL_BLUE_SIZE, 8,
+        EGL_ALPHA_SIZE, 8,
+        EGL_NONE
+    };
+
+    m_hasPbuffers = chooseConfig(pbufferAttributes) && initShareContext();
+    if (m_hasPbuffers) {
+        m_isValid = true;
+        return;
+    }
+
+    if (!m_hasSurfacelessContext) {
+        fprintf(stderr, "EGL display supports neither pbuffers nor surfaceless contexts.\n");
+        return;
+    }
+
+    EGLint surfacelessAttributes[] = {
+        EGL_RENDERABLE_TYPE, EGL_OPENGL_ES2_BIT,
+        EGL_NONE
+    };
+
+    // Without a config, the context is created with EGL_NO_CONFIG_KHR.
+    chooseConfig(surfacelessAttributes);
+    if (!initShareContext()) {
+        fprintf(stderr, "Can't create a headless EGL context.\n");
+        return;
+    }
+    m_isValid = true;
+}
+
+HeadlessDisplay::~HeadlessDisplay()
+{
+    if (m_eglDisplay == EGL_NO_DISPLAY)
+        return;
+    if (m_shareContext != EGL_NO_CONTEXT)
+        eglDestroyContext(m_eglDisplay, m_shareContext);
+
+    std::lock_guard<std::mutex> lock(s_referencesMutex);
+    if (--s_references[m_eglDisplay])
+        return;
+    s_references.erase(m_eglDisplay);
+    eglTerminate(m_eglDisplay);
+}
+
+std::unique_ptr<Window> HeadlessDisplay::createWindow(const char* title, unsigned width, unsigned height)
+{
+    return std::unique_ptr<Window>(new HeadlessWindow(std::static_pointer_cast<HeadlessDisplay>(shared_from_this()), title, width, height));
+}
+
+} // namespace LearningGLES
@@ -0,0 +1,29 @@
+#pragma once
+
+#include "Display.h"
+
+namespace LearningGLES {
+
+// EGL display that needs neither a window system nor a GPU. Mesa hands out the same EGLDisplay
+// for every such display in the process, so it is only terminated along with the last one.
+class HeadlessDisplay : public Display {
+public:
+    HeadlessDisplay();
+    ~HeadlessDisplay() override;
+
+    std::unique_ptr<Window> createWindow(const char* title, unsigned width, unsigned height) override;
+
+    // False if there is no headless EGL display, or it can create no context to render with.
+    bool isValid() const { return m_isValid; }
+
+    // Otherwise windows render into a framebuffer object, with a surfaceless context.
+    bool hasPbuffers() const { return m_hasPbuffers; }
+    bool hasSurfacelessContext() const { return m_hasSurfacelessContext; }
+
+private:
+    bool m_isValid { false };
+    bool m_hasPbuffers { false };
+    bool m_hasSurfacelessContext { false };
+};
+
+} // namespace LearningGLES
@@ -0,0 +1,126 @@
+#include "HeadlessWindow.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+
+namespace LearningGLES {
+
+HeadlessWindow::HeadlessWindow(std::shared_ptr<HeadlessDisplay> display, const char* title, unsigned width, unsigned height)
+    : Window(display, title, width, height)
+{
+    // There is no compositor refresh to follow, so VSync pacing runs off a timer.
+    m_frameScheduler.setHasVSyncSource(false);
+    int64_t start = FrameProfiler::now();
+    initEGL(*display);
+    display->recordStartupPhase("window", start);
+}
+
+void HeadlessWindow::initEGL(HeadlessDisplay& display)
+{
+    m_eglContext = display.createContext();
+    if (m_eglContext == EGL_NO_CONTEXT) {
+        fprintf(stderr, "Can't create a headless EGL context.\n");
+        exit(1);
+    }
+
+    if (display.hasPbuffers()) {
+        EGLint surfaceAttributes[] = {
+            EGL_WIDTH, static_cast<EGLint>(m_width),
+            EGL_HEIGHT, static_cast<EGLint>(m_height),
+            EGL_NONE
+        };
+        m_eglSurface = eglCreatePbufferSurface(m_eglDisplay, m_eglConfig, surfaceAttributes);
+        if (m_eglSurface != EGL_NO_SURFACE && eglMakeCurrent(m_eglDisplay, m_eglSurface, m_eglSurface, m_eglContext))
+            return;
+
+        if (m_eglSurface != EGL_NO_SURFACE)
+            eglDestroySurface(m_eglDisplay, m_eglSurface);
+        m_eglSurface = EGL_NO_SURFACE;
+    }
+
+    if (!display.hasSurfacelessContext() || !eglMakeCurrent(m_eglDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE, m_eglContext)) {
+        fprintf(stderr, "Can't make a surfaceless EGL context current.\n");
+        exit(1);
+    }
+    initFramebuffer();
+}
+
+void HeadlessWindow::initFramebuffer()
+{
+    glGenTextures(1, &m_colorTexture);
+    glBindTexture(GL_TEXTURE_2D, m_colorTexture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, m_width, m_height, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    glGenFramebuffers(1, &m_framebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, m_framebuffer);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, m_colorTexture, 0);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+        fprintf(stderr, "Offscreen framebuffer is incomplete.\n");
+        exit(1);
+    }
+    glViewport(0, 0, m_width, m_height);
+}
+
+HeadlessWindow::~HeadlessWindow()
+{
+    makeCurrent();
+    m_profiler = nullptr;
+    m_capture = nullptr;
+    if (m_framebuffer) {
+        glDeleteFramebuffers(1, &m_framebuffer);
+        glDeleteTextures(1, &m_colorTexture);
+    }
+    eglMakeCurrent(m_eglDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    if (m_eglSurface != EGL_NO_SURFACE)
+        eglDestroySurface(m_eglDisplay, m_eglSurface);
+    eglDestroyContext(m_eglDisplay, m_eglContext);
+}
+
+void HeadlessWindow::waitForNextFrame()
+{
+    std::this_thread::sleep_for(m_frameScheduler.timeUntilNextFrame());
+    makeCurrent();
+    if (m_frameScheduler.pacing() == FramePacing::LowLatency)
+        m_frameQueue.frameStarted(m_frameScheduler.maxFramesInFlight());
+    m_frameScheduler.frameStarted();
+
+    if (m_profiler)
+        m_profiler->frameStarted();
+}
+
+void HeadlessWindow::swapBuffers()
+{
+    takeDamage();
+    makeCurrent();
+
+    if (m_profiler)
+        m_profiler->swapStarted();
+    if (m_capture)
+        m_capture->captureFrame(m_width, m_height);
+    if (m_frameScheduler.pacing() == FramePacing::LowLatency)
+        m_frameQueue.frameSubmitted();
+
+    // Swapping a pbuffer is a no-op, so flush to make the driver actually render the frame.
+    if (m_eglSurface != EGL_NO_SURFACE)
+        eglSwapBuffers(m_eglDisplay, m_eglSurface);
+    glFlush();
+
+    if (m_profiler)
+        m_profiler->swapFinished(false);
+
+    ++m_framesSwapped;
+    m_frameScheduler.frameRendered();
+    m_frameScheduler.framePresented();
+}
+
+unsigned HeadlessWindow::bufferAge()
+{
+    // Offscreen contents persist from one frame to the next.
+    return m_framesSwapped ? 1 : 0;
+}
+
+} // namespace LearningGLES
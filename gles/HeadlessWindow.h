@@ -0,0 +1,36 @@
+#pragma once
+
+#include "HeadlessDisplay.h"
+#include "Window.h"
+#include <GLES2/gl2.h>
+
+namespace LearningGLES {
+
+// Renders offscreen, without any compositor or display server. Uses an EGL pbuffer when the
+// driver offers one, and otherwise a surfaceless context rendering into a framebuffer object,
+// in which case eglSurface() is EGL_NO_SURFACE. Works with Mesa's llvmpipe and softpipe.
+class HeadlessWindow : public Window {
+public:
+    HeadlessWindow(std::shared_ptr<HeadlessDisplay>, const char* title, unsigned width, unsigned height);
+    ~HeadlessWindow() override;
+
+    const char* backendName() const override { return m_framebuffer ? "headless-surfaceless" : "headless-pbuffer"; }
+
+    // There is no seat, only injected events.
+    void processInputs() override { consumeInputs(); }
+    void waitForNextFrame() override;
+    void swapBuffers() override;
+
+protected:
+    unsigned bufferAge() override;
+
+private:
+    void initEGL(HeadlessDisplay&);
+    void initFramebuffer();
+
+    GLuint m_framebuffer { 0 };
+    GLuint m_colorTexture { 0 };
+    uint64_t m_framesSwapped { 0 };
+};
+
+} // namespace LearningGLES
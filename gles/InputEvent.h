@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstdint>
+
+namespace LearningGLES {
+
+// Pointer or keyboard event delivered to a window, with the compositor's timestamp so the frame
+// consuming it can tell how long it took to reach the screen.
+struct InputEvent {
+    enum class Type {
+        PointerEnter,
+        PointerLeave,
+        PointerMotion,
+        // `code` is the linux/input-event-codes.h button, BTN_LEFT and so on.
+        PointerButton,
+        // `code` is 0 for vertical scrolling and 1 for horizontal, `value` the distance.
+        PointerAxis,
+        // `code` is the evdev key code, KEY_A and so on, regardless of the keymap.
+        Key,
+    };
+
+    Type type { Type::PointerMotion };
+    // When the event happened, in FrameProfiler::now() time. Compositors timestamp events with
+    // millisecond precision, on CLOCK_MONOTONIC in practice. 0 for enter and leave events.
+    int64_t time { 0 };
+    // When the event reached the process.
+    int64_t receivedTime { 0 };
+    // Pointer position in the coordinates of Window::width() and height(), kept from the last
+    // motion for button events.
+    double x { 0 };
+    double y { 0 };
+    uint32_t code { 0 };
+    double value { 0 };
+    bool pressed { false };
+};
+
+} // namespace LearningGLES
@@ -0,0 +1,50 @@
+#pragma once
+
+namespace LearningGLES {
+
+enum class LayerPlacement { Below, Above };
+
+// How a layer's commits relate to its window's frames.
+enum class LayerSync {
+    // Shown along with the window's next swapBuffers(), so both change in the same frame.
+    Synchronized,
+    // Shown as soon as committed, on a cadence of its own.
+    Desynchronized,
+};
+
+// A surface of its own stacked below or above a window's, with buffers of its own, that the
+// compositor blends with the window. Content that changes rarely, a background or a HUD, costs
+// nothing in the frames where it doesn't change, while the window's surface only holds what
+// moves, over transparent pixels.
+//
+// Positions and sizes are in the window's surface coordinates, unaffected by its resolution
+// scaler. Layers must be destroyed before their window.
+class Layer {
+public:
+    virtual ~Layer() { }
+
+    unsigned width() const { return m_width; }
+    unsigned height() const { return m_height; }
+
+    // Makes the window's context current on the layer's surface, to draw all of its next
+    // content. The viewport is left to the render code.
+    virtual void makeCurrent() = 0;
+    // Presents what was drawn since makeCurrent(), and makes the window's surface current again.
+    virtual void commit() = 0;
+
+    // Both take effect with the window's next swapBuffers(). A resized layer must be redrawn.
+    virtual void setPosition(int x, int y) = 0;
+    virtual void resize(unsigned width, unsigned height) = 0;
+
+protected:
+    Layer(unsigned width, unsigned height)
+        : m_width(width)
+        , m_height(height)
+    {
+    }
+
+    unsigned m_width;
+    unsigned m_height;
+};
+
+} // namespace LearningGLES
@@ -0,0 +1,39 @@
+#include "PixelBuffer.h"
+
+#include <algorithm>
+
+namespace LearningGLES {
+
+void fillRect(const PixelBuffer& buffer, const Rect& rect, uint32_t color)
+{
+    Rect visible = intersection(rect, Rect { 0, 0, static_cast<int>(buffer.width), static_cast<int>(buffer.height) });
+    if (visible.isEmpty())
+        return;
+    for (int y = visible.y; y < visible.y + visible.height; ++y)
+        std::fill_n(buffer.row(y) + visible.x, visible.width, color);
+}
+
+void blendRect(const PixelBuffer& buffer, const Rect& rect, uint32_t color)
+{
+    uint32_t alpha = color >> 24;
+    if (alpha == 0xff) {
+        fillRect(buffer, rect, color);
+        return;
+    }
+    Rect visible = intersection(rect, Rect { 0, 0, static_cast<int>(buffer.width), static_cast<int>(buffer.height) });
+    if (visible.isEmpty() || !alpha)
+        return;
+
+    // Premultiplied source over: each channel is scaled by 1 - alpha, two channels at a time.
+    uint32_t inverse = 255 - alpha;
+    for (int y = visible.y; y < visible.y + visible.height; ++y) {
+        uint32_t* pixel = buffer.row(y) + visible.x;
+        for (int x = 0; x < visible.width; ++x, ++pixel) {
+            uint32_t redBlue = ((*pixel & 0xff00ff) * inverse + 0x800080) >> 8 & 0xff00ff;
+            uint32_t alphaGreen = ((*pixel >> 8 & 0xff00ff) * inverse + 0x800080) & 0xff00ff00;
+            *pixel = color + (redBlue | alphaGreen);
+        }
+    }
+}
+
+} // namespace LearningGLES
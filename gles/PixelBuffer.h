@@ -0,0 +1,25 @@
+#pragma once
+
+#include "DamageRegion.h"
+#include <cstddef>
+#include <cstdint>
+
+namespace LearningGLES {
+
+// Pixels of a CPU-rendered back buffer, premultiplied 0xAARRGGBB, top row first.
+struct PixelBuffer {
+    uint32_t* data { nullptr };
+    unsigned width { 0 };
+    unsigned height { 0 };
+    // In pixels.
+    unsigned stride { 0 };
+
+    uint32_t* row(unsigned y) const { return data + static_cast<size_t>(y) * stride; }
+};
+
+// Fills the part of `rect` inside the buffer with `color`.
+void fillRect(const PixelBuffer&, const Rect&, uint32_t color);
+// Same, blending `color` over the pixels.
+void blendRect(const PixelBuffer&, const Rect&, uint32_t color);
+
+} // namespace LearningGLES
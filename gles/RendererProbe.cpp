@@ -0,0 +1,102 @@
+#include "RendererProbe.h"
+
+#include "Display.h"
+#include "FrameProfiler.h"
+#include "PixelBuffer.h"
+#include "Window.h"
+#include <GLES2/gl2.h>
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+namespace LearningGLES {
+
+static const unsigned probeFrames = 7;
+static const unsigned probeRects = 16;
+
+static Rect probeRect(unsigned index, unsigned width, unsigned height)
+{
+    return Rect { static_cast<int>(index * width / probeRects), static_cast<int>(index * height / probeRects), 64, 64 };
+}
+
+static double median(std::vector<double>& samples)
+{
+    std::sort(samples.begin(), samples.end());
+    return samples[samples.size() / 2];
+}
+
+static bool isSoftwareRenderer()
+{
+    const char* renderer = reinterpret_cast<const char*>(glGetString(GL_RENDERER));
+    return renderer && (strstr(renderer, "llvmpipe") || strstr(renderer, "softpipe") || strstr(renderer, "swrast"));
+}
+
+static double probeGL(unsigned width, unsigned height)
+{
+    std::shared_ptr<Display> display = Display::create(WindowBackend::Headless);
+    std::unique_ptr<Window> window = display ? display->createWindow("probe", width, height) : nullptr;
+    if (!window)
+        return 0;
+    window->frameScheduler().setPacing(FramePacing::Unthrottled);
+    bool readBack = isSoftwareRenderer();
+    std::vector<uint32_t> pixels(readBack ? static_cast<size_t>(width) * height : 0);
+
+    std::vector<double> samples;
+    // The first frame only warms the driver up.
+    for (unsigned frame = 0; frame <= probeFrames; ++frame) {
+        window->waitForNextFrame();
+        int64_t start = FrameProfiler::now();
+        GLState& state = window->glState();
+        state.clearColor(1.0, 0.0, 0.0, 0.5);
+        glClear(GL_COLOR_BUFFER_BIT);
+        state.enable(GL_SCISSOR_TEST);
+        state.clearColor(0.0, 1.0, 0.0, 1.0);
+        for (unsigned i = 0; i < probeRects; ++i) {
+            Rect rect = probeRect(i, width, height);
+            state.scissor(rect.x, height - rect.y - rect.height, rect.width, rect.height);
+            glClear(GL_COLOR_BUFFER_BIT);
+        }
+        state.disable(GL_SCISSOR_TEST);
+        if (readBack)
+            glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+        glFinish();
+        if (frame)
+            samples.push_back((FrameProfiler::now() - start) / 1e9);
+        window->swapBuffers();
+    }
+    return median(samples);
+}
+
+static double probeCPU(unsigned width, unsigned height)
+{
+    std::vector<uint32_t> pixels(static_cast<size_t>(width) * height);
+    PixelBuffer buffer;
+    buffer.data = pixels.data();
+    buffer.width = width;
+    buffer.height = height;
+    buffer.stride = width;
+
+    std::vector<double> samples;
+    for (unsigned frame = 0; frame <= probeFrames; ++frame) {
+        int64_t start = FrameProfiler::now();
+        fillRect(buffer, Rect { 0, 0, static_cast<int>(width), static_cast<int>(height) }, 0x80800000);
+        for (unsigned i = 0; i < probeRects; ++i)
+            fillRect(buffer, probeRect(i, width, height), 0xff00ff00);
+        if (frame)
+            samples.push_back((FrameProfiler::now() - start) / 1e9);
+    }
+    return median(samples);
+}
+
+RendererProbe probeRenderers(unsigned width, unsigned height)
+{
+    RendererProbe probe;
+    probe.cpuSeconds = probeCPU(width, height);
+    probe.glSeconds = probeGL(width, height);
+    // Without a working GLES driver, the CPU wins by default.
+    if (!probe.glSeconds)
+        probe.glSeconds = probe.cpuSeconds + 1;
+    return probe;
+}
+
+} // namespace LearningGLES
@@ -0,0 +1,22 @@
+#pragma once
+
+namespace LearningGLES {
+
+// How long one test frame takes to draw on this machine with GLES and with the CPU, in seconds.
+struct RendererProbe {
+    double glSeconds { 0 };
+    double cpuSeconds { 0 };
+
+    bool preferCPU() const { return cpuSeconds < glSeconds; }
+};
+
+// Draws the same frame, a full clear and a few rectangles, a handful of times with each
+// renderer and keeps the median. The GLES side renders offscreen on a headless display, and
+// reads the frame back when the driver is a software one, which is what Mesa does to present
+// it through wl_shm. That is the same driver as the Wayland EGL display the GLES side stands
+// for, but not its swaps, so a driver whose Wayland presentation costs much more than its
+// rendering is favored. Without a working headless display, the CPU wins.
+// Takes a few tens of milliseconds on a software driver.
+RendererProbe probeRenderers(unsigned width, unsigned height);
+
+} // namespace LearningGLES
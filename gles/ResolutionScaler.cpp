@@ -0,0 +1,64 @@
+#include "ResolutionScaler.h"
+
+#include <cmath>
+
+namespace LearningGLES {
+
+constexpr double ResolutionScaler::scaleStep;
+constexpr double ResolutionScaler::targetLoad;
+constexpr double ResolutionScaler::raiseLoad;
+
+bool ResolutionScaler::frameRendered(double frameSeconds, double budgetSeconds)
+{
+    if (!m_enabled)
+        return false;
+
+    m_stats.frames++;
+    m_stats.frameSecondsSum += frameSeconds;
+    m_frameSecondsSum += frameSeconds;
+    if (++m_frames < framesPerUpdate)
+        return false;
+
+    double mean = m_frameSecondsSum / m_frames;
+    m_frames = 0;
+    m_frameSecondsSum = 0;
+    if (mean <= 0 || (mean <= budgetSeconds && mean >= raiseLoad * budgetSeconds)) {
+        m_updatesUnderRaiseLoad = 0;
+        return false;
+    }
+    if (mean < raiseLoad * budgetSeconds) {
+        if (++m_updatesUnderRaiseLoad < updatesBeforeRaise)
+            return false;
+    }
+    m_updatesUnderRaiseLoad = 0;
+
+    double scale = m_scale * std::sqrt(targetLoad * budgetSeconds / mean);
+    if (scale > m_scale + 2 * scaleStep)
+        scale = m_scale + 2 * scaleStep;
+    // Rounded down: a step too low costs some sharpness, a step too high misses frames.
+    scale = std::floor(scale / scaleStep + 1e-9) * scaleStep;
+    if (scale > 1)
+        scale = 1;
+    if (scale < m_minScale)
+        scale = m_minScale;
+    if (scale == m_scale)
+        return false;
+
+    m_scale = scale;
+    m_stats.changes++;
+    if (scale < m_stats.minScale)
+        m_stats.minScale = scale;
+    return true;
+}
+
+ResolutionStats ResolutionScaler::takeStats()
+{
+    ResolutionStats stats = m_stats;
+    stats.scale = scale();
+    m_stats = ResolutionStats();
+    m_stats.scale = stats.scale;
+    m_stats.minScale = stats.scale;
+    return stats;
+}
+
+} // namespace LearningGLES
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <cstdint>
+
+namespace LearningGLES {
+
+// Activity of a ResolutionScaler since the last ResolutionScaler::takeStats().
+struct ResolutionStats {
+    uint64_t frames { 0 };
+    // Times the scale changed, each reallocating the window's buffers.
+    uint64_t changes { 0 };
+    double scale { 1 };
+    // Lowest scale reached.
+    double minScale { 1 };
+    // Frame times the controller was fed, summed over `frames`.
+    double frameSecondsSum { 0 };
+};
+
+// Picks the fraction of the window's size to render at, so frames fit in the budget of the
+// target frame rate on hosts too slow to fill the whole window, with the compositor scaling
+// the result up. Rendering cost is taken to grow with the pixel count, and the scale to aim
+// for is recomputed from the mean frame time every framesPerUpdate frames. Going up is done in
+// small steps and only with plenty of headroom for updatesBeforeRaise updates in a row, so the
+// scale settles instead of oscillating, and it moves by whole scaleSteps, so frame time noise
+// doesn't reallocate the buffers.
+//
+// Disabled by default, and only honored by backends whose compositor can scale surfaces.
+class ResolutionScaler {
+public:
+    static const unsigned framesPerUpdate = 30;
+    static constexpr double scaleStep = 1.0 / 16;
+    // Share of the budget the scale aims to use, and below which it goes up again.
+    static constexpr double targetLoad = 0.8;
+    static constexpr double raiseLoad = 0.6;
+    // Frame time doesn't shrink as fast as the pixel count, so a single quick update after a
+    // drop isn't enough to go back up.
+    static const unsigned updatesBeforeRaise = 4;
+
+    void setEnabled(bool enabled) { m_enabled = enabled; }
+    bool isEnabled() const { return m_enabled; }
+
+    // The scale never goes below `minScale`, in (0, 1].
+    void setMinScale(double minScale) { m_minScale = minScale; }
+
+    // Current scale, 1 while disabled.
+    double scale() const { return m_enabled ? m_scale : 1; }
+
+    // Feeds the time the frame took to draw and submit. Returns true if scale() changed.
+    bool frameRendered(double frameSeconds, double budgetSeconds);
+
+    ResolutionStats takeStats();
+
+private:
+    bool m_enabled { false };
+    double m_minScale { 0.5 };
+    double m_scale { 1 };
+    unsigned m_frames { 0 };
+    double m_frameSecondsSum { 0 };
+    // Updates in a row with the mean under raiseLoad.
+    unsigned m_updatesUnderRaiseLoad { 0 };
+
+    ResolutionStats m_stats;
+};
+
+} // namespace LearningGLES
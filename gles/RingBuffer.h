@@ -0,0 +1,51 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+
+namespace LearningGLES {
+
+// Bounded, lock-free queue for exactly one producer thread and one consumer thread.
+// Capacity must be a power of two.
+template<typename T, size_t Capacity>
+class SPSCRingBuffer {
+    static_assert(Capacity && !(Capacity & (Capacity - 1)), "Capacity must be a power of two");
+
+public:
+    // Producer side. Returns false, leaving the queue untouched, when it is full.
+    bool push(const T& value)
+    {
+        size_t head = m_head.load(std::memory_order_relaxed);
+        if (head - m_tail.load(std::memory_order_acquire) == Capacity)
+            return false;
+        m_items[head & (Capacity - 1)] = value;
+        m_head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer side. Returns false when the queue is empty.
+    bool pop(T& value)
+    {
+        size_t tail = m_tail.load(std::memory_order_relaxed);
+        if (tail == m_head.load(std::memory_order_acquire))
+            return false;
+        value = m_items[tail & (Capacity - 1)];
+        m_tail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    size_t size() const { return m_head.load(std::memory_order_acquire) - m_tail.load(std::memory_order_acquire); }
+    bool isEmpty() const { return !size(); }
+
+private:
+    // Keep the indices on separate cache lines, so the two threads don't false-share. Padding
+    // rather than alignas() keeps the owner allocatable with plain new before C++17.
+    static const size_t cacheLineSize = 64;
+    std::atomic<size_t> m_head { 0 };
+    char m_headPadding[cacheLineSize - sizeof(std::atomic<size_t>)];
+    std::atomic<size_t> m_tail { 0 };
+    char m_tailPadding[cacheLineSize - sizeof(std::atomic<size_t>)];
+    T m_items[Capacity];
+};
+
+} // namespace LearningGLES
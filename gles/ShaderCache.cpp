@@ -0,0 +1,211 @@
+#include "ShaderCache.h"
+
+#include "DiskCache.h"
+#include <EGL/egl.h>
+#include <cstdio>
+#include <cstring>
+#include <unistd.h>
+
+namespace LearningGLES {
+
+namespace {
+
+// Bump when the file layout changes, so old files are ignored.
+const uint32_t binaryFileVersion = 1;
+
+struct BinaryFileHeader {
+    char magic[4];
+    uint32_t version;
+    uint64_t key;
+    uint32_t format;
+    uint32_t size;
+};
+
+uint64_t hash(uint64_t value, const GLubyte* string)
+{
+    return LearningGLES::hash(value, reinterpret_cast<const char*>(string));
+}
+
+GLuint compileShader(GLenum type, const char* source)
+{
+    GLuint shader = glCreateShader(type);
+    glShaderSource(shader, 1, &source, nullptr);
+    glCompileShader(shader);
+
+    GLint status;
+    glGetShaderiv(shader, GL_COMPILE_STATUS, &status);
+    if (status)
+        return shader;
+
+    char log[1024] = { };
+    glGetShaderInfoLog(shader, sizeof(log), nullptr, log);
+    fprintf(stderr, "Failed to compile %s shader: %s\n", type == GL_VERTEX_SHADER ? "vertex" : "fragment", log);
+    glDeleteShader(shader);
+    return 0;
+}
+
+} // namespace
+
+ShaderCache::ShaderCache(const std::string& directory)
+    : m_directory(directory)
+{
+    m_driverHash = hash(hashSeed, glGetString(GL_VENDOR));
+    m_driverHash = hash(m_driverHash, glGetString(GL_RENDERER));
+    m_driverHash = hash(m_driverHash, glGetString(GL_VERSION));
+
+    const char* extensions = reinterpret_cast<const char*>(glGetString(GL_EXTENSIONS));
+    if (m_directory.empty() || !extensions || !strstr(extensions, "GL_OES_get_program_binary"))
+        return;
+    // Drivers may expose the extension without supporting any format.
+    GLint formats = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS_OES, &formats);
+    if (formats <= 0)
+        return;
+
+    m_glGetProgramBinary = reinterpret_cast<PFNGLGETPROGRAMBINARYOESPROC>(eglGetProcAddress("glGetProgramBinaryOES"));
+    m_glProgramBinary = reinterpret_cast<PFNGLPROGRAMBINARYOESPROC>(eglGetProcAddress("glProgramBinaryOES"));
+    m_hasProgramBinary = m_glGetProgramBinary && m_glProgramBinary && makeDirectories(m_directory);
+}
+
+ShaderCache::~ShaderCache()
+{
+    for (auto& entry : m_programs)
+        glDeleteProgram(entry.second);
+}
+
+std::string ShaderCache::defaultDirectory()
+{
+    return cacheDirectory("shaders");
+}
+
+GLuint ShaderCache::program(const char* vertexSource, const char* fragmentSource, const std::vector<const char*>& attributes)
+{
+    uint64_t key = hash(m_driverHash, vertexSource);
+    key = hash(key, fragmentSource);
+    for (const char* attribute : attributes)
+        key = hash(key, attribute);
+
+    auto found = m_programs.find(key);
+    if (found != m_programs.end())
+        return found->second;
+
+    std::string path;
+    GLuint program = 0;
+    if (m_hasProgramBinary) {
+        path = m_directory + "/" + hashName(key) + ".bin";
+        program = loadBinary(path, key);
+    }
+
+    if (!program) {
+        program = compile(vertexSource, fragmentSource, attributes);
+        if (!program) {
+            m_stats.failed++;
+            return 0;
+        }
+        m_stats.compiled++;
+        if (m_hasProgramBinary)
+            storeBinary(path, key, program);
+    }
+
+    m_programs[key] = program;
+    return program;
+}
+
+GLuint ShaderCache::loadBinary(const std::string& path, uint64_t key)
+{
+    FILE* file = fopen(path.c_str(), "rb");
+    if (!file)
+        return 0;
+
+    BinaryFileHeader header;
+    std::vector<char> binary;
+    bool valid = fread(&header, sizeof(header), 1, file) == 1
+        && !memcmp(header.magic, "LGPB", 4) && header.version == binaryFileVersion && header.key == key;
+    if (valid) {
+        binary.resize(header.size);
+        valid = fread(binary.data(), 1, binary.size(), file) == binary.size();
+    }
+    fclose(file);
+    if (!valid) {
+        unlink(path.c_str());
+        return 0;
+    }
+
+    GLuint program = glCreateProgram();
+    m_glProgramBinary(program, header.format, binary.data(), binary.size());
+    GLint status = GL_FALSE;
+    glGetProgramiv(program, GL_LINK_STATUS, &status);
+    if (!status) {
+        // Not an error: drivers refuse binaries from other versions, and the caller recompiles.
+        glDeleteProgram(program);
+        unlink(path.c_str());
+        m_stats.rejected++;
+        return 0;
+    }
+
+    m_stats.loaded++;
+    return program;
+}
+
+void ShaderCache::storeBinary(const std::string& path, uint64_t key, GLuint program)
+{
+    GLint length = 0;
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH_OES, &length);
+    if (length <= 0)
+        return;
+
+    BinaryFileHeader header;
+    memcpy(header.magic, "LGPB", 4);
+    header.version = binaryFileVersion;
+    header.key = key;
+    std::vector<char> binary(length);
+    GLsizei size = 0;
+    m_glGetProgramBinary(program, length, &size, &header.format, binary.data());
+    if (size <= 0)
+        return;
+    header.size = size;
+
+    // Written aside and renamed, so concurrent runs never see a partial file.
+    std::string temporaryPath = path + "." + std::to_string(getpid());
+    FILE* file = fopen(temporaryPath.c_str(), "wb");
+    if (!file)
+        return;
+    bool written = fwrite(&header, sizeof(header), 1, file) == 1
+        && fwrite(binary.data(), 1, size, file) == static_cast<size_t>(size);
+    if (fclose(file) || !written || rename(temporaryPath.c_str(), path.c_str()))
+        unlink(temporaryPath.c_str());
+}
+
+GLuint ShaderCache::compile(const char* vertexSource, const char* fragmentSource, const std::vector<const char*>& attributes)
+{
+    GLuint vertexShader = compileShader(GL_VERTEX_SHADER, vertexSource);
+    GLuint fragmentShader = compileShader(GL_FRAGMENT_SHADER, fragmentSource);
+    if (!vertexShader || !fragmentShader) {
+        glDeleteShader(vertexShader);
+        glDeleteShader(fragmentShader);
+        return 0;
+    }
+
+    GLuint program = glCreateProgram();
+    glAttachShader(program, vertexShader);
+    glAttachShader(program, fragmentShader);
+    for (size_t i = 0; i < attributes.size(); ++i)
+        glBindAttribLocation(program, i, attributes[i]);
+    glLinkProgram(program);
+    // Flagged for deletion, they go away with the program.
+    glDeleteShader(vertexShader);
+    glDeleteShader(fragmentShader);
+
+    GLint status;
+    glGetProgramiv(program, GL_LINK_STATUS, &status);
+    if (!status) {
+        char log[1024] = { };
+        glGetProgramInfoLog(program, sizeof(log), nullptr, log);
+        fprintf(stderr, "Failed to link program: %s\n", log);
+        glDeleteProgram(program);
+        return 0;
+    }
+    return program;
+}
+
+} // namespace LearningGLES
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <GLES2/gl2.h>
+#include <GLES2/gl2ext.h>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace LearningGLES {
+
+struct ShaderCacheStats {
+    // Programs compiled and linked from source.
+    unsigned compiled { 0 };
+    // Programs loaded from a binary on disk.
+    unsigned loaded { 0 };
+    // Binaries the driver refused, typically after a driver update. Those are recompiled.
+    unsigned rejected { 0 };
+    unsigned failed { 0 };
+};
+
+// Builds GL programs from source and keeps them for the lifetime of the cache, so asking twice
+// for the same sources returns the same program.
+//
+// When the driver has GL_OES_get_program_binary, linked programs are also saved to disk and
+// loaded on later runs, skipping compilation altogether. A binary is keyed by a hash of the
+// sources, attribute bindings and the GL vendor, renderer and version strings, so a driver or
+// GPU change misses the cache rather than loading a binary the driver would reject.
+//
+// Must be used with the context it was created with current.
+class ShaderCache {
+public:
+    // An empty directory disables the disk cache.
+    explicit ShaderCache(const std::string& directory = defaultDirectory());
+    ~ShaderCache();
+
+    // $XDG_CACHE_HOME/learning-gles/shaders, or ~/.cache/learning-gles/shaders.
+    static std::string defaultDirectory();
+
+    // Attribute i of `attributes` is bound to location i. Returns 0 and prints the info log if
+    // the program doesn't compile or link.
+    GLuint program(const char* vertexSource, const char* fragmentSource, const std::vector<const char*>& attributes = { });
+
+    bool hasProgramBinary() const { return m_hasProgramBinary; }
+    const ShaderCacheStats& stats() const { return m_stats; }
+
+private:
+    GLuint loadBinary(const std::string& path, uint64_t key);
+    void storeBinary(const std::string& path, uint64_t key, GLuint program);
+    GLuint compile(const char* vertexSource, const char* fragmentSource, const std::vector<const char*>& attributes);
+
+    std::string m_directory;
+    // Hash of the GL vendor, renderer and version strings.
+    uint64_t m_driverHash { 0 };
+    std::unordered_map<uint64_t, GLuint> m_programs;
+    ShaderCacheStats m_stats;
+
+    bool m_hasProgramBinary { false };
+    PFNGLGETPROGRAMBINARYOESPROC m_glGetProgramBinary { nullptr };
+    PFNGLPROGRAMBINARYOESPROC m_glProgramBinary { nullptr };
+};
+
+} // namespace LearningGLES
@@ -0,0 +1,152 @@
+#include "ShmWindow.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <sys/mman.h>
+#include <unistd.h>
+
+namespace LearningGLES {
+
+struct wl_buffer_listener ShmWindow::s_wlBufferListener = {
+    /* release */
+    [](void* data, struct wl_buffer* buffer) {
+        Event event;
+        event.type = Event::Type::BufferReleased;
+        event.proxy = buffer;
+        static_cast<ShmWindow*>(data)->postEvent(event);
+    }
+};
+
+ShmWindow::ShmWindow(std::shared_ptr<WaylandDisplay> display, const char* title, unsigned width, unsigned height)
+    : WaylandWindow(display, title, width, height, Buffers::Custom)
+{
+}
+
+ShmWindow::~ShmWindow()
+{
+    // A release listener may be running until the buffers are destroyed.
+    std::lock_guard<std::mutex> lock(m_waylandDisplay.dispatchMutex());
+    for (auto& buffer : m_buffers)
+        destroy(buffer);
+}
+
+void ShmWindow::allocate(Buffer& buffer)
+{
+    size_t size = static_cast<size_t>(m_width) * m_height * 4;
+    if (buffer.wlBuffer)
+        wl_buffer_destroy(buffer.wlBuffer);
+
+    if (size > buffer.capacity) {
+        if (buffer.wlPool) {
+            wl_shm_pool_destroy(buffer.wlPool);
+            munmap(buffer.data, buffer.capacity);
+            close(buffer.fd);
+        }
+        buffer.capacity = std::max(size, buffer.capacity + buffer.capacity / 2);
+        buffer.fd = memfd_create("learning-gles-shm", MFD_CLOEXEC);
+        if (buffer.fd < 0 || ftruncate(buffer.fd, buffer.capacity) < 0) {
+            fprintf(stderr, "Cannot allocate a %zu bytes shm buffer.\n", buffer.capacity);
+            exit(1);
+        }
+        buffer.data = mmap(nullptr, buffer.capacity, PROT_READ | PROT_WRITE, MAP_SHARED, buffer.fd, 0);
+        if (buffer.data == MAP_FAILED) {
+            fprintf(stderr, "Cannot map a %zu bytes shm buffer.\n", buffer.capacity);
+            exit(1);
+        }
+        buffer.wlPool = wl_shm_create_pool(m_waylandDisplay.wlShm(), buffer.fd, buffer.capacity);
+    }
+
+    buffer.wlBuffer = wl_shm_pool_create_buffer(buffer.wlPool, 0, m_width, m_height, m_width * 4, WL_SHM_FORMAT_ARGB8888);
+    wl_buffer_add_listener(buffer.wlBuffer, &s_wlBufferListener, this);
+    buffer.width = m_width;
+    buffer.height = m_height;
+    buffer.frame = 0;
+}
+
+void ShmWindow::destroy(Buffer& buffer)
+{
+    if (buffer.wlBuffer)
+        wl_buffer_destroy(buffer.wlBuffer);
+    if (buffer.wlPool) {
+        wl_shm_pool_destroy(buffer.wlPool);
+        munmap(buffer.data, buffer.capacity);
+        close(buffer.fd);
+    }
+    buffer = Buffer();
+}
+
+void ShmWindow::beginFrame()
+{
+    while (!m_backBuffer) {
+        for (auto& buffer : m_buffers) {
+            if (!buffer.busy) {
+                m_backBuffer = &buffer;
+                break;
+            }
+        }
+        if (!m_backBuffer && !dispatchEvents(std::chrono::nanoseconds(-1))) {
+            fprintf(stderr, "Lost the connection while waiting for a buffer.\n");
+            exit(1);
+        }
+    }
+
+    if (m_backBuffer->width != m_width || m_backBuffer->height != m_height) {
+        std::lock_guard<std::mutex> lock(m_waylandDisplay.dispatchMutex());
+        allocate(*m_backBuffer);
+    }
+}
+
+PixelBuffer ShmWindow::pixelBuffer()
+{
+    PixelBuffer pixels;
+    if (!m_backBuffer)
+        return pixels;
+    pixels.data = static_cast<uint32_t*>(m_backBuffer->data);
+    pixels.width = m_backBuffer->width;
+    pixels.height = m_backBuffer->height;
+    pixels.stride = m_backBuffer->width;
+    return pixels;
+}
+
+void ShmWindow::present(const DamageRegion& damage)
+{
+    if (!m_backBuffer)
+        return;
+
+    wl_surface_attach(m_wlSurface, m_backBuffer->wlBuffer, 0, 0);
+    // Damage is in surface coordinates, which the viewport may scale the buffer to.
+    double scaleX = static_cast<double>(m_surfaceWidth) / m_backBuffer->width;
+    double scaleY = static_cast<double>(m_surfaceHeight) / m_backBuffer->height;
+    for (auto& rect : damage) {
+        int x = static_cast<int>(std::floor(rect.x * scaleX));
+        int y = static_cast<int>(std::floor(rect.y * scaleY));
+        wl_surface_damage(m_wlSurface, x, y, static_cast<int>(std::ceil((rect.x + rect.width) * scaleX)) - x,
+            static_cast<int>(std::ceil((rect.y + rect.height) * scaleY)) - y);
+    }
+    wl_surface_commit(m_wlSurface);
+    // eglSwapBuffers flushes for EGL windows, here nothing would until the event thread wakes up.
+    wl_display_flush(m_waylandDisplay.wlDisplay());
+
+    m_backBuffer->busy = true;
+    m_backBuffer->frame = ++m_framesAttached;
+    m_backBuffer = nullptr;
+}
+
+void ShmWindow::bufferReleased(struct wl_buffer* wlBuffer)
+{
+    for (auto& buffer : m_buffers) {
+        if (buffer.wlBuffer == wlBuffer)
+            buffer.busy = false;
+    }
+}
+
+unsigned ShmWindow::bufferAge()
+{
+    if (!m_backBuffer || !m_backBuffer->frame)
+        return 0;
+    return m_framesAttached - m_backBuffer->frame + 1;
+}
+
+} // namespace LearningGLES
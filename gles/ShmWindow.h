@@ -0,0 +1,60 @@
+#pragma once
+
+#include "WaylandWindow.h"
+
+namespace LearningGLES {
+
+// A Wayland window drawn by the CPU into wl_shm buffers, for machines where that beats their
+// GLES driver, typically when it is a software one that would copy every frame into such a
+// buffer anyway. There is no EGL context: render code draws into pixelBuffer() between
+// waitForNextFrame() and swapBuffers().
+//
+// Buffers are reused once the compositor releases them, and waitForNextFrame() blocks while it
+// holds all of them. On resize they are only reallocated once free, and their backing store
+// grows geometrically and never shrinks, so a resize drag reallocates rarely.
+class ShmWindow : public WaylandWindow {
+public:
+    static const unsigned bufferCount = 3;
+
+    ShmWindow(std::shared_ptr<WaylandDisplay>, const char* title, unsigned width, unsigned height);
+    ~ShmWindow() override;
+
+    const char* backendName() const override { return "wayland-shm"; }
+
+    PixelBuffer pixelBuffer() override;
+
+protected:
+    void beginFrame() override;
+    void present(const DamageRegion&) override;
+    // Buffers catch up with the window's size when next acquired.
+    void resizeBuffers() override { }
+    void bufferReleased(struct wl_buffer*) override;
+    unsigned bufferAge() override;
+
+private:
+    struct Buffer {
+        struct wl_buffer* wlBuffer { nullptr };
+        struct wl_shm_pool* wlPool { nullptr };
+        int fd { -1 };
+        void* data { nullptr };
+        size_t capacity { 0 };
+        // Size of wlBuffer, which lags behind the window's until the buffer is next acquired.
+        unsigned width { 0 };
+        unsigned height { 0 };
+        bool busy { false };
+        // Frame at which the buffer was last attached, 0 if never.
+        uint64_t frame { 0 };
+    };
+
+    // (Re)creates the buffer at the window's size. Must be called with the dispatch mutex held.
+    void allocate(Buffer&);
+    void destroy(Buffer&);
+
+    static struct wl_buffer_listener s_wlBufferListener;
+
+    Buffer m_buffers[bufferCount];
+    Buffer* m_backBuffer { nullptr };
+    uint64_t m_framesAttached { 0 };
+};
+
+} // namespace LearningGLES
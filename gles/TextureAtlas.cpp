@@ -0,0 +1,367 @@
+#include "TextureAtlas.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace LearningGLES {
+
+// Free texels right and below every image, so linear filtering never blends in a neighbour.
+static const int gutter = 1;
+
+TextureAtlas::TextureAtlas(GLState& state, unsigned pageSize, unsigned maxPages)
+    : m_state(state)
+    , m_pageSize(pageSize)
+    , m_maxPages(maxPages)
+{
+}
+
+TextureAtlas::~TextureAtlas()
+{
+    for (auto& page : m_pages)
+        m_state.deleteTexture(page->texture);
+}
+
+TextureAtlas::Page& TextureAtlas::createPage()
+{
+    std::unique_ptr<Page> page(new Page);
+    page->texels.assign(static_cast<size_t>(m_pageSize) * m_pageSize * 4, 0);
+    page->skyline.push_back({ 0, 0, m_pageSize });
+
+    glGenTextures(1, &page->texture);
+    m_state.bindTexture(GL_TEXTURE_2D, page->texture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, m_pageSize, m_pageSize, 0, GL_RGBA, GL_UNSIGNED_BYTE, page->texels.data());
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    m_stats.bytesUploaded += page->texels.size();
+    m_stats.uploads++;
+
+    m_pages.push_back(std::move(page));
+    return *m_pages.back();
+}
+
+// Bottom-left skyline packing: the position whose top ends up lowest, ties going to the
+// narrowest segment, which leaves the wider ones for larger images.
+bool TextureAtlas::pack(Page& page, int width, int height, int& x, int& y)
+{
+    auto& skyline = page.skyline;
+    size_t best = skyline.size();
+    int bestTop = m_pageSize + 1;
+    int bestWidth = m_pageSize + 1;
+    int bestY = 0;
+
+    for (size_t i = 0; i < skyline.size(); ++i) {
+        if (skyline[i].x + width > m_pageSize)
+            break;
+        int top = 0;
+        for (size_t j = i; j < skyline.size() && skyline[j].x < skyline[i].x + width; ++j)
+            top = std::max(top, skyline[j].y);
+        if (top + height > m_pageSize)
+            continue;
+        if (top + height < bestTop || (top + height == bestTop && skyline[i].width < bestWidth)) {
+            best = i;
+            bestTop = top + height;
+            bestWidth = skyline[i].width;
+            bestY = top;
+        }
+    }
+    if (best == skyline.size())
+        return false;
+
+    x = skyline[best].x;
+    y = bestY;
+    skyline.insert(skyline.begin() + best, { x, y + height, width });
+
+    // Trim or drop the segments the new one now covers.
+    for (size_t i = best + 1; i < skyline.size(); ) {
+        int covered = x + width - skyline[i].x;
+        if (covered <= 0)
+            break;
+        if (covered < skyline[i].width) {
+            skyline[i].x += covered;
+            skyline[i].width -= covered;
+            break;
+        }
+        skyline.erase(skyline.begin() + i);
+    }
+    for (size_t i = 0; i + 1 < skyline.size(); ) {
+        if (skyline[i].y == skyline[i + 1].y) {
+            skyline[i].width += skyline[i + 1].width;
+            skyline.erase(skyline.begin() + i + 1);
+        } else
+            ++i;
+    }
+    return true;
+}
+
+bool TextureAtlas::fits(Page& page, int width, int height)
+{
+    std::vector<SkylineNode> skyline = page.skyline;
+    int x, y;
+    bool fits = pack(page, width, height, x, y);
+    page.skyline.swap(skyline);
+    return fits;
+}
+
+void TextureAtlas::write(Page& page, const Rect& rect, const uint8_t* pixels, unsigned stride)
+{
+    for (int row = 0; row < rect.height; ++row) {
+        uint8_t* destination = page.texels.data() + ((static_cast<size_t>(rect.y) + row) * m_pageSize + rect.x) * 4;
+        memcpy(destination, pixels + static_cast<size_t>(row) * stride, rect.width * 4);
+    }
+    markDirty(page, rect);
+}
+
+void TextureAtlas::markDirty(Page& page, const Rect& rect)
+{
+    for (auto& dirty : page.dirty) {
+        if (unite(dirty, rect).area() == dirty.area())
+            return;
+    }
+    page.dirty.push_back(rect);
+}
+
+bool TextureAtlas::place(unsigned pageIndex, uint64_t id, unsigned width, unsigned height, const uint8_t* pixels)
+{
+    Page& page = *m_pages[pageIndex];
+    int x, y;
+    if (!pack(page, width + gutter, height + gutter, x, y))
+        return false;
+
+    Entry& entry = m_entries[id];
+    entry.page = pageIndex;
+    entry.rect = { x, y, static_cast<int>(width), static_cast<int>(height) };
+    entry.lastUsed = m_frame;
+    entry.region.texture = page.texture;
+    entry.region.u0 = static_cast<float>(x) / m_pageSize;
+    entry.region.v0 = static_cast<float>(y) / m_pageSize;
+    entry.region.u1 = static_cast<float>(x + width) / m_pageSize;
+    entry.region.v1 = static_cast<float>(y + height) / m_pageSize;
+    page.imageArea += static_cast<long>(width + gutter) * (height + gutter);
+    if (pixels)
+        write(page, entry.rect, pixels, width * 4);
+    return true;
+}
+
+void TextureAtlas::release(Entry& entry)
+{
+    // The space stays packed over until the page is repacked.
+    m_pages[entry.page]->imageArea -= static_cast<long>(entry.rect.width + gutter) * (entry.rect.height + gutter);
+}
+
+bool TextureAtlas::add(uint64_t id, unsigned width, unsigned height, const uint8_t* pixels)
+{
+    auto found = m_entries.find(id);
+    if (found != m_entries.end()) {
+        Entry& entry = found->second;
+        if (entry.rect.width == static_cast<int>(width) && entry.rect.height == static_cast<int>(height)) {
+            write(*m_pages[entry.page], entry.rect, pixels, width * 4);
+            entry.lastUsed = m_frame;
+            return true;
+        }
+        release(entry);
+        m_entries.erase(found);
+    }
+
+    if (static_cast<int>(width + gutter) > m_pageSize || static_cast<int>(height + gutter) > m_pageSize) {
+        m_stats.failures++;
+        return false;
+    }
+
+    for (unsigned i = 0; i < m_pages.size(); ++i) {
+        if (place(i, id, width, height, pixels))
+            return true;
+    }
+    if (m_pages.size() < m_maxPages) {
+        createPage();
+        if (place(m_pages.size() - 1, id, width, height, pixels))
+            return true;
+    }
+
+    unsigned pageIndex;
+    if (evictFor(width + gutter, height + gutter, pageIndex) && place(pageIndex, id, width, height, pixels))
+        return true;
+    m_stats.failures++;
+    return false;
+}
+
+bool TextureAtlas::evictFor(int width, int height, unsigned& pageIndex)
+{
+    // Images not used in the current frame, oldest first, per page.
+    std::vector<std::vector<std::pair<uint64_t, uint64_t>>> evictable(m_pages.size());
+    std::vector<long> evictableArea(m_pages.size(), 0);
+    for (auto& entry : m_entries) {
+        if (entry.second.lastUsed >= m_frame)
+            continue;
+        evictable[entry.second.page].emplace_back(entry.second.lastUsed, entry.first);
+        evictableArea[entry.second.page] += static_cast<long>(entry.second.rect.width + gutter) * (entry.second.rect.height + gutter);
+    }
+    pageIndex = std::max_element(evictableArea.begin(), evictableArea.end()) - evictableArea.begin();
+    if (!evictableArea[pageIndex])
+        return false;
+
+    auto& candidates = evictable[pageIndex];
+    std::sort(candidates.begin(), candidates.end());
+    Page& page = *m_pages[pageIndex];
+    long pageArea = static_cast<long>(m_pageSize) * m_pageSize;
+    // Free at least a quarter of the page, so a full atlas doesn't repack on every add().
+    long wanted = std::max(static_cast<long>(width) * height, pageArea / 4);
+
+    // First drop only the oldest images, then all of them if the image still doesn't fit.
+    size_t evicted = 0;
+    for (int attempt = 0; attempt < 2; ++attempt) {
+        long freeArea = pageArea - page.imageArea;
+        while (evicted < candidates.size() && (attempt || freeArea < wanted)) {
+            Entry& entry = m_entries[candidates[evicted].second];
+            freeArea += static_cast<long>(entry.rect.width + gutter) * (entry.rect.height + gutter);
+            release(entry);
+            m_entries.erase(candidates[evicted].second);
+            m_stats.evictions++;
+            evicted++;
+        }
+
+        std::vector<uint64_t> kept;
+        for (auto& entry : m_entries) {
+            if (entry.second.page == pageIndex)
+                kept.push_back(entry.first);
+        }
+        repack(pageIndex, kept);
+
+        if (fits(page, width, height))
+            return true;
+        if (evicted == candidates.size())
+            return false;
+    }
+    return false;
+}
+
+void TextureAtlas::repack(unsigned pageIndex, const std::vector<uint64_t>& kept)
+{
+    Page& page = *m_pages[pageIndex];
+    std::vector<uint8_t> oldTexels(page.texels.size(), 0);
+    oldTexels.swap(page.texels);
+    std::vector<SkylineNode> oldSkyline(1, { 0, 0, m_pageSize });
+    oldSkyline.swap(page.skyline);
+    page.imageArea = 0;
+
+    // Tallest first packs tightest with a skyline.
+    std::vector<std::pair<Rect, uint64_t>> images;
+    for (uint64_t id : kept)
+        images.emplace_back(m_entries[id].rect, id);
+    std::sort(images.begin(), images.end(), [](const std::pair<Rect, uint64_t>& a, const std::pair<Rect, uint64_t>& b) {
+        return a.first.height > b.first.height;
+    });
+
+    for (auto& image : images) {
+        const Rect& old = image.first;
+        uint64_t lastUsed = m_entries[image.second].lastUsed;
+        m_entries.erase(image.second);
+        // Everything fitted before, but a different order may not; whatever doesn't is evicted.
+        if (!place(pageIndex, image.second, old.width, old.height, nullptr)) {
+            m_stats.evictions++;
+            continue;
+        }
+        Entry& entry = m_entries[image.second];
+        entry.lastUsed = lastUsed;
+        for (int row = 0; row < old.height; ++row) {
+            memcpy(page.texels.data() + ((static_cast<size_t>(entry.rect.y) + row) * m_pageSize + entry.rect.x) * 4,
+                oldTexels.data() + ((static_cast<size_t>(old.y) + row) * m_pageSize + old.x) * 4, old.width * 4);
+        }
+    }
+
+    // Everything moved, but nothing above both skylines' tops can differ from what the texture
+    // holds.
+    int top = 0;
+    for (auto& node : oldSkyline)
+        top = std::max(top, node.y);
+    for (auto& node : page.skyline)
+        top = std::max(top, node.y);
+    page.dirty.assign(1, { 0, 0, m_pageSize, top });
+    m_stats.repacks++;
+}
+
+void TextureAtlas::update(uint64_t id, const Rect& rect, const uint8_t* pixels)
+{
+    auto found = m_entries.find(id);
+    if (found == m_entries.end())
+        return;
+    Entry& entry = found->second;
+    Rect clipped = intersection({ 0, 0, entry.rect.width, entry.rect.height }, rect);
+    if (clipped.isEmpty())
+        return;
+
+    const uint8_t* source = pixels + (static_cast<size_t>(clipped.y - rect.y) * rect.width + clipped.x - rect.x) * 4;
+    write(*m_pages[entry.page], { entry.rect.x + clipped.x, entry.rect.y + clipped.y, clipped.width, clipped.height }, source, rect.width * 4);
+    entry.lastUsed = m_frame;
+}
+
+void TextureAtlas::remove(uint64_t id)
+{
+    auto found = m_entries.find(id);
+    if (found == m_entries.end())
+        return;
+    release(found->second);
+    m_entries.erase(found);
+}
+
+const AtlasRegion* TextureAtlas::lookup(uint64_t id)
+{
+    auto found = m_entries.find(id);
+    if (found == m_entries.end())
+        return nullptr;
+    found->second.lastUsed = m_frame;
+    return &found->second.region;
+}
+
+void TextureAtlas::upload()
+{
+    for (auto& page : m_pages) {
+        if (page->dirty.empty())
+            continue;
+        m_state.bindTexture(GL_TEXTURE_2D, page->texture);
+        for (const Rect& rect : page->dirty) {
+            // GLES2 has no GL_UNPACK_ROW_LENGTH, so rows narrower than the page are gathered.
+            const uint8_t* source = page->texels.data() + static_cast<size_t>(rect.y) * m_pageSize * 4;
+            size_t rowSize = rect.width * 4;
+            if (rect.width != m_pageSize) {
+                m_staging.resize(rowSize * rect.height);
+                for (int row = 0; row < rect.height; ++row)
+                    memcpy(m_staging.data() + row * rowSize, source + (static_cast<size_t>(row) * m_pageSize + rect.x) * 4, rowSize);
+                source = m_staging.data();
+            }
+            glTexSubImage2D(GL_TEXTURE_2D, 0, rect.x, rect.y, rect.width, rect.height, GL_RGBA, GL_UNSIGNED_BYTE, source);
+            m_stats.bytesUploaded += rowSize * rect.height;
+            m_stats.uploads++;
+        }
+        page->dirty.clear();
+    }
+    m_frame++;
+}
+
+AtlasStats TextureAtlas::takeStats()
+{
+    AtlasStats stats = m_stats;
+    m_stats = AtlasStats();
+
+    long imageArea = 0;
+    long packedArea = 0;
+    for (auto& page : m_pages) {
+        imageArea += page->imageArea;
+        for (auto& node : page->skyline)
+            packedArea += static_cast<long>(node.width) * node.y;
+    }
+    long pixelArea = 0;
+    for (auto& entry : m_entries)
+        pixelArea += entry.second.rect.area();
+
+    stats.pages = m_pages.size();
+    stats.images = m_entries.size();
+    if (!m_pages.empty())
+        stats.occupancy = static_cast<double>(pixelArea) / (static_cast<double>(m_pageSize) * m_pageSize * m_pages.size());
+    if (packedArea)
+        stats.fragmentation = 1 - static_cast<double>(imageArea) / packedArea;
+    return stats;
+}
+
+} // namespace LearningGLES
@@ -0,0 +1,114 @@
+#pragma once
+
+#include "DamageRegion.h"
+#include "GLState.h"
+#include <GLES2/gl2.h>
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+namespace LearningGLES {
+
+// Where an image lives in the atlas, valid until the next TextureAtlas::upload().
+struct AtlasRegion {
+    GLuint texture { 0 };
+    float u0 { 0 };
+    float v0 { 0 };
+    float u1 { 0 };
+    float v1 { 0 };
+};
+
+struct AtlasStats {
+    unsigned pages { 0 };
+    unsigned images { 0 };
+    // Share of the pages' area covered by images.
+    double occupancy { 0 };
+    // Share of the area already packed over that holds no image: gaps the skyline left behind,
+    // and images removed or replaced since the page was last repacked.
+    double fragmentation { 0 };
+
+    // Counters since the last TextureAtlas::takeStats().
+    uint64_t bytesUploaded { 0 };
+    uint64_t uploads { 0 };
+    uint64_t evictions { 0 };
+    uint64_t repacks { 0 };
+    // Images that didn't fit even after evicting everything not used in the current frame.
+    uint64_t failures { 0 };
+};
+
+// Packs many small RGBA images into a few large textures, so drawing them needs few texture
+// binds. Each page is packed with a skyline allocator and keeps a copy of its texels, changes
+// are only recorded there and the rectangles that changed reach the texture at upload().
+//
+// When every page is full, the page with the most area used by images not needed in the
+// current frame drops them, least recently used first, and is repacked. Repacking moves the
+// images that stay, so regions must be looked up again every frame.
+class TextureAtlas {
+public:
+    TextureAtlas(GLState&, unsigned pageSize = 1024, unsigned maxPages = 4);
+    ~TextureAtlas();
+
+    // Adds or replaces the image called `id`, `pixels` being tightly packed RGBA. Returns false
+    // if it can't fit.
+    bool add(uint64_t id, unsigned width, unsigned height, const uint8_t* pixels);
+    // Replaces part of an image already in the atlas; only that part is uploaded.
+    void update(uint64_t id, const Rect&, const uint8_t* pixels);
+    void remove(uint64_t id);
+
+    // Marks the image as used in the current frame, which protects it from eviction. Returns
+    // nullptr if it was never added or was evicted since.
+    const AtlasRegion* lookup(uint64_t id);
+
+    // Uploads what changed since the last call, and starts a new frame. Must be called after
+    // the frame's last add() or update() and before drawing with the atlas.
+    void upload();
+
+    AtlasStats takeStats();
+
+private:
+    struct SkylineNode {
+        int x;
+        int y;
+        int width;
+    };
+
+    struct Page {
+        GLuint texture { 0 };
+        std::vector<uint8_t> texels;
+        std::vector<SkylineNode> skyline;
+        // Rectangles changed since the last upload. Unlike a DamageRegion they are kept apart
+        // however many there are, as merging scattered images would upload everything between.
+        std::vector<Rect> dirty;
+        // Gutters included.
+        long imageArea { 0 };
+    };
+
+    struct Entry {
+        unsigned page;
+        Rect rect;
+        uint64_t lastUsed;
+        AtlasRegion region;
+    };
+
+    Page& createPage();
+    bool pack(Page&, int width, int height, int& x, int& y);
+    bool fits(Page&, int width, int height);
+    bool place(unsigned pageIndex, uint64_t id, unsigned width, unsigned height, const uint8_t* pixels);
+    bool evictFor(int width, int height, unsigned& pageIndex);
+    void repack(unsigned pageIndex, const std::vector<uint64_t>& kept);
+    void write(Page&, const Rect&, const uint8_t* pixels, unsigned stride);
+    void markDirty(Page&, const Rect&);
+    void release(Entry&);
+
+    GLState& m_state;
+    int m_pageSize;
+    unsigned m_maxPages;
+    std::vector<std::unique_ptr<Page>> m_pages;
+    std::unordered_map<uint64_t, Entry> m_entries;
+    uint64_t m_frame { 1 };
+    std::vector<uint8_t> m_staging;
+    AtlasStats m_stats;
+};
+
+} // namespace LearningGLES
@@ -0,0 +1,431 @@
+#include "WaylandDisplay.h"
+
+#include "ShmWindow.h"
+#include "WaylandWindow.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+namespace LearningGLES {
+
+struct wl_registry_listener WaylandDisplay::s_wlRegistryListener = {
+    /* global */
+    [](void* data, struct wl_registry* registry, uint32_t id, const char* interface, uint32_t version) {
+        auto& display = *static_cast<WaylandDisplay*>(data);
+        if (!strcmp(interface, "wl_compositor"))
+            display.m_wlCompositor = static_cast<struct wl_compositor*>(wl_registry_bind(registry, id, &wl_compositor_interface, 1));
+        else if (!strcmp(interface, "wl_subcompositor"))
+            display.m_wlSubcompositor = static_cast<struct wl_subcompositor*>(wl_registry_bind(registry, id, &wl_subcompositor_interface, 1));
+        else if (!strcmp(interface, "wl_shell"))
+            display.m_wlShell = static_cast<struct wl_shell*>(wl_registry_bind(registry, id, &wl_shell_interface, 1));
+        else if (!strcmp(interface, "wl_shm") && display.m_rendering == WaylandRendering::Shm)
+            display.m_wlShm = static_cast<struct wl_shm*>(wl_registry_bind(registry, id, &wl_shm_interface, 1));
+        else if (!strcmp(interface, "wp_presentation")) {
+            display.m_wpPresentation = static_cast<struct wp_presentation*>(wl_registry_bind(registry, id, &wp_presentation_interface, 1));
+            wp_presentation_add_listener(display.m_wpPresentation, &s_wpPresentationListener, &display);
+        } else if (!strcmp(interface, "wp_viewporter"))
+            display.m_wpViewporter = static_cast<struct wp_viewporter*>(wl_registry_bind(registry, id, &wp_viewporter_interface, 1));
+        else if (!strcmp(interface, "wl_seat") && !display.m_wlSeat) {
+            display.m_wlSeat = static_cast<struct wl_seat*>(wl_registry_bind(registry, id, &wl_seat_interface, std::min(version, 5u)));
+            wl_seat_add_listener(display.m_wlSeat, &s_wlSeatListener, &display);
+        }
+    },
+    /* global_remove */
+    [](void*, struct wl_registry*, uint32_t) {}
+};
+
+struct wp_presentation_listener WaylandDisplay::s_wpPresentationListener = {
+    /* clock_id */
+    [](void* data, struct wp_presentation*, uint32_t clockID) {
+        auto& display = *static_cast<WaylandDisplay*>(data);
+        if (clockID == CLOCK_MONOTONIC) {
+            display.m_presentationClockOffset = 0;
+            return;
+        }
+
+        // Good enough for profiling: the two clocks are sampled a few hundred nanoseconds apart.
+        struct timespec ts;
+        clock_gettime(clockID, &ts);
+        display.m_presentationClockOffset = FrameProfiler::now() - (static_cast<int64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec);
+    }
+};
+
+struct wl_seat_listener WaylandDisplay::s_wlSeatListener = {
+    /* capabilities */
+    [](void* data, struct wl_seat*, uint32_t capabilities) {
+        static_cast<WaylandDisplay*>(data)->updateSeatCapabilities(capabilities);
+    },
+    /* name */
+    [](void*, struct wl_seat*, const char*) {}
+};
+
+struct wl_pointer_listener WaylandDisplay::s_wlPointerListener = {
+    /* enter */
+    [](void* data, struct wl_pointer*, uint32_t, struct wl_surface* surface, wl_fixed_t x, wl_fixed_t y) {
+        auto& display = *static_cast<WaylandDisplay*>(data);
+        display.m_pointerFocus = windowForSurface(surface);
+        display.m_pointerX = wl_fixed_to_double(x);
+        display.m_pointerY = wl_fixed_to_double(y);
+        if (!display.m_pointerFocus)
+            return;
+
+        InputEvent event;
+        event.type = InputEvent::Type::PointerEnter;
+        event.receivedTime = FrameProfiler::now();
+        event.x = display.m_pointerX;
+        event.y = display.m_pointerY;
+        display.m_pointerFocus->postInput(event);
+    },
+    /* leave */
+    [](void* data, struct wl_pointer*, uint32_t, struct wl_surface*) {
+        auto& display = *static_cast<WaylandDisplay*>(data);
+        if (!display.m_pointerFocus)
+            return;
+
+        InputEvent event;
+        event.type = InputEvent::Type::PointerLeave;
+        event.receivedTime = FrameProfiler::now();
+        display.m_pointerFocus->postInput(event);
+        display.m_pointerFocus = nullptr;
+    },
+    /* motion */
+    [](void* data, struct wl_pointer*, uint32_t time, wl_fixed_t x, wl_fixed_t y) {
+        auto& display = *static_cast<WaylandDisplay*>(data);
+        display.m_pointerX = wl_fixed_to_double(x);
+        display.m_pointerY = wl_fixed_to_double(y);
+        if (!display.m_pointerFocus)
+            return;
+
+        InputEvent event;
+        event.type = InputEvent::Type::PointerMotion;
+        event.receivedTime = FrameProfiler::now();
+        event.time = inputEventTime(time, event.receivedTime);
+        event.x = display.m_pointerX;
+        event.y = display.m_pointerY;
+        display.m_pointerFocus->postInput(event);
+    },
+    /* button */
+    [](void* data, struct wl_pointer*, uint32_t, uint32_t time, uint32_t button, uint32_t state) {
+        auto& display = *static_cast<WaylandDisplay*>(data);
+        if (!display.m_pointerFocus)
+            return;
+
+        InputEvent event;
+        event.type = InputEvent::Type::PointerButton;
+        event.receivedTime = FrameProfiler::now();
+        event.time = inputEventTime(time, event.receivedTime);
+        event.x = display.m_pointerX;
+        event.y = display.m_pointerY;
+        event.code = button;
+        event.pressed = state == WL_POINTER_BUTTON_STATE_PRESSED;
+        display.m_pointerFocus->postInput(event);
+    },
+    /* axis */
+    [](void* data, struct wl_pointer*, uint32_t time, uint32_t axis, wl_fixed_t value) {
+        auto& display = *static_cast<WaylandDisplay*>(data);
+        if (!display.m_pointerFocus)
+            return;
+
+        InputEvent event;
+        event.type = InputEvent::Type::PointerAxis;
+        event.receivedTime = FrameProfiler::now();
+        event.time = inputEventTime(time, event.receivedTime);
+        event.x = display.m_pointerX;
+        event.y = display.m_pointerY;
+        event.code = axis;
+        event.value = wl_fixed_to_double(value);
+        display.m_pointerFocus->postInput(event);
+    },
+    /* frame */
+    [](void*, struct wl_pointer*) {},
+    /* axis_source */
+    [](void*, struct wl_pointer*, uint32_t) {},
+    /* axis_stop */
+    [](void*, struct wl_pointer*, uint32_t, uint32_t) {},
+    /* axis_discrete */
+    [](void*, struct wl_pointer*, uint32_t, int32_t) {}
+};
+
+struct wl_keyboard_listener WaylandDisplay::s_wlKeyboardListener = {
+    /* keymap */
+    [](void*, struct wl_keyboard*, uint32_t, int32_t fd, uint32_t) {
+        // Key codes are reported as is, so the keymap isn't needed.
+        close(fd);
+    },
+    /* enter */
+    [](void* data, struct wl_keyboard*, uint32_t, struct wl_surface* surface, struct wl_array*) {
+        static_cast<WaylandDisplay*>(data)->m_keyboardFocus = windowForSurface(surface);
+    },
+    /* leave */
+    [](void* data, struct wl_keyboard*, uint32_t, struct wl_surface*) {
+        static_cast<WaylandDisplay*>(data)->m_keyboardFocus = nullptr;
+    },
+    /* key */
+    [](void* data, struct wl_keyboard*, uint32_t, uint32_t time, uint32_t key, uint32_t state) {
+        auto& display = *static_cast<WaylandDisplay*>(data);
+        if (!display.m_keyboardFocus)
+            return;
+
+        InputEvent event;
+        event.type = InputEvent::Type::Key;
+        event.receivedTime = FrameProfiler::now();
+        event.time = inputEventTime(time, event.receivedTime);
+        event.code = key;
+        event.pressed = state == WL_KEYBOARD_KEY_STATE_PRESSED;
+        display.m_keyboardFocus->postInput(event);
+    },
+    /* modifiers */
+    [](void*, struct wl_keyboard*, uint32_t, uint32_t, uint32_t, uint32_t, uint32_t) {},
+    /* repeat_info */
+    [](void*, struct wl_keyboard*, int32_t, int32_t) {}
+};
+
+WaylandDisplay::WaylandDisplay(WaylandRendering rendering)
+    : m_rendering(rendering)
+{
+    int64_t start = FrameProfiler::now();
+    m_wlDisplay = wl_display_connect(nullptr);
+    if (!m_wlDisplay) {
+        fprintf(stderr, "Can't connect to the compositor.\n");
+        exit(1);
+    }
+    recordStartupPhase("connect", start);
+
+    // EGL only needs the connection: Mesa binds its own globals from a queue of its own, so its
+    // roundtrips and ours are in flight at the same time instead of one after the other.
+    bool hasEGL = false;
+    std::thread eglThread;
+    if (m_rendering == WaylandRendering::EGL)
+        eglThread = std::thread([this, &hasEGL] { hasEGL = initEGL(); });
+    initWayland();
+    if (eglThread.joinable())
+        eglThread.join();
+    if (!m_wlCompositor || !m_wlShell) {
+        fprintf(stderr, "No compositor or shell.\n");
+        exit(1);
+    }
+    if (m_rendering == WaylandRendering::Shm && !m_wlShm) {
+        fprintf(stderr, "The compositor has no wl_shm.\n");
+        exit(1);
+    }
+    if (m_rendering == WaylandRendering::EGL && !hasEGL) {
+        fprintf(stderr, "Can't create an EGL context.\n");
+        exit(1);
+    }
+
+    startEventThread();
+}
+
+void WaylandDisplay::initWayland()
+{
+    int64_t start = FrameProfiler::now();
+
+    // Everything created from here on, the globals included, belongs to the private queue, which
+    // only the event thread dispatches once it runs. Getting the registry through a wrapper
+    // leaves no window for its events to land on the default queue.
+    m_wlEventQueue = wl_display_create_queue(m_wlDisplay);
+    auto* wrapper = static_cast<struct wl_display*>(wl_proxy_create_wrapper(m_wlDisplay));
+    wl_proxy_set_queue(reinterpret_cast<struct wl_proxy*>(wrapper), m_wlEventQueue);
+    m_wlRegistry = wl_display_get_registry(wrapper);
+    wl_proxy_wrapper_destroy(wrapper);
+    wl_registry_add_listener(m_wlRegistry, &s_wlRegistryListener, this);
+
+    // The globals are announced before the reply to our sync, so a single roundtrip binds them.
+    wl_display_roundtrip_queue(m_wlDisplay, m_wlEventQueue);
+    recordStartupPhase("registry", start);
+}
+
+bool WaylandDisplay::initEGL()
+{
+    int64_t start = FrameProfiler::now();
+    m_eglDisplay = eglGetDisplay(reinterpret_cast<EGLNativeDisplayType>(m_wlDisplay));
+    if (!eglInitialize(m_eglDisplay, nullptr, nullptr))
+        return false;
+    recordStartupPhase("egl_initialize", start);
+
+    EGLint attributes[] = {
+        EGL_RENDERABLE_TYPE, EGL_OPENGL_ES2_BIT,
+        EGL_SURFACE_TYPE, EGL_WINDOW_BIT,
+        EGL_RED_SIZE, 8,
+        EGL_GREEN_SIZE, 8,
+        EGL_BLUE_SIZE, 8,
+        EGL_ALPHA_SIZE, 8,
+        EGL_NONE
+    };
+
+    if (!chooseConfig(attributes) || !initShareContext())
+        return false;
+
+    // Without these we fall back to swapping, and repainting, the whole surface.
+    const char* extensions = eglQueryString(m_eglDisplay, EGL_EXTENSIONS);
+    if (strstr(extensions, "EGL_KHR_swap_buffers_with_damage"))
+        m_eglSwapBuffersWithDamage = reinterpret_cast<PFNEGLSWAPBUFFERSWITHDAMAGEKHRPROC>(eglGetProcAddress("eglSwapBuffersWithDamageKHR"));
+    else if (strstr(extensions, "EGL_EXT_swap_buffers_with_damage"))
+        m_eglSwapBuffersWithDamage = reinterpret_cast<PFNEGLSWAPBUFFERSWITHDAMAGEKHRPROC>(eglGetProcAddress("eglSwapBuffersWithDamageEXT"));
+    m_hasBufferAge = strstr(extensions, "EGL_EXT_buffer_age");
+    return true;
+}
+
+WaylandDisplay::~WaylandDisplay()
+{
+    stopEventThread();
+    if (m_wlPointer)
+        wl_pointer_destroy(m_wlPointer);
+    if (m_wlKeyboard)
+        wl_keyboard_destroy(m_wlKeyboard);
+    if (m_wlSeat)
+        wl_seat_destroy(m_wlSeat);
+    if (m_wpPresentation)
+        wp_presentation_destroy(m_wpPresentation);
+    if (m_wpViewporter)
+        wp_viewporter_destroy(m_wpViewporter);
+    if (m_wlShm)
+        wl_shm_destroy(m_wlShm);
+    if (m_wlSubcompositor)
+        wl_subcompositor_destroy(m_wlSubcompositor);
+    wl_shell_destroy(m_wlShell);
+    wl_compositor_destroy(m_wlCompositor);
+    wl_registry_destroy(m_wlRegistry);
+    if (m_eglDisplay != EGL_NO_DISPLAY) {
+        eglDestroyContext(m_eglDisplay, m_shareContext);
+        eglTerminate(m_eglDisplay);
+    }
+    wl_event_queue_destroy(m_wlEventQueue);
+    wl_display_disconnect(m_wlDisplay);
+}
+
+std::unique_ptr<Window> WaylandDisplay::createWindow(const char* title, unsigned width, unsigned height)
+{
+    auto display = std::static_pointer_cast<WaylandDisplay>(shared_from_this());
+    if (m_rendering == WaylandRendering::Shm)
+        return std::unique_ptr<Window>(new ShmWindow(display, title, width, height));
+    return std::unique_ptr<Window>(new WaylandWindow(display, title, width, height));
+}
+
+void WaylandDisplay::addWindow(WaylandWindow* window)
+{
+    std::lock_guard<std::mutex> lock(m_windowsMutex);
+    m_windows.push_back(window);
+}
+
+void WaylandDisplay::removeWindow(WaylandWindow* window)
+{
+    std::lock_guard<std::mutex> lock(m_windowsMutex);
+    m_windows.erase(std::remove(m_windows.begin(), m_windows.end(), window), m_windows.end());
+}
+
+void WaylandDisplay::clearInputFocus(WaylandWindow* window)
+{
+    if (m_pointerFocus == window)
+        m_pointerFocus = nullptr;
+    if (m_keyboardFocus == window)
+        m_keyboardFocus = nullptr;
+}
+
+int64_t WaylandDisplay::inputEventTime(uint32_t milliseconds, int64_t receivedTime)
+{
+    // Signed, as the compositor may have rounded its clock up past ours.
+    int32_t age = static_cast<int32_t>(static_cast<uint32_t>(receivedTime / 1000000) - milliseconds);
+    return receivedTime - static_cast<int64_t>(age) * 1000000;
+}
+
+WaylandWindow* WaylandDisplay::windowForSurface(struct wl_surface* surface)
+{
+    // Windows set their surface's user data to themselves. Focus may move to a surface being
+    // destroyed, which libwayland hands over as null.
+    return surface ? static_cast<WaylandWindow*>(wl_surface_get_user_data(surface)) : nullptr;
+}
+
+void WaylandDisplay::updateSeatCapabilities(uint32_t capabilities)
+{
+    bool hasPointer = capabilities & WL_SEAT_CAPABILITY_POINTER;
+    if (hasPointer && !m_wlPointer) {
+        m_wlPointer = wl_seat_get_pointer(m_wlSeat);
+        wl_pointer_add_listener(m_wlPointer, &s_wlPointerListener, this);
+    } else if (!hasPointer && m_wlPointer) {
+        wl_pointer_destroy(m_wlPointer);
+        m_wlPointer = nullptr;
+        m_pointerFocus = nullptr;
+    }
+
+    bool hasKeyboard = capabilities & WL_SEAT_CAPABILITY_KEYBOARD;
+    if (hasKeyboard && !m_wlKeyboard) {
+        m_wlKeyboard = wl_seat_get_keyboard(m_wlSeat);
+        wl_keyboard_add_listener(m_wlKeyboard, &s_wlKeyboardListener, this);
+    } else if (!hasKeyboard && m_wlKeyboard) {
+        wl_keyboard_destroy(m_wlKeyboard);
+        m_wlKeyboard = nullptr;
+        m_keyboardFocus = nullptr;
+    }
+}
+
+void WaylandDisplay::startEventThread()
+{
+    m_stopEventThreadFD = eventfd(0, EFD_CLOEXEC);
+    if (m_stopEventThreadFD < 0) {
+        fprintf(stderr, "Cannot create an eventfd.\n");
+        exit(1);
+    }
+
+    m_eventThread = std::thread([this] { runEventThread(); });
+}
+
+void WaylandDisplay::stopEventThread()
+{
+    uint64_t one = 1;
+    if (write(m_stopEventThreadFD, &one, sizeof(one)) != sizeof(one))
+        fprintf(stderr, "Cannot stop the Wayland event thread.\n");
+    m_eventThread.join();
+    close(m_stopEventThreadFD);
+}
+
+int WaylandDisplay::dispatchPending()
+{
+    std::lock_guard<std::mutex> lock(m_dispatchMutex);
+    return wl_display_dispatch_queue_pending(m_wlDisplay, m_wlEventQueue);
+}
+
+bool WaylandDisplay::prepareRead()
+{
+    // Mesa reads from the same socket for its own queue, so always go through prepare_read.
+    while (wl_display_prepare_read_queue(m_wlDisplay, m_wlEventQueue) != 0) {
+        if (dispatchPending() == -1)
+            return false;
+    }
+    return true;
+}
+
+void WaylandDisplay::runEventThread()
+{
+    while (prepareRead()) {
+        // Sends pongs right away, and whatever the rendering threads queued without flushing.
+        wl_display_flush(m_wlDisplay);
+
+        struct pollfd fds[] = {
+            { wl_display_get_fd(m_wlDisplay), POLLIN, 0 },
+            { m_stopEventThreadFD, POLLIN, 0 }
+        };
+        if (poll(fds, 2, -1) <= 0 || fds[1].revents) {
+            wl_display_cancel_read(m_wlDisplay);
+            if (fds[1].revents)
+                return;
+            continue;
+        }
+
+        if (wl_display_read_events(m_wlDisplay) == -1 || dispatchPending() == -1)
+            break;
+    }
+
+    fprintf(stderr, "Lost the connection to the compositor.\n");
+    m_connectionLost = true;
+    std::lock_guard<std::mutex> lock(m_windowsMutex);
+    for (auto* window : m_windows)
+        window->wakeUp();
+}
+
+} // namespace LearningGLES
@@ -0,0 +1,120 @@
+#pragma once
+
+#include "Display.h"
+#include <EGL/eglext.h>
+#include <atomic>
+#include <mutex>
+#include <presentation-time-client-protocol.h>
+#include <thread>
+#include <vector>
+#include <viewporter-client-protocol.h>
+#include <wayland-client.h>
+
+namespace LearningGLES {
+
+class WaylandWindow;
+
+// How the windows of a display fill their surfaces: with GLES through EGL, or with the CPU into
+// wl_shm buffers. Displays of the latter don't initialize EGL at all.
+enum class WaylandRendering { EGL, Shm };
+
+// One connection to the compositor shared by any number of windows. The globals are bound
+// once, and the events of every window are read and dispatched from a single private event
+// queue on a dedicated thread, so a slow frame never delays a ping. Listeners answer pings on
+// the spot and hand everything else, input included, over to the window's rendering thread.
+class WaylandDisplay : public Display {
+public:
+    explicit WaylandDisplay(WaylandRendering = WaylandRendering::EGL);
+    ~WaylandDisplay() override;
+
+    WaylandRendering rendering() const { return m_rendering; }
+
+    std::unique_ptr<Window> createWindow(const char* title, unsigned width, unsigned height) override;
+
+    struct wl_display* wlDisplay() { return m_wlDisplay; }
+    struct wl_compositor* wlCompositor() { return m_wlCompositor; }
+    // Null if the compositor has no subsurfaces, in which case windows have no layers.
+    struct wl_subcompositor* wlSubcompositor() { return m_wlSubcompositor; }
+    struct wl_shell* wlShell() { return m_wlShell; }
+    struct wl_shm* wlShm() { return m_wlShm; }
+    struct wp_presentation* wpPresentation() { return m_wpPresentation; }
+    // Null if the compositor can't scale surfaces, in which case windows render at full size.
+    struct wp_viewporter* wpViewporter() { return m_wpViewporter; }
+    // Offset from the compositor's presentation clock to CLOCK_MONOTONIC, in nanoseconds.
+    int64_t presentationClockOffset() const { return m_presentationClockOffset; }
+
+    PFNEGLSWAPBUFFERSWITHDAMAGEKHRPROC eglSwapBuffersWithDamage() const { return m_eglSwapBuffersWithDamage; }
+    bool hasBufferAge() const { return m_hasBufferAge; }
+
+    bool connectionLost() const { return m_connectionLost; }
+
+    // Held by the event thread while it dispatches. Windows hold it while creating or destroying
+    // proxies on the shared queue, so no listener runs for a window half set up or torn down.
+    std::mutex& dispatchMutex() { return m_dispatchMutex; }
+
+    // Windows to wake up if the connection is lost.
+    void addWindow(WaylandWindow*);
+    void removeWindow(WaylandWindow*);
+    // Stops sending input to a window being destroyed. Must be called with the dispatch mutex held.
+    void clearInputFocus(WaylandWindow*);
+
+private:
+    WaylandRendering m_rendering;
+
+    void initWayland();
+    // Runs on a thread of its own, concurrently with initWayland(). Returns false on failure.
+    bool initEGL();
+
+    void startEventThread();
+    void stopEventThread();
+    void runEventThread();
+    int dispatchPending();
+    // Returns false if the connection is lost, without a read prepared: the read API must then
+    // not be used at all.
+    bool prepareRead();
+
+    // Converts a wrapping millisecond timestamp of the compositor to FrameProfiler::now() time.
+    static int64_t inputEventTime(uint32_t milliseconds, int64_t receivedTime);
+    static WaylandWindow* windowForSurface(struct wl_surface*);
+    void updateSeatCapabilities(uint32_t capabilities);
+
+    static struct wl_registry_listener s_wlRegistryListener;
+    static struct wp_presentation_listener s_wpPresentationListener;
+    static struct wl_seat_listener s_wlSeatListener;
+    static struct wl_pointer_listener s_wlPointerListener;
+    static struct wl_keyboard_listener s_wlKeyboardListener;
+
+    struct wl_display* m_wlDisplay { nullptr };
+    struct wl_registry* m_wlRegistry { nullptr };
+    struct wl_event_queue* m_wlEventQueue { nullptr };
+    struct wl_compositor* m_wlCompositor { nullptr };
+    struct wl_subcompositor* m_wlSubcompositor { nullptr };
+    struct wl_shell* m_wlShell { nullptr };
+    struct wl_shm* m_wlShm { nullptr };
+    struct wp_presentation* m_wpPresentation { nullptr };
+    std::atomic<int64_t> m_presentationClockOffset { 0 };
+    struct wp_viewporter* m_wpViewporter { nullptr };
+
+    // Only the first seat is used. Everything below is only touched by listeners, which run on
+    // the event thread with the dispatch mutex held.
+    struct wl_seat* m_wlSeat { nullptr };
+    struct wl_pointer* m_wlPointer { nullptr };
+    struct wl_keyboard* m_wlKeyboard { nullptr };
+    WaylandWindow* m_pointerFocus { nullptr };
+    WaylandWindow* m_keyboardFocus { nullptr };
+    double m_pointerX { 0 };
+    double m_pointerY { 0 };
+
+    std::thread m_eventThread;
+    std::mutex m_dispatchMutex;
+    // eventfd stopping the event thread.
+    int m_stopEventThreadFD { -1 };
+    std::atomic<bool> m_connectionLost { false };
+    std::mutex m_windowsMutex;
+    std::vector<WaylandWindow*> m_windows;
+
+    PFNEGLSWAPBUFFERSWITHDAMAGEKHRPROC m_eglSwapBuffersWithDamage { nullptr };
+    bool m_hasBufferAge { false };
+};
+
+} // namespace LearningGLES
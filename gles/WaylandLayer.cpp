@@ -0,0 +1,74 @@
+#include "WaylandLayer.h"
+
+#include "WaylandWindow.h"
+#include <cstdio>
+#include <cstdlib>
+
+namespace LearningGLES {
+
+WaylandLayer::WaylandLayer(WaylandWindow& window, LayerPlacement placement, LayerSync sync, int x, int y, unsigned width, unsigned height)
+    : Layer(width, height)
+    , m_window(window)
+{
+    WaylandDisplay& display = window.waylandDisplay();
+    {
+        // Same as the window's proxies: they share the display's queue.
+        std::lock_guard<std::mutex> lock(display.dispatchMutex());
+        m_wlSurface = wl_compositor_create_surface(display.wlCompositor());
+        m_wlSubsurface = wl_subcompositor_get_subsurface(display.wlSubcompositor(), m_wlSurface, window.wlSurface());
+    }
+    wl_subsurface_set_position(m_wlSubsurface, x, y);
+    if (placement == LayerPlacement::Below)
+        wl_subsurface_place_below(m_wlSubsurface, window.wlSurface());
+    if (sync == LayerSync::Desynchronized)
+        wl_subsurface_set_desync(m_wlSubsurface);
+
+    m_wlEGLWindow = wl_egl_window_create(m_wlSurface, width, height);
+    m_eglSurface = eglCreateWindowSurface(window.eglDisplay(), window.display().eglConfig(), reinterpret_cast<EGLNativeWindowType>(m_wlEGLWindow), nullptr);
+    if (m_eglSurface == EGL_NO_SURFACE) {
+        fprintf(stderr, "Cannot create the EGL surface of a layer.\n");
+        exit(1);
+    }
+}
+
+WaylandLayer::~WaylandLayer()
+{
+    // The layer's surface may be the current one.
+    m_window.makeCurrent();
+    eglDestroySurface(m_window.eglDisplay(), m_eglSurface);
+    wl_egl_window_destroy(m_wlEGLWindow);
+
+    std::lock_guard<std::mutex> lock(m_window.waylandDisplay().dispatchMutex());
+    wl_subsurface_destroy(m_wlSubsurface);
+    wl_surface_destroy(m_wlSurface);
+}
+
+void WaylandLayer::makeCurrent()
+{
+    eglMakeCurrent(m_window.eglDisplay(), m_eglSurface, m_eglSurface, m_window.eglContext());
+    // The swap interval belongs to the surface. Layers are never paced by frame callbacks.
+    if (!m_swapIntervalSet) {
+        eglSwapInterval(m_window.eglDisplay(), 0);
+        m_swapIntervalSet = true;
+    }
+}
+
+void WaylandLayer::commit()
+{
+    eglSwapBuffers(m_window.eglDisplay(), m_eglSurface);
+    m_window.makeCurrent();
+}
+
+void WaylandLayer::setPosition(int x, int y)
+{
+    wl_subsurface_set_position(m_wlSubsurface, x, y);
+}
+
+void WaylandLayer::resize(unsigned width, unsigned height)
+{
+    wl_egl_window_resize(m_wlEGLWindow, width, height, 0, 0);
+    m_width = width;
+    m_height = height;
+}
+
+} // namespace LearningGLES
@@ -0,0 +1,34 @@
+#pragma once
+
+#include "Layer.h"
+#include <EGL/egl.h>
+#include <wayland-client.h>
+#include <wayland-egl.h>
+
+namespace LearningGLES {
+
+class WaylandWindow;
+
+// A wl_subsurface of the window's surface, drawn with the window's context through an EGL
+// surface of its own. Stacking and position are double-buffered state of the window's surface,
+// applied by its next commit.
+class WaylandLayer : public Layer {
+public:
+    WaylandLayer(WaylandWindow&, LayerPlacement, LayerSync, int x, int y, unsigned width, unsigned height);
+    ~WaylandLayer() override;
+
+    void makeCurrent() override;
+    void commit() override;
+    void setPosition(int x, int y) override;
+    void resize(unsigned width, unsigned height) override;
+
+private:
+    WaylandWindow& m_window;
+    struct wl_surface* m_wlSurface { nullptr };
+    struct wl_subsurface* m_wlSubsurface { nullptr };
+    struct wl_egl_window* m_wlEGLWindow { nullptr };
+    EGLSurface m_eglSurface { EGL_NO_SURFACE };
+    bool m_swapIntervalSet { false };
+};
+
+} // namespace LearningGLES
@@ -1,24 +1,16 @@
 #include "WaylandWindow.h"
 
+#include "WaylandLayer.h"
+
+#include <cmath>
 #include <cstdio>
 #include <cstdlib>
-#include <cstring>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
 
 namespace LearningGLES {
 
-struct wl_registry_listener WaylandWindow::s_wlRegistryListener = {
-    /* global */
-    [](void* data, struct wl_registry* registry, uint32_t id, const char* interface, uint32_t version) {
-        auto& window = *static_cast<WaylandWindow*>(data);
-        if (!strcmp(interface, "wl_compositor"))
-            window.m_wlCompositor = static_cast<struct wl_compositor*>(wl_registry_bind(registry, id, &wl_compositor_interface, 1));
-        else if (!strcmp(interface, "wl_shell"))
-            window.m_wlShell = static_cast<struct wl_shell*>(wl_registry_bind(registry, id, &wl_shell_interface, 1));
-    },
-    /* global_remove */
-    [](void*, struct wl_registry*, uint32_t) {}
-};
-
 struct wl_shell_surface_listener WaylandWindow::s_wlShellSurfaceListener = {
     /* ping */
     [](void* data, struct wl_shell_surface* surface, uint32_t serial) {
@@ -26,81 +18,422 @@ struct wl_shell_surface_listener WaylandWindow::s_wlShellSurfaceListener = {
     },
     /* configure */
     [](void* data, struct wl_shell_surface* surface, uint32_t edges, int32_t width, int32_t height) {
-        auto& window = *static_cast<WaylandWindow*>(data);
-        wl_egl_window_resize(window.m_wlEGLWindow, width, height, 0, 0);
+        Event event;
+        event.type = Event::Type::Configure;
+        event.width = width;
+        event.height = height;
+        static_cast<WaylandWindow*>(data)->postEvent(event);
     },
     /* popup_done */
     [](void* data, struct wl_shell_surface* surface) {}
 };
 
-WaylandWindow::WaylandWindow(const char* title, unsigned width, unsigned height)
-    : Window(title, width, height)
-{
-    initWayland();
-    wl_shell_surface_set_title(m_wlShellSurface, title);
-    initEGL();
-}
+struct wl_callback_listener WaylandWindow::s_wlFrameListener = {
+    /* done */
+    [](void* data, struct wl_callback* callback, uint32_t time) {
+        Event event;
+        event.type = Event::Type::FrameDone;
+        event.proxy = callback;
+        static_cast<WaylandWindow*>(data)->postEvent(event);
+    }
+};
 
-void WaylandWindow::initWayland()
-{
-    m_wlDisplay = wl_display_connect(nullptr);
+struct wp_presentation_feedback_listener WaylandWindow::s_wpPresentationFeedbackListener = {
+    /* sync_output */
+    [](void*, struct wp_presentation_feedback*, struct wl_output*) {},
+    /* presented */
+    [](void* data, struct wp_presentation_feedback* feedback, uint32_t secondsHigh, uint32_t secondsLow, uint32_t nanoseconds, uint32_t refresh, uint32_t, uint32_t, uint32_t flags) {
+        auto* context = static_cast<PresentationFeedback*>(data);
+        WaylandWindow& window = *context->window;
+        int64_t seconds = (static_cast<int64_t>(secondsHigh) << 32) | secondsLow;
 
-    struct wl_registry* registry = wl_display_get_registry(m_wlDisplay);
-    wl_registry_add_listener(registry, &s_wlRegistryListener, this);
+        Event event;
+        event.type = Event::Type::Presented;
+        event.proxy = feedback;
+        event.feedback = context;
+        event.frame = context->frame;
+        event.presentTime = seconds * 1000000000 + nanoseconds + window.m_waylandDisplay.presentationClockOffset();
+        event.refreshPeriod = refresh;
+        event.presentFlags = flags;
+        window.postEvent(event);
+    },
+    /* discarded */
+    [](void* data, struct wp_presentation_feedback* feedback) {
+        auto* context = static_cast<PresentationFeedback*>(data);
+        Event event;
+        event.type = Event::Type::Discarded;
+        event.proxy = feedback;
+        event.feedback = context;
+        event.frame = context->frame;
+        context->window->postEvent(event);
+    }
+};
 
-    wl_display_dispatch(m_wlDisplay);
-    wl_display_roundtrip(m_wlDisplay);
+WaylandWindow::WaylandWindow(std::shared_ptr<WaylandDisplay> display, const char* title, unsigned width, unsigned height)
+    : WaylandWindow(display, title, width, height, Buffers::EGL)
+{
+}
 
-    if (!m_wlCompositor || !m_wlShell) {
-        fprintf(stderr, "No compositor or shell.\n");
-        wl_display_disconnect(m_wlDisplay);
+WaylandWindow::WaylandWindow(std::shared_ptr<WaylandDisplay> display, const char* title, unsigned width, unsigned height, Buffers buffers)
+    : Window(display, title, width, height)
+    , m_waylandDisplay(*display)
+    , m_surfaceWidth(width)
+    , m_surfaceHeight(height)
+{
+    m_eventsPostedFD = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (m_eventsPostedFD < 0) {
+        fprintf(stderr, "Cannot create an eventfd.\n");
         exit(1);
     }
+    m_waylandDisplay.addWindow(this);
+
+    int64_t start = FrameProfiler::now();
+    initWayland();
+    if (buffers == Buffers::EGL)
+        initEGL();
+    m_waylandDisplay.recordStartupPhase("window", start);
+}
+
+void WaylandWindow::initWayland()
+{
+    for (auto& context : m_presentationFeedbacks)
+        context.window = this;
 
+    // The proxies inherit the display's queue, whose listeners must not run before they are set.
+    std::lock_guard<std::mutex> lock(m_waylandDisplay.dispatchMutex());
     // No error checking for simplicity.
-    m_wlSurface = wl_compositor_create_surface(m_wlCompositor);
-    m_wlShellSurface = wl_shell_get_shell_surface(m_wlShell, m_wlSurface);
+    m_wlSurface = wl_compositor_create_surface(m_waylandDisplay.wlCompositor());
+    // How the display finds the window input is focused on.
+    wl_surface_set_user_data(m_wlSurface, this);
+    m_wlShellSurface = wl_shell_get_shell_surface(m_waylandDisplay.wlShell(), m_wlSurface);
     wl_shell_surface_add_listener(m_wlShellSurface, &s_wlShellSurfaceListener, this);
     wl_shell_surface_set_toplevel(m_wlShellSurface);
+    wl_shell_surface_set_title(m_wlShellSurface, m_title.c_str());
+    if (m_waylandDisplay.wpViewporter()) {
+        m_wpViewport = wp_viewporter_get_viewport(m_waylandDisplay.wpViewporter(), m_wlSurface);
+        wp_viewport_set_destination(m_wpViewport, m_surfaceWidth, m_surfaceHeight);
+    }
 }
 
 void WaylandWindow::initEGL()
 {
-    m_eglDisplay = eglGetDisplay(m_wlDisplay);
-    eglInitialize(m_eglDisplay, nullptr, nullptr);
-
-    EGLint attributes[] = {
-        EGL_RENDERABLE_TYPE, EGL_OPENGL_ES2_BIT,
-        EGL_SURFACE_TYPE, EGL_WINDOW_BIT,
-        EGL_RED_SIZE, 8,
-        EGL_GREEN_SIZE, 8,
-        EGL_BLUE_SIZE, 8,
-        EGL_ALPHA_SIZE, 8,
-        EGL_NONE
-    };
-
-    EGLint numConfigs;
-    eglChooseConfig(m_eglDisplay, attributes, &m_eglConfig, 1, &numConfigs);
-    m_eglContext = eglCreateContext(m_eglDisplay, m_eglConfig, EGL_NO_CONTEXT, nullptr);
+    m_eglContext = m_waylandDisplay.createContext();
     m_wlEGLWindow = wl_egl_window_create(m_wlSurface, m_width, m_height);
-    m_eglSurface = eglCreateWindowSurface(m_eglDisplay, m_eglConfig, m_wlEGLWindow, nullptr);
+    m_eglSurface = eglCreateWindowSurface(m_eglDisplay, m_eglConfig, reinterpret_cast<EGLNativeWindowType>(m_wlEGLWindow), nullptr);
     eglMakeCurrent(m_eglDisplay, m_eglSurface, m_eglSurface, m_eglContext);
+
+    // Pacing is driven by our own frame callbacks, so eglSwapBuffers must not block on its own.
+    eglSwapInterval(m_eglDisplay, 0);
 }
 
 WaylandWindow::~WaylandWindow()
 {
-    eglDestroySurface(m_eglDisplay, m_eglSurface);
-    wl_egl_window_destroy(m_wlEGLWindow);
-    wl_shell_surface_destroy(m_wlShellSurface);
-    wl_surface_destroy(m_wlSurface);
-    eglDestroyContext(m_eglDisplay, m_eglContext);
-    eglTerminate(m_eglDisplay);
-    wl_display_disconnect(m_wlDisplay);
+    makeCurrent();
+    m_profiler = nullptr;
+    m_capture = nullptr;
+    if (m_wlEGLWindow) {
+        eglMakeCurrent(m_eglDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+        eglDestroySurface(m_eglDisplay, m_eglSurface);
+        wl_egl_window_destroy(m_wlEGLWindow);
+        eglDestroyContext(m_eglDisplay, m_eglContext);
+    }
+
+    {
+        // Once destroyed, the proxies' queued events are dropped, but a listener may be running.
+        std::lock_guard<std::mutex> lock(m_waylandDisplay.dispatchMutex());
+        for (auto& context : m_presentationFeedbacks) {
+            if (context.feedback)
+                wp_presentation_feedback_destroy(context.feedback);
+        }
+        if (m_wlFrameCallback)
+            wl_callback_destroy(m_wlFrameCallback);
+        if (m_wpViewport)
+            wp_viewport_destroy(m_wpViewport);
+        wl_shell_surface_destroy(m_wlShellSurface);
+        wl_surface_destroy(m_wlSurface);
+        m_waylandDisplay.clearInputFocus(this);
+    }
+
+    m_waylandDisplay.removeWindow(this);
+    close(m_eventsPostedFD);
+}
+
+std::unique_ptr<Layer> WaylandWindow::createLayer(LayerPlacement placement, LayerSync sync, int x, int y, unsigned width, unsigned height)
+{
+    if (!m_waylandDisplay.wlSubcompositor() || !m_wlEGLWindow)
+        return nullptr;
+    return std::unique_ptr<Layer>(new WaylandLayer(*this, placement, sync, x, y, width, height));
+}
+
+void WaylandWindow::wakeUp()
+{
+    uint64_t one = 1;
+    if (write(m_eventsPostedFD, &one, sizeof(one)) != sizeof(one))
+        fprintf(stderr, "Cannot wake the rendering thread up.\n");
+}
+
+void WaylandWindow::postEvent(const Event& event)
+{
+    // Once an event overflows, the ones after it follow it into the list until the rendering
+    // thread takes them, so that events are handled in order.
+    if (m_hasOverflowEvents.load(std::memory_order_acquire) || !m_events.push(event)) {
+        std::lock_guard<std::mutex> lock(m_overflowMutex);
+        m_overflowEvents.push_back(event);
+        m_hasOverflowEvents.store(true, std::memory_order_release);
+    }
+    wakeUp();
+}
+
+void WaylandWindow::postInput(const InputEvent& input)
+{
+    // Only happens if the rendering thread stops handling events for a while.
+    if (!m_inputEvents.push(input)) {
+        if (!m_droppedInputEvents++)
+            fprintf(stderr, "The rendering thread is not handling input, dropping it.\n");
+        return;
+    }
+    wakeUp();
 }
 
 void WaylandWindow::processInputs()
 {
-    wl_display_dispatch_pending(m_wlDisplay);
+    dispatchEvents(std::chrono::nanoseconds::zero());
+    consumeInputs();
+}
+
+void WaylandWindow::waitForNextFrame()
+{
+    switch (m_frameScheduler.pacing()) {
+    case FramePacing::VSync:
+        while (m_wlFrameCallback) {
+            if (!dispatchEvents(std::chrono::nanoseconds(-1)))
+                break;
+        }
+        break;
+    case FramePacing::CappedFPS:
+        // Wake up for configure events while we wait, pings are answered by the event thread anyway.
+        while (true) {
+            auto timeout = m_frameScheduler.timeUntilNextFrame();
+            if (timeout <= FrameScheduler::Clock::duration::zero() || !dispatchEvents(timeout))
+                break;
+        }
+        break;
+    case FramePacing::Unthrottled:
+        break;
+    case FramePacing::LowLatency:
+        // Frame callbacks only count presented frames here, the GPU fences do the pacing.
+        dispatchEvents(std::chrono::nanoseconds::zero());
+        break;
+    }
+
+    applyPendingResize();
+    beginFrame();
+    m_frameScheduler.frameStarted();
+    m_frameStartTime = FrameProfiler::now();
+
+    if (m_profiler)
+        m_profiler->frameStarted();
+}
+
+void WaylandWindow::beginFrame()
+{
+    makeCurrent();
+    if (m_frameScheduler.pacing() == FramePacing::LowLatency)
+        m_frameQueue.frameStarted(m_frameScheduler.maxFramesInFlight());
+}
+
+void WaylandWindow::swapBuffers()
+{
+    // Keep a single frame callback in flight, so presented frames are counted once per compositor repaint.
+    if (!m_wlFrameCallback) {
+        m_wlFrameCallback = wl_surface_frame(m_wlSurface);
+        wl_callback_add_listener(m_wlFrameCallback, &s_wlFrameListener, this);
+    }
+
+    DamageRegion damage = takeDamage();
+
+    // The feedback request must precede the commit done by present() to apply to this frame.
+    bool expectPresentation = m_profiler && m_waylandDisplay.wpPresentation();
+    if (m_profiler) {
+        m_profiler->swapStarted();
+        if (expectPresentation)
+            requestPresentationFeedback(m_profiler->currentFrame());
+    }
+    present(damage);
+
+    if (m_profiler)
+        m_profiler->swapFinished(expectPresentation);
+    m_frameScheduler.frameRendered();
+
+    // From the end of the wait to the end of the swap: all of a frame with a software renderer,
+    // and on a GPU, swaps block once it falls behind. The new scale applies to the next frame.
+    if (m_wpViewport) {
+        double budget = 1.0 / (m_frameScheduler.targetFPS() ? m_frameScheduler.targetFPS() : 60);
+        m_resolutionScaler.frameRendered((FrameProfiler::now() - m_frameStartTime) / 1e9, budget);
+    }
+}
+
+void WaylandWindow::present(const DamageRegion& damage)
+{
+    makeCurrent();
+    if (m_capture)
+        m_capture->captureFrame(m_width, m_height);
+    if (m_frameScheduler.pacing() == FramePacing::LowLatency)
+        m_frameQueue.frameSubmitted();
+
+    if (auto swapBuffersWithDamage = m_waylandDisplay.eglSwapBuffersWithDamage()) {
+        // EGL wants the rectangles with a bottom-left origin.
+        EGLint rects[4 * DamageRegion::maxRects];
+        EGLint count = 0;
+        for (auto& rect : damage) {
+            rects[4 * count] = rect.x;
+            rects[4 * count + 1] = m_height - rect.y - rect.height;
+            rects[4 * count + 2] = rect.width;
+            rects[4 * count + 3] = rect.height;
+            ++count;
+        }
+        swapBuffersWithDamage(m_eglDisplay, m_eglSurface, rects, count);
+    } else
+        eglSwapBuffers(m_eglDisplay, m_eglSurface);
+}
+
+void WaylandWindow::applyPendingResize()
+{
+    if (m_pendingWidth) {
+        if (static_cast<unsigned>(m_pendingWidth) != m_surfaceWidth || static_cast<unsigned>(m_pendingHeight) != m_surfaceHeight) {
+            m_surfaceWidth = m_pendingWidth;
+            m_surfaceHeight = m_pendingHeight;
+            // Double-buffered, applied by the commit of the first frame at the new size.
+            if (m_wpViewport)
+                wp_viewport_set_destination(m_wpViewport, m_surfaceWidth, m_surfaceHeight);
+            m_resizeStats.applied++;
+        }
+        m_pendingWidth = 0;
+        m_pendingHeight = 0;
+    }
+
+    double scale = m_wpViewport ? m_resolutionScaler.scale() : 1;
+    unsigned width = static_cast<unsigned>(std::lround(m_surfaceWidth * scale));
+    unsigned height = static_cast<unsigned>(std::lround(m_surfaceHeight * scale));
+    width = width ? width : 1;
+    height = height ? height : 1;
+    if (width != m_width || height != m_height) {
+        m_width = width;
+        m_height = height;
+        resizeBuffers();
+    }
+}
+
+void WaylandWindow::resizeBuffers()
+{
+    wl_egl_window_resize(m_wlEGLWindow, m_width, m_height, 0, 0);
+}
+
+void WaylandWindow::requestPresentationFeedback(uint64_t frame)
+{
+    // A feedback still outstanding after maxFramesInFlight frames is no longer tracked by the profiler.
+    PresentationFeedback& context = m_presentationFeedbacks[frame % FrameProfiler::maxFramesInFlight];
+    // The event thread may be running the listener of the feedback destroyed here.
+    std::lock_guard<std::mutex> lock(m_waylandDisplay.dispatchMutex());
+    if (context.feedback)
+        wp_presentation_feedback_destroy(context.feedback);
+
+    context.frame = frame;
+    context.feedback = wp_presentation_feedback(m_waylandDisplay.wpPresentation(), m_wlSurface);
+    wp_presentation_feedback_add_listener(context.feedback, &s_wpPresentationFeedbackListener, &context);
+}
+
+unsigned WaylandWindow::bufferAge()
+{
+    EGLint age = 0;
+    if (m_waylandDisplay.hasBufferAge())
+        eglQuerySurface(m_eglDisplay, m_eglSurface, EGL_BUFFER_AGE_EXT, &age);
+    return age;
+}
+
+bool WaylandWindow::dispatchEvents(std::chrono::nanoseconds timeout)
+{
+    struct timespec ts;
+    struct timespec* tsPtr = nullptr;
+    if (timeout >= std::chrono::nanoseconds::zero()) {
+        ts.tv_sec = timeout.count() / 1000000000;
+        ts.tv_nsec = timeout.count() % 1000000000;
+        tsPtr = &ts;
+    }
+
+    struct pollfd fd = { m_eventsPostedFD, POLLIN, 0 };
+    if (ppoll(&fd, 1, tsPtr, nullptr) > 0) {
+        // Reset the eventfd before draining, so events posted meanwhile wake us up next time.
+        uint64_t count;
+        if (read(m_eventsPostedFD, &count, sizeof(count)) != sizeof(count))
+            count = 0;
+    }
+
+    Event event;
+    while (m_events.pop(event))
+        handleEvent(event);
+    // Posted after everything in m_events, and the flag is only cleared once they are taken.
+    if (m_hasOverflowEvents.load(std::memory_order_acquire)) {
+        std::vector<Event> events;
+        {
+            std::lock_guard<std::mutex> lock(m_overflowMutex);
+            events.swap(m_overflowEvents);
+            m_hasOverflowEvents.store(false, std::memory_order_release);
+        }
+        for (auto& overflowEvent : events)
+            handleEvent(overflowEvent);
+    }
+
+    InputEvent input;
+    while (m_inputEvents.pop(input)) {
+        // Render code works in buffer coordinates.
+        input.x *= static_cast<double>(m_width) / m_surfaceWidth;
+        input.y *= static_cast<double>(m_height) / m_surfaceHeight;
+        queueInput(input);
+    }
+
+    return !m_waylandDisplay.connectionLost();
+}
+
+void WaylandWindow::handleEvent(const Event& event)
+{
+    switch (event.type) {
+    case Event::Type::Configure:
+        if (event.width <= 0 || event.height <= 0)
+            break;
+        m_pendingWidth = event.width;
+        m_pendingHeight = event.height;
+        m_resizeStats.requested++;
+        break;
+    case Event::Type::FrameDone:
+        wl_callback_destroy(static_cast<struct wl_callback*>(event.proxy));
+        m_wlFrameCallback = nullptr;
+        m_frameScheduler.framePresented();
+        break;
+    case Event::Type::Presented:
+    case Event::Type::Discarded: {
+        // The feedback may have been given up on, and its slot reused, since the event was posted.
+        PresentationFeedback& context = *event.feedback;
+        if (!context.feedback || context.frame != event.frame)
+            break;
+        {
+            std::lock_guard<std::mutex> lock(m_waylandDisplay.dispatchMutex());
+            wp_presentation_feedback_destroy(context.feedback);
+            context.feedback = nullptr;
+        }
+
+        if (!m_profiler)
+            break;
+        if (event.type == Event::Type::Presented)
+            m_profiler->framePresented(context.frame, event.presentTime, event.refreshPeriod, event.presentFlags);
+        else
+            m_profiler->frameDiscarded(context.frame);
+        break;
+    }
+    case Event::Type::BufferReleased:
+        bufferReleased(static_cast<struct wl_buffer*>(event.proxy));
+        break;
+    }
 }
 
 } // namespace LearningGLES
@@ -1,32 +1,137 @@
 #pragma once
 
+#include "RingBuffer.h"
+#include "WaylandDisplay.h"
 #include "Window.h"
-#include <wayland-client.h>
+#include <atomic>
+#include <mutex>
+#include <vector>
 #include <wayland-egl.h>
 
 namespace LearningGLES {
 
+// The display's event thread hands the window's events over to its rendering thread through
+// lock-free queues, applied from processInputs() and waitForNextFrame(). Proxies are only
+// destroyed on the rendering thread.
 class WaylandWindow : public Window {
 public:
-    WaylandWindow(const char* title, unsigned width, unsigned height);
-    ~WaylandWindow();
+    WaylandWindow(std::shared_ptr<WaylandDisplay>, const char* title, unsigned width, unsigned height);
+    ~WaylandWindow() override;
 
-    void processInputs();
+    const char* backendName() const override { return "wayland"; }
+
+    void processInputs() override;
+    void waitForNextFrame() override;
+    void swapBuffers() override;
+
+    // Makes the rendering thread check for events, called from the event thread.
+    void wakeUp();
+    // Hands input over to the rendering thread, called from the event thread.
+    void postInput(const InputEvent&);
+
+    // A subsurface, if the compositor has wl_subcompositor and the window an EGL context.
+    std::unique_ptr<Layer> createLayer(LayerPlacement, LayerSync, int x, int y, unsigned width, unsigned height) override;
+
+    unsigned surfaceWidth() const override { return m_surfaceWidth; }
+    unsigned surfaceHeight() const override { return m_surfaceHeight; }
+
+    WaylandDisplay& waylandDisplay() { return m_waylandDisplay; }
+    struct wl_surface* wlSurface() { return m_wlSurface; }
+
+protected:
+    // One per frame whose presentation feedback is still outstanding. Written by the rendering
+    // thread with the dispatch mutex held, so listeners can read it.
+    struct PresentationFeedback {
+        WaylandWindow* window { nullptr };
+        uint64_t frame { 0 };
+        struct wp_presentation_feedback* feedback { nullptr };
+    };
+
+    // What the event thread hands over to the rendering thread.
+    struct Event {
+        enum class Type { Configure, FrameDone, Presented, Discarded, BufferReleased };
+        Type type { Type::Configure };
+        // The callback or feedback that delivered the event, for the rendering thread to destroy.
+        void* proxy { nullptr };
+        PresentationFeedback* feedback { nullptr };
+        // Frame the feedback was requested for. Its proxy may be destroyed and its slot reused
+        // before the event is handled, possibly by a proxy at the same address.
+        uint64_t frame { 0 };
+        int32_t width { 0 };
+        int32_t height { 0 };
+        int64_t presentTime { 0 };
+        uint32_t refreshPeriod { 0 };
+        uint32_t presentFlags { 0 };
+    };
+
+    // For subclasses filling the surface's buffers themselves, without EGL.
+    enum class Buffers { EGL, Custom };
+    WaylandWindow(std::shared_ptr<WaylandDisplay>, const char* title, unsigned width, unsigned height, Buffers);
+
+    // The steps of a frame that depend on where its buffers come from. beginFrame() runs at the
+    // end of waitForNextFrame(), once the frame's size is known, and present() attaches and
+    // commits the frame in swapBuffers(), after the frame callback and feedback are requested.
+    virtual void beginFrame();
+    virtual void present(const DamageRegion&);
+    // Called with the new m_width and m_height.
+    virtual void resizeBuffers();
+    // The compositor is done with a buffer, posted as Event::Type::BufferReleased.
+    virtual void bufferReleased(struct wl_buffer*) { }
+    unsigned bufferAge() override;
+
+    // Never drops the event: the rendering thread would wait forever for a lost frame callback,
+    // and leak the proxies of lost feedbacks and the buffers of lost releases.
+    void postEvent(const Event&);
+    // Waits at most `timeout` for the event thread to post events, then handles all of them.
+    // A negative timeout waits indefinitely. Returns false if the connection is broken.
+    bool dispatchEvents(std::chrono::nanoseconds timeout);
+
+    WaylandDisplay& m_waylandDisplay;
+    struct wl_surface* m_wlSurface { nullptr };
+    // Size of the surface on screen. The viewport scales the buffers, m_width by m_height, to it.
+    unsigned m_surfaceWidth { 0 };
+    unsigned m_surfaceHeight { 0 };
 
 private:
     void initWayland();
     void initEGL();
 
-    static struct wl_registry_listener s_wlRegistryListener;
+    void handleEvent(const Event&);
+    // Applies the last configured size, so a burst of configure events costs one reallocation,
+    // and the resolution scaler's last scale.
+    void applyPendingResize();
+
+    void requestPresentationFeedback(uint64_t frame);
+
     static struct wl_shell_surface_listener s_wlShellSurfaceListener;
+    static struct wl_callback_listener s_wlFrameListener;
+    static struct wp_presentation_feedback_listener s_wpPresentationFeedbackListener;
 
-    struct wl_display* m_wlDisplay { nullptr };
-    struct wl_compositor* m_wlCompositor { nullptr };
-    struct wl_surface* m_wlSurface { nullptr };
-    struct wl_shell* m_wlShell { nullptr };
     struct wl_shell_surface* m_wlShellSurface { nullptr };
     struct wl_region* m_wlRegion { nullptr };
     struct wl_egl_window* m_wlEGLWindow { nullptr };
+    struct wl_callback* m_wlFrameCallback { nullptr };
+    struct wp_viewport* m_wpViewport { nullptr };
+    // When the frame being drawn started, for the resolution scaler.
+    int64_t m_frameStartTime { 0 };
+    PresentationFeedback m_presentationFeedbacks[FrameProfiler::maxFramesInFlight];
+
+    // Last size configured by the shell, 0 if none since the last applied resize.
+    int32_t m_pendingWidth { 0 };
+    int32_t m_pendingHeight { 0 };
+
+    SPSCRingBuffer<Event, 256> m_events;
+    // Where events go while m_events is full, and until the rendering thread has taken them,
+    // so they keep their order.
+    std::mutex m_overflowMutex;
+    std::vector<Event> m_overflowEvents;
+    std::atomic<bool> m_hasOverflowEvents { false };
+    // Input has a queue of its own, which drops events rather than hold up the others.
+    SPSCRingBuffer<InputEvent, 256> m_inputEvents;
+    // eventfd waking the rendering thread up when events are posted.
+    int m_eventsPostedFD { -1 };
+    // Only touched by the event thread.
+    uint64_t m_droppedInputEvents { 0 };
 };
 
 } // namespace LearningGLES
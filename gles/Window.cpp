@@ -2,11 +2,103 @@
 
 namespace LearningGLES {
 
-Window::Window(const char* title, unsigned width, unsigned height)
-    : m_title(title)
+std::unique_ptr<Window> Window::create(const char* title, unsigned width, unsigned height, WindowBackend backend)
+{
+    std::shared_ptr<Display> display = Display::create(backend);
+    if (!display)
+        return nullptr;
+    return display->createWindow(title, width, height);
+}
+
+Window::Window(std::shared_ptr<Display> display, const char* title, unsigned width, unsigned height)
+    : m_display(display)
+    , m_eglDisplay(display->eglDisplay())
+    , m_eglConfig(display->eglConfig())
+    , m_title(title)
     , m_width(width)
     , m_height(height)
+    , m_frameQueue(display->eglDisplay())
+{
+}
+
+void Window::makeCurrent()
+{
+    if (eglGetCurrentContext() != m_eglContext || eglGetCurrentSurface(EGL_DRAW) != m_eglSurface)
+        eglMakeCurrent(m_eglDisplay, m_eglSurface, m_eglSurface, m_eglContext);
+}
+
+ResizeStats Window::takeResizeStats()
+{
+    ResizeStats stats = m_resizeStats;
+    m_resizeStats = ResizeStats();
+    return stats;
+}
+
+void Window::setProfilingEnabled(bool enabled)
+{
+    if (enabled && !m_profiler)
+        m_profiler.reset(new FrameProfiler);
+    else if (!enabled)
+        m_profiler = nullptr;
+}
+
+bool Window::startCapture(const char* path, unsigned fps)
+{
+    if (m_eglContext == EGL_NO_CONTEXT)
+        return false;
+    m_capture = FrameCapture::create(path, m_width, m_height, fps);
+    return !!m_capture;
+}
+
+void Window::stopCapture()
 {
+    m_capture = nullptr;
+}
+
+void Window::injectInput(InputEvent event)
+{
+    int64_t now = FrameProfiler::now();
+    if (!event.time)
+        event.time = now;
+    if (!event.receivedTime)
+        event.receivedTime = now;
+    queueInput(event);
+}
+
+void Window::consumeInputs()
+{
+    m_inputEvents.swap(m_pendingInputs);
+    m_pendingInputs.clear();
+    if (!m_profiler)
+        return;
+    for (auto& event : m_inputEvents) {
+        if (event.time)
+            m_profiler->inputConsumed(event.time);
+    }
+}
+
+void Window::addDamage(const Rect& rect)
+{
+    m_damage.add(intersection(rect, Rect { 0, 0, static_cast<int>(m_width), static_cast<int>(m_height) }));
+}
+
+DamageRegion Window::repaintRegion()
+{
+    DamageRegion damage = m_damage;
+    if (damage.isEmpty())
+        damage.setFull(m_width, m_height);
+    return m_damageHistory.repaintRegion(bufferAge(), damage, m_width, m_height);
+}
+
+DamageRegion Window::takeDamage()
+{
+    DamageRegion damage = m_damage;
+    if (damage.isEmpty())
+        damage.setFull(m_width, m_height);
+
+    m_damageHistory.push(damage);
+    m_damage.clear();
+    return damage;
 }
 
 } // namespace LearningGLES
@@ -1,21 +1,128 @@
 #pragma once
 
-// FIXME: this breaks inheritance. It shouldn't be here.
-#define WL_EGL_PLATFORM
+#include "DamageRegion.h"
+#include "Display.h"
+#include "FrameCapture.h"
+#include "FrameProfiler.h"
+#include "FrameQueue.h"
+#include "FrameScheduler.h"
+#include "GLState.h"
+#include "InputEvent.h"
+#include "Layer.h"
+#include "PixelBuffer.h"
+#include "ResolutionScaler.h"
 #include <EGL/egl.h>
+#include <memory>
 #include <string>
+#include <vector>
 
 namespace LearningGLES {
 
+// Resize activity since the last Window::takeResizeStats().
+struct ResizeStats {
+    // Sizes the compositor asked for.
+    unsigned requested { 0 };
+    // Sizes actually applied, at most one per frame. Each reallocates the surface's buffers.
+    unsigned applied { 0 };
+};
+
 class Window {
 public:
-    Window(const char* title, unsigned width, unsigned height);
+    // A window with a display of its own. Returns nullptr if the backend is not available in
+    // this build. Windows meant to coexist should come from a single Display::createWindow().
+    static std::unique_ptr<Window> create(const char* title, unsigned width, unsigned height, WindowBackend = WindowBackend::Default);
+
+    Window(std::shared_ptr<Display>, const char* title, unsigned width, unsigned height);
+    virtual ~Window() { }
+
+    virtual const char* backendName() const = 0;
+
+    // Makes the input received so far the current frame's inputEvents(). Call once per frame,
+    // after waitForNextFrame(), so the profiler attributes the events to the frame using them.
+    virtual void processInputs() = 0;
+    // Oldest first. Valid until the next processInputs().
+    const std::vector<InputEvent>& inputEvents() const { return m_inputEvents; }
+    // Queues an event as if the compositor had sent it, for backends without a seat or to
+    // measure latency without a user. Times left at 0 are set to now.
+    void injectInput(InputEvent);
+
+    // Blocks until the frame scheduler allows drawing the next frame.
+    virtual void waitForNextFrame() = 0;
+    virtual void swapBuffers() = 0;
+
+    Display& display() { return *m_display; }
+    // Windows of a display may be drawn from the same thread: waitForNextFrame() and
+    // swapBuffers() make the window's context current.
+    void makeCurrent();
+
+    // A layer drawn with the window's context, or nullptr if the backend has no compositor to
+    // blend layers, in which case render code draws their content into the window itself.
+    virtual std::unique_ptr<Layer> createLayer(LayerPlacement, LayerSync, int, int, unsigned, unsigned) { return nullptr; }
+
+    // Backends rendered by the CPU have no EGL context or surface. They hand out the back buffer
+    // of the frame being drawn instead, valid from waitForNextFrame() until swapBuffers(). Its
+    // data is null for GL backends.
+    virtual PixelBuffer pixelBuffer() { return PixelBuffer(); }
 
     EGLDisplay eglDisplay() { return m_eglDisplay; }
     EGLSurface eglSurface() { return m_eglSurface; }
     EGLContext eglContext() { return m_eglContext; }
 
+    // Size of the back buffer, which render code draws, damages and receives pointer positions
+    // in. Smaller than the window on screen while the resolution scaler renders below 1.
+    unsigned width() const { return m_width; }
+    unsigned height() const { return m_height; }
+    // Size of the window on screen, which layers are positioned and sized in. The same as the
+    // back buffer's unless the resolution scaler renders below 1.
+    virtual unsigned surfaceWidth() const { return m_width; }
+    virtual unsigned surfaceHeight() const { return m_height; }
+
+    FrameScheduler& frameScheduler() { return m_frameScheduler; }
+    // Only used with FramePacing::LowLatency, where it reports the queue depth and latency.
+    FrameQueue& frameQueue() { return m_frameQueue; }
+
+    // Redundant state filter for the window's context. Render code should set the state it
+    // covers through it rather than calling GL directly.
+    GLState& glState() { return m_glState; }
+
+    ResizeStats takeResizeStats();
+
+    // Dynamic resolution, off by default. Backends whose compositor can't scale surfaces up, and
+    // headless ones, leave it alone and render at full size.
+    ResolutionScaler& resolutionScaler() { return m_resolutionScaler; }
+
+    // Per-frame timing instrumentation, off by default. While off it costs a null check per
+    // frame. The context must be current when enabling or disabling it.
+    void setProfilingEnabled(bool);
+    FrameProfiler* profiler() { return m_profiler.get(); }
+
+    // Records every frame swapped from now on to a Y4M file at the current size, until
+    // stopCapture(). The context must be current. Returns false if the file can't be created, or
+    // if the window has no GL context to read frames back from.
+    bool startCapture(const char* path, unsigned fps);
+    void stopCapture();
+    FrameCapture* capture() { return m_capture.get(); }
+
+    // Marks part of the surface as changed in the frame being drawn. A frame without any
+    // damage is assumed to change the whole surface.
+    void addDamage(const Rect&);
+    // Region of the back buffer the frame must repaint: its damage, plus whatever the back
+    // buffer missed since it was last presented. The whole surface if the backend can't tell.
+    DamageRegion repaintRegion();
+
 protected:
+    // How many frames old the back buffer is, as in EGL_EXT_buffer_age. 0 if unknown.
+    virtual unsigned bufferAge() = 0;
+
+    // Returns the damage of the frame being swapped and starts tracking the next one.
+    DamageRegion takeDamage();
+
+    // Backends queue events as they arrive, then processInputs() hands them over with
+    // consumeInputs(). Rendering thread only.
+    void queueInput(const InputEvent& event) { m_pendingInputs.push_back(event); }
+    void consumeInputs();
+
+    std::shared_ptr<Display> m_display;
     EGLDisplay m_eglDisplay { nullptr };
     EGLConfig m_eglConfig { nullptr };
     EGLSurface m_eglSurface { nullptr };
@@ -24,6 +131,22 @@ protected:
     std::string m_title;
     unsigned m_width { 0 };
     unsigned m_height { 0 };
+
+    FrameScheduler m_frameScheduler;
+    FrameQueue m_frameQueue;
+    GLState m_glState;
+    ResizeStats m_resizeStats;
+    ResolutionScaler m_resolutionScaler;
+    // Backends must reset it while their context is still alive.
+    std::unique_ptr<FrameProfiler> m_profiler;
+    // Same as m_profiler. Backends capture the frame right before swapping it.
+    std::unique_ptr<FrameCapture> m_capture;
+
+private:
+    std::vector<InputEvent> m_pendingInputs;
+    std::vector<InputEvent> m_inputEvents;
+    DamageRegion m_damage;
+    DamageHistory m_damageHistory;
 };
 
 } // namespace LearningGLES
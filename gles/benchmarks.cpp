@@ -0,0 +1,1026 @@
+#include "BatchRenderer.h"
+#include "Benchmark.h"
+#include "CommandBuffer.h"
+#include "DiskCache.h"
+#include "FramePipeline.h"
+#include "RendererProbe.h"
+#include "ShaderCache.h"
+#include "TextureAtlas.h"
+#include "Window.h"
+#include <GLES2/gl2.h>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <dirent.h>
+#include <unistd.h>
+
+using namespace LearningGLES;
+
+namespace {
+
+struct Options {
+    WindowBackend backend { WindowBackend::Default };
+    unsigned width { 1280 };
+    unsigned height { 720 };
+    // Scales the number of iterations of every benchmark.
+    double scale { 1 };
+};
+
+unsigned iterations(const Options& options, unsigned count)
+{
+    unsigned scaled = static_cast<unsigned>(count * options.scale);
+    return scaled ? scaled : 1;
+}
+
+std::unique_ptr<Window> createWindow(const Options& options)
+{
+    std::unique_ptr<Window> window = Window::create("benchmark", options.width, options.height, options.backend);
+    if (!window)
+        exit(1);
+    window->frameScheduler().setPacing(FramePacing::Unthrottled);
+    return window;
+}
+
+void benchmarkWindowInit(BenchmarkSuite& suite, const Options& options)
+{
+    suite.measure("window_init", iterations(options, 20), [&] {
+        createWindow(options);
+    });
+}
+
+void benchmarkClearSwap(BenchmarkSuite& suite, const Options& options)
+{
+    std::unique_ptr<Window> window = createWindow(options);
+    unsigned frames = iterations(options, 1000);
+
+    auto start = BenchmarkSuite::Clock::now();
+    BenchmarkResult& result = suite.measure("clear_swap", frames, [&] {
+        window->waitForNextFrame();
+        glClearColor(1.0, 0.0, 0.0, 1.0);
+        glClear(GL_COLOR_BUFFER_BIT);
+        window->swapBuffers();
+    });
+    glFinish();
+    result.addMetric("fps", (frames + 1) / (BenchmarkSuite::nanosecondsSince(start) / 1e9));
+}
+
+// Time from the start of a frame until the GPU has finished it, without any pipelining.
+void benchmarkFrameLatency(BenchmarkSuite& suite, const Options& options)
+{
+    std::unique_ptr<Window> window = createWindow(options);
+    suite.measure("frame_latency", iterations(options, 300), [&] {
+        window->waitForNextFrame();
+        glClearColor(0.0, 1.0, 0.0, 1.0);
+        glClear(GL_COLOR_BUFFER_BIT);
+        window->swapBuffers();
+        glFinish();
+    });
+}
+
+// Frames drawn with at most `framesInFlight` of them queued on the GPU, each covering the
+// surface several times so the GPU is the bottleneck. Reports the measured queue depth and the
+// latency from the start of a frame until the GPU finished it.
+void benchmarkLowLatency(BenchmarkSuite& suite, const Options& options, unsigned framesInFlight)
+{
+    std::unique_ptr<Window> window = createWindow(options);
+    window->frameScheduler().setPacing(FramePacing::LowLatency);
+    window->frameScheduler().setMaxFramesInFlight(framesInFlight);
+    unsigned frames = iterations(options, 300);
+
+    std::string name = "low_latency/" + std::to_string(framesInFlight);
+    auto start = BenchmarkSuite::Clock::now();
+    BenchmarkResult& result = suite.measure(name.c_str(), frames, [&] {
+        window->waitForNextFrame();
+        for (unsigned i = 0; i < 8; ++i) {
+            window->glState().clearColor(i / 8.0, 1.0, 0.0, 1.0);
+            glClear(GL_COLOR_BUFFER_BIT);
+        }
+        window->swapBuffers();
+    });
+    glFinish();
+    result.addMetric("fps", (frames + 1) / (BenchmarkSuite::nanosecondsSince(start) / 1e9));
+
+    FrameQueueStats stats = window->frameQueue().takeStats();
+    result.addMetric("queue_depth", stats.frames ? static_cast<double>(stats.depthSum) / stats.frames : 0);
+    result.addMetric("latency_ms", stats.completed ? 1e3 * stats.latencySum / stats.completed : 0);
+    result.addMetric("max_latency_ms", 1e3 * stats.maxLatency);
+}
+
+// Same with a simulated GPU taking 4 ms per frame, much slower than the CPU drawing them, so
+// the cap engages even where fences are signaled by the time frames are flushed. Exits if the
+// queue ever held more frames than the cap, or never had to wait.
+void benchmarkSimulatedGPULag(BenchmarkSuite& suite, const Options& options, unsigned framesInFlight)
+{
+    std::unique_ptr<Window> window = createWindow(options);
+    window->frameScheduler().setPacing(FramePacing::LowLatency);
+    window->frameScheduler().setMaxFramesInFlight(framesInFlight);
+    window->frameQueue().simulateGPU(0.004);
+    unsigned frames = iterations(options, 100);
+
+    std::string name = "low_latency/gpu_lag_" + std::to_string(framesInFlight);
+    BenchmarkResult& result = suite.measure(name.c_str(), frames, [&] {
+        window->waitForNextFrame();
+        window->glState().clearColor(0.0, 1.0, 0.0, 1.0);
+        glClear(GL_COLOR_BUFFER_BIT);
+        window->swapBuffers();
+    });
+
+    FrameQueueStats stats = window->frameQueue().takeStats();
+    result.addMetric("queue_depth", stats.frames ? static_cast<double>(stats.depthSum) / stats.frames : 0);
+    result.addMetric("max_depth", stats.maxDepth);
+    result.addMetric("waits_pct", stats.frames ? 100.0 * stats.waits / stats.frames : 0);
+    result.addMetric("latency_ms", stats.completed ? 1e3 * stats.latencySum / stats.completed : 0);
+    // Frames are counted before waiting, so a full queue shows as a depth of the cap itself.
+    if (stats.maxDepth > framesInFlight || (frames > framesInFlight && !stats.waits)) {
+        fprintf(stderr, "%s: %u frames in flight with a cap of %u, %llu waits.\n", name.c_str(), stats.maxDepth,
+            framesInFlight, static_cast<unsigned long long>(stats.waits));
+        exit(1);
+    }
+}
+
+void benchmarkLowLatency(BenchmarkSuite& suite, const Options& options)
+{
+    for (unsigned framesInFlight : { 1, 2, 3 })
+        benchmarkLowLatency(suite, options, framesInFlight);
+    for (unsigned framesInFlight : { 1, 2, 3 })
+        benchmarkSimulatedGPULag(suite, options, framesInFlight);
+}
+
+// Time from an input event until the frame consuming it is presented, or swapped when the
+// backend can't tell when it is presented. Events are injected right after a frame is swapped,
+// the worst case for paced modes: the event waits a whole interval for the next frame to start.
+void benchmarkInputLatency(BenchmarkSuite& suite, const Options& options, FramePacing pacing)
+{
+    std::unique_ptr<Window> window = createWindow(options);
+    window->frameScheduler().setPacing(pacing);
+    window->setProfilingEnabled(true);
+    BenchmarkResult& result = suite.add(pacing == FramePacing::LowLatency ? "input_latency/low_latency" : "input_latency/vsync");
+    unsigned frames = iterations(options, 120);
+    unsigned presented = 0;
+
+    auto collect = [&] {
+        FrameRecord record;
+        while (window->profiler()->pop(record)) {
+            if (!record.inputTime)
+                continue;
+            int64_t shown = record.presentTime ? record.presentTime : record.swapEnd;
+            result.samples.push_back(shown - record.inputTime);
+            presented += record.presentTime != 0;
+        }
+    };
+
+    for (unsigned frame = 0; frame < frames; ++frame) {
+        InputEvent event;
+        event.type = InputEvent::Type::PointerMotion;
+        event.x = frame % window->width();
+        event.y = frame % window->height();
+        window->injectInput(event);
+
+        window->waitForNextFrame();
+        window->processInputs();
+        for (auto& input : window->inputEvents())
+            window->glState().clearColor(input.x / window->width(), input.y / window->height(), 0, 1);
+        glClear(GL_COLOR_BUFFER_BIT);
+        window->swapBuffers();
+        collect();
+    }
+    // Presentation feedback of the last frames arrives a few frames late.
+    for (unsigned frame = 0; frame < 4; ++frame) {
+        window->waitForNextFrame();
+        window->processInputs();
+        window->swapBuffers();
+        collect();
+    }
+    glFinish();
+    window->setProfilingEnabled(false);
+
+    result.addMetric("presented", result.samples.empty() ? 0 : static_cast<double>(presented) / result.samples.size());
+}
+
+void benchmarkInputLatency(BenchmarkSuite& suite, const Options& options)
+{
+    benchmarkInputLatency(suite, options, FramePacing::VSync);
+    benchmarkInputLatency(suite, options, FramePacing::LowLatency);
+}
+
+// clear_swap while recording every frame, to compare against it. The recording goes to a
+// temporary file removed afterwards.
+void benchmarkCapture(BenchmarkSuite& suite, const Options& options)
+{
+    std::unique_ptr<Window> window = createWindow(options);
+    char path[] = "/tmp/learning-gles-capture-XXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0)
+        return;
+    close(fd);
+    if (!window->startCapture(path, 60)) {
+        unlink(path);
+        return;
+    }
+    unsigned frames = iterations(options, 300);
+
+    auto start = BenchmarkSuite::Clock::now();
+    BenchmarkResult& result = suite.measure("capture", frames, [&] {
+        window->waitForNextFrame();
+        glClearColor(1.0, 0.0, 0.0, 1.0);
+        glClear(GL_COLOR_BUFFER_BIT);
+        window->swapBuffers();
+    });
+    glFinish();
+    result.addMetric("fps", (frames + 1) / (BenchmarkSuite::nanosecondsSince(start) / 1e9));
+
+    FrameCaptureStats stats = window->capture()->takeStats();
+    result.addMetric("pixel_buffers", window->capture()->usesPixelBuffers());
+    result.addMetric("capture_ms", stats.frames ? 1e3 * stats.captureSeconds / stats.frames : 0);
+    result.addMetric("encode_ms", stats.encoded ? 1e3 * stats.encodeSeconds / stats.encoded : 0);
+    result.addMetric("dropped", stats.frames ? static_cast<double>(stats.dropped) / stats.frames : 0);
+    window->stopCapture();
+    unlink(path);
+}
+
+const unsigned startupPrograms = 32;
+
+// A lit, textured material, varied by `variant` so that every program is distinct. `nonce`
+// makes the sources unique to one run, so the driver's own shader cache can't serve them.
+void shaderSources(unsigned variant, unsigned nonce, std::string& vertex, std::string& fragment)
+{
+    std::string seed = std::to_string(variant) + ".0 + " + std::to_string(nonce) + ".0 * 0.0";
+    vertex =
+        "attribute vec3 position;\n"
+        "attribute vec3 normal;\n"
+        "attribute vec2 uv;\n"
+        "uniform mat4 modelViewProjection;\n"
+        "uniform mat3 normalMatrix;\n"
+        "varying vec3 vNormal;\n"
+        "varying vec2 vUV;\n"
+        "void main() {\n"
+        "    vNormal = normalize(normalMatrix * normal);\n"
+        "    vUV = uv * (1.0 + " + seed + ");\n"
+        "    gl_Position = modelViewProjection * vec4(position, 1.0);\n"
+        "}\n";
+    fragment =
+        "precision mediump float;\n"
+        "uniform sampler2D albedo;\n"
+        "uniform vec3 lightDirections[4];\n"
+        "uniform vec3 lightColors[4];\n"
+        "varying vec3 vNormal;\n"
+        "varying vec2 vUV;\n"
+        "void main() {\n"
+        "    vec3 color = vec3(0.05);\n"
+        "    for (int i = 0; i < 4; ++i)\n"
+        "        color += lightColors[i] * max(dot(vNormal, lightDirections[i]), 0.0);\n"
+        "    gl_FragColor = vec4(color * texture2D(albedo, vUV).rgb * (" + seed + "), 1.0);\n"
+        "}\n";
+}
+
+void buildPrograms(ShaderCache& cache, unsigned nonce)
+{
+    std::string vertex, fragment;
+    for (unsigned i = 0; i < startupPrograms; ++i) {
+        shaderSources(i, nonce, vertex, fragment);
+        if (!cache.program(vertex.c_str(), fragment.c_str(), { "position", "normal", "uv" }))
+            exit(1);
+    }
+}
+
+void removeDirectory(const std::string& path)
+{
+    DIR* directory = opendir(path.c_str());
+    if (!directory)
+        return;
+    while (struct dirent* entry = readdir(directory)) {
+        if (strcmp(entry->d_name, ".") && strcmp(entry->d_name, ".."))
+            unlink((path + "/" + entry->d_name).c_str());
+    }
+    closedir(directory);
+    rmdir(path.c_str());
+}
+
+// Time to build the programs an application needs at startup, without any cached binary (cold)
+// and with all of them saved by an earlier run (warm).
+void benchmarkShaderStartup(BenchmarkSuite& suite, const Options& options)
+{
+    std::unique_ptr<Window> window = createWindow(options);
+    char directoryTemplate[] = "/tmp/learning-gles-shaders-XXXXXX";
+    if (!mkdtemp(directoryTemplate))
+        exit(1);
+    std::string directory = directoryTemplate;
+    unsigned nonce = getpid() * 1000;
+    bool hasProgramBinary = false;
+
+    BenchmarkResult& cold = suite.measure("shader_startup/cold", iterations(options, 10), [&] {
+        ShaderCache cache(directory);
+        buildPrograms(cache, ++nonce);
+        glFinish();
+        hasProgramBinary = cache.hasProgramBinary();
+    });
+
+    unsigned warmNonce = ++nonce;
+    ShaderCacheStats stats;
+    BenchmarkResult& warm = suite.measure("shader_startup/warm", iterations(options, 10), [&] {
+        ShaderCache cache(directory);
+        buildPrograms(cache, warmNonce);
+        glFinish();
+        stats = cache.stats();
+    });
+
+    removeDirectory(directory);
+
+    cold.addMetric("programs", startupPrograms);
+    cold.addMetric("program_binary", hasProgramBinary);
+    warm.addMetric("programs", startupPrograms);
+    warm.addMetric("loaded", stats.loaded);
+    warm.addMetric("rejected", stats.rejected);
+    std::vector<double> coldSamples = cold.samples;
+    std::vector<double> warmSamples = warm.samples;
+    std::sort(coldSamples.begin(), coldSamples.end());
+    std::sort(warmSamples.begin(), warmSamples.end());
+    warm.addMetric("speedup", BenchmarkSuite::percentile(coldSamples, 50) / BenchmarkSuite::percentile(warmSamples, 50));
+}
+
+// Sprites of random size and position using one of a few textures, drawn in random order, so
+// the renderer has to sort them to batch anything.
+void benchmarkBatchRenderer(BenchmarkSuite& suite, const Options& options, unsigned sprites)
+{
+    std::unique_ptr<Window> window = createWindow(options);
+    ShaderCache shaderCache;
+    BatchRenderer renderer(window->glState(), shaderCache);
+
+    const unsigned textureCount = 8;
+    GLuint textures[textureCount];
+    glGenTextures(textureCount, textures);
+    std::vector<uint8_t> texels(32 * 32 * 4);
+    for (unsigned i = 0; i < textureCount; ++i) {
+        for (size_t j = 0; j < texels.size(); ++j)
+            texels[j] = (i * 37 + j) & 0xff;
+        window->glState().bindTexture(GL_TEXTURE_2D, textures[i]);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 32, 32, 0, GL_RGBA, GL_UNSIGNED_BYTE, texels.data());
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    }
+
+    std::vector<Quad> quads(sprites);
+    uint32_t random = 1;
+    auto next = [&random] {
+        random = random * 1664525 + 1013904223;
+        return random >> 8;
+    };
+    for (auto& quad : quads) {
+        quad.width = quad.height = 4 + next() % 28;
+        quad.x = next() % (options.width - 32);
+        quad.y = next() % (options.height - 32);
+        quad.texture = textures[next() % textureCount];
+        quad.color[3] = quad.color[0] = quad.color[1] = quad.color[2] = 128 + next() % 128;
+    }
+
+    unsigned frames = iterations(options, sprites > 10000 ? 10 : 30);
+    std::string name = "batch/sprites=" + std::to_string(sprites);
+    auto start = BenchmarkSuite::Clock::now();
+    BenchmarkResult& result = suite.measure(name.c_str(), frames, [&] {
+        window->waitForNextFrame();
+        window->glState().clearColor(0, 0, 0, 1);
+        glClear(GL_COLOR_BUFFER_BIT);
+        renderer.begin(window->width(), window->height());
+        for (auto& quad : quads)
+            renderer.drawQuad(quad);
+        renderer.end();
+        window->swapBuffers();
+    });
+    glFinish();
+    double seconds = BenchmarkSuite::nanosecondsSince(start) / 1e9;
+
+    // measure() also ran one warm-up frame.
+    BatchStats stats = renderer.takeStats();
+    result.addMetric("quads_per_second", stats.quads / seconds);
+    result.addMetric("draw_calls_per_frame", static_cast<double>(stats.drawCalls) / (frames + 1));
+    result.addMetric("orphans_per_frame", static_cast<double>(stats.orphans) / (frames + 1));
+
+    for (GLuint texture : textures)
+        window->glState().deleteTexture(texture);
+}
+
+void benchmarkBatchRenderer(BenchmarkSuite& suite, const Options& options)
+{
+    benchmarkBatchRenderer(suite, options, 10000);
+    benchmarkBatchRenderer(suite, options, 100000);
+}
+
+struct AtlasImage {
+    unsigned width;
+    unsigned height;
+    std::vector<uint8_t> pixels;
+    float x;
+    float y;
+};
+
+std::vector<AtlasImage> atlasImages(const Options& options, unsigned count, uint32_t seed)
+{
+    std::vector<AtlasImage> images(count);
+    for (auto& image : images) {
+        seed = seed * 1664525 + 1013904223;
+        image.width = 8 + (seed >> 8) % 25;
+        image.height = 8 + (seed >> 16) % 25;
+        image.pixels.assign(image.width * image.height * 4, seed >> 24);
+        image.x = (seed >> 4) % (options.width - 32);
+        image.y = (seed >> 12) % (options.height - 32);
+    }
+    return images;
+}
+
+// Glyph-like images, a few of which change every frame, drawn either from an atlas or from one
+// texture each.
+void benchmarkAtlas(BenchmarkSuite& suite, const Options& options, bool useAtlas)
+{
+    std::unique_ptr<Window> window = createWindow(options);
+    GLState& state = window->glState();
+    ShaderCache shaderCache;
+    BatchRenderer renderer(state, shaderCache);
+    TextureAtlas atlas(state);
+
+    const unsigned imageCount = 2000;
+    const unsigned changesPerFrame = 20;
+    std::vector<AtlasImage> images = atlasImages(options, imageCount, 1);
+    std::vector<GLuint> textures(imageCount);
+    for (unsigned i = 0; i < imageCount; ++i) {
+        AtlasImage& image = images[i];
+        if (useAtlas) {
+            atlas.add(i, image.width, image.height, image.pixels.data());
+            continue;
+        }
+        glGenTextures(1, &textures[i]);
+        state.bindTexture(GL_TEXTURE_2D, textures[i]);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, image.width, image.height, 0, GL_RGBA, GL_UNSIGNED_BYTE, image.pixels.data());
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        // Non-power-of-two textures are incomplete with GL_REPEAT on GLES 2 without OES_texture_npot.
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    }
+    atlas.upload();
+    atlas.takeStats();
+
+    unsigned frames = iterations(options, 30);
+    unsigned frame = 0;
+    uint64_t bytesUploaded = 0;
+    BenchmarkResult& result = suite.measure(useAtlas ? "atlas/atlas" : "atlas/texture_per_image", frames, [&] {
+        window->waitForNextFrame();
+
+        // The top half of a few images changes, as when animating or re-rendering glyphs.
+        for (unsigned i = 0; i < changesPerFrame; ++i) {
+            unsigned index = (frame * changesPerFrame + i) * 7919 % imageCount;
+            AtlasImage& image = images[index];
+            Rect changed = { 0, 0, static_cast<int>(image.width), static_cast<int>(image.height / 2) };
+            size_t changedBytes = static_cast<size_t>(changed.area()) * 4;
+            for (size_t j = 0; j < changedBytes; ++j)
+                image.pixels[j] += 1;
+            if (useAtlas)
+                atlas.update(index, changed, image.pixels.data());
+            else {
+                state.bindTexture(GL_TEXTURE_2D, textures[index]);
+                glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, changed.width, changed.height, GL_RGBA, GL_UNSIGNED_BYTE, image.pixels.data());
+                bytesUploaded += changed.area() * 4;
+            }
+        }
+        frame++;
+
+        state.clearColor(0, 0, 0, 1);
+        glClear(GL_COLOR_BUFFER_BIT);
+        renderer.begin(window->width(), window->height());
+        for (unsigned i = 0; i < imageCount; ++i) {
+            Quad quad;
+            quad.x = images[i].x;
+            quad.y = images[i].y;
+            quad.width = images[i].width;
+            quad.height = images[i].height;
+            if (useAtlas) {
+                const AtlasRegion* region = atlas.lookup(i);
+                quad.texture = region->texture;
+                quad.u0 = region->u0;
+                quad.v0 = region->v0;
+                quad.u1 = region->u1;
+                quad.v1 = region->v1;
+            } else
+                quad.texture = textures[i];
+            renderer.drawQuad(quad);
+        }
+        atlas.upload();
+        renderer.end();
+        window->swapBuffers();
+    });
+    glFinish();
+
+    BatchStats batchStats = renderer.takeStats();
+    AtlasStats atlasStats = atlas.takeStats();
+    if (useAtlas)
+        bytesUploaded = atlasStats.bytesUploaded;
+    result.addMetric("draw_calls_per_frame", static_cast<double>(batchStats.drawCalls) / (frames + 1));
+    result.addMetric("bytes_uploaded_per_frame", static_cast<double>(bytesUploaded) / (frames + 1));
+    if (useAtlas) {
+        result.addMetric("pages", atlasStats.pages);
+        result.addMetric("occupancy", atlasStats.occupancy);
+        result.addMetric("fragmentation", atlasStats.fragmentation);
+    }
+
+    for (GLuint texture : textures)
+        state.deleteTexture(texture);
+}
+
+// A working set that moves on faster than a small atlas can hold: every frame brings new
+// images, and only the latest ones are drawn, so older ones get evicted.
+void benchmarkAtlasChurn(BenchmarkSuite& suite, const Options& options)
+{
+    std::unique_ptr<Window> window = createWindow(options);
+    TextureAtlas atlas(window->glState(), 512, 1);
+
+    const unsigned newPerFrame = 50;
+    const unsigned drawnPerFrame = 200;
+    std::vector<AtlasImage> images = atlasImages(options, 4096, 2);
+    unsigned frames = iterations(options, 200);
+    uint64_t next = 0;
+    BenchmarkResult& result = suite.measure("atlas/churn", frames, [&] {
+        for (unsigned i = 0; i < newPerFrame; ++i, ++next) {
+            AtlasImage& image = images[next % images.size()];
+            atlas.add(next, image.width, image.height, image.pixels.data());
+        }
+        for (uint64_t id = next > drawnPerFrame ? next - drawnPerFrame : 0; id < next; ++id)
+            atlas.lookup(id);
+        atlas.upload();
+    });
+    glFinish();
+
+    AtlasStats stats = atlas.takeStats();
+    result.addMetric("evictions_per_frame", static_cast<double>(stats.evictions) / (frames + 1));
+    result.addMetric("repacks_per_frame", static_cast<double>(stats.repacks) / (frames + 1));
+    result.addMetric("failures", stats.failures);
+    result.addMetric("bytes_uploaded_per_frame", static_cast<double>(stats.bytesUploaded) / (frames + 1));
+    result.addMetric("occupancy", stats.occupancy);
+    result.addMetric("fragmentation", stats.fragmentation);
+}
+
+void benchmarkAtlas(BenchmarkSuite& suite, const Options& options)
+{
+    benchmarkAtlas(suite, options, false);
+    benchmarkAtlas(suite, options, true);
+    benchmarkAtlasChurn(suite, options);
+}
+
+long residentBytes()
+{
+    long size = 0;
+    long pages = 0;
+    FILE* file = fopen("/proc/self/statm", "r");
+    if (file) {
+        if (fscanf(file, "%ld %ld", &size, &pages) != 2)
+            pages = 0;
+        fclose(file);
+    }
+    return pages * sysconf(_SC_PAGESIZE);
+}
+
+// Time until `count` windows have drawn their first frame, each with a display of its own or
+// all attached to a single one, and the memory they take. Windows are kept small, so the cost
+// of their buffers doesn't hide the cost of everything else.
+void benchmarkWindows(BenchmarkSuite& suite, const Options& options, unsigned count, bool shared)
+{
+    std::string name = std::string("windows/") + (shared ? "shared/" : "separate/") + std::to_string(count);
+    BenchmarkResult& result = suite.add(name.c_str());
+    unsigned runs = iterations(options, count >= 100 ? 3 : 10);
+    long memory = 0;
+
+    for (unsigned run = 0; run < runs; ++run) {
+        long residentBefore = residentBytes();
+        auto start = BenchmarkSuite::Clock::now();
+        std::shared_ptr<Display> display;
+        if (shared)
+            display = Display::create(options.backend);
+        std::vector<std::unique_ptr<Window>> windows;
+        for (unsigned i = 0; i < count; ++i) {
+            windows.push_back(shared ? display->createWindow("benchmark", 256, 256) : Window::create("benchmark", 256, 256, options.backend));
+            if (!windows.back())
+                exit(1);
+            Window& window = *windows.back();
+            window.frameScheduler().setPacing(FramePacing::Unthrottled);
+            window.waitForNextFrame();
+            window.glState().clearColor(0, 0, 1, 1);
+            glClear(GL_COLOR_BUFFER_BIT);
+            window.swapBuffers();
+        }
+        for (auto& window : windows) {
+            window->makeCurrent();
+            glFinish();
+        }
+        result.samples.push_back(BenchmarkSuite::nanosecondsSince(start));
+        memory = std::max(memory, residentBytes() - residentBefore);
+    }
+
+    result.addMetric("windows", count);
+    result.addMetric("kb_per_window", memory / 1024.0 / count);
+}
+
+void benchmarkWindows(BenchmarkSuite& suite, const Options& options)
+{
+    for (unsigned count : { 1, 10, 100 }) {
+        benchmarkWindows(suite, options, count, false);
+        benchmarkWindows(suite, options, count, true);
+    }
+}
+
+// Time to the first frame of a new display and window, with the EGL config cache emptied
+// before each run or left in place, and the mean duration of each startup phase.
+void benchmarkStartup(BenchmarkSuite& suite, const Options& options, bool warm)
+{
+    BenchmarkResult& result = suite.add(warm ? "startup/warm" : "startup/cold");
+    std::string directory = cacheDirectory("egl-configs");
+    std::vector<std::pair<std::string, double>> phases;
+    unsigned runs = iterations(options, 20);
+
+    for (unsigned run = 0; run <= runs; ++run) {
+        if (!warm)
+            removeDirectory(directory);
+        auto start = BenchmarkSuite::Clock::now();
+        std::shared_ptr<Display> display = Display::create(options.backend);
+        std::unique_ptr<Window> window = display ? display->createWindow("benchmark", 256, 256) : nullptr;
+        if (!window)
+            exit(1);
+        window->frameScheduler().setPacing(FramePacing::Unthrottled);
+        window->waitForNextFrame();
+        window->glState().clearColor(0, 0, 1, 1);
+        glClear(GL_COLOR_BUFFER_BIT);
+        window->swapBuffers();
+        glFinish();
+        // The first run only fills the cache for the warm case.
+        if (!run)
+            continue;
+        result.samples.push_back(BenchmarkSuite::nanosecondsSince(start));
+
+        for (auto& phase : display->startupPhases()) {
+            auto found = std::find_if(phases.begin(), phases.end(), [&](const std::pair<std::string, double>& entry) {
+                return entry.first == phase.name;
+            });
+            if (found == phases.end())
+                found = phases.insert(phases.end(), std::make_pair(std::string(phase.name), 0.0));
+            found->second += (phase.end - phase.start) / 1e6;
+        }
+    }
+
+    for (auto& phase : phases)
+        result.addMetric((phase.first + "_ms").c_str(), phase.second / runs);
+}
+
+void benchmarkStartup(BenchmarkSuite& suite, const Options& options)
+{
+    // Keeps the user's own cache out of it.
+    char directoryTemplate[] = "/tmp/learning-gles-cache-XXXXXX";
+    if (!mkdtemp(directoryTemplate))
+        exit(1);
+    const char* previous = getenv("XDG_CACHE_HOME");
+    std::string previousCache = previous ? previous : "";
+    setenv("XDG_CACHE_HOME", directoryTemplate, 1);
+
+    benchmarkStartup(suite, options, false);
+    benchmarkStartup(suite, options, true);
+
+    removeDirectory(cacheDirectory("egl-configs"));
+    rmdir((std::string(directoryTemplate) + "/learning-gles").c_str());
+    rmdir(directoryTemplate);
+    if (previous)
+        setenv("XDG_CACHE_HOME", previousCache.c_str(), 1);
+    else
+        unsetenv("XDG_CACHE_HOME");
+}
+
+// GPU time per frame of the example's scene with a costly background: a static background of
+// translucent quads and a HUD under a moving square, drawn as a single surface redrawn in full,
+// as one redrawn where damaged, and with the background and HUD in layers of their own, where a
+// frame only clears the square's old and new positions and fills it, and the HUD is redrawn once
+// a second. Headless windows have no layers, so the HUD is drawn into the window there; blending
+// the layers is left to the compositor and not measured.
+enum class LayersMode { SingleFull, SingleDamage, Layered };
+
+void benchmarkLayers(BenchmarkSuite& suite, const Options& options, LayersMode mode, double singleFull, double& median)
+{
+    static const char* names[] = { "layers/single_full", "layers/single_damage", "layers/layered" };
+    std::unique_ptr<Window> window = createWindow(options);
+    ShaderCache shaderCache;
+    BatchRenderer renderer(window->glState(), shaderCache);
+    GLState& state = window->glState();
+
+    std::vector<Quad> background(500);
+    uint32_t random = 1;
+    auto next = [&random] {
+        random = random * 1664525 + 1013904223;
+        return random >> 8;
+    };
+    for (auto& quad : background) {
+        quad.width = 64 + next() % 256;
+        quad.height = 64 + next() % 256;
+        quad.x = next() % options.width;
+        quad.y = next() % options.height;
+        quad.color[3] = 96;
+        quad.color[0] = next() % 96;
+        quad.color[1] = next() % 96;
+        quad.color[2] = next() % 96;
+    }
+    Quad hud;
+    hud.x = hud.y = 16;
+    hud.width = 256;
+    hud.height = 48;
+    hud.color[0] = hud.color[1] = hud.color[2] = 12;
+    hud.color[3] = 192;
+    hud.layer = 1;
+    Quad square;
+    square.width = square.height = 200;
+    square.color[0] = square.color[2] = 0;
+    square.layer = 2;
+
+    int dx = 7;
+    int dy = 5;
+    unsigned frame = 0;
+    // The scene, clipped to `rect` unless it's empty.
+    auto drawScene = [&](const Rect& rect, bool withBackground, bool withHUD) {
+        if (!rect.isEmpty()) {
+            state.enable(GL_SCISSOR_TEST);
+            state.scissor(rect.x, options.height - rect.y - rect.height, rect.width, rect.height);
+        }
+        state.clearColor(0, 0, 0, withBackground ? 1 : 0);
+        glClear(GL_COLOR_BUFFER_BIT);
+        renderer.begin(options.width, options.height);
+        if (withBackground) {
+            for (auto& quad : background)
+                renderer.drawQuad(quad);
+        }
+        if (withHUD)
+            renderer.drawQuad(hud);
+        renderer.drawQuad(square);
+        renderer.end();
+        state.disable(GL_SCISSOR_TEST);
+    };
+
+    BenchmarkResult& result = suite.measure(names[static_cast<int>(mode)], iterations(options, 30), [&] {
+        window->waitForNextFrame();
+        Rect old = { static_cast<int>(square.x), static_cast<int>(square.y), 200, 200 };
+        square.x += dx;
+        square.y += dy;
+        if (square.x < 0 || square.x + 200 > options.width)
+            dx = -dx;
+        if (square.y < 0 || square.y + 200 > options.height)
+            dy = -dy;
+        Rect current = { static_cast<int>(square.x), static_cast<int>(square.y), 200, 200 };
+
+        switch (mode) {
+        case LayersMode::SingleFull:
+            drawScene(Rect(), true, true);
+            break;
+        case LayersMode::SingleDamage:
+            drawScene(old, true, true);
+            drawScene(current, true, true);
+            break;
+        case LayersMode::Layered:
+            drawScene(old, false, false);
+            drawScene(current, false, false);
+            if (!(frame % 60))
+                drawScene(Rect { 16, 16, 256, 48 }, false, true);
+            break;
+        }
+        ++frame;
+        // The GPU's share of the frame counts too.
+        glFinish();
+        window->swapBuffers();
+    });
+
+    std::vector<double> sorted = result.samples;
+    std::sort(sorted.begin(), sorted.end());
+    median = BenchmarkSuite::percentile(sorted, 50);
+    if (singleFull)
+        result.addMetric("saved_pct", 100 * (1 - median / singleFull));
+}
+
+void benchmarkLayers(BenchmarkSuite& suite, const Options& options)
+{
+    double singleFull = 0;
+    double median = 0;
+    if (suite.shouldRun("layers/single_full"))
+        benchmarkLayers(suite, options, LayersMode::SingleFull, 0, singleFull);
+    if (suite.shouldRun("layers/single_damage"))
+        benchmarkLayers(suite, options, LayersMode::SingleDamage, singleFull, median);
+    if (suite.shouldRun("layers/layered"))
+        benchmarkLayers(suite, options, LayersMode::Layered, singleFull, median);
+}
+
+// The startup probe choosing between GLES and CPU rendering, with the frame time it measured
+// for each, at the benchmark resolution.
+void benchmarkRendererProbe(BenchmarkSuite& suite, const Options& options)
+{
+    RendererProbe probe;
+    BenchmarkResult& result = suite.measure("renderer_probe", iterations(options, 5), [&] {
+        probe = probeRenderers(options.width, options.height);
+    });
+    result.addMetric("gl_ms", 1e3 * probe.glSeconds);
+    result.addMetric("cpu_ms", 1e3 * probe.cpuSeconds);
+    result.addMetric("prefers_cpu", probe.preferCPU());
+}
+
+// A CPU-heavy scene: a particle simulation stepped every frame and recorded as quads, replayed
+// with a BatchRenderer. The single-threaded loop records and replays each frame in turn, the
+// pipelined ones record on a FramePipeline thread while the GL thread replays and swaps, which
+// only pays off with a core for each. Reports the frame rate and the speedup over the
+// single-threaded loop.
+class ParticleScene {
+public:
+    static const unsigned particleCount = 40000;
+    // Only every drawnEvery-th particle is drawn, the simulation being the costly part.
+    static const unsigned drawnEvery = 8;
+
+    ParticleScene(unsigned width, unsigned height)
+        : m_particles(particleCount)
+        , m_width(width)
+        , m_height(height)
+    {
+        uint32_t random = 1;
+        for (auto& particle : m_particles) {
+            random = random * 1664525 + 1013904223;
+            particle.x = (random >> 8) % width;
+            random = random * 1664525 + 1013904223;
+            particle.y = (random >> 8) % height;
+            particle.phase = (random >> 8) % 628 / 100.0f;
+        }
+    }
+
+    void record(CommandBuffer& commands, const FrameInfo& frame)
+    {
+        commands.fill(Rect { 0, 0, static_cast<int>(m_width), static_cast<int>(m_height) }, 0.0, 0.0, 0.1, 1.0);
+        float time = frame.frame / 60.0f;
+        Quad quad;
+        quad.width = quad.height = 6;
+        quad.color[3] = 192;
+        for (unsigned i = 0; i < m_particles.size(); ++i) {
+            Particle& particle = m_particles[i];
+            // A swirling flow field, costly enough to stand for game logic.
+            float angle = std::sin(particle.x * 0.01f + time) + std::cos(particle.y * 0.013f - time) + particle.phase;
+            particle.x = std::fmod(particle.x + std::cos(angle) * 2 + m_width, static_cast<float>(m_width));
+            particle.y = std::fmod(particle.y + std::sin(angle) * 2 + m_height, static_cast<float>(m_height));
+            if (i % drawnEvery)
+                continue;
+            quad.x = particle.x;
+            quad.y = particle.y;
+            quad.color[0] = static_cast<uint8_t>(96 + 96 * std::sin(angle));
+            quad.color[1] = 128;
+            quad.color[2] = static_cast<uint8_t>(96 + 96 * std::cos(angle));
+            commands.drawQuad(quad);
+        }
+    }
+
+private:
+    struct Particle {
+        float x;
+        float y;
+        float phase;
+    };
+
+    std::vector<Particle> m_particles;
+    unsigned m_width;
+    unsigned m_height;
+};
+
+void benchmarkPipeline(BenchmarkSuite& suite, const Options& options, unsigned framesAhead, double& fps, double singleThreadFPS)
+{
+    std::unique_ptr<Window> window = createWindow(options);
+    ShaderCache shaderCache;
+    BatchRenderer renderer(window->glState(), shaderCache);
+    ParticleScene scene(options.width, options.height);
+    auto record = [&scene](CommandBuffer& commands, const FrameInfo& frame) {
+        scene.record(commands, frame);
+    };
+
+    std::unique_ptr<FramePipeline> pipeline;
+    if (framesAhead)
+        pipeline.reset(new FramePipeline(record, framesAhead));
+    CommandBuffer commands;
+    FrameInfo info;
+    info.width = options.width;
+    info.height = options.height;
+
+    std::string name = framesAhead ? "pipeline/frames_ahead_" + std::to_string(framesAhead) : "pipeline/single_thread";
+    unsigned frames = iterations(options, 120);
+    auto start = BenchmarkSuite::Clock::now();
+    BenchmarkResult& result = suite.measure(name.c_str(), frames, [&] {
+        window->waitForNextFrame();
+        if (pipeline) {
+            pipeline->update(options.width, options.height, window->inputEvents());
+            pipeline->acquire().replay(*window, &renderer);
+            pipeline->release();
+        } else {
+            commands.reset();
+            scene.record(commands, info);
+            ++info.frame;
+            commands.replay(*window, &renderer);
+        }
+        window->swapBuffers();
+    });
+    glFinish();
+    fps = (frames + 1) / (BenchmarkSuite::nanosecondsSince(start) / 1e9);
+    result.addMetric("fps", fps);
+    if (singleThreadFPS)
+        result.addMetric("speedup", fps / singleThreadFPS);
+    if (pipeline) {
+        FramePipelineStats stats = pipeline->takeStats();
+        result.addMetric("record_ms", stats.frames ? 1e3 * stats.recordSeconds / stats.frames : 0);
+        result.addMetric("recorder_wait_pct", stats.frames ? 100.0 * stats.recorderStalls / stats.frames : 0);
+        result.addMetric("replay_wait_pct", stats.frames ? 100.0 * stats.replayStalls / stats.frames : 0);
+    }
+}
+
+void benchmarkPipeline(BenchmarkSuite& suite, const Options& options)
+{
+    double singleThreadFPS = 0;
+    double fps = 0;
+    if (suite.shouldRun("pipeline/single_thread"))
+        benchmarkPipeline(suite, options, 0, singleThreadFPS, 0);
+    for (unsigned framesAhead : { 1, 2 }) {
+        if (suite.shouldRun(("pipeline/frames_ahead_" + std::to_string(framesAhead)).c_str()))
+            benchmarkPipeline(suite, options, framesAhead, fps, singleThreadFPS);
+    }
+}
+
+struct Benchmark {
+    const char* name;
+    void (*run)(BenchmarkSuite&, const Options&);
+};
+
+const Benchmark benchmarks[] = {
+    { "window_init", benchmarkWindowInit },
+    { "clear_swap", benchmarkClearSwap },
+    { "frame_latency", benchmarkFrameLatency },
+    { "low_latency", benchmarkLowLatency },
+    { "input_latency", benchmarkInputLatency },
+    { "capture", benchmarkCapture },
+    { "shader_startup", benchmarkShaderStartup },
+    { "batch", benchmarkBatchRenderer },
+    { "atlas", benchmarkAtlas },
+    { "windows", benchmarkWindows },
+    { "startup", benchmarkStartup },
+    { "renderer_probe", benchmarkRendererProbe },
+    { "layers", benchmarkLayers },
+    { "pipeline", benchmarkPipeline },
+};
+
+void usage(const char* program)
+{
+    fprintf(stderr, "Usage: %s [--backend wayland|headless] [--filter <substring>] [--scale <factor>] [--output <file.json>]\n", program);
+    fprintf(stderr, "Runs the LearningGLES benchmarks and writes the results as JSON (to stdout by default).\n");
+    exit(1);
+}
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+    Options options;
+    BenchmarkSuite suite("LearningGLES");
+    const char* output = nullptr;
+
+    for (int i = 1; i < argc; ++i) {
+        if (!strcmp(argv[i], "--backend") && i + 1 < argc) {
+            ++i;
+            if (!strcmp(argv[i], "wayland"))
+                options.backend = WindowBackend::Wayland;
+            else if (!strcmp(argv[i], "headless"))
+                options.backend = WindowBackend::Headless;
+            else
+                usage(argv[0]);
+        } else if (!strcmp(argv[i], "--filter") && i + 1 < argc)
+            suite.setFilter(argv[++i]);
+        else if (!strcmp(argv[i], "--scale") && i + 1 < argc)
+            options.scale = atof(argv[++i]);
+        else if (!strcmp(argv[i], "--output") && i + 1 < argc)
+            output = argv[++i];
+        else
+            usage(argv[0]);
+    }
+
+    {
+        std::unique_ptr<Window> window = createWindow(options);
+        suite.setContext("backend", window->backendName());
+        suite.setContext("renderer", reinterpret_cast<const char*>(glGetString(GL_RENDERER)));
+        suite.setContext("version", reinterpret_cast<const char*>(glGetString(GL_VERSION)));
+        suite.setContext("resolution", std::to_string(options.width) + "x" + std::to_string(options.height));
+    }
+
+    for (auto& benchmark : benchmarks) {
+        if (suite.shouldRun(benchmark.name))
+            benchmark.run(suite, options);
+    }
+
+    suite.printSummary(stderr);
+
+    FILE* file = output ? fopen(output, "w") : stdout;
+    if (!file) {
+        fprintf(stderr, "Can't open %s for writing.\n", output);
+        return 1;
+    }
+    suite.writeJSON(file);
+    if (output)
+        fclose(file);
+    return 0;
+}
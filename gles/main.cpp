@@ -1,22 +1,305 @@
-#include "WaylandWindow.h"
+#include "CommandBuffer.h"
+#include "FramePipeline.h"
+#include "Window.h"
 #include <GLES2/gl2.h>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
 
 using namespace LearningGLES;
 
-static void draw(WaylandWindow& window)
+// With --layers, the background and a HUD showing the frame rate are layers of their own,
+// redrawn only when they change, and the window only holds the square over transparent pixels.
+struct Layers {
+    std::unique_ptr<Layer> background;
+    std::unique_ptr<Layer> hud;
+    bool backgroundDrawn { false };
+    unsigned hudFrames { 0 };
+    int64_t hudStart { 0 };
+};
+
+static const unsigned hudWidth = 256;
+static const unsigned hudHeight = 48;
+static const unsigned hudMaxFPS = 240;
+
+static void updateLayers(Window& window, Layers& layers)
 {
-    glClearColor(1.0, 0.0, 0.0, 0.5);
+    GLState& state = window.glState();
+    if (layers.background->width() != window.surfaceWidth() || layers.background->height() != window.surfaceHeight()) {
+        layers.background->resize(window.surfaceWidth(), window.surfaceHeight());
+        layers.backgroundDrawn = false;
+    }
+    // Synchronized, so it changes size in the same frame as the window.
+    if (!layers.backgroundDrawn) {
+        layers.background->makeCurrent();
+        state.clearColor(1.0, 0.0, 0.0, 0.5);
+        glClear(GL_COLOR_BUFFER_BIT);
+        layers.background->commit();
+        layers.backgroundDrawn = true;
+    }
+
+    ++layers.hudFrames;
+    int64_t now = FrameProfiler::now();
+    if (layers.hudStart && now - layers.hudStart < 1000000000)
+        return;
+    double fps = layers.hudStart ? layers.hudFrames * 1e9 / (now - layers.hudStart) : 0;
+    unsigned bar = fps < hudMaxFPS ? static_cast<unsigned>(fps * (hudWidth - 16) / hudMaxFPS) : hudWidth - 16;
+    layers.hud->makeCurrent();
+    state.clearColor(0.05, 0.05, 0.05, 0.75);
+    glClear(GL_COLOR_BUFFER_BIT);
+    state.enable(GL_SCISSOR_TEST);
+    state.scissor(8, 16, bar, hudHeight - 32);
+    state.clearColor(0.0, 0.75, 0.0, 1.0);
     glClear(GL_COLOR_BUFFER_BIT);
-    eglSwapBuffers(window.eglDisplay(), window.eglSurface());
+    state.disable(GL_SCISSOR_TEST);
+    layers.hud->commit();
+    layers.hudFrames = 0;
+    layers.hudStart = now;
+}
+
+// A static background with a square moving over it, so only a small part of each frame changes.
+// With layers, the window only holds the square over transparent pixels.
+static void recordScene(CommandBuffer& commands, const FrameInfo& frame, bool layers)
+{
+    static Rect square = { 0, 0, 100, 100 };
+    static int dx = 4;
+    static int dy = 3;
+
+    commands.addDamage(square);
+    // The square follows the pointer while it moves, and bounces around otherwise.
+    const InputEvent* motion = nullptr;
+    for (auto& event : frame.inputs) {
+        if (event.type == InputEvent::Type::PointerMotion)
+            motion = &event;
+    }
+    if (motion) {
+        square.x = static_cast<int>(motion->x) - square.width / 2;
+        square.y = static_cast<int>(motion->y) - square.height / 2;
+    } else {
+        square.x += dx;
+        square.y += dy;
+        if (square.x < 0 || square.x + square.width > static_cast<int>(frame.width))
+            dx = -dx;
+        if (square.y < 0 || square.y + square.height > static_cast<int>(frame.height))
+            dy = -dy;
+    }
+    commands.addDamage(square);
+
+    Rect all = { 0, 0, static_cast<int>(frame.width), static_cast<int>(frame.height) };
+    if (layers)
+        commands.fill(all, 0.0, 0.0, 0.0, 0.0);
+    else
+        commands.fill(all, 0.5, 0.0, 0.0, 0.5);
+    commands.fill(square, 0.0, 1.0, 0.0, 1.0);
+}
+
+static void usage(const char* program)
+{
+    fprintf(stderr, "Usage: %s [--vsync | --fps <n> | --unthrottled | --low-latency <frames in flight>]\n"
+        "          [--backend wayland|wayland-shm|headless|auto]\n"
+        "          [--dynamic-resolution <min scale>] [--layers] [--pipeline <frames ahead>]\n"
+        "          [--frames <n>] [--profile <trace.json>] [--capture <video.y4m>]\n", program);
+    exit(1);
 }
 
 int main(int argc, char* argv[])
 {
-    WaylandWindow window("green", 1280, 720);
+    int64_t startTime = FrameProfiler::now();
+    FramePacing pacing = FramePacing::VSync;
+    unsigned fps = 60;
+    unsigned framesInFlight = 1;
+    WindowBackend backend = WindowBackend::Default;
+    unsigned maxFrames = 0;
+    const char* profilePath = nullptr;
+    const char* capturePath = nullptr;
+    double minScale = 0;
+    bool useLayers = false;
+    unsigned framesAhead = 0;
+    for (int i = 1; i < argc; ++i) {
+        if (!strcmp(argv[i], "--vsync"))
+            pacing = FramePacing::VSync;
+        else if (!strcmp(argv[i], "--fps") && i + 1 < argc) {
+            pacing = FramePacing::CappedFPS;
+            fps = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--unthrottled"))
+            pacing = FramePacing::Unthrottled;
+        else if (!strcmp(argv[i], "--low-latency") && i + 1 < argc) {
+            pacing = FramePacing::LowLatency;
+            framesInFlight = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--backend") && i + 1 < argc) {
+            ++i;
+            if (!strcmp(argv[i], "wayland"))
+                backend = WindowBackend::Wayland;
+            else if (!strcmp(argv[i], "wayland-shm"))
+                backend = WindowBackend::WaylandShm;
+            else if (!strcmp(argv[i], "headless"))
+                backend = WindowBackend::Headless;
+            else if (!strcmp(argv[i], "auto"))
+                backend = WindowBackend::Auto;
+            else
+                usage(argv[0]);
+        } else if (!strcmp(argv[i], "--frames") && i + 1 < argc)
+            maxFrames = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--profile") && i + 1 < argc)
+            profilePath = argv[++i];
+        else if (!strcmp(argv[i], "--capture") && i + 1 < argc)
+            capturePath = argv[++i];
+        else if (!strcmp(argv[i], "--dynamic-resolution") && i + 1 < argc) {
+            minScale = atof(argv[++i]);
+            if (minScale <= 0 || minScale > 1)
+                usage(argv[0]);
+        } else if (!strcmp(argv[i], "--layers"))
+            useLayers = true;
+        else if (!strcmp(argv[i], "--pipeline") && i + 1 < argc) {
+            framesAhead = atoi(argv[++i]);
+            if (!framesAhead || framesAhead > FramePipeline::maxFramesAhead)
+                usage(argv[0]);
+        } else
+            usage(argv[0]);
+    }
+
+    std::unique_ptr<Window> windowPtr = Window::create("green", 1280, 720, backend);
+    if (!windowPtr)
+        return 1;
+    Window& window = *windowPtr;
+    window.frameScheduler().setPacing(pacing, fps);
+    window.frameScheduler().setMaxFramesInFlight(framesInFlight);
+    if (minScale) {
+        window.resolutionScaler().setEnabled(true);
+        window.resolutionScaler().setMinScale(minScale);
+    }
+    printf("Using the %s backend\n", window.backendName());
+
+    // Destroyed before the window, as they must.
+    Layers layers;
+    if (useLayers) {
+        layers.background = window.createLayer(LayerPlacement::Below, LayerSync::Synchronized, 0, 0, window.surfaceWidth(), window.surfaceHeight());
+        layers.hud = window.createLayer(LayerPlacement::Above, LayerSync::Desynchronized, 16, 16, hudWidth, hudHeight);
+        if (!layers.background || !layers.hud) {
+            printf("The %s backend has no layers, drawing everything in the window\n", window.backendName());
+            useLayers = false;
+        }
+    }
+
+    // Drained every frame, so the profiler's ring buffer never overflows however long we run.
+    std::vector<FrameRecord> records;
+    if (profilePath)
+        window.setProfilingEnabled(true);
+    if (capturePath && !window.startCapture(capturePath, pacing == FramePacing::CappedFPS ? fps : 60)) {
+        fprintf(stderr, "Cannot open %s\n", capturePath);
+        return 1;
+    }
 
-    while (true) {
+    // Frames are recorded, then replayed: on this thread, or with --pipeline on a recorder
+    // thread running ahead of this one.
+    auto recordFrame = [useLayers](CommandBuffer& commands, const FrameInfo& frame) {
+        recordScene(commands, frame, useLayers);
+    };
+    std::unique_ptr<FramePipeline> pipeline;
+    if (framesAhead)
+        pipeline.reset(new FramePipeline(recordFrame, framesAhead));
+    CommandBuffer commands;
+    FrameInfo frameInfo;
+
+    auto lastReport = FrameScheduler::Clock::now();
+    for (unsigned frame = 0; !maxFrames || frame < maxFrames; ++frame) {
+        window.waitForNextFrame();
         window.processInputs();
-        draw(window);
+        if (useLayers)
+            updateLayers(window, layers);
+        if (pipeline) {
+            pipeline->update(window.width(), window.height(), window.inputEvents());
+            pipeline->acquire().replay(window, nullptr);
+            pipeline->release();
+        } else {
+            frameInfo.frame = frame;
+            frameInfo.width = window.width();
+            frameInfo.height = window.height();
+            frameInfo.inputs = window.inputEvents();
+            commands.reset();
+            recordFrame(commands, frameInfo);
+            commands.replay(window, nullptr);
+        }
+        window.swapBuffers();
+        if (!frame) {
+            window.display().recordStartupPhase("first_frame", startTime);
+            printf("Startup:\n");
+            window.display().printStartupPhases(stdout);
+        }
+
+        auto now = FrameScheduler::Clock::now();
+        if (now - lastReport >= std::chrono::seconds(1)) {
+            FrameStats stats = window.frameScheduler().takeStats();
+            printf("rendered %.1f fps, presented %.1f fps, CPU %.1f%%\n",
+                stats.framesRendered / stats.elapsedSeconds,
+                stats.framesPresented / stats.elapsedSeconds,
+                100 * stats.cpuSeconds / stats.elapsedSeconds);
+            GLStateStats state = window.glState().takeStats();
+            if (stats.framesRendered) {
+                printf("GL state calls per frame: %.1f issued, %.1f filtered\n",
+                    static_cast<double>(state.issued) / stats.framesRendered,
+                    static_cast<double>(state.filtered) / stats.framesRendered);
+            }
+            FrameQueueStats queue = window.frameQueue().takeStats();
+            if (queue.frames) {
+                printf("GPU queue depth %.2f (max %u), %.1f%% of frames waited, latency %.2f ms (max %.2f ms)\n",
+                    static_cast<double>(queue.depthSum) / queue.frames, queue.maxDepth, 100.0 * queue.waits / queue.frames,
+                    queue.completed ? 1e3 * queue.latencySum / queue.completed : 0, 1e3 * queue.maxLatency);
+            }
+            if (window.capture()) {
+                FrameCaptureStats capture = window.capture()->takeStats();
+                printf("captured %.1f fps, encoded %.1f fps, dropped %.1f fps, %.3f ms per frame to capture, %.3f ms to encode\n",
+                    capture.captured / stats.elapsedSeconds, capture.encoded / stats.elapsedSeconds, capture.dropped / stats.elapsedSeconds,
+                    capture.frames ? 1e3 * capture.captureSeconds / capture.frames : 0,
+                    capture.encoded ? 1e3 * capture.encodeSeconds / capture.encoded : 0);
+            }
+            ResolutionStats resolution = window.resolutionScaler().takeStats();
+            if (resolution.frames) {
+                printf("render scale %.3f (min %.3f, %llu changes), %.2f ms per frame to draw\n",
+                    resolution.scale, resolution.minScale, static_cast<unsigned long long>(resolution.changes),
+                    1e3 * resolution.frameSecondsSum / resolution.frames);
+            }
+            if (pipeline) {
+                FramePipelineStats pipelineStats = pipeline->takeStats();
+                if (pipelineStats.frames) {
+                    printf("recorded in %.3f ms per frame, recorder waited %.1f%% of frames (%.2f ms), GL thread %.1f%% (%.2f ms)\n",
+                        1e3 * pipelineStats.recordSeconds / pipelineStats.frames,
+                        100.0 * pipelineStats.recorderStalls / pipelineStats.frames,
+                        pipelineStats.recorderStalls ? 1e3 * pipelineStats.recorderStallSeconds / pipelineStats.recorderStalls : 0,
+                        100.0 * pipelineStats.replayStalls / pipelineStats.frames,
+                        pipelineStats.replayStalls ? 1e3 * pipelineStats.replayStallSeconds / pipelineStats.replayStalls : 0);
+                }
+            }
+            ResizeStats resizes = window.takeResizeStats();
+            if (resizes.requested) {
+                printf("resized %.1f times/s for %.1f requests/s\n",
+                    resizes.applied / stats.elapsedSeconds, resizes.requested / stats.elapsedSeconds);
+            }
+            lastReport = now;
+        }
+
+        FrameRecord record;
+        while (window.profiler() && window.profiler()->pop(record))
+            records.push_back(record);
+    }
+
+    if (capturePath) {
+        window.makeCurrent();
+        window.stopCapture();
+        printf("Wrote the capture to %s\n", capturePath);
+    }
+
+    if (profilePath) {
+        FrameProfiler::printHistogram(stdout, records);
+        FILE* file = fopen(profilePath, "w");
+        if (!file) {
+            fprintf(stderr, "Cannot open %s\n", profilePath);
+            return 1;
+        }
+        FrameProfiler::writeChromeTrace(file, records);
+        fclose(file);
+        printf("Wrote %zu frames to %s\n", records.size(), profilePath);
     }
 
     return 0;
@@ -0,0 +1,235 @@
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "bench.h"
+
+struct summary {
+    double min;
+    double max;
+    double mean;
+    double stddev;
+    double p50;
+    double p90;
+    double p99;
+};
+
+double bench_now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+void bench_suite_init(struct bench_suite *suite, const char *name)
+{
+    char timestamp[32];
+    time_t now = time(NULL);
+
+    memset(suite, 0, sizeof(*suite));
+    suite->name = name;
+    strftime(timestamp, sizeof(timestamp), "%Y-%m-%dT%H:%M:%SZ", gmtime(&now));
+    bench_suite_set_context(suite, "date", timestamp);
+}
+
+void bench_suite_finish(struct bench_suite *suite)
+{
+    size_t i;
+
+    for (i = 0; i < suite->count; ++i) {
+        free(suite->results[i]->samples);
+        free(suite->results[i]);
+    }
+    free(suite->results);
+    suite->results = NULL;
+    suite->count = suite->capacity = 0;
+}
+
+void bench_suite_set_context(struct bench_suite *suite, const char *key, const char *value)
+{
+    if (suite->context_count == BENCH_MAX_CONTEXT)
+        return;
+    suite->context_keys[suite->context_count] = key;
+    snprintf(suite->context_values[suite->context_count], sizeof(suite->context_values[0]), "%s", value);
+    suite->context_count++;
+}
+
+int bench_suite_should_run(const struct bench_suite *suite, const char *name)
+{
+    return !suite->filter || strstr(name, suite->filter);
+}
+
+struct bench_result *bench_suite_add(struct bench_suite *suite, const char *name)
+{
+    struct bench_result *result;
+
+    if (suite->count == suite->capacity) {
+        suite->capacity = suite->capacity ? 2 * suite->capacity : 16;
+        suite->results = realloc(suite->results, suite->capacity * sizeof(*suite->results));
+        if (!suite->results)
+            abort();
+    }
+
+    result = calloc(1, sizeof(*result));
+    if (!result)
+        abort();
+    snprintf(result->name, sizeof(result->name), "%s", name);
+    result->unit = "ns";
+    suite->results[suite->count++] = result;
+    return result;
+}
+
+void bench_result_add_sample(struct bench_result *result, double value)
+{
+    if (result->count == result->capacity) {
+        result->capacity = result->capacity ? 2 * result->capacity : 64;
+        result->samples = realloc(result->samples, result->capacity * sizeof(double));
+        if (!result->samples)
+            abort();
+    }
+    result->samples[result->count++] = value;
+}
+
+void bench_result_add_metric(struct bench_result *result, const char *name, double value)
+{
+    if (result->metric_count == BENCH_MAX_METRICS)
+        return;
+    result->metric_names[result->metric_count] = name;
+    result->metric_values[result->metric_count] = value;
+    result->metric_count++;
+}
+
+static int compare_doubles(const void *a, const void *b)
+{
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+    return x < y ? -1 : x > y;
+}
+
+static double sorted_percentile(const double *sorted, size_t count, double p)
+{
+    size_t rank;
+
+    if (!count)
+        return 0;
+    rank = (size_t)ceil(p / 100 * count);
+    if (rank > count)
+        rank = count;
+    return sorted[rank ? rank - 1 : 0];
+}
+
+static struct summary summarize(const struct bench_result *result)
+{
+    struct summary s = { 0 };
+    double *sorted;
+    double sum = 0, variance = 0;
+    size_t i;
+
+    if (!result->count)
+        return s;
+
+    sorted = malloc(result->count * sizeof(double));
+    if (!sorted)
+        abort();
+    memcpy(sorted, result->samples, result->count * sizeof(double));
+    qsort(sorted, result->count, sizeof(double), compare_doubles);
+
+    for (i = 0; i < result->count; ++i)
+        sum += sorted[i];
+    s.mean = sum / result->count;
+    for (i = 0; i < result->count; ++i)
+        variance += (sorted[i] - s.mean) * (sorted[i] - s.mean);
+    s.stddev = sqrt(variance / result->count);
+
+    s.min = sorted[0];
+    s.max = sorted[result->count - 1];
+    s.p50 = sorted_percentile(sorted, result->count, 50);
+    s.p90 = sorted_percentile(sorted, result->count, 90);
+    s.p99 = sorted_percentile(sorted, result->count, 99);
+    free(sorted);
+    return s;
+}
+
+double bench_result_percentile(const struct bench_result *result, double p)
+{
+    double *sorted;
+    double value;
+
+    if (!result->count)
+        return 0;
+    sorted = malloc(result->count * sizeof(double));
+    if (!sorted)
+        abort();
+    memcpy(sorted, result->samples, result->count * sizeof(double));
+    qsort(sorted, result->count, sizeof(double), compare_doubles);
+    value = sorted_percentile(sorted, result->count, p);
+    free(sorted);
+    return value;
+}
+
+void bench_suite_print_summary(const struct bench_suite *suite, FILE *file)
+{
+    size_t i;
+    int m;
+
+    for (i = 0; i < suite->count; ++i) {
+        const struct bench_result *result = suite->results[i];
+        struct summary s = summarize(result);
+
+        fprintf(file, "%-32s p50 %12.1f %s  p99 %12.1f %s", result->name, s.p50, result->unit, s.p99, result->unit);
+        for (m = 0; m < result->metric_count; ++m)
+            fprintf(file, "  %s %.2f", result->metric_names[m], result->metric_values[m]);
+        fputc('\n', file);
+    }
+}
+
+static void write_string(FILE *file, const char *string)
+{
+    fputc('"', file);
+    for (; *string; ++string) {
+        if (*string == '"' || *string == '\\')
+            fputc('\\', file);
+        if ((unsigned char)*string >= 0x20)
+            fputc(*string, file);
+    }
+    fputc('"', file);
+}
+
+void bench_suite_write_json(const struct bench_suite *suite, FILE *file)
+{
+    size_t i;
+    int c, m;
+
+    fprintf(file, "{\n  \"suite\": ");
+    write_string(file, suite->name);
+    fprintf(file, ",\n  \"context\": {");
+    for (c = 0; c < suite->context_count; ++c) {
+        fprintf(file, "%s\n    ", c ? "," : "");
+        write_string(file, suite->context_keys[c]);
+        fprintf(file, ": ");
+        write_string(file, suite->context_values[c]);
+    }
+    fprintf(file, "\n  },\n  \"benchmarks\": [");
+
+    for (i = 0; i < suite->count; ++i) {
+        const struct bench_result *result = suite->results[i];
+        struct summary s = summarize(result);
+
+        fprintf(file, "%s\n    {\n      \"name\": ", i ? "," : "");
+        write_string(file, result->name);
+        fprintf(file, ",\n      \"unit\": ");
+        write_string(file, result->unit);
+        fprintf(file, ",\n      \"count\": %zu", result->count);
+        fprintf(file, ",\n      \"min\": %.3f,\n      \"mean\": %.3f,\n      \"p50\": %.3f,\n      \"p90\": %.3f,\n      \"p99\": %.3f,\n      \"max\": %.3f,\n      \"stddev\": %.3f",
+                s.min, s.mean, s.p50, s.p90, s.p99, s.max, s.stddev);
+        for (m = 0; m < result->metric_count; ++m) {
+            fprintf(file, ",\n      ");
+            write_string(file, result->metric_names[m]);
+            fprintf(file, ": %.3f", result->metric_values[m]);
+        }
+        fprintf(file, "\n    }");
+    }
+
+    fprintf(file, "\n  ]\n}\n");
+}
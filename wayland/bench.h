@@ -0,0 +1,54 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <stddef.h>
+#include <stdio.h>
+
+#define BENCH_MAX_METRICS 4
+#define BENCH_MAX_CONTEXT 8
+
+// Samples of one benchmark. Timings are always in nanoseconds.
+struct bench_result {
+    char name[64];
+    const char *unit;
+    double *samples;
+    size_t count;
+    size_t capacity;
+    int metric_count;
+    const char *metric_names[BENCH_MAX_METRICS];
+    double metric_values[BENCH_MAX_METRICS];
+};
+
+// Collects benchmark samples and writes them as JSON with percentiles, in the same layout as
+// the LearningGLES benchmarks, so runs on different commits can be compared by a script.
+struct bench_suite {
+    const char *name;
+    const char *filter;
+    int context_count;
+    const char *context_keys[BENCH_MAX_CONTEXT];
+    char context_values[BENCH_MAX_CONTEXT][64];
+    struct bench_result **results;
+    size_t count;
+    size_t capacity;
+};
+
+void bench_suite_init(struct bench_suite *suite, const char *name);
+void bench_suite_finish(struct bench_suite *suite);
+void bench_suite_set_context(struct bench_suite *suite, const char *key, const char *value);
+// Only benchmarks whose name contains the filter run. A NULL filter runs everything.
+int bench_suite_should_run(const struct bench_suite *suite, const char *name);
+// The returned result stays valid until bench_suite_finish().
+struct bench_result *bench_suite_add(struct bench_suite *suite, const char *name);
+
+void bench_result_add_sample(struct bench_result *result, double value);
+void bench_result_add_metric(struct bench_result *result, const char *name, double value);
+// Nearest-rank percentile of the samples, `p` in [0, 100].
+double bench_result_percentile(const struct bench_result *result, double p);
+
+// One line per benchmark, for humans.
+void bench_suite_print_summary(const struct bench_suite *suite, FILE *file);
+void bench_suite_write_json(const struct bench_suite *suite, FILE *file);
+
+double bench_now_ns();
+
+#endif
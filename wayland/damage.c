@@ -0,0 +1,164 @@
+#include <string.h>
+#include <wayland-client.h>
+
+#include "damage.h"
+
+static int min(int a, int b)
+{
+    return a < b ? a : b;
+}
+
+static int max(int a, int b)
+{
+    return a > b ? a : b;
+}
+
+static long rect_area(const struct damage_rect *r)
+{
+    return (long)r->width * r->height;
+}
+
+static struct damage_rect rect_union(const struct damage_rect *a, const struct damage_rect *b)
+{
+    struct damage_rect u;
+
+    u.x = min(a->x, b->x);
+    u.y = min(a->y, b->y);
+    u.width = max(a->x + a->width, b->x + b->width) - u.x;
+    u.height = max(a->y + a->height, b->y + b->height) - u.y;
+    return u;
+}
+
+// Touching rectangles count too. Merging takes the bounding box, so it may over-approximate the
+// damage, which only costs repainting a few pixels that did not change.
+static int rects_overlap(const struct damage_rect *a, const struct damage_rect *b)
+{
+    return a->x <= b->x + b->width && b->x <= a->x + a->width
+        && a->y <= b->y + b->height && b->y <= a->y + a->height;
+}
+
+static void remove_rect(struct damage_region *region, int index)
+{
+    region->rects[index] = region->rects[--region->count];
+}
+
+static void insert_rect(struct damage_region *region, struct damage_rect rect)
+{
+    int i, best = 0;
+    long best_growth = -1;
+
+    // Merging may make the result overlap other rectangles, so keep going until it doesn't.
+    for (i = 0; i < region->count;) {
+        if (rects_overlap(&region->rects[i], &rect)) {
+            rect = rect_union(&region->rects[i], &rect);
+            remove_rect(region, i);
+            i = 0;
+        } else {
+            ++i;
+        }
+    }
+
+    if (region->count < DAMAGE_MAX_RECTS) {
+        region->rects[region->count++] = rect;
+        return;
+    }
+
+    for (i = 0; i < region->count; ++i) {
+        struct damage_rect u = rect_union(&region->rects[i], &rect);
+        long growth = rect_area(&u) - rect_area(&region->rects[i]) - rect_area(&rect);
+        if (best_growth < 0 || growth < best_growth) {
+            best_growth = growth;
+            best = i;
+        }
+    }
+    rect = rect_union(&region->rects[best], &rect);
+    remove_rect(region, best);
+    insert_rect(region, rect);
+}
+
+void damage_region_clear(struct damage_region *region)
+{
+    region->count = 0;
+}
+
+void damage_region_add(struct damage_region *region, int x, int y, int width, int height, int buffer_width, int buffer_height)
+{
+    struct damage_rect rect;
+
+    rect.x = max(x, 0);
+    rect.y = max(y, 0);
+    rect.width = min(x + width, buffer_width) - rect.x;
+    rect.height = min(y + height, buffer_height) - rect.y;
+    if (rect.width <= 0 || rect.height <= 0)
+        return;
+
+    insert_rect(region, rect);
+}
+
+void damage_region_add_region(struct damage_region *region, const struct damage_region *other)
+{
+    int i;
+
+    for (i = 0; i < other->count; ++i)
+        insert_rect(region, other->rects[i]);
+}
+
+void damage_region_set_full(struct damage_region *region, int width, int height)
+{
+    region->count = 1;
+    region->rects[0].x = 0;
+    region->rects[0].y = 0;
+    region->rects[0].width = width;
+    region->rects[0].height = height;
+}
+
+int damage_region_is_empty(const struct damage_region *region)
+{
+    return region->count == 0;
+}
+
+long damage_region_area(const struct damage_region *region)
+{
+    long area = 0;
+    int i;
+
+    for (i = 0; i < region->count; ++i)
+        area += rect_area(&region->rects[i]);
+    return area;
+}
+
+void damage_region_emit(const struct damage_region *region, struct wl_surface *surface)
+{
+    int use_buffer_damage = wl_surface_get_version(surface) >= WL_SURFACE_DAMAGE_BUFFER_SINCE_VERSION;
+    int i;
+
+    for (i = 0; i < region->count; ++i) {
+        const struct damage_rect *r = &region->rects[i];
+        if (use_buffer_damage)
+            wl_surface_damage_buffer(surface, r->x, r->y, r->width, r->height);
+        else
+            wl_surface_damage(surface, r->x, r->y, r->width, r->height);
+    }
+}
+
+void damage_history_push(struct damage_history *history, const struct damage_region *region)
+{
+    history->regions[history->frames % DAMAGE_HISTORY_FRAMES] = *region;
+    history->frames++;
+}
+
+void damage_history_repaint_region(const struct damage_history *history, unsigned age, const struct damage_region *damage,
+                                   int width, int height, struct damage_region *out)
+{
+    unsigned i;
+
+    // A buffer that is `age` frames old misses the damage of the last age - 1 frames.
+    if (age == 0 || age > DAMAGE_HISTORY_FRAMES || age - 1 > history->frames) {
+        damage_region_set_full(out, width, height);
+        return;
+    }
+
+    *out = *damage;
+    for (i = 1; i < age; ++i)
+        damage_region_add_region(out, &history->regions[(history->frames - i) % DAMAGE_HISTORY_FRAMES]);
+}
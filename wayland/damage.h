@@ -0,0 +1,51 @@
+#ifndef DAMAGE_H
+#define DAMAGE_H
+
+#include <stdint.h>
+
+struct wl_surface;
+
+#define DAMAGE_MAX_RECTS 8
+// How many past frames are remembered for buffer age repair.
+#define DAMAGE_HISTORY_FRAMES 8
+
+struct damage_rect {
+    int x;
+    int y;
+    int width;
+    int height;
+};
+
+// A small set of buffer-space rectangles. Overlapping rectangles are merged on insertion, and
+// once DAMAGE_MAX_RECTS is reached new ones are merged into the one that grows the least.
+struct damage_region {
+    int count;
+    struct damage_rect rects[DAMAGE_MAX_RECTS];
+};
+
+// Damage of the last DAMAGE_HISTORY_FRAMES frames, to bring an older buffer up to date.
+struct damage_history {
+    uint64_t frames;
+    struct damage_region regions[DAMAGE_HISTORY_FRAMES];
+};
+
+void damage_region_clear(struct damage_region *region);
+// Adds a rectangle, clipped to the width x height buffer.
+void damage_region_add(struct damage_region *region, int x, int y, int width, int height, int buffer_width, int buffer_height);
+void damage_region_add_region(struct damage_region *region, const struct damage_region *other);
+void damage_region_set_full(struct damage_region *region, int width, int height);
+int damage_region_is_empty(const struct damage_region *region);
+// Total area of the rectangles. Overlaps are impossible after merging.
+long damage_region_area(const struct damage_region *region);
+
+// Posts the region with wl_surface.damage_buffer, or wl_surface.damage on compositors older
+// than version 4 (the two are equivalent for unscaled, untransformed buffers).
+void damage_region_emit(const struct damage_region *region, struct wl_surface *surface);
+
+void damage_history_push(struct damage_history *history, const struct damage_region *region);
+// Region to repaint in a buffer that is `age` frames old to make it match the latest frame,
+// `damage` being what changes in the frame being drawn now. Age 0 means unknown contents.
+void damage_history_repaint_region(const struct damage_history *history, unsigned age, const struct damage_region *damage,
+                                   int width, int height, struct damage_region *out);
+
+#endif
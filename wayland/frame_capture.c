@@ -0,0 +1,196 @@
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "frame_capture.h"
+
+static double now_seconds()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static uint8_t clamp_byte(int value)
+{
+    return value < 0 ? 0 : value > 255 ? 255 : value;
+}
+
+// BT.601 limited range, in 8.8 fixed point.
+static uint8_t luma(uint32_t pixel)
+{
+    int r = (pixel >> 16) & 0xFF, g = (pixel >> 8) & 0xFF, b = pixel & 0xFF;
+    return clamp_byte(((66 * r + 129 * g + 25 * b + 128) >> 8) + 16);
+}
+
+// Each chroma sample averages a 2x2 block of pixels.
+static void chroma(uint32_t a, uint32_t b, uint32_t c, uint32_t d, uint8_t *u, uint8_t *v)
+{
+    int red = (((a >> 16) & 0xFF) + ((b >> 16) & 0xFF) + ((c >> 16) & 0xFF) + ((d >> 16) & 0xFF) + 2) / 4;
+    int green = (((a >> 8) & 0xFF) + ((b >> 8) & 0xFF) + ((c >> 8) & 0xFF) + ((d >> 8) & 0xFF) + 2) / 4;
+    int blue = ((a & 0xFF) + (b & 0xFF) + (c & 0xFF) + (d & 0xFF) + 2) / 4;
+
+    *u = clamp_byte(((-38 * red - 74 * green + 112 * blue + 128) >> 8) + 128);
+    *v = clamp_byte(((112 * red - 94 * green - 18 * blue + 128) >> 8) + 128);
+}
+
+static void encode(struct frame_capture *capture, const uint32_t *pixels)
+{
+    int width = capture->width;
+    int height = capture->height;
+    int chroma_width = (width + 1) / 2;
+    int chroma_height = (height + 1) / 2;
+    uint8_t *y_plane = capture->yuv;
+    uint8_t *u_plane = y_plane + (size_t)width * height;
+    uint8_t *v_plane = u_plane + (size_t)chroma_width * chroma_height;
+    int x, y;
+
+    for (y = 0; y < height; ++y) {
+        for (x = 0; x < width; ++x)
+            y_plane[(size_t)y * width + x] = luma(pixels[(size_t)y * width + x]);
+    }
+    // Odd edges repeat the last row or column.
+    for (y = 0; y < chroma_height; ++y) {
+        const uint32_t *top = pixels + (size_t)2 * y * width;
+        const uint32_t *bottom = 2 * y + 1 < height ? top + width : top;
+        for (x = 0; x < chroma_width; ++x) {
+            int left = 2 * x;
+            int right = left + 1 < width ? left + 1 : left;
+            chroma(top[left], top[right], bottom[left], bottom[right],
+                   &u_plane[(size_t)y * chroma_width + x], &v_plane[(size_t)y * chroma_width + x]);
+        }
+    }
+
+    fputs("FRAME\n", capture->file);
+    fwrite(capture->yuv, 1, capture->yuv_size, capture->file);
+}
+
+static void *encoder_main(void *d)
+{
+    struct frame_capture *capture = d;
+
+    pthread_mutex_lock(&capture->mutex);
+    while (1) {
+        while (!capture->queued && !capture->quit)
+            pthread_cond_wait(&capture->ready, &capture->mutex);
+        // Frames already captured are still written when quitting.
+        if (!capture->queued)
+            break;
+        pthread_mutex_unlock(&capture->mutex);
+
+        double start = now_seconds();
+        encode(capture, capture->buffers[capture->head]);
+        double seconds = now_seconds() - start;
+
+        pthread_mutex_lock(&capture->mutex);
+        capture->head = (capture->head + 1) % FRAME_CAPTURE_BUFFERS;
+        capture->queued--;
+        capture->stats.encoded++;
+        capture->stats.encode_seconds += seconds;
+    }
+    pthread_mutex_unlock(&capture->mutex);
+    return NULL;
+}
+
+int frame_capture_init(struct frame_capture *capture, const char *path, int width, int height, int fps)
+{
+    int i, allocated = 1;
+
+    memset(capture, 0, sizeof(*capture));
+    capture->width = width;
+    capture->height = height;
+    capture->yuv_size = (size_t)width * height + 2 * (size_t)((width + 1) / 2) * ((height + 1) / 2);
+    capture->yuv = malloc(capture->yuv_size);
+    // Touched up front, so the first frames don't page fault on the rendering thread.
+    for (i = 0; i < FRAME_CAPTURE_BUFFERS; ++i) {
+        capture->buffers[i] = malloc((size_t)width * height * 4);
+        if (capture->buffers[i])
+            memset(capture->buffers[i], 0, (size_t)width * height * 4);
+        allocated = allocated && capture->buffers[i];
+    }
+    capture->file = fopen(path, "wb");
+    if (!capture->yuv || !allocated || !capture->file) {
+        fprintf(stderr, "Can't start capturing to %s\n", path);
+        goto fail;
+    }
+    fprintf(capture->file, "YUV4MPEG2 W%d H%d F%d:1 Ip A1:1 C420jpeg\n", width, height, fps);
+
+    pthread_mutex_init(&capture->mutex, NULL);
+    pthread_cond_init(&capture->ready, NULL);
+    if (pthread_create(&capture->thread, NULL, encoder_main, capture)) {
+        pthread_cond_destroy(&capture->ready);
+        pthread_mutex_destroy(&capture->mutex);
+        goto fail;
+    }
+    return 0;
+
+fail:
+    if (capture->file)
+        fclose(capture->file);
+    for (i = 0; i < FRAME_CAPTURE_BUFFERS; ++i)
+        free(capture->buffers[i]);
+    free(capture->yuv);
+    return -1;
+}
+
+void frame_capture_finish(struct frame_capture *capture)
+{
+    int i;
+
+    pthread_mutex_lock(&capture->mutex);
+    capture->quit = 1;
+    pthread_cond_signal(&capture->ready);
+    pthread_mutex_unlock(&capture->mutex);
+    pthread_join(capture->thread, NULL);
+
+    pthread_cond_destroy(&capture->ready);
+    pthread_mutex_destroy(&capture->mutex);
+    fclose(capture->file);
+    for (i = 0; i < FRAME_CAPTURE_BUFFERS; ++i)
+        free(capture->buffers[i]);
+    free(capture->yuv);
+}
+
+int frame_capture_push(struct frame_capture *capture, const void *pixels, int width, int height, int stride)
+{
+    double start = now_seconds();
+    int slot = -1;
+    int y;
+
+    pthread_mutex_lock(&capture->mutex);
+    capture->stats.frames++;
+    if (width == capture->width && height == capture->height && capture->queued < FRAME_CAPTURE_BUFFERS)
+        slot = (capture->head + capture->queued) % FRAME_CAPTURE_BUFFERS;
+    else
+        capture->stats.dropped++;
+    pthread_mutex_unlock(&capture->mutex);
+    if (slot < 0)
+        return -1;
+
+    // The slot is past the queue, so the encoder won't touch it until it is queued below.
+    if (stride == width * 4)
+        memcpy(capture->buffers[slot], pixels, (size_t)width * height * 4);
+    else {
+        for (y = 0; y < height; ++y)
+            memcpy(capture->buffers[slot] + (size_t)y * width, (const char *)pixels + (size_t)y * stride, (size_t)width * 4);
+    }
+
+    pthread_mutex_lock(&capture->mutex);
+    capture->queued++;
+    capture->stats.captured++;
+    capture->stats.copy_seconds += now_seconds() - start;
+    pthread_cond_signal(&capture->ready);
+    pthread_mutex_unlock(&capture->mutex);
+    return 0;
+}
+
+struct frame_capture_stats frame_capture_take_stats(struct frame_capture *capture)
+{
+    struct frame_capture_stats stats;
+
+    pthread_mutex_lock(&capture->mutex);
+    stats = capture->stats;
+    memset(&capture->stats, 0, sizeof(capture->stats));
+    pthread_mutex_unlock(&capture->mutex);
+    return stats;
+}
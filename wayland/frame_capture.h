@@ -0,0 +1,64 @@
+#ifndef FRAME_CAPTURE_H
+#define FRAME_CAPTURE_H
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#define FRAME_CAPTURE_BUFFERS 4
+
+struct frame_capture_stats {
+    // Frames offered to frame_capture_push().
+    unsigned frames;
+    // Frames copied and handed over to the encoder.
+    unsigned captured;
+    // Frames skipped because the encoder was behind, or because they no longer had the size
+    // of the recording.
+    unsigned dropped;
+    unsigned encoded;
+    // Time frame_capture_push() took on the calling thread, which is what capturing costs a frame.
+    double copy_seconds;
+    // Time the encoder thread spent converting and writing frames.
+    double encode_seconds;
+};
+
+// Records frames to a Y4M file. frame_capture_push() only copies the frame into one of a few
+// buffers, and an encoder thread converts it to YUV 4:2:0 and writes it. When every buffer is
+// still waiting for the encoder, the frame is dropped instead of waited for.
+struct frame_capture {
+    FILE *file;
+    int width;
+    int height;
+
+    pthread_t thread;
+    pthread_mutex_t mutex;
+    pthread_cond_t ready;
+    // Frames are 0xAARRGGBB pixels, tightly packed. Buffers [head, head + queued) wait for the
+    // encoder, in order, the one at head staying queued while it is encoded. The others are free.
+    uint32_t *buffers[FRAME_CAPTURE_BUFFERS];
+    int head;
+    int queued;
+    int quit;
+
+    // Encoder thread only.
+    uint8_t *yuv;
+    size_t yuv_size;
+
+    // Updated under the mutex, since both threads count.
+    struct frame_capture_stats stats;
+};
+
+// Records `width` x `height` frames to `path`. `fps` is only the rate written in the file header.
+// Returns -1 on failure.
+int frame_capture_init(struct frame_capture *capture, const char *path, int width, int height, int fps);
+// Writes the frames still queued and closes the file.
+void frame_capture_finish(struct frame_capture *capture);
+
+// Copies a frame of WL_SHM_FORMAT_ARGB8888 or XRGB8888 pixels, with `stride` bytes per row.
+// Returns -1 if it was dropped.
+int frame_capture_push(struct frame_capture *capture, const void *pixels, int width, int height, int stride);
+
+// Returns the stats since the last call.
+struct frame_capture_stats frame_capture_take_stats(struct frame_capture *capture);
+
+#endif
@@ -0,0 +1,644 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+
+#include "bench.h"
+#include "damage.h"
+#include "frame_capture.h"
+#include "os_compat.h"
+#include "pixel_kernels.h"
+#include "raster.h"
+#include "shm_arena.h"
+
+#define SHM_FORMAT_ARGB8888 0
+#define SHM_FORMAT_XBGR8888 0x34324258
+
+static const struct {
+    const char *name;
+    int width;
+    int height;
+} resolutions[] = {
+    { "720p", 1280, 720 },
+    { "4K", 3840, 2160 },
+};
+
+static const char *variants[] = { "scalar", "sse2", "avx2" };
+
+enum kernel {
+    KERNEL_FILL_SOLID,
+    KERNEL_FILL_GRADIENT,
+    KERNEL_BLEND_OVER,
+    KERNEL_CONVERT,
+    KERNEL_COUNT
+};
+
+static const char *kernel_names[KERNEL_COUNT] = { "fill_solid", "fill_gradient", "blend_over", "convert" };
+
+// Bytes each kernel reads and writes per pixel.
+static const int kernel_bytes_per_pixel[KERNEL_COUNT] = { 4, 4, 12, 8 };
+
+// Scales the number of iterations of every benchmark.
+static double scale = 1;
+
+static int iterations(int count)
+{
+    int scaled = (int)(count * scale);
+    return scaled > 0 ? scaled : 1;
+}
+
+static void run_kernel(const struct pixel_kernels *kernels, enum kernel kernel, uint32_t *dst, const uint32_t *src,
+                       int width, int height, int iteration)
+{
+    size_t count = (size_t)width * height;
+    int y;
+
+    switch (kernel) {
+    case KERNEL_FILL_SOLID:
+        kernels->fill_solid(dst, count, 0xFF000000 | iteration);
+        break;
+    case KERNEL_FILL_GRADIENT:
+        // Gradients are per row, like a typical UI background.
+        for (y = 0; y < height; ++y)
+            kernels->fill_gradient(dst + (size_t)y * width, width, 0xFF000000 | iteration, 0xFFFFFFFF);
+        break;
+    case KERNEL_BLEND_OVER:
+        kernels->blend_over(dst, src, count);
+        break;
+    case KERNEL_CONVERT:
+        pixel_convert(kernels, dst, SHM_FORMAT_XBGR8888, src, SHM_FORMAT_ARGB8888, count);
+        break;
+    default:
+        break;
+    }
+}
+
+static void bench_pixel_kernels(struct bench_suite *suite)
+{
+    size_t r, v;
+    int k, i;
+
+    for (r = 0; r < sizeof(resolutions) / sizeof(resolutions[0]); ++r) {
+        int width = resolutions[r].width;
+        int height = resolutions[r].height;
+        size_t size = (size_t)width * height * 4;
+        uint32_t *dst = NULL;
+        uint32_t *src = NULL;
+        size_t p;
+
+        for (k = 0; k < KERNEL_COUNT; ++k) {
+            for (v = 0; v < sizeof(variants) / sizeof(variants[0]); ++v) {
+                const struct pixel_kernels *kernels = pixel_kernels_get_variant(variants[v]);
+                struct bench_result *result;
+                char name[64];
+
+                snprintf(name, sizeof(name), "pixel/%s/%s/%s", kernel_names[k], resolutions[r].name, variants[v]);
+                if (!kernels || !bench_suite_should_run(suite, name))
+                    continue;
+
+                if (!dst) {
+                    dst = aligned_alloc(64, size);
+                    src = aligned_alloc(64, size);
+                    if (!dst || !src) {
+                        fprintf(stderr, "Failed to allocate %zu bytes\n", size);
+                        exit(1);
+                    }
+                    // Premultiplied, half transparent source.
+                    for (p = 0; p < (size_t)width * height; ++p)
+                        src[p] = 0x80000000 | ((p & 0x7F) << 16) | ((p >> 7) & 0x7F);
+                    memset(dst, 0xFF, size);
+                }
+
+                result = bench_suite_add(suite, name);
+                // Warm up page tables and caches.
+                run_kernel(kernels, k, dst, src, width, height, 0);
+                for (i = 0; i < iterations(50); ++i) {
+                    double start = bench_now_ns();
+                    run_kernel(kernels, k, dst, src, width, height, i);
+                    bench_result_add_sample(result, bench_now_ns() - start);
+                }
+                bench_result_add_metric(result, "gbps", (double)width * height * kernel_bytes_per_pixel[k] / bench_result_percentile(result, 50));
+            }
+        }
+
+        free(dst);
+        free(src);
+    }
+}
+
+// Client side cost of a new SHM buffer: the shared file and its mapping, then the page faults
+// taken when it is painted for the first time.
+static void bench_shm_buffers(struct bench_suite *suite)
+{
+    long page_size = sysconf(_SC_PAGESIZE);
+    size_t r;
+    int i;
+
+    for (r = 0; r < sizeof(resolutions) / sizeof(resolutions[0]); ++r) {
+        size_t size = (size_t)resolutions[r].width * resolutions[r].height * 4;
+        struct bench_result *create_map = NULL;
+        struct bench_result *first_touch = NULL;
+        char name[64];
+
+        snprintf(name, sizeof(name), "shm/create_map/%s", resolutions[r].name);
+        if (bench_suite_should_run(suite, name))
+            create_map = bench_suite_add(suite, name);
+        snprintf(name, sizeof(name), "shm/first_touch/%s", resolutions[r].name);
+        if (bench_suite_should_run(suite, name))
+            first_touch = bench_suite_add(suite, name);
+        if (!create_map && !first_touch)
+            continue;
+
+        for (i = 0; i < iterations(50); ++i) {
+            double start = bench_now_ns();
+            char *data;
+            size_t offset;
+            int fd;
+
+            fd = os_create_anonymous_file(size);
+            if (fd < 0) {
+                fprintf(stderr, "Failed to create file with %zu bytes: %m\n", size);
+                exit(1);
+            }
+            data = mmap(0, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+            if (data == MAP_FAILED) {
+                fprintf(stderr, "mmap failed: %m\n");
+                exit(1);
+            }
+            if (create_map)
+                bench_result_add_sample(create_map, bench_now_ns() - start);
+
+            start = bench_now_ns();
+            for (offset = 0; offset < size; offset += page_size)
+                data[offset] = 1;
+            if (first_touch)
+                bench_result_add_sample(first_touch, bench_now_ns() - start);
+
+            munmap(data, size);
+            close(fd);
+        }
+    }
+}
+
+// Buffers of a client with many small surfaces (icons, tooltips, text fields) and a few large ones.
+static const struct {
+    int width;
+    int height;
+} churn_buffers[] = {
+    { 32, 32 }, { 64, 64 }, { 128, 32 }, { 256, 256 }, { 300, 40 }, { 512, 128 }, { 640, 480 }, { 1280, 720 },
+    { 48, 48 }, { 96, 24 }, { 200, 200 }, { 400, 300 }, { 16, 16 }, { 800, 60 }, { 128, 128 }, { 1920, 1080 },
+};
+
+#define CHURN_BUFFER_COUNT (int)(sizeof(churn_buffers) / sizeof(churn_buffers[0]))
+
+static long minor_page_faults()
+{
+    struct rusage usage;
+
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_minflt;
+}
+
+static void touch_pages(char *data, size_t size, long page_size)
+{
+    size_t offset;
+
+    for (offset = 0; offset < size; offset += page_size)
+        data[offset] = 1;
+}
+
+enum churn_allocator {
+    CHURN_POOL_PER_BUFFER,
+    CHURN_ARENA,
+    CHURN_ARENA_HUGEPAGES,
+};
+
+// Client side cost of creating, painting and destroying a set of differently sized buffers,
+// either with a file and mapping per buffer (the wl_shm_pool per buffer path) or carved out of an
+// arena. The Wayland requests are left out: one pool per buffer adds a create and a destroy
+// request per buffer on top, the arena one wl_shm_pool overall.
+static void bench_shm_churn(struct bench_suite *suite, enum churn_allocator allocator)
+{
+    static const char *names[] = { "pool_per_buffer", "arena", "arena_hugepages" };
+    long page_size = sysconf(_SC_PAGESIZE);
+    struct bench_result *result;
+    struct shm_arena arena;
+    size_t sizes[CHURN_BUFFER_COUNT];
+    size_t total = 0;
+    long faults;
+    char name[64];
+    int i, b;
+
+    snprintf(name, sizeof(name), "shm/buffer_churn/%s", names[allocator]);
+    if (!bench_suite_should_run(suite, name))
+        return;
+
+    for (b = 0; b < CHURN_BUFFER_COUNT; ++b) {
+        sizes[b] = (size_t)churn_buffers[b].width * churn_buffers[b].height * 4;
+        total += sizes[b] + page_size;
+    }
+    if (allocator != CHURN_POOL_PER_BUFFER
+        && shm_arena_init(&arena, total, allocator == CHURN_ARENA_HUGEPAGES ? SHM_ARENA_HUGEPAGES : 0) < 0)
+        exit(1);
+
+    result = bench_suite_add(suite, name);
+    faults = minor_page_faults();
+    for (i = 0; i < iterations(200); ++i) {
+        double start = bench_now_ns();
+
+        if (allocator == CHURN_POOL_PER_BUFFER) {
+            for (b = 0; b < CHURN_BUFFER_COUNT; ++b) {
+                int fd = os_create_anonymous_file(sizes[b]);
+                char *data;
+
+                if (fd < 0) {
+                    fprintf(stderr, "Failed to create file with %zu bytes: %m\n", sizes[b]);
+                    exit(1);
+                }
+                data = mmap(0, sizes[b], PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+                if (data == MAP_FAILED) {
+                    fprintf(stderr, "mmap failed: %m\n");
+                    exit(1);
+                }
+                touch_pages(data, sizes[b], page_size);
+                munmap(data, sizes[b]);
+                close(fd);
+            }
+        } else {
+            long offsets[CHURN_BUFFER_COUNT];
+
+            for (b = 0; b < CHURN_BUFFER_COUNT; ++b) {
+                offsets[b] = shm_arena_alloc(&arena, sizes[b]);
+                if (offsets[b] < 0) {
+                    fprintf(stderr, "SHM arena is full\n");
+                    exit(1);
+                }
+                touch_pages(arena.data + offsets[b], sizes[b], page_size);
+            }
+            for (b = 0; b < CHURN_BUFFER_COUNT; ++b)
+                shm_arena_free(&arena, offsets[b], sizes[b]);
+        }
+
+        bench_result_add_sample(result, bench_now_ns() - start);
+    }
+
+    bench_result_add_metric(result, "page_faults_per_buffer", (double)(minor_page_faults() - faults) / (iterations(200) * CHURN_BUFFER_COUNT));
+    bench_result_add_metric(result, "files_per_buffer", allocator == CHURN_POOL_PER_BUFFER ? 1 : 0);
+    if (allocator != CHURN_POOL_PER_BUFFER) {
+        bench_result_add_metric(result, "hugetlb", arena.hugepages);
+        shm_arena_finish(&arena);
+    }
+}
+
+static uint32_t next_random(uint32_t *seed)
+{
+    *seed = *seed * 1103515245 + 12345;
+    return (*seed >> 8) & 0xFFFFFF;
+}
+
+// A UI-like scene: a gradient background, then a mix of shaded triangles, translucent panels and
+// scaled images. The same pseudo-random sequence is used for every run.
+static void record_scene(struct raster *raster, int width, int height, const struct raster_texture *texture)
+{
+    uint32_t seed = 1;
+    int i, k;
+
+    {
+        float x[3] = { 0, (float)width, 0 };
+        float y[3] = { 0, 0, (float)height };
+        float x2[3] = { (float)width, (float)width, 0 };
+        float y2[3] = { 0, (float)height, (float)height };
+        uint32_t top[3] = { 0xFF101040, 0xFF101040, 0xFF000000 };
+        uint32_t bottom[3] = { 0xFF101040, 0xFF000000, 0xFF000000 };
+        raster_fill_triangle(raster, x, y, top);
+        raster_fill_triangle(raster, x2, y2, bottom);
+    }
+    for (i = 0; i < 2000; ++i) {
+        float cx = next_random(&seed) % width;
+        float cy = next_random(&seed) % height;
+        float x[3], y[3];
+        uint32_t color[3];
+
+        for (k = 0; k < 3; ++k) {
+            x[k] = cx + (int)(next_random(&seed) % 200) - 100;
+            y[k] = cy + (int)(next_random(&seed) % 200) - 100;
+            color[k] = 0xFF000000 | next_random(&seed);
+        }
+        raster_fill_triangle(raster, x, y, color);
+    }
+    // Drawn into locals first: the order arguments are evaluated in is unspecified.
+    for (i = 0; i < 200; ++i) {
+        int x = next_random(&seed) % width;
+        int y = next_random(&seed) % height;
+        int w = 50 + next_random(&seed) % 300;
+        int h = 20 + next_random(&seed) % 200;
+        raster_fill_rect(raster, x, y, w, h, 0x80202020);
+    }
+    for (i = 0; i < 100; ++i) {
+        int x = next_random(&seed) % width;
+        int y = next_random(&seed) % height;
+        int w = 32 + next_random(&seed) % 256;
+        int h = 32 + next_random(&seed) % 256;
+        raster_draw_texture(raster, x, y, w, h, texture);
+    }
+}
+
+// Frame time of the tile rasterizer against the number of threads, doubling up to the CPU count.
+static void bench_raster(struct bench_suite *suite)
+{
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    uint32_t texels[64 * 64];
+    struct raster_texture texture = { texels, 64, 64, 64, 0 };
+    size_t r;
+    int p, i;
+
+    for (p = 0; p < 64 * 64; ++p)
+        texels[p] = (p / 64 + p % 64) & 8 ? 0xFFFFFFFF : 0x80000040;
+
+    for (r = 0; r < sizeof(resolutions) / sizeof(resolutions[0]); ++r) {
+        int width = resolutions[r].width;
+        int height = resolutions[r].height;
+        struct raster_target target = { NULL, width, height, width };
+        double single_thread = 0;
+        int threads;
+
+        for (threads = 1;; threads = threads * 2 < cpus ? threads * 2 : cpus) {
+            struct bench_result *result;
+            struct thread_pool pool;
+            struct raster raster;
+            char name[64];
+
+            snprintf(name, sizeof(name), "raster/scene/%s/threads=%d", resolutions[r].name, threads);
+            if (bench_suite_should_run(suite, name)) {
+                if (!target.pixels)
+                    target.pixels = aligned_alloc(64, (size_t)width * height * 4);
+                if (!target.pixels || thread_pool_init(&pool, threads) < 0) {
+                    fprintf(stderr, "Failed to set up the rasterizer\n");
+                    exit(1);
+                }
+                raster_init(&raster, &pool);
+
+                result = bench_suite_add(suite, name);
+                for (i = 0; i < iterations(20) + 1; ++i) {
+                    double start = bench_now_ns();
+                    raster_begin(&raster, &target, 0, 0, width, height);
+                    record_scene(&raster, width, height, &texture);
+                    raster_end(&raster);
+                    // The first frame warms up the bins and page tables.
+                    if (i)
+                        bench_result_add_sample(result, bench_now_ns() - start);
+                }
+
+                bench_result_add_metric(result, "fps", 1e9 / bench_result_percentile(result, 50));
+                if (threads == 1)
+                    single_thread = bench_result_percentile(result, 50);
+                else if (single_thread)
+                    bench_result_add_metric(result, "speedup", single_thread / bench_result_percentile(result, 50));
+                bench_result_add_metric(result, "steals_per_frame", (double)pool.stats.steals / pool.stats.batches);
+
+                raster_finish(&raster);
+                thread_pool_finish(&pool);
+            }
+            if (threads >= cpus)
+                break;
+        }
+        free(target.pixels);
+    }
+}
+
+// Per-frame painting cost of main_shm.c's scene, a static background and HUD under a moving
+// square, drawn three ways: the whole single surface every frame, only the damaged part of it,
+// and with the background and HUD in layers of their own (-l), where a frame clears and fills
+// the square's old and new positions on a transparent surface and the HUD is repainted once a
+// second. Compositing the layers is left to the compositor and not measured.
+enum layers_mode {
+    LAYERS_SINGLE_FULL,
+    LAYERS_SINGLE_DAMAGE,
+    LAYERS_LAYERED,
+};
+
+static const char *layers_mode_names[] = { "single_full", "single_damage", "layered" };
+
+static void record_hud(struct raster *raster)
+{
+    raster_fill_rect(raster, 16, 16, 256, 48, 0xC0101010);
+    raster_fill_rect(raster, 24, 32, 120, 16, 0xFF00C000);
+}
+
+// The square bounces off the edges from a little outside of them.
+static void clip_rect(struct damage_rect *rect, int width, int height)
+{
+    int x1 = rect->x + rect->width < width ? rect->x + rect->width : width;
+    int y1 = rect->y + rect->height < height ? rect->y + rect->height : height;
+
+    rect->x = rect->x > 0 ? rect->x : 0;
+    rect->y = rect->y > 0 ? rect->y : 0;
+    rect->width = x1 - rect->x;
+    rect->height = y1 - rect->y;
+}
+
+static void bench_layers(struct bench_suite *suite)
+{
+    uint32_t texels[64 * 64];
+    struct raster_texture texture = { texels, 64, 64, 64, 0 };
+    int r, p;
+
+    for (p = 0; p < 64 * 64; ++p)
+        texels[p] = (p / 64 + p % 64) & 8 ? 0xFFFFFFFF : 0x80000040;
+
+    for (r = 0; r < (int)(sizeof(resolutions) / sizeof(resolutions[0])); ++r) {
+        int width = resolutions[r].width, height = resolutions[r].height;
+        struct raster_target target = { NULL, width, height, width };
+        double single_full = 0;
+        enum layers_mode mode;
+
+        for (mode = LAYERS_SINGLE_FULL; mode <= LAYERS_LAYERED; ++mode) {
+            struct bench_result *result;
+            struct thread_pool pool;
+            struct raster raster;
+            int x = 0, y = 0, dx = 7, dy = 5;
+            double pixels = 0;
+            char name[64];
+            int i, frames = iterations(120);
+
+            snprintf(name, sizeof(name), "layers/%s/%s", layers_mode_names[mode], resolutions[r].name);
+            if (!bench_suite_should_run(suite, name))
+                continue;
+            if (!target.pixels)
+                target.pixels = aligned_alloc(64, (size_t)width * height * 4);
+            if (!target.pixels || thread_pool_init(&pool, 0) < 0) {
+                fprintf(stderr, "Failed to set up the rasterizer\n");
+                exit(1);
+            }
+            raster_init(&raster, &pool);
+
+            result = bench_suite_add(suite, name);
+            for (i = 0; i < frames + 1; ++i) {
+                // The square's old and new positions, as main_shm.c damages them.
+                struct damage_rect rects[2] = { { x, y, 200, 200 }, { 0, 0, 200, 200 } };
+                double start = bench_now_ns();
+                int k, row;
+
+                x += dx;
+                y += dy;
+                if (x < 0 || x + 200 > width)
+                    dx = -dx;
+                if (y < 0 || y + 200 > height)
+                    dy = -dy;
+                rects[1].x = x;
+                rects[1].y = y;
+                clip_rect(&rects[0], width, height);
+                clip_rect(&rects[1], width, height);
+
+                if (mode == LAYERS_SINGLE_FULL) {
+                    raster_begin(&raster, &target, 0, 0, width, height);
+                    record_scene(&raster, width, height, &texture);
+                    record_hud(&raster);
+                    raster_fill_rect(&raster, x, y, 200, 200, 0xFF0000FF);
+                    raster_end(&raster);
+                    pixels += (double)width * height;
+                } else {
+                    for (k = 0; k < 2; ++k) {
+                        const struct damage_rect *rect = &rects[k];
+                        if (mode == LAYERS_LAYERED) {
+                            for (row = rect->y; row < rect->y + rect->height; ++row)
+                                memset(target.pixels + (size_t)row * width + rect->x, 0, (size_t)rect->width * 4);
+                        }
+                        raster_begin(&raster, &target, rect->x, rect->y, rect->width, rect->height);
+                        if (mode == LAYERS_SINGLE_DAMAGE) {
+                            record_scene(&raster, width, height, &texture);
+                            record_hud(&raster);
+                        }
+                        raster_fill_rect(&raster, x, y, 200, 200, 0xFF0000FF);
+                        raster_end(&raster);
+                        pixels += (double)rect->width * rect->height;
+                    }
+                    // The HUD layer, once a second at 60 fps.
+                    if (mode == LAYERS_LAYERED && i % 60 == 0) {
+                        raster_begin(&raster, &target, 16, 16, 256, 48);
+                        record_hud(&raster);
+                        raster_end(&raster);
+                        pixels += 256 * 48;
+                    }
+                }
+                // The first frame warms up the bins and page tables.
+                if (i)
+                    bench_result_add_sample(result, bench_now_ns() - start);
+            }
+
+            bench_result_add_metric(result, "pixels_per_frame", pixels / (frames + 1));
+            if (mode == LAYERS_SINGLE_FULL)
+                single_full = bench_result_percentile(result, 50);
+            else if (single_full)
+                bench_result_add_metric(result, "saved_pct", 100 * (1 - bench_result_percentile(result, 50) / single_full));
+
+            raster_finish(&raster);
+            thread_pool_finish(&pool);
+        }
+        free(target.pixels);
+    }
+}
+
+// Frames pushed to a capture at 60 fps, as main_shm.c does with -c. Samples are the time each
+// push takes on the rendering thread; encoding runs concurrently, into /dev/null.
+static void bench_capture(struct bench_suite *suite)
+{
+    int r;
+
+    for (r = 0; r < (int)(sizeof(resolutions) / sizeof(resolutions[0])); ++r) {
+        int width = resolutions[r].width, height = resolutions[r].height;
+        struct frame_capture capture;
+        struct frame_capture_stats stats;
+        struct bench_result *result;
+        uint32_t *pixels;
+        char name[64];
+        int i, frames = iterations(120);
+
+        snprintf(name, sizeof(name), "capture/%s", resolutions[r].name);
+        if (!bench_suite_should_run(suite, name))
+            continue;
+        pixels = malloc((size_t)width * height * 4);
+        if (!pixels || frame_capture_init(&capture, "/dev/null", width, height, 60) < 0) {
+            free(pixels);
+            continue;
+        }
+        for (i = 0; i < width * height; ++i)
+            pixels[i] = 0xFF000000 | (i * 2654435761u >> 8);
+
+        result = bench_suite_add(suite, name);
+        for (i = 0; i < frames; ++i) {
+            double start = bench_now_ns();
+            frame_capture_push(&capture, pixels, width, height, width * 4);
+            double elapsed = bench_now_ns() - start;
+            bench_result_add_sample(result, elapsed);
+            if (elapsed < 1e9 / 60)
+                usleep((useconds_t)((1e9 / 60 - elapsed) / 1000));
+        }
+        frame_capture_finish(&capture);
+        stats = capture.stats;
+        bench_result_add_metric(result, "encode_ms", stats.encoded ? 1000 * stats.encode_seconds / stats.encoded : 0);
+        bench_result_add_metric(result, "dropped", (double)stats.dropped / stats.frames);
+        free(pixels);
+    }
+}
+
+static void usage(const char *program)
+{
+    fprintf(stderr, "Usage: %s [-f filter] [-s scale] [-o output.json]\n", program);
+    fprintf(stderr, "Runs the SHM path benchmarks and writes the results as JSON (to stdout by default).\n");
+    exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+    struct bench_suite suite;
+    const char *output = NULL;
+    FILE *file;
+    int opt;
+
+    bench_suite_init(&suite, "wayland-shm");
+    while ((opt = getopt(argc, argv, "f:s:o:")) != -1) {
+        switch (opt) {
+        case 'f':
+            suite.filter = optarg;
+            break;
+        case 's':
+            scale = atof(optarg);
+            break;
+        case 'o':
+            output = optarg;
+            break;
+        default:
+            usage(argv[0]);
+        }
+    }
+
+    // Headless machines have no session, so no XDG_RUNTIME_DIR. Use the same kind of tmpfs.
+    setenv("XDG_RUNTIME_DIR", "/dev/shm", 0);
+    bench_suite_set_context(&suite, "pixel_kernels", pixel_kernels_get()->name);
+
+    bench_pixel_kernels(&suite);
+    bench_shm_buffers(&suite);
+    bench_shm_churn(&suite, CHURN_POOL_PER_BUFFER);
+    bench_shm_churn(&suite, CHURN_ARENA);
+    bench_shm_churn(&suite, CHURN_ARENA_HUGEPAGES);
+    bench_raster(&suite);
+    bench_layers(&suite);
+    bench_capture(&suite);
+
+    bench_suite_print_summary(&suite, stderr);
+
+    file = output ? fopen(output, "w") : stdout;
+    if (!file) {
+        fprintf(stderr, "Can't open %s for writing: %m\n", output);
+        return 1;
+    }
+    bench_suite_write_json(&suite, file);
+    if (output)
+        fclose(file);
+
+    bench_suite_finish(&suite);
+    return 0;
+}
@@ -1,6 +1,11 @@
+#include <errno.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
 #include <wayland-client.h>
 #include <wayland-egl.h>
 #include <EGL/egl.h>
@@ -28,6 +33,23 @@ static struct {
 static const int WIDTH = 1280;
 static const int HEIGHT = 720;
 
+// When main() started, in milliseconds of CLOCK_MONOTONIC.
+static double startup_time;
+
+static double now_ms()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+// EGL and Wayland phases run on two threads, so print when each ended to show the overlap.
+static void phase_done(const char *name, double start)
+{
+    double now = now_ms();
+    printf("[%7.2f ms] %s took %.2f ms\n", now - startup_time, name, now - start);
+}
+
 static void xdg_shell_ping(void *data, struct zxdg_shell_v6* shell, uint32_t serial)
 {
     zxdg_shell_v6_pong(shell, serial);
@@ -107,25 +129,31 @@ static const struct zxdg_toplevel_v6_listener xdg_toplevel_listener = {
     xdg_toplevel_close
 };
 
-static void init_wayland()
+static void connect_display()
 {
-    // 1 - connect to display
+    double start = now_ms();
     wl_data.display = wl_display_connect(0);
     if (!wl_data.display) {
         fprintf(stderr, "Failed to connect to wayland display :/\n");
         exit(1);
     }
     printf("Connected to display!\n");
+    phase_done("connect", start);
+}
+
+static void init_wayland()
+{
+    double start = now_ms();
 
-    // 2 - add registry listeners
+    // 1 - add registry listeners
     struct wl_registry *registry = wl_display_get_registry(wl_data.display);
     wl_registry_add_listener(registry, &listener, 0);
 
-    // 3 - we do a roundtrip to wait for a valid compositor
-    wl_display_dispatch(wl_data.display);
+    // 2 - the globals are announced before the reply to our sync, so one roundtrip binds them all
     wl_display_roundtrip(wl_data.display);
+    phase_done("registry", start);
 
-    // 4 - we should have a valid compositor set now
+    // 3 - we should have a valid compositor set now
     if (!wl_data.compositor) {
         fprintf(stderr, "No compositor :/\n");
         // FIXME: Doesn't this exit leave the display connected?
@@ -133,7 +161,7 @@ static void init_wayland()
     }
     printf("Compositor bound!\n");
 
-    // 5 - create a surface
+    // 4 - create a surface
     wl_data.surface = wl_compositor_create_surface(wl_data.compositor);
     if (!wl_data.surface) {
         fprintf(stderr, "Can't create surface :/\n");
@@ -141,7 +169,7 @@ static void init_wayland()
     }
     printf("Surface created!\n");
 
-    // 6 - create a xdg shell surface
+    // 5 - create a xdg shell surface
     wl_data.xdg_surface = zxdg_shell_v6_get_xdg_surface(wl_data.xdg_shell, wl_data.surface);
     if (!wl_data.xdg_surface) {
         fprintf(stderr, "Can't create xdg shell surface :/\n");
@@ -158,19 +186,104 @@ static void init_wayland()
     wl_surface_commit(wl_data.surface);
 }
 
+static const EGLint config_attribs[] = {
+    EGL_SURFACE_TYPE, EGL_WINDOW_BIT,
+    EGL_RED_SIZE, 8,
+    EGL_GREEN_SIZE, 8,
+    EGL_BLUE_SIZE, 8,
+    EGL_ALPHA_SIZE, 8,
+    EGL_RENDERABLE_TYPE, EGL_OPENGL_ES2_BIT,
+    EGL_NONE
+};
+
+// $XDG_CACHE_HOME/learning-gles/egl-config, or ~/.cache/learning-gles/egl-config, holding the
+// EGL vendor and version on the first line and the ID of the config picked on the second.
+static int config_cache_path(char *path, size_t size, int create_directories)
+{
+    const char *cache = getenv("XDG_CACHE_HOME");
+    const char *home = getenv("HOME");
+    int length;
+    if (cache && *cache)
+        length = snprintf(path, size, "%s/learning-gles/egl-config", cache);
+    else if (home && *home)
+        length = snprintf(path, size, "%s/.cache/learning-gles/egl-config", home);
+    else
+        return 0;
+    if (length < 0 || (size_t)length >= size)
+        return 0;
+
+    if (create_directories) {
+        // mkdir -p of everything up to the file name
+        for (char *slash = strchr(path + 1, '/'); slash; slash = strchr(slash + 1, '/')) {
+            *slash = 0;
+            int failed = mkdir(path, 0755) && errno != EEXIST;
+            *slash = '/';
+            if (failed)
+                return 0;
+        }
+    }
+    return 1;
+}
+
+// Whether the config still has everything config_attribs asks for, in case the driver now
+// numbers its configs differently.
+static int config_matches(EGLConfig config)
+{
+    for (const EGLint *attrib = config_attribs; *attrib != EGL_NONE; attrib += 2) {
+        EGLint value;
+        if (!eglGetConfigAttrib(egl_data.display, config, attrib[0], &value))
+            return 0;
+        if (attrib[0] == EGL_SURFACE_TYPE || attrib[0] == EGL_RENDERABLE_TYPE) {
+            if ((value & attrib[1]) != attrib[1])
+                return 0;
+        } else if (value < attrib[1])
+            return 0;
+    }
+    return 1;
+}
+
+static int load_cached_config(const char *driver)
+{
+    char path[4096], line[256];
+    EGLint id = 0, n = 0;
+    if (!config_cache_path(path, sizeof(path), 0))
+        return 0;
+    FILE *file = fopen(path, "r");
+    if (!file)
+        return 0;
+    int valid = fgets(line, sizeof(line), file) && !strcmp(line, driver) && fscanf(file, "%d", &id) == 1;
+    fclose(file);
+    if (!valid)
+        return 0;
+
+    EGLint id_attribs[] = { EGL_CONFIG_ID, id, EGL_NONE };
+    return eglChooseConfig(egl_data.display, id_attribs, &egl_data.config, 1, &n) && n
+        && config_matches(egl_data.config);
+}
+
+static void store_cached_config(const char *driver)
+{
+    char path[4096], temporary_path[4200];
+    EGLint id;
+    if (!eglGetConfigAttrib(egl_data.display, egl_data.config, EGL_CONFIG_ID, &id)
+        || !config_cache_path(path, sizeof(path), 1))
+        return;
+
+    // written aside and renamed, so a concurrent run never reads half a file
+    snprintf(temporary_path, sizeof(temporary_path), "%s.%d", path, (int)getpid());
+    FILE *file = fopen(temporary_path, "w");
+    if (!file)
+        return;
+    int written = fprintf(file, "%s%d\n", driver, id) > 0;
+    if (fclose(file) || !written || rename(temporary_path, path))
+        unlink(temporary_path);
+}
+
 static void init_egl()
 {
-    EGLint major, minor, count, n, size;
-    EGLConfig *configs;
-    EGLint config_attribs[] = {
-        EGL_SURFACE_TYPE, EGL_WINDOW_BIT,
-        EGL_RED_SIZE, 8,
-        EGL_GREEN_SIZE, 8,
-        EGL_BLUE_SIZE, 8,
-        EGL_ALPHA_SIZE, 8,
-        EGL_RENDERABLE_TYPE, EGL_OPENGL_ES2_BIT,
-        EGL_NONE
-    };
+    EGLint major, minor, n, size;
+    char driver[256];
+    double start = now_ms();
 
     static const EGLint context_attribs[] = {
         EGL_CONTEXT_CLIENT_VERSION, 2,
@@ -189,31 +302,50 @@ static void init_egl()
         exit(1);
     }
     printf("EGL %d.%d!\n", major, minor);
+    phase_done("EGL initialization", start);
+
+    // Ask for the best matching config only, the cached one if the driver didn't change
+    start = now_ms();
+    snprintf(driver, sizeof(driver), "%s %s\n", eglQueryString(egl_data.display, EGL_VENDOR),
+        eglQueryString(egl_data.display, EGL_VERSION));
+    if (load_cached_config(driver))
+        phase_done("EGL config (cached)", start);
+    else {
+        if (!eglChooseConfig(egl_data.display, config_attribs, &egl_data.config, 1, &n) || !n) {
+            fprintf(stderr, "No EGL config for a GLES2 RGBA8888 window :/\n");
+            exit(1);
+        }
+        phase_done("EGL config", start);
+        store_cached_config(driver);
+    }
 
-    eglGetConfigs(egl_data.display, 0, 0, &count);
-    printf("EGL has %d configs.\n", count);
-
-    configs = calloc(count, sizeof(EGLConfig));
-
-    eglChooseConfig(egl_data.display, config_attribs, configs, count, &n);
-
-    eglGetConfigAttrib(egl_data.display, configs[0], EGL_BUFFER_SIZE, &size);
+    eglGetConfigAttrib(egl_data.display, egl_data.config, EGL_BUFFER_SIZE, &size);
     printf("Buffer size for config is %d.\n", size);
 
-    eglGetConfigAttrib(egl_data.display, configs[0], EGL_RED_SIZE, &size);
+    eglGetConfigAttrib(egl_data.display, egl_data.config, EGL_RED_SIZE, &size);
     printf("Red size for config is %d.\n", size);
 
-    eglGetConfigAttrib(egl_data.display, configs[0], EGL_ALPHA_SIZE, &size);
+    eglGetConfigAttrib(egl_data.display, egl_data.config, EGL_ALPHA_SIZE, &size);
     printf("Alpha size for config is %d.\n", size);
 
-    // Go home with the first config
-    egl_data.config = configs[0];
-
+    start = now_ms();
     egl_data.context = eglCreateContext(egl_data.display, egl_data.config, EGL_NO_CONTEXT, context_attribs);
+    if (egl_data.context == EGL_NO_CONTEXT) {
+        fprintf(stderr, "Can't create EGL context :/\n");
+        exit(1);
+    }
+    phase_done("EGL context", start);
+}
+
+static void *init_egl_thread(void *arg)
+{
+    init_egl();
+    return 0;
 }
 
 static void create_window()
 {
+    double start = now_ms();
     wl_data.egl_window = wl_egl_window_create(wl_data.surface, WIDTH, HEIGHT);
     if (wl_data.egl_window == EGL_NO_SURFACE) {
         fprintf(stderr, "Can't create EGL window :/\n");
@@ -239,6 +371,8 @@ static void create_window()
         fprintf(stderr, "Failed to swap buffers :/\n");
         exit(1);
     }
+    phase_done("window and first frame", start);
+    phase_done("time to first frame", startup_time);
 }
 
 static void clear_wayland()
@@ -248,8 +382,18 @@ static void clear_wayland()
 
 int main(int argc, char *argv[])
 {
+    startup_time = now_ms();
+    connect_display();
+
+    // EGL only needs the connection, and Mesa binds its globals from an event queue of its own,
+    // so its initialization runs while we wait for the registry.
+    pthread_t egl_thread;
+    int egl_threaded = !pthread_create(&egl_thread, 0, init_egl_thread, 0);
     init_wayland();
-    init_egl();
+    if (egl_threaded)
+        pthread_join(egl_thread, 0);
+    else
+        init_egl();
     create_window();
 
     while (wl_display_dispatch(wl_data.display) != -1)
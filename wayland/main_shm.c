@@ -1,30 +1,83 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include <unistd.h>
-#include <errno.h>
-#include <sys/mman.h>
-#include <fcntl.h>
 
 #include <wayland-egl.h>
 #include <wayland-client.h>
 
+#include "damage.h"
+#include "frame_capture.h"
+#include "pixel_kernels.h"
+#include "raster.h"
+#include "shm_swapchain.h"
+#include "thread_pool.h"
+
+// A subsurface with buffers of its own, repainted in full and committed only when it changes.
+struct layer {
+    struct wl_surface *surface;
+    struct wl_subsurface *subsurface;
+    struct shm_swapchain swapchain;
+    int width;
+    int height;
+    // Set when the layer must be repainted and committed before the next frame.
+    int dirty;
+    unsigned commits;
+};
+
 static struct {
     struct wl_display *display;
     struct wl_compositor *compositor;
+    struct wl_subcompositor *subcompositor;
     struct wl_surface *surface;
     struct wl_shell *shell;
     struct wl_shell_surface *shell_surface;
-    void *shm_data;
-    struct wl_buffer *buffer;
+    struct shm_swapchain swapchain;
+    int buffer_count;
+    // Set by -a: every buffer is carved out of one shared memory file and wl_shm_pool.
+    int use_arena;
+    int arena_flags;
+    struct shm_arena arena;
+    // Set by -t, 0 means one rasterizer thread per CPU.
+    int thread_count;
+    struct thread_pool thread_pool;
+    struct raster raster;
+    enum shm_swapchain_wait wait;
     struct wl_shm *shm;
     uint32_t format;
     struct wl_callback *frame_callback;
+    int frame_ready;
+    struct damage_history damage_history;
+    // Set by -c: every committed frame is also recorded to a Y4M file.
+    const char *capture_path;
+    struct frame_capture capture;
+    long repainted_pixels;
+    // Set by -l: the background and a HUD are subsurfaces below and above the main surface,
+    // which only holds the moving square over transparent pixels.
+    int use_layers;
+    struct layer background;
+    struct layer hud;
+    // Frames drawn since the HUD was last updated, and when that was.
+    unsigned hud_frames;
+    double hud_start;
+    int width;
+    int height;
+    // The last size the shell asked for; configure events are coalesced into one resize per frame.
+    int pending_width;
+    int pending_height;
+    // Set when the surface changed size, until a frame damaging all of it has been committed.
+    int resized;
+    // Counts over the current one second window, with the swapchain's counters at its start.
+    struct {
+        double start;
+        unsigned configures;
+        unsigned resizes;
+        unsigned buffer_resizes;
+        unsigned reallocations;
+    } resize_stats;
 } data = {0};
 
-static const int WIDTH = 1280;
-static const int HEIGHT = 720;
-
 static void shm_format(void *d, struct wl_shm *shm, uint32_t format)
 {
     static uint8_t ran = 0;
@@ -45,6 +98,8 @@ static void global_registry_handler(void *d, struct wl_registry *registry, uint3
     printf("Got a registry event for %s, id = %d\n", interface, id);
     if (!strcmp(interface, "wl_compositor"))
         data.compositor = wl_registry_bind(registry, id, &wl_compositor_interface, version);
+    else if (!strcmp(interface, "wl_subcompositor"))
+        data.subcompositor = wl_registry_bind(registry, id, &wl_subcompositor_interface, 1);
     else if (!strcmp(interface, "wl_shell"))
         data.shell = wl_registry_bind(registry, id, &wl_shell_interface, version);
     else if (!strcmp(interface, "wl_shm")) {
@@ -71,7 +126,12 @@ static void handle_ping(void *d, struct wl_shell_surface *shell_surface, uint32_
 
 static void handle_configure(void *d, struct wl_shell_surface *shell_surface, uint32_t edges, int32_t width, int32_t height)
 {
-    printf("Received configure event on shell surface: edges = %d, width = %d, height = %d\n", edges, width, height);
+    // No printing here: a resize drag sends one of these per pointer motion.
+    if (width <= 0 || height <= 0)
+        return;
+    data.pending_width = width;
+    data.pending_height = height;
+    data.resize_stats.configures++;
 }
 
 static void handle_popup_done(void *d, struct wl_shell_surface *shell_surface)
@@ -141,130 +201,210 @@ static void init_wayland()
     wl_callback_add_listener(data.frame_callback, &frame_listener, 0);
 }
 
-static int set_cloexec_or_close(int fd)
-{
-    long flags;
-
-    if (fd == -1)
-        return -1;
+static const int SQUARE_SIZE = 200;
 
-    flags = fcntl(fd, F_GETFD);
-    if (flags == -1)
-        goto err;
-
-    if (fcntl(fd, F_SETFD, flags | FD_CLOEXEC) == -1)
-        goto err;
+// The scene is a static background with a square bouncing over it, so only the square's
+// old and new positions change from one frame to the next.
+static struct {
+    int x;
+    int y;
+    int dx;
+    int dy;
+    uint32_t color;
+} square = { 0, 0, 7, 5, 0 };
+
+static void paint_background(const struct raster_target *target)
+{
+    // Vertical gradient from dark blue to black, two triangles covering the window.
+    uint32_t top = pixel_color_from_argb(0xFF202040, data.format);
+    uint32_t bottom = pixel_color_from_argb(0xFF000000, data.format);
+    float upper_x[3] = { 0, target->width, 0 };
+    float upper_y[3] = { 0, 0, target->height };
+    uint32_t upper_colors[3] = { top, top, bottom };
+    float lower_x[3] = { target->width, target->width, 0 };
+    float lower_y[3] = { 0, target->height, target->height };
+    uint32_t lower_colors[3] = { top, bottom, bottom };
+
+    raster_fill_triangle(&data.raster, upper_x, upper_y, upper_colors);
+    raster_fill_triangle(&data.raster, lower_x, lower_y, lower_colors);
+}
 
-    return fd;
+static void paint_rect(uint32_t *pixels, const struct damage_rect *rect)
+{
+    struct raster_target target = { pixels, data.width, data.height, data.width };
+    int y;
 
-err:
-    close(fd);
-    return -1;
+    // With layers, the background shows through from below instead of being painted here.
+    if (data.use_layers) {
+        for (y = rect->y; y < rect->y + rect->height; ++y)
+            memset(pixels + (size_t)y * data.width + rect->x, 0, (size_t)rect->width * 4);
+    }
+    raster_begin(&data.raster, &target, rect->x, rect->y, rect->width, rect->height);
+    if (!data.use_layers)
+        paint_background(&target);
+    raster_fill_rect(&data.raster, square.x, square.y, SQUARE_SIZE, SQUARE_SIZE, square.color);
+    raster_end(&data.raster);
 }
 
-static int create_tmpfile_cloexec(char *tmpname)
+static void paint_region(uint32_t *pixels, const struct damage_region *region)
 {
-    int fd;
-
-#ifdef HAVE_MKOSTEMP
-    fd = mkostemp(tmpname, O_CLOEXEC);
-    if (fd >= 0)
-        unlink(tmpname);
-#else
-    fd = mkstemp(tmpname);
-    if (fd >= 0) {
-        fd = set_cloexec_or_close(fd);
-        unlink(tmpname);
-    }
-#endif
+    int i;
 
-    return fd;
+    for (i = 0; i < region->count; ++i)
+        paint_rect(pixels, &region->rects[i]);
+    data.repainted_pixels += damage_region_area(region);
 }
 
-int os_create_anonymous_file(off_t size)
+static double now_seconds()
 {
-    static const char template[] = "/shared-XXXXXX";
-    const char *path;
-    char *name;
-    int fd;
-
-    path = getenv("XDG_RUNTIME_DIR");
-    if (!path) {
-        errno = ENOENT;
-        return -1;
-    }
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
 
-    name = malloc(strlen(path) + sizeof(template));
-    if (!name) {
-        errno = ENOMEM;
-        return -1;
-    }
+static const int HUD_WIDTH = 256;
+static const int HUD_HEIGHT = 48;
+static const int HUD_MAX_FPS = 240;
 
-    strcpy(name, path);
-    strcat(name, template);
+static void paint_hud(const struct raster_target *target)
+{
+    double elapsed = now_seconds() - data.hud_start;
+    double fps = elapsed > 0 ? data.hud_frames / elapsed : 0;
+    int bar = fps < HUD_MAX_FPS ? (int)(fps * (HUD_WIDTH - 16) / HUD_MAX_FPS) : HUD_WIDTH - 16;
 
-    fd = create_tmpfile_cloexec(name);
+    // Translucent panel with a bar as long as the frame rate, blended by the compositor.
+    raster_fill_rect(&data.raster, 0, 0, HUD_WIDTH, HUD_HEIGHT, pixel_color_from_argb(0xC0101010, WL_SHM_FORMAT_ARGB8888));
+    raster_fill_rect(&data.raster, 8, 16, bar, HUD_HEIGHT - 32, pixel_color_from_argb(0xFF00C000, WL_SHM_FORMAT_ARGB8888));
+}
 
-    free(name);
+static void layer_init(struct layer *layer, int x, int y, int width, int height, uint32_t format)
+{
+    layer->surface = wl_compositor_create_surface(data.compositor);
+    layer->subsurface = wl_subcompositor_get_subsurface(data.subcompositor, layer->surface, data.surface);
+    if (!layer->surface || !layer->subsurface) {
+        fprintf(stderr, "Can't create subsurface :/\n");
+        exit(1);
+    }
+    wl_subsurface_set_position(layer->subsurface, x, y);
+    if (shm_swapchain_init(&layer->swapchain, data.display, data.shm, NULL, width, height, format, 2) < 0)
+        exit(1);
+    layer->width = width;
+    layer->height = height;
+    layer->dirty = 1;
+}
 
-    if (fd < 0)
-        return -1;
+static void layer_resize(struct layer *layer, int width, int height)
+{
+    shm_swapchain_resize(&layer->swapchain, width, height);
+    layer->width = width;
+    layer->height = height;
+    layer->dirty = 1;
+}
 
-    if (ftruncate(fd, size) < 0) {
-        close(fd);
-        return -1;
-    }
+// Repaints the whole layer with `paint` and commits it. A synchronized layer shows up with the
+// next commit of the main surface, a desynchronized one right away.
+static void layer_update(struct layer *layer, void (*paint)(const struct raster_target *target))
+{
+    struct shm_swapchain_buffer *buffer = shm_swapchain_acquire(&layer->swapchain, SHM_SWAPCHAIN_BLOCK);
+    struct raster_target target = { buffer->data, layer->width, layer->height, layer->width };
+
+    memset(buffer->data, 0, (size_t)layer->swapchain.stride * layer->height);
+    raster_begin(&data.raster, &target, 0, 0, layer->width, layer->height);
+    paint(&target);
+    raster_end(&data.raster);
+
+    shm_swapchain_attach(&layer->swapchain, buffer, layer->surface);
+    wl_surface_damage(layer->surface, 0, 0, layer->width, layer->height);
+    wl_surface_commit(layer->surface);
+    layer->dirty = 0;
+    layer->commits++;
+}
 
-    return fd;
+static void layer_finish(struct layer *layer)
+{
+    shm_swapchain_finish(&layer->swapchain);
+    wl_subsurface_destroy(layer->subsurface);
+    wl_surface_destroy(layer->surface);
 }
 
-static struct wl_buffer *create_buffer()
+// The background is synchronized, so a resized one appears in the same frame as the main
+// surface at the new size. The HUD is not: its commits don't wait for the next frame.
+static void init_layers()
 {
-    struct wl_shm_pool *pool;
-    int stride = WIDTH * 4;
-    int size = stride * HEIGHT;
-    int fd;
-    struct wl_buffer *buffer;
-
-    fd = os_create_anonymous_file(size);
-    if (fd < 0) {
-        fprintf(stderr, "Failed to create file with %d bytes: %m\n", size);
+    if (!data.subcompositor) {
+        fprintf(stderr, "No subcompositor, can't use layers :/\n");
         exit(1);
     }
+    layer_init(&data.background, 0, 0, data.width, data.height, data.format);
+    wl_subsurface_place_below(data.background.subsurface, data.surface);
+    layer_init(&data.hud, 16, 16, HUD_WIDTH, HUD_HEIGHT, WL_SHM_FORMAT_ARGB8888);
+    wl_subsurface_set_desync(data.hud.subsurface);
+    data.hud_start = now_seconds();
+    printf("Layers created!\n");
+}
 
-    data.shm_data = mmap(0, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
-    if (data.shm_data == MAP_FAILED) {
-        fprintf(stderr, "mmap failed: %m\n");
-        close(fd);
-        exit(1);
+// Called right before the main surface is committed.
+static void update_layers()
+{
+    if (data.background.dirty)
+        layer_update(&data.background, paint_background);
+
+    data.hud_frames++;
+    if (data.hud.dirty || now_seconds() - data.hud_start >= 1) {
+        layer_update(&data.hud, paint_hud);
+        data.hud_frames = 0;
+        data.hud_start = now_seconds();
     }
-
-    pool = wl_shm_create_pool(data.shm, fd, size);
-    buffer = wl_shm_pool_create_buffer(pool, 0, WIDTH, HEIGHT, stride, data.format);
-    wl_shm_pool_destroy(pool);
-
-    return buffer;
 }
 
 static void create_window()
 {
-    data.buffer = create_buffer();
+    struct shm_swapchain_buffer *buffer;
+    struct damage_region full;
+
+    if (data.use_arena) {
+        // Room for every buffer at 4K. Untouched pages of a memfd cost nothing.
+        if (shm_arena_init(&data.arena, (size_t)data.buffer_count * 3840 * 2160 * 4, data.arena_flags) < 0)
+            exit(1);
+        shm_arena_create_pool(&data.arena, data.shm);
+        printf("SHM arena of %zu MB created%s!\n", data.arena.size >> 20, data.arena.hugepages ? " with huge pages" : "");
+    }
 
-    wl_surface_attach(data.surface, data.buffer, 0, 0);
+    if (shm_swapchain_init(&data.swapchain, data.display, data.shm, data.use_arena ? &data.arena : NULL,
+                           data.width, data.height, data.format, data.buffer_count) < 0)
+        exit(1);
+    printf("Swapchain created with %d buffers!\n", data.buffer_count);
+    printf("Using %s pixel kernels.\n", pixel_kernels_get()->name);
+
+    if (thread_pool_init(&data.thread_pool, data.thread_count) < 0)
+        exit(1);
+    raster_init(&data.raster, &data.thread_pool);
+    printf("Rasterizing with %d threads.\n", data.thread_pool.thread_count);
+    if (data.use_layers) {
+        init_layers();
+        update_layers();
+    }
+
+    damage_region_set_full(&full, data.width, data.height);
+    buffer = shm_swapchain_acquire(&data.swapchain, SHM_SWAPCHAIN_BLOCK);
+    paint_region(buffer->data, &full);
+    if (data.capture_path)
+        frame_capture_push(&data.capture, buffer->data, data.width, data.height, data.swapchain.stride);
+    shm_swapchain_attach(&data.swapchain, buffer, data.surface);
+    damage_region_emit(&full, data.surface);
     wl_surface_commit(data.surface);
+    damage_history_push(&data.damage_history, &full);
 }
 
-static void paint_pixels(int ht)
+static void animate_square(struct damage_region *damage)
 {
     static uint32_t pixel_value = 0x00;
 
-    int n;
-    uint32_t *pixel = data.shm_data;
     uint32_t draw_color = 0;
 
     switch (data.format) {
     case WL_SHM_FORMAT_ARGB8888:
-        draw_color = pixel_value;
+        draw_color = 0xFF000000 | pixel_value;
         break;
     case WL_SHM_FORMAT_XRGB8888:
         draw_color = 0xFFFFFF - pixel_value;
@@ -274,8 +414,17 @@ static void paint_pixels(int ht)
         break;
     }
 
-    for (n = 0; n < WIDTH * ht; ++n)
-        *pixel++ = pixel_value;
+    damage_region_add(damage, square.x, square.y, SQUARE_SIZE, SQUARE_SIZE, data.width, data.height);
+
+    square.x += square.dx;
+    square.y += square.dy;
+    if (square.x < 0 || square.x + SQUARE_SIZE > data.width)
+        square.dx = -square.dx;
+    if (square.y < 0 || square.y + SQUARE_SIZE > data.height)
+        square.dy = -square.dy;
+    square.color = draw_color;
+
+    damage_region_add(damage, square.x, square.y, SQUARE_SIZE, SQUARE_SIZE, data.width, data.height);
 
     if (pixel_value < 0x100)
         pixel_value += 0x01; // varying blue
@@ -287,35 +436,214 @@ static void paint_pixels(int ht)
         pixel_value = 0x00;
 }
 
-static void redraw(void *d, struct wl_callback *callback, uint32_t time)
+static void print_swapchain_stats()
 {
-    static int ht = 0;
-    wl_callback_destroy(data.frame_callback);
-    if (ht == 0)
-        ht = HEIGHT;
-    wl_surface_damage(data.surface, 0, 0, WIDTH, ht);
-    paint_pixels(ht--);
+    const struct shm_swapchain_stats *stats = &data.swapchain.stats;
+    unsigned attempts = stats->acquired + stats->dropped;
+
+    printf("Swapchain: %u frames, %u stalls (%.1f%%), %.3f ms stalled per stall, %u dropped\n",
+           stats->acquired, stats->stalls, attempts ? 100.0 * stats->stalls / attempts : 0.0,
+           stats->stalls ? 1000 * stats->stall_seconds / stats->stalls : 0.0, stats->dropped);
+    if (stats->acquired)
+        printf("Repainted %.1f%% of the buffer per frame\n", 100.0 * data.repainted_pixels / ((double)stats->acquired * data.width * data.height));
+    if (data.use_layers)
+        printf("Layers: background committed %u times, HUD %u times\n", data.background.commits, data.hud.commits);
+    if (data.capture_path) {
+        struct frame_capture_stats capture = frame_capture_take_stats(&data.capture);
+        printf("Capture: %u frames, %u encoded, %u dropped, %.3f ms per frame to copy, %.3f ms to encode\n",
+               capture.captured, capture.encoded, capture.dropped,
+               capture.captured ? 1000 * capture.copy_seconds / capture.captured : 0.0,
+               capture.encoded ? 1000 * capture.encode_seconds / capture.encoded : 0.0);
+    }
+}
+
+// Reports once a second while the window is being resized.
+static void print_resize_stats()
+{
+    const struct shm_swapchain_stats *stats = &data.swapchain.stats;
+    double now = now_seconds();
+    double elapsed = now - data.resize_stats.start;
+
+    if (elapsed < 1)
+        return;
+
+    if (data.resize_stats.configures) {
+        printf("Resize: %.1f configures/s coalesced into %.1f resizes/s, %.1f buffer resizes/s, %.1f reallocations/s\n",
+               data.resize_stats.configures / elapsed, data.resize_stats.resizes / elapsed,
+               (stats->resizes - data.resize_stats.buffer_resizes) / elapsed,
+               (stats->reallocations - data.resize_stats.reallocations) / elapsed);
+    }
+
+    data.resize_stats.start = now;
+    data.resize_stats.configures = 0;
+    data.resize_stats.resizes = 0;
+    data.resize_stats.buffer_resizes = stats->resizes;
+    data.resize_stats.reallocations = stats->reallocations;
+}
+
+// Applies the latest configured size, if any. Called once per frame.
+static void apply_pending_resize()
+{
+    if (!data.pending_width || (data.pending_width == data.width && data.pending_height == data.height))
+        return;
+
+    data.width = data.pending_width;
+    data.height = data.pending_height;
+    data.resize_stats.resizes++;
+    data.resized = 1;
+    shm_swapchain_resize(&data.swapchain, data.width, data.height);
+    if (data.use_layers)
+        layer_resize(&data.background, data.width, data.height);
+
+    // Resized buffers come back with an age of 0, so the next frames are repainted in full.
+    if (square.x + SQUARE_SIZE > data.width)
+        square.x = data.width > SQUARE_SIZE ? data.width - SQUARE_SIZE : 0;
+    if (square.y + SQUARE_SIZE > data.height)
+        square.y = data.height > SQUARE_SIZE ? data.height - SQUARE_SIZE : 0;
+}
+
+static void redraw()
+{
+    struct shm_swapchain_buffer *buffer;
+    struct damage_region damage, repaint;
+
+    apply_pending_resize();
+
+    // With no free buffer in drop mode we keep frame_ready set and retry once the next event
+    // (usually a buffer release) has been dispatched.
+    buffer = shm_swapchain_acquire(&data.swapchain, data.wait);
+    if (!buffer)
+        return;
+    data.frame_ready = 0;
+
+    // The compositor only needs this frame's damage, but the buffer we got may be a few frames
+    // behind and must first catch up with what changed since it was last attached.
+    damage_region_clear(&damage);
+    animate_square(&damage);
+    // Otherwise the compositor may keep the parts of its old, differently sized contents the
+    // square didn't touch.
+    if (data.resized) {
+        damage_region_set_full(&damage, data.width, data.height);
+        data.resized = 0;
+    }
+    damage_history_repaint_region(&data.damage_history, shm_swapchain_buffer_age(&data.swapchain, buffer),
+                                  &damage, data.width, data.height, &repaint);
+    paint_region(buffer->data, &repaint);
+    // Copied before the commit, while the compositor can't be reading the buffer yet.
+    if (data.capture_path)
+        frame_capture_push(&data.capture, buffer->data, data.width, data.height, data.swapchain.stride);
+
     data.frame_callback = wl_surface_frame(data.surface);
-    wl_surface_attach(data.surface, data.buffer, 0, 0);
+    shm_swapchain_attach(&data.swapchain, buffer, data.surface);
+    damage_region_emit(&damage, data.surface);
     wl_callback_add_listener(data.frame_callback, &frame_listener, 0);
+    if (data.use_layers)
+        update_layers();
     wl_surface_commit(data.surface);
+    damage_history_push(&data.damage_history, &damage);
+
+    if (data.swapchain.stats.acquired % 300 == 0)
+        print_swapchain_stats();
+    print_resize_stats();
+}
+
+static void frame_done(void *d, struct wl_callback *callback, uint32_t time)
+{
+    wl_callback_destroy(data.frame_callback);
+    data.frame_callback = NULL;
+    data.frame_ready = 1;
 }
 
-static const struct wl_callback_listener frame_listener = { redraw };
+static const struct wl_callback_listener frame_listener = { frame_done };
 
 static void clear_wayland()
 {
+    print_swapchain_stats();
+    if (data.capture_path) {
+        frame_capture_finish(&data.capture);
+        printf("Capture written to %s\n", data.capture_path);
+    }
+    if (data.use_layers) {
+        layer_finish(&data.hud);
+        layer_finish(&data.background);
+    }
+    raster_finish(&data.raster);
+    thread_pool_finish(&data.thread_pool);
+    shm_swapchain_finish(&data.swapchain);
+    if (data.use_arena) {
+        shm_arena_destroy_pool(&data.arena);
+        shm_arena_finish(&data.arena);
+    }
     wl_display_disconnect(data.display);
 }
 
+static void usage(const char *program)
+{
+    fprintf(stderr, "Usage: %s [-n buffers] [-d] [-a | -H] [-t threads] [-l | -c video.y4m]\n", program);
+    fprintf(stderr, "  -n  number of swapchain buffers (2-%d, default 2)\n", SHM_SWAPCHAIN_MAX_BUFFERS);
+    fprintf(stderr, "  -d  drop frames instead of blocking when no buffer is free\n");
+    fprintf(stderr, "  -a  sub-allocate buffers from a single memfd arena and pool\n");
+    fprintf(stderr, "  -H  like -a, backed by huge pages when available\n");
+    fprintf(stderr, "  -t  number of rasterizer threads (default one per CPU)\n");
+    fprintf(stderr, "  -l  draw the background and a HUD in subsurfaces, repainted only when they change\n");
+    fprintf(stderr, "  -c  record the frames to a Y4M file, dropping those the encoder can't keep up with\n");
+    exit(1);
+}
+
 int main(int argc, char *argv[])
 {
+    int opt;
+
+    data.width = 1280;
+    data.height = 720;
+    data.buffer_count = 2;
+    data.wait = SHM_SWAPCHAIN_BLOCK;
+    while ((opt = getopt(argc, argv, "n:daHt:lc:")) != -1) {
+        switch (opt) {
+        case 'n':
+            data.buffer_count = atoi(optarg);
+            break;
+        case 'd':
+            data.wait = SHM_SWAPCHAIN_DROP;
+            break;
+        case 'H':
+            data.arena_flags |= SHM_ARENA_HUGEPAGES;
+            // fall through
+        case 'a':
+            data.use_arena = 1;
+            break;
+        case 't':
+            data.thread_count = atoi(optarg);
+            break;
+        case 'l':
+            data.use_layers = 1;
+            break;
+        case 'c':
+            data.capture_path = optarg;
+            break;
+        default:
+            usage(argv[0]);
+        }
+    }
+    // Only the compositor sees the layers blended together.
+    if (data.use_layers && data.capture_path)
+        usage(argv[0]);
+
+    // Resizes are not followed: frames of another size are dropped.
+    if (data.capture_path && frame_capture_init(&data.capture, data.capture_path, data.width, data.height, 60) < 0)
+        exit(1);
     init_wayland();
+    // The main surface must be transparent where the square isn't, and ARGB8888 is always supported.
+    if (data.use_layers)
+        data.format = WL_SHM_FORMAT_ARGB8888;
     create_window();
-    redraw(0, 0, 0);
+    data.resize_stats.start = now_seconds();
 
+    // Painting happens outside of event handlers, so a blocking acquire can dispatch events itself.
     while (wl_display_dispatch(data.display) != -1)
     {
+        if (data.frame_ready)
+            redraw();
     }
 
     clear_wayland();
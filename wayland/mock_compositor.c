@@ -0,0 +1,1171 @@
+// A Wayland compositor that shows nothing, so the clients can be run and measured on machines
+// without a display or GPU. It advertises wl_compositor, wl_subcompositor, wl_shm, wl_shell,
+// zxdg_shell_v6, wp_presentation and wp_viewporter, copies the damaged part of every committed SHM
+// buffer like a compositor uploading it to a texture, and fires frame callbacks and presentation
+// feedback at a synthetic refresh rate. With -p, a wl_seat moves a pointer in circles over every
+// client's first surface. Commits, damage, viewports and buffer releases are logged with their
+// timing.
+//
+// EGL clients render with llvmpipe over wl_shm against it: there is no wl_drm or dmabuf global.
+#include <errno.h>
+#include <math.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/timerfd.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <wayland-server.h>
+
+#include "presentation-time-server-protocol.h"
+#include "viewporter-server-protocol.h"
+#include "xdg-shell-unstable-v6-server-protocol.h"
+
+// What happened over some time; kept for the last second and for the whole run.
+struct counters {
+    unsigned commits;
+    unsigned frame_callbacks;
+    unsigned presented;
+    unsigned discarded;
+    unsigned releases;
+    double damage_pixels;
+    double copy_seconds;
+    // From the commit that attached a buffer until its release.
+    double held_seconds;
+};
+
+// A wl_pointer, in data.pointers.
+struct pointer {
+    struct wl_resource *resource;
+    struct wl_list link;
+    // Surface the pointer entered, NULL if none.
+    struct surface *focus;
+};
+
+struct surface {
+    struct wl_resource *resource;
+    struct wl_list link;
+    unsigned id;
+
+    // Double-buffered state, applied on commit.
+    struct wl_resource *pending_buffer;
+    struct wl_listener pending_buffer_destroy;
+    int pending_attached;
+    int pending_x0, pending_y0, pending_x1, pending_y1;
+    unsigned pending_damage_rects;
+    struct wl_list pending_frame_callbacks;
+    struct wl_list pending_feedbacks;
+
+    // Committed state, waiting for the next refresh.
+    struct wl_list frame_callbacks;
+    struct wl_list feedbacks;
+
+    // With -k, the buffer kept until the next one is committed, as when a compositor samples
+    // client buffers directly instead of copying them.
+    struct wl_resource *held_buffer;
+    struct wl_listener held_buffer_destroy;
+    double held_since;
+
+    // Its wp_viewport, whose user data is the surface until either is destroyed, and the
+    // destination size, double-buffered like the rest. 0 by 0 without one.
+    struct wl_resource *viewport;
+    int pending_destination_width, pending_destination_height;
+    int destination_width, destination_height;
+
+    // Our copy of the surface contents.
+    uint32_t *pixels;
+    int width;
+    int height;
+};
+
+static struct {
+    struct wl_display *display;
+    struct wl_event_loop *loop;
+    struct wl_list surfaces;
+    unsigned next_surface_id;
+    uint32_t next_serial;
+    int refresh_fd;
+    unsigned refresh_rate;
+    uint64_t refresh_sequence;
+    // Set by -p, 0 without a seat.
+    unsigned pointer_rate;
+    struct wl_list pointers;
+    struct wl_event_source *pointer_timer;
+    unsigned motions;
+    // Set by -k.
+    int keep_buffers;
+    FILE *log;
+    double start;
+    double interval_start;
+    struct counters interval;
+    struct counters total;
+} data = {0};
+
+static double now_seconds()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Milliseconds since startup, for the log.
+static double log_time(double time)
+{
+    return 1000 * (time - data.start);
+}
+
+static void count(unsigned *interval, unsigned *total)
+{
+    ++*interval;
+    ++*total;
+}
+
+static void add(double *interval, double *total, double value)
+{
+    *interval += value;
+    *total += value;
+}
+
+static void destroy_resource(struct wl_client *client, struct wl_resource *resource)
+{
+    wl_resource_destroy(resource);
+}
+
+// Frame callbacks and feedbacks sit in the surface's lists through their resource link.
+static void unlink_resource(struct wl_resource *resource)
+{
+    wl_list_remove(wl_resource_get_link(resource));
+}
+
+static void detach_resources(struct wl_list *list)
+{
+    struct wl_resource *resource, *next;
+    wl_resource_for_each_safe(resource, next, list) {
+        wl_list_remove(wl_resource_get_link(resource));
+        wl_list_init(wl_resource_get_link(resource));
+    }
+}
+
+// wl_region: only needed for clients to set opaque and input regions, which we ignore.
+
+static void region_add(struct wl_client *client, struct wl_resource *resource, int32_t x, int32_t y, int32_t width, int32_t height)
+{
+}
+
+static void region_subtract(struct wl_client *client, struct wl_resource *resource, int32_t x, int32_t y, int32_t width, int32_t height)
+{
+}
+
+static const struct wl_region_interface region_implementation = {
+    destroy_resource,
+    region_add,
+    region_subtract
+};
+
+// wl_surface
+
+static void release_held_buffer(struct surface *surface, double now)
+{
+    if (!surface->held_buffer)
+        return;
+
+    double held = now - surface->held_since;
+    wl_buffer_send_release(surface->held_buffer);
+    wl_list_remove(&surface->held_buffer_destroy.link);
+    surface->held_buffer = NULL;
+    count(&data.interval.releases, &data.total.releases);
+    add(&data.interval.held_seconds, &data.total.held_seconds, held);
+    if (data.log)
+        fprintf(data.log, "release %.3f surface=%u held=%.3f\n", log_time(now), surface->id, 1000 * held);
+}
+
+static void pending_buffer_destroyed(struct wl_listener *listener, void *d)
+{
+    struct surface *surface = wl_container_of(listener, surface, pending_buffer_destroy);
+    surface->pending_buffer = NULL;
+}
+
+static void held_buffer_destroyed(struct wl_listener *listener, void *d)
+{
+    struct surface *surface = wl_container_of(listener, surface, held_buffer_destroy);
+    surface->held_buffer = NULL;
+}
+
+static void surface_attach(struct wl_client *client, struct wl_resource *resource, struct wl_resource *buffer, int32_t x, int32_t y)
+{
+    struct surface *surface = wl_resource_get_user_data(resource);
+
+    if (surface->pending_buffer)
+        wl_list_remove(&surface->pending_buffer_destroy.link);
+    surface->pending_buffer = buffer;
+    surface->pending_attached = 1;
+    if (buffer)
+        wl_resource_add_destroy_listener(buffer, &surface->pending_buffer_destroy);
+}
+
+static void surface_damage(struct wl_client *client, struct wl_resource *resource, int32_t x, int32_t y, int32_t width, int32_t height)
+{
+    struct surface *surface = wl_resource_get_user_data(resource);
+
+    if (width <= 0 || height <= 0)
+        return;
+    // Tracked as a bounding box, clipped to the buffer on commit. Scale and transform are 1
+    // and normal, so surface and buffer coordinates are the same.
+    if (!surface->pending_damage_rects++) {
+        surface->pending_x0 = x;
+        surface->pending_y0 = y;
+        surface->pending_x1 = x + width;
+        surface->pending_y1 = y + height;
+        return;
+    }
+    if (x < surface->pending_x0)
+        surface->pending_x0 = x;
+    if (y < surface->pending_y0)
+        surface->pending_y0 = y;
+    if (x + width > surface->pending_x1)
+        surface->pending_x1 = x + width;
+    if (y + height > surface->pending_y1)
+        surface->pending_y1 = y + height;
+}
+
+static void callback_destroyed(struct wl_resource *resource)
+{
+    unlink_resource(resource);
+}
+
+static void surface_frame(struct wl_client *client, struct wl_resource *resource, uint32_t id)
+{
+    struct surface *surface = wl_resource_get_user_data(resource);
+    struct wl_resource *callback = wl_resource_create(client, &wl_callback_interface, 1, id);
+
+    if (!callback) {
+        wl_client_post_no_memory(client);
+        return;
+    }
+    wl_resource_set_implementation(callback, NULL, NULL, callback_destroyed);
+    wl_list_insert(surface->pending_frame_callbacks.prev, wl_resource_get_link(callback));
+}
+
+static void surface_set_opaque_region(struct wl_client *client, struct wl_resource *resource, struct wl_resource *region)
+{
+}
+
+static void surface_set_input_region(struct wl_client *client, struct wl_resource *resource, struct wl_resource *region)
+{
+}
+
+// Copies the damaged rows of the buffer into our copy of the surface, as a compositor uploads
+// them to a texture. Returns the number of pixels copied.
+static long copy_buffer(struct surface *surface, struct wl_shm_buffer *shm_buffer, int x0, int y0, int x1, int y1)
+{
+    int width = wl_shm_buffer_get_width(shm_buffer);
+    int height = wl_shm_buffer_get_height(shm_buffer);
+    int stride = wl_shm_buffer_get_stride(shm_buffer);
+
+    if (width != surface->width || height != surface->height) {
+        free(surface->pixels);
+        surface->pixels = malloc((size_t)width * height * 4);
+        surface->width = width;
+        surface->height = height;
+        x0 = 0;
+        y0 = 0;
+        x1 = width;
+        y1 = height;
+    }
+    if (!surface->pixels)
+        return 0;
+
+    x0 = x0 < 0 ? 0 : x0;
+    y0 = y0 < 0 ? 0 : y0;
+    x1 = x1 > width ? width : x1;
+    y1 = y1 > height ? height : y1;
+    if (x0 >= x1 || y0 >= y1)
+        return 0;
+
+    // The client may shrink the pool under us; begin_access turns that into a client error
+    // instead of a SIGBUS.
+    wl_shm_buffer_begin_access(shm_buffer);
+    const uint8_t *source = wl_shm_buffer_get_data(shm_buffer);
+    for (int y = y0; y < y1; ++y)
+        memcpy(surface->pixels + (size_t)y * width + x0, source + (size_t)y * stride + x0 * 4, (size_t)(x1 - x0) * 4);
+    wl_shm_buffer_end_access(shm_buffer);
+    return (long)(x1 - x0) * (y1 - y0);
+}
+
+static void surface_commit(struct wl_client *client, struct wl_resource *resource)
+{
+    struct surface *surface = wl_resource_get_user_data(resource);
+    double now = now_seconds();
+    struct wl_resource *buffer = surface->pending_attached ? surface->pending_buffer : NULL;
+    struct wl_resource *feedback, *next;
+    long pixels = 0;
+    double copy = 0;
+
+    if (buffer) {
+        struct wl_shm_buffer *shm_buffer = wl_shm_buffer_get(buffer);
+        if (shm_buffer) {
+            if (!surface->pending_damage_rects) {
+                surface->pending_x0 = surface->pending_y0 = 0;
+                surface->pending_x1 = surface->pending_y1 = 0;
+            }
+            pixels = copy_buffer(surface, shm_buffer, surface->pending_x0, surface->pending_y0, surface->pending_x1, surface->pending_y1);
+            copy = now_seconds() - now;
+        } else
+            fprintf(stderr, "Surface %u committed a buffer that isn't from wl_shm, ignoring its contents.\n", surface->id);
+    }
+
+    count(&data.interval.commits, &data.total.commits);
+    add(&data.interval.damage_pixels, &data.total.damage_pixels, pixels);
+    add(&data.interval.copy_seconds, &data.total.copy_seconds, copy);
+    if (data.log) {
+        fprintf(data.log, "commit %.3f surface=%u buffer=%dx%d damage=%u/%ld copy=%.3f\n", log_time(now), surface->id,
+                buffer ? surface->width : 0, buffer ? surface->height : 0, surface->pending_damage_rects, pixels, 1000 * copy);
+    }
+    if (surface->pending_destination_width != surface->destination_width || surface->pending_destination_height != surface->destination_height) {
+        surface->destination_width = surface->pending_destination_width;
+        surface->destination_height = surface->pending_destination_height;
+        if (data.log) {
+            fprintf(data.log, "viewport %.3f surface=%u destination=%dx%d\n", log_time(now), surface->id,
+                    surface->destination_width, surface->destination_height);
+        }
+    }
+
+    if (surface->pending_attached && surface->held_buffer != buffer)
+        release_held_buffer(surface, now);
+    if (buffer && surface->held_buffer != buffer) {
+        surface->held_buffer = buffer;
+        surface->held_since = now;
+        wl_resource_add_destroy_listener(buffer, &surface->held_buffer_destroy);
+        // Copied already, so it can go back to the client right away.
+        if (!data.keep_buffers)
+            release_held_buffer(surface, now_seconds());
+    }
+
+    // Content committed but not shown yet is replaced by this commit.
+    wl_resource_for_each_safe(feedback, next, &surface->feedbacks) {
+        wp_presentation_feedback_send_discarded(feedback);
+        wl_resource_destroy(feedback);
+        count(&data.interval.discarded, &data.total.discarded);
+    }
+    wl_list_insert_list(surface->feedbacks.prev, &surface->pending_feedbacks);
+    wl_list_init(&surface->pending_feedbacks);
+    wl_list_insert_list(surface->frame_callbacks.prev, &surface->pending_frame_callbacks);
+    wl_list_init(&surface->pending_frame_callbacks);
+
+    if (surface->pending_buffer)
+        wl_list_remove(&surface->pending_buffer_destroy.link);
+    surface->pending_buffer = NULL;
+    surface->pending_attached = 0;
+    surface->pending_damage_rects = 0;
+}
+
+static void surface_set_buffer_transform(struct wl_client *client, struct wl_resource *resource, int32_t transform)
+{
+}
+
+static void surface_set_buffer_scale(struct wl_client *client, struct wl_resource *resource, int32_t scale)
+{
+}
+
+static const struct wl_surface_interface surface_implementation = {
+    destroy_resource,
+    surface_attach,
+    surface_damage,
+    surface_frame,
+    surface_set_opaque_region,
+    surface_set_input_region,
+    surface_commit,
+    surface_set_buffer_transform,
+    surface_set_buffer_scale,
+    surface_damage
+};
+
+static void surface_destroyed(struct wl_resource *resource)
+{
+    struct surface *surface = wl_resource_get_user_data(resource);
+
+    // Callbacks and feedbacks outlive the surface as resources of the client, so they must not
+    // point into it anymore.
+    detach_resources(&surface->pending_frame_callbacks);
+    detach_resources(&surface->frame_callbacks);
+    detach_resources(&surface->pending_feedbacks);
+    detach_resources(&surface->feedbacks);
+    if (surface->pending_buffer)
+        wl_list_remove(&surface->pending_buffer_destroy.link);
+    if (surface->held_buffer)
+        wl_list_remove(&surface->held_buffer_destroy.link);
+    if (surface->viewport)
+        wl_resource_set_user_data(surface->viewport, NULL);
+    struct pointer *pointer;
+    wl_list_for_each(pointer, &data.pointers, link) {
+        if (pointer->focus == surface)
+            pointer->focus = NULL;
+    }
+    wl_list_remove(&surface->link);
+    free(surface->pixels);
+    free(surface);
+}
+
+// wl_compositor
+
+static void compositor_create_surface(struct wl_client *client, struct wl_resource *resource, uint32_t id)
+{
+    struct surface *surface = calloc(1, sizeof(*surface));
+
+    if (surface)
+        surface->resource = wl_resource_create(client, &wl_surface_interface, wl_resource_get_version(resource), id);
+    if (!surface || !surface->resource) {
+        free(surface);
+        wl_client_post_no_memory(client);
+        return;
+    }
+
+    surface->id = ++data.next_surface_id;
+    surface->pending_buffer_destroy.notify = pending_buffer_destroyed;
+    surface->held_buffer_destroy.notify = held_buffer_destroyed;
+    wl_list_init(&surface->pending_frame_callbacks);
+    wl_list_init(&surface->pending_feedbacks);
+    wl_list_init(&surface->frame_callbacks);
+    wl_list_init(&surface->feedbacks);
+    wl_list_insert(data.surfaces.prev, &surface->link);
+    wl_resource_set_implementation(surface->resource, &surface_implementation, surface, surface_destroyed);
+}
+
+static void compositor_create_region(struct wl_client *client, struct wl_resource *resource, uint32_t id)
+{
+    struct wl_resource *region = wl_resource_create(client, &wl_region_interface, 1, id);
+
+    if (!region) {
+        wl_client_post_no_memory(client);
+        return;
+    }
+    wl_resource_set_implementation(region, &region_implementation, NULL, NULL);
+}
+
+static const struct wl_compositor_interface compositor_implementation = {
+    compositor_create_surface,
+    compositor_create_region
+};
+
+static void bind_compositor(struct wl_client *client, void *d, uint32_t version, uint32_t id)
+{
+    struct wl_resource *resource = wl_resource_create(client, &wl_compositor_interface, version, id);
+
+    if (!resource) {
+        wl_client_post_no_memory(client);
+        return;
+    }
+    wl_resource_set_implementation(resource, &compositor_implementation, NULL, NULL);
+}
+
+// wl_subcompositor: subsurfaces are accepted and logged, but their position, stacking and
+// synchronized mode are ignored. Every surface's commits apply right away, which is all the
+// timing of commits and copies needs, as nothing is composited.
+
+static void subsurface_set_position(struct wl_client *client, struct wl_resource *resource, int32_t x, int32_t y)
+{
+}
+
+static void subsurface_place(struct wl_client *client, struct wl_resource *resource, struct wl_resource *sibling)
+{
+}
+
+static void subsurface_set_mode(struct wl_client *client, struct wl_resource *resource)
+{
+}
+
+static const struct wl_subsurface_interface subsurface_implementation = {
+    destroy_resource,
+    subsurface_set_position,
+    subsurface_place,
+    subsurface_place,
+    subsurface_set_mode,
+    subsurface_set_mode
+};
+
+static void subcompositor_get_subsurface(struct wl_client *client, struct wl_resource *resource, uint32_t id,
+                                         struct wl_resource *surface_resource, struct wl_resource *parent_resource)
+{
+    struct surface *surface = wl_resource_get_user_data(surface_resource);
+    struct surface *parent = wl_resource_get_user_data(parent_resource);
+    struct wl_resource *subsurface = wl_resource_create(client, &wl_subsurface_interface, 1, id);
+
+    if (!subsurface) {
+        wl_client_post_no_memory(client);
+        return;
+    }
+    wl_resource_set_implementation(subsurface, &subsurface_implementation, NULL, NULL);
+    if (data.log)
+        fprintf(data.log, "subsurface %.3f surface=%u parent=%u\n", log_time(now_seconds()), surface->id, parent->id);
+}
+
+static const struct wl_subcompositor_interface subcompositor_implementation = {
+    destroy_resource,
+    subcompositor_get_subsurface
+};
+
+static void bind_subcompositor(struct wl_client *client, void *d, uint32_t version, uint32_t id)
+{
+    struct wl_resource *resource = wl_resource_create(client, &wl_subcompositor_interface, 1, id);
+
+    if (!resource) {
+        wl_client_post_no_memory(client);
+        return;
+    }
+    wl_resource_set_implementation(resource, &subcompositor_implementation, NULL, NULL);
+}
+
+// wl_shell: every surface is a toplevel and is never asked to change size.
+
+static void shell_surface_pong(struct wl_client *client, struct wl_resource *resource, uint32_t serial)
+{
+}
+
+static void shell_surface_move(struct wl_client *client, struct wl_resource *resource, struct wl_resource *seat, uint32_t serial)
+{
+}
+
+static void shell_surface_resize(struct wl_client *client, struct wl_resource *resource, struct wl_resource *seat, uint32_t serial, uint32_t edges)
+{
+}
+
+static void shell_surface_set_toplevel(struct wl_client *client, struct wl_resource *resource)
+{
+}
+
+static void shell_surface_set_transient(struct wl_client *client, struct wl_resource *resource, struct wl_resource *parent, int32_t x, int32_t y, uint32_t flags)
+{
+}
+
+static void shell_surface_set_fullscreen(struct wl_client *client, struct wl_resource *resource, uint32_t method, uint32_t framerate, struct wl_resource *output)
+{
+}
+
+static void shell_surface_set_popup(struct wl_client *client, struct wl_resource *resource, struct wl_resource *seat, uint32_t serial, struct wl_resource *parent, int32_t x, int32_t y, uint32_t flags)
+{
+}
+
+static void shell_surface_set_maximized(struct wl_client *client, struct wl_resource *resource, struct wl_resource *output)
+{
+}
+
+static void shell_surface_set_title(struct wl_client *client, struct wl_resource *resource, const char *title)
+{
+    struct surface *surface = wl_resource_get_user_data(resource);
+    printf("Surface %u is titled \"%s\"\n", surface->id, title);
+}
+
+static void shell_surface_set_class(struct wl_client *client, struct wl_resource *resource, const char *class_)
+{
+}
+
+static const struct wl_shell_surface_interface shell_surface_implementation = {
+    shell_surface_pong,
+    shell_surface_move,
+    shell_surface_resize,
+    shell_surface_set_toplevel,
+    shell_surface_set_transient,
+    shell_surface_set_fullscreen,
+    shell_surface_set_popup,
+    shell_surface_set_maximized,
+    shell_surface_set_title,
+    shell_surface_set_class
+};
+
+static void shell_get_shell_surface(struct wl_client *client, struct wl_resource *resource, uint32_t id, struct wl_resource *surface)
+{
+    struct wl_resource *shell_surface = wl_resource_create(client, &wl_shell_surface_interface, 1, id);
+
+    if (!shell_surface) {
+        wl_client_post_no_memory(client);
+        return;
+    }
+    wl_resource_set_implementation(shell_surface, &shell_surface_implementation, wl_resource_get_user_data(surface), NULL);
+}
+
+static const struct wl_shell_interface shell_implementation = {
+    shell_get_shell_surface
+};
+
+static void bind_shell(struct wl_client *client, void *d, uint32_t version, uint32_t id)
+{
+    struct wl_resource *resource = wl_resource_create(client, &wl_shell_interface, 1, id);
+
+    if (!resource) {
+        wl_client_post_no_memory(client);
+        return;
+    }
+    wl_resource_set_implementation(resource, &shell_implementation, NULL, NULL);
+}
+
+// zxdg_shell_v6: toplevels only, configured once with a size left to the client.
+
+static void toplevel_set_parent(struct wl_client *client, struct wl_resource *resource, struct wl_resource *parent)
+{
+}
+
+static void toplevel_set_title(struct wl_client *client, struct wl_resource *resource, const char *title)
+{
+    struct surface *surface = wl_resource_get_user_data(resource);
+    printf("Surface %u is titled \"%s\"\n", surface->id, title);
+}
+
+static void toplevel_set_app_id(struct wl_client *client, struct wl_resource *resource, const char *app_id)
+{
+}
+
+static void toplevel_show_window_menu(struct wl_client *client, struct wl_resource *resource, struct wl_resource *seat, uint32_t serial, int32_t x, int32_t y)
+{
+}
+
+static void toplevel_move(struct wl_client *client, struct wl_resource *resource, struct wl_resource *seat, uint32_t serial)
+{
+}
+
+static void toplevel_resize(struct wl_client *client, struct wl_resource *resource, struct wl_resource *seat, uint32_t serial, uint32_t edges)
+{
+}
+
+static void toplevel_set_size(struct wl_client *client, struct wl_resource *resource, int32_t width, int32_t height)
+{
+}
+
+static void toplevel_set_state(struct wl_client *client, struct wl_resource *resource)
+{
+}
+
+static void toplevel_set_fullscreen(struct wl_client *client, struct wl_resource *resource, struct wl_resource *output)
+{
+}
+
+static const struct zxdg_toplevel_v6_interface toplevel_implementation = {
+    destroy_resource,
+    toplevel_set_parent,
+    toplevel_set_title,
+    toplevel_set_app_id,
+    toplevel_show_window_menu,
+    toplevel_move,
+    toplevel_resize,
+    toplevel_set_size,
+    toplevel_set_size,
+    toplevel_set_state,
+    toplevel_set_state,
+    toplevel_set_fullscreen,
+    toplevel_set_state,
+    toplevel_set_state
+};
+
+static void xdg_surface_get_toplevel(struct wl_client *client, struct wl_resource *resource, uint32_t id)
+{
+    struct wl_resource *toplevel = wl_resource_create(client, &zxdg_toplevel_v6_interface, 1, id);
+    struct wl_array states;
+
+    if (!toplevel) {
+        wl_client_post_no_memory(client);
+        return;
+    }
+    wl_resource_set_implementation(toplevel, &toplevel_implementation, wl_resource_get_user_data(resource), NULL);
+
+    wl_array_init(&states);
+    zxdg_toplevel_v6_send_configure(toplevel, 0, 0, &states);
+    wl_array_release(&states);
+    zxdg_surface_v6_send_configure(resource, ++data.next_serial);
+}
+
+static void xdg_surface_get_popup(struct wl_client *client, struct wl_resource *resource, uint32_t id, struct wl_resource *parent, struct wl_resource *positioner)
+{
+    wl_resource_post_error(resource, ZXDG_SHELL_V6_ERROR_INVALID_POSITIONER, "popups are not supported");
+}
+
+static void xdg_surface_set_window_geometry(struct wl_client *client, struct wl_resource *resource, int32_t x, int32_t y, int32_t width, int32_t height)
+{
+}
+
+static void xdg_surface_ack_configure(struct wl_client *client, struct wl_resource *resource, uint32_t serial)
+{
+}
+
+static const struct zxdg_surface_v6_interface xdg_surface_implementation = {
+    destroy_resource,
+    xdg_surface_get_toplevel,
+    xdg_surface_get_popup,
+    xdg_surface_set_window_geometry,
+    xdg_surface_ack_configure
+};
+
+static void xdg_shell_create_positioner(struct wl_client *client, struct wl_resource *resource, uint32_t id)
+{
+    wl_resource_post_error(resource, ZXDG_SHELL_V6_ERROR_INVALID_POSITIONER, "popups are not supported");
+}
+
+static void xdg_shell_get_xdg_surface(struct wl_client *client, struct wl_resource *resource, uint32_t id, struct wl_resource *surface)
+{
+    struct wl_resource *xdg_surface = wl_resource_create(client, &zxdg_surface_v6_interface, 1, id);
+
+    if (!xdg_surface) {
+        wl_client_post_no_memory(client);
+        return;
+    }
+    wl_resource_set_implementation(xdg_surface, &xdg_surface_implementation, wl_resource_get_user_data(surface), NULL);
+}
+
+static void xdg_shell_pong(struct wl_client *client, struct wl_resource *resource, uint32_t serial)
+{
+}
+
+static const struct zxdg_shell_v6_interface xdg_shell_implementation = {
+    destroy_resource,
+    xdg_shell_create_positioner,
+    xdg_shell_get_xdg_surface,
+    xdg_shell_pong
+};
+
+static void bind_xdg_shell(struct wl_client *client, void *d, uint32_t version, uint32_t id)
+{
+    struct wl_resource *resource = wl_resource_create(client, &zxdg_shell_v6_interface, 1, id);
+
+    if (!resource) {
+        wl_client_post_no_memory(client);
+        return;
+    }
+    wl_resource_set_implementation(resource, &xdg_shell_implementation, NULL, NULL);
+}
+
+// wp_presentation: everything committed before a refresh is presented at that refresh.
+
+static void presentation_feedback(struct wl_client *client, struct wl_resource *resource, struct wl_resource *surface_resource, uint32_t id)
+{
+    struct surface *surface = wl_resource_get_user_data(surface_resource);
+    struct wl_resource *feedback = wl_resource_create(client, &wp_presentation_feedback_interface, 1, id);
+
+    if (!feedback) {
+        wl_client_post_no_memory(client);
+        return;
+    }
+    wl_resource_set_implementation(feedback, NULL, NULL, callback_destroyed);
+    wl_list_insert(surface->pending_feedbacks.prev, wl_resource_get_link(feedback));
+}
+
+static const struct wp_presentation_interface presentation_implementation = {
+    destroy_resource,
+    presentation_feedback
+};
+
+static void bind_presentation(struct wl_client *client, void *d, uint32_t version, uint32_t id)
+{
+    struct wl_resource *resource = wl_resource_create(client, &wp_presentation_interface, 1, id);
+
+    if (!resource) {
+        wl_client_post_no_memory(client);
+        return;
+    }
+    wl_resource_set_implementation(resource, &presentation_implementation, NULL, NULL);
+    wp_presentation_send_clock_id(resource, CLOCK_MONOTONIC);
+}
+
+// wp_viewporter: the destination size is logged on commit, the source rectangle is ignored.
+// Surfaces are not scaled, as nothing is composited: a client rendering at a lower resolution
+// shows up as smaller buffers and copies.
+
+static void viewport_destroyed(struct wl_resource *resource)
+{
+    struct surface *surface = wl_resource_get_user_data(resource);
+
+    if (!surface)
+        return;
+    surface->viewport = NULL;
+    surface->pending_destination_width = 0;
+    surface->pending_destination_height = 0;
+}
+
+static void viewport_set_source(struct wl_client *client, struct wl_resource *resource, wl_fixed_t x, wl_fixed_t y, wl_fixed_t width, wl_fixed_t height)
+{
+    if (!wl_resource_get_user_data(resource))
+        wl_resource_post_error(resource, WP_VIEWPORT_ERROR_NO_SURFACE, "the surface was destroyed");
+}
+
+static void viewport_set_destination(struct wl_client *client, struct wl_resource *resource, int32_t width, int32_t height)
+{
+    struct surface *surface = wl_resource_get_user_data(resource);
+
+    if (!surface) {
+        wl_resource_post_error(resource, WP_VIEWPORT_ERROR_NO_SURFACE, "the surface was destroyed");
+        return;
+    }
+    if ((width != -1 || height != -1) && (width <= 0 || height <= 0)) {
+        wl_resource_post_error(resource, WP_VIEWPORT_ERROR_BAD_VALUE, "bad destination size %dx%d", width, height);
+        return;
+    }
+    surface->pending_destination_width = width == -1 ? 0 : width;
+    surface->pending_destination_height = height == -1 ? 0 : height;
+}
+
+static const struct wp_viewport_interface viewport_implementation = {
+    destroy_resource,
+    viewport_set_source,
+    viewport_set_destination
+};
+
+static void viewporter_get_viewport(struct wl_client *client, struct wl_resource *resource, uint32_t id, struct wl_resource *surface_resource)
+{
+    struct surface *surface = wl_resource_get_user_data(surface_resource);
+    struct wl_resource *viewport;
+
+    if (surface->viewport) {
+        wl_resource_post_error(resource, WP_VIEWPORTER_ERROR_VIEWPORT_EXISTS, "surface %u already has a viewport", surface->id);
+        return;
+    }
+    viewport = wl_resource_create(client, &wp_viewport_interface, 1, id);
+    if (!viewport) {
+        wl_client_post_no_memory(client);
+        return;
+    }
+    wl_resource_set_implementation(viewport, &viewport_implementation, surface, viewport_destroyed);
+    surface->viewport = viewport;
+}
+
+static const struct wp_viewporter_interface viewporter_implementation = {
+    destroy_resource,
+    viewporter_get_viewport
+};
+
+static void bind_viewporter(struct wl_client *client, void *d, uint32_t version, uint32_t id)
+{
+    struct wl_resource *resource = wl_resource_create(client, &wp_viewporter_interface, 1, id);
+
+    if (!resource) {
+        wl_client_post_no_memory(client);
+        return;
+    }
+    wl_resource_set_implementation(resource, &viewporter_implementation, NULL, NULL);
+}
+
+// wl_seat: a pointer with nothing else. Each pointer enters the first surface of its client
+// with contents, then moves in a circle over it at the -p rate, so clients can measure their
+// input latency.
+
+static void pointer_set_cursor(struct wl_client *client, struct wl_resource *resource, uint32_t serial, struct wl_resource *surface, int32_t x, int32_t y)
+{
+}
+
+static const struct wl_pointer_interface pointer_implementation = {
+    pointer_set_cursor,
+    destroy_resource
+};
+
+static void pointer_destroyed(struct wl_resource *resource)
+{
+    struct pointer *pointer = wl_resource_get_user_data(resource);
+
+    wl_list_remove(&pointer->link);
+    free(pointer);
+}
+
+static void seat_get_pointer(struct wl_client *client, struct wl_resource *resource, uint32_t id)
+{
+    struct pointer *pointer = calloc(1, sizeof(*pointer));
+
+    if (pointer)
+        pointer->resource = wl_resource_create(client, &wl_pointer_interface, wl_resource_get_version(resource), id);
+    if (!pointer || !pointer->resource) {
+        free(pointer);
+        wl_client_post_no_memory(client);
+        return;
+    }
+    wl_resource_set_implementation(pointer->resource, &pointer_implementation, pointer, pointer_destroyed);
+    wl_list_insert(data.pointers.prev, &pointer->link);
+}
+
+// The capabilities rule keyboards and touch out, but a racing client may still ask.
+static void seat_get_keyboard(struct wl_client *client, struct wl_resource *resource, uint32_t id)
+{
+    struct wl_resource *keyboard = wl_resource_create(client, &wl_keyboard_interface, wl_resource_get_version(resource), id);
+
+    if (!keyboard) {
+        wl_client_post_no_memory(client);
+        return;
+    }
+    wl_resource_set_implementation(keyboard, NULL, NULL, NULL);
+}
+
+static void seat_get_touch(struct wl_client *client, struct wl_resource *resource, uint32_t id)
+{
+    struct wl_resource *touch = wl_resource_create(client, &wl_touch_interface, wl_resource_get_version(resource), id);
+
+    if (!touch) {
+        wl_client_post_no_memory(client);
+        return;
+    }
+    wl_resource_set_implementation(touch, NULL, NULL, NULL);
+}
+
+static const struct wl_seat_interface seat_implementation = {
+    seat_get_pointer,
+    seat_get_keyboard,
+    seat_get_touch,
+    destroy_resource
+};
+
+static void bind_seat(struct wl_client *client, void *d, uint32_t version, uint32_t id)
+{
+    struct wl_resource *resource = wl_resource_create(client, &wl_seat_interface, version, id);
+
+    if (!resource) {
+        wl_client_post_no_memory(client);
+        return;
+    }
+    wl_resource_set_implementation(resource, &seat_implementation, NULL, NULL);
+    wl_seat_send_capabilities(resource, WL_SEAT_CAPABILITY_POINTER);
+    if (version >= WL_SEAT_NAME_SINCE_VERSION)
+        wl_seat_send_name(resource, "mock");
+}
+
+static struct surface *first_surface_of(struct wl_client *client)
+{
+    struct surface *surface;
+
+    wl_list_for_each(surface, &data.surfaces, link) {
+        if (wl_resource_get_client(surface->resource) == client && surface->pixels)
+            return surface;
+    }
+    return NULL;
+}
+
+static int move_pointers(void *d)
+{
+    struct pointer *pointer;
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    uint32_t time = (uint32_t)(ts.tv_sec * 1000 + ts.tv_nsec / 1000000);
+    // A turn every two seconds.
+    double angle = 3.14159265358979 * (ts.tv_sec % 2 + ts.tv_nsec / 1e9);
+
+    wl_list_for_each(pointer, &data.pointers, link) {
+        struct surface *surface = first_surface_of(wl_resource_get_client(pointer->resource));
+        if (!surface)
+            continue;
+        wl_fixed_t x = wl_fixed_from_double(surface->width * (0.5 + 0.4 * cos(angle)));
+        wl_fixed_t y = wl_fixed_from_double(surface->height * (0.5 + 0.4 * sin(angle)));
+        if (pointer->focus != surface) {
+            pointer->focus = surface;
+            wl_pointer_send_enter(pointer->resource, ++data.next_serial, surface->resource, x, y);
+            if (data.log)
+                fprintf(data.log, "enter %.3f surface=%u\n", log_time(now_seconds()), surface->id);
+        } else
+            wl_pointer_send_motion(pointer->resource, time, x, y);
+        if (wl_resource_get_version(pointer->resource) >= WL_POINTER_FRAME_SINCE_VERSION)
+            wl_pointer_send_frame(pointer->resource);
+        ++data.motions;
+    }
+
+    wl_event_source_timer_update(data.pointer_timer, 1000 / data.pointer_rate);
+    return 0;
+}
+
+// Refresh
+
+static void print_stats(const char *label, const struct counters *counters, double elapsed)
+{
+    printf("%s: %.1f commits/s, %.1f frame callbacks/s, %.1f presented/s, %.1f discarded/s, "
+           "%.0f damaged pixels/commit, copy %.3f ms/commit, buffers held %.3f ms\n",
+           label, counters->commits / elapsed, counters->frame_callbacks / elapsed, counters->presented / elapsed,
+           counters->discarded / elapsed, counters->commits ? counters->damage_pixels / counters->commits : 0.0,
+           counters->commits ? 1000 * counters->copy_seconds / counters->commits : 0.0,
+           counters->releases ? 1000 * counters->held_seconds / counters->releases : 0.0);
+}
+
+static int refresh(int fd, uint32_t mask, void *d)
+{
+    uint64_t expirations;
+    struct timespec ts;
+    struct surface *surface;
+    struct wl_resource *resource, *next;
+    unsigned callbacks = 0, presented = 0;
+
+    if (read(fd, &expirations, sizeof(expirations)) != sizeof(expirations))
+        return 0;
+    // Missed refreshes still count, so the sequence keeps matching the elapsed time.
+    data.refresh_sequence += expirations;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    uint32_t time = (uint32_t)(ts.tv_sec * 1000 + ts.tv_nsec / 1000000);
+    uint32_t refresh_ns = 1000000000 / data.refresh_rate;
+
+    wl_list_for_each(surface, &data.surfaces, link) {
+        wl_resource_for_each_safe(resource, next, &surface->feedbacks) {
+            wp_presentation_feedback_send_presented(resource, (uint32_t)((uint64_t)ts.tv_sec >> 32), (uint32_t)ts.tv_sec, ts.tv_nsec,
+                                                    refresh_ns, (uint32_t)(data.refresh_sequence >> 32), (uint32_t)data.refresh_sequence,
+                                                    WP_PRESENTATION_FEEDBACK_KIND_VSYNC);
+            wl_resource_destroy(resource);
+            ++presented;
+        }
+        wl_resource_for_each_safe(resource, next, &surface->frame_callbacks) {
+            wl_callback_send_done(resource, time);
+            wl_resource_destroy(resource);
+            ++callbacks;
+        }
+    }
+
+    data.interval.frame_callbacks += callbacks;
+    data.total.frame_callbacks += callbacks;
+    data.interval.presented += presented;
+    data.total.presented += presented;
+    if (data.log && (callbacks || presented))
+        fprintf(data.log, "refresh %.3f callbacks=%u presented=%u\n", log_time(now_seconds()), callbacks, presented);
+
+    double now = now_seconds();
+    if (now - data.interval_start >= 1) {
+        print_stats("Last second", &data.interval, now - data.interval_start);
+        memset(&data.interval, 0, sizeof(data.interval));
+        data.interval_start = now;
+    }
+    return 0;
+}
+
+static int init_refresh()
+{
+    struct itimerspec period;
+
+    data.refresh_fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
+    if (data.refresh_fd < 0)
+        return 0;
+    period.it_interval.tv_sec = 0;
+    period.it_interval.tv_nsec = 1000000000 / data.refresh_rate;
+    period.it_value = period.it_interval;
+    return !timerfd_settime(data.refresh_fd, 0, &period, NULL)
+        && wl_event_loop_add_fd(data.loop, data.refresh_fd, WL_EVENT_READABLE, refresh, NULL);
+}
+
+static int terminate(int signal_number, void *d)
+{
+    wl_display_terminate(data.display);
+    return 0;
+}
+
+static int timeout(void *d)
+{
+    wl_display_terminate(data.display);
+    return 0;
+}
+
+static void usage(const char *program)
+{
+    fprintf(stderr, "Usage: %s [-r hz] [-s socket] [-l log] [-k] [-p hz] [-t seconds]\n", program);
+    fprintf(stderr, "  -r  refresh rate of frame callbacks and presentation (1-1000, default 60)\n");
+    fprintf(stderr, "  -s  socket name (default: the first free wayland-N)\n");
+    fprintf(stderr, "  -l  log every commit, viewport change, buffer release and refresh to this file, - for stdout\n");
+    fprintf(stderr, "  -k  keep buffers until the next commit instead of releasing them once copied\n");
+    fprintf(stderr, "  -p  advertise a seat whose pointer moves at this rate (1-1000)\n");
+    fprintf(stderr, "  -t  exit after this many seconds\n");
+    exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+    const char *socket = NULL;
+    const char *log_path = NULL;
+    int seconds = 0;
+    int opt;
+
+    data.refresh_rate = 60;
+    while ((opt = getopt(argc, argv, "r:s:l:kp:t:")) != -1) {
+        switch (opt) {
+        case 'r':
+            data.refresh_rate = atoi(optarg);
+            break;
+        case 's':
+            socket = optarg;
+            break;
+        case 'l':
+            log_path = optarg;
+            break;
+        case 'k':
+            data.keep_buffers = 1;
+            break;
+        case 'p':
+            data.pointer_rate = atoi(optarg);
+            if (data.pointer_rate < 1 || data.pointer_rate > 1000)
+                usage(argv[0]);
+            break;
+        case 't':
+            seconds = atoi(optarg);
+            break;
+        default:
+            usage(argv[0]);
+        }
+    }
+    if (data.refresh_rate < 1 || data.refresh_rate > 1000)
+        usage(argv[0]);
+
+    if (log_path) {
+        data.log = strcmp(log_path, "-") ? fopen(log_path, "w") : stdout;
+        if (!data.log) {
+            fprintf(stderr, "Can't open %s: %s\n", log_path, strerror(errno));
+            exit(1);
+        }
+    }
+
+    data.display = wl_display_create();
+    if (!data.display) {
+        fprintf(stderr, "Can't create the display :/\n");
+        exit(1);
+    }
+    data.loop = wl_display_get_event_loop(data.display);
+    wl_list_init(&data.surfaces);
+    wl_list_init(&data.pointers);
+
+    if (socket ? wl_display_add_socket(data.display, socket) : !(socket = wl_display_add_socket_auto(data.display))) {
+        fprintf(stderr, "Can't listen on a socket :/\n");
+        exit(1);
+    }
+
+    if (!wl_global_create(data.display, &wl_compositor_interface, 4, NULL, bind_compositor)
+        || !wl_global_create(data.display, &wl_subcompositor_interface, 1, NULL, bind_subcompositor)
+        || !wl_global_create(data.display, &wl_shell_interface, 1, NULL, bind_shell)
+        || !wl_global_create(data.display, &zxdg_shell_v6_interface, 1, NULL, bind_xdg_shell)
+        || !wl_global_create(data.display, &wp_presentation_interface, 1, NULL, bind_presentation)
+        || !wl_global_create(data.display, &wp_viewporter_interface, 1, NULL, bind_viewporter)
+        || wl_display_init_shm(data.display)) {
+        fprintf(stderr, "Can't create the globals :/\n");
+        exit(1);
+    }
+
+    if (data.pointer_rate) {
+        data.pointer_timer = wl_event_loop_add_timer(data.loop, move_pointers, NULL);
+        if (!data.pointer_timer || !wl_global_create(data.display, &wl_seat_interface, 5, NULL, bind_seat)
+            || wl_event_source_timer_update(data.pointer_timer, 1000 / data.pointer_rate)) {
+            fprintf(stderr, "Can't create the seat :/\n");
+            exit(1);
+        }
+    }
+
+    if (!init_refresh()) {
+        fprintf(stderr, "Can't start the refresh timer :/\n");
+        exit(1);
+    }
+    wl_event_loop_add_signal(data.loop, SIGINT, terminate, NULL);
+    wl_event_loop_add_signal(data.loop, SIGTERM, terminate, NULL);
+    if (seconds > 0) {
+        struct wl_event_source *timer = wl_event_loop_add_timer(data.loop, timeout, NULL);
+        wl_event_source_timer_update(timer, seconds * 1000);
+    }
+
+    printf("Listening on %s at %u Hz, run clients with WAYLAND_DISPLAY=%s\n", socket, data.refresh_rate, socket);
+    fflush(stdout);
+    data.start = now_seconds();
+    data.interval_start = data.start;
+    wl_display_run(data.display);
+
+    print_stats("Total", &data.total, now_seconds() - data.start);
+    if (data.pointer_rate)
+        printf("Pointer: %.1f events/s\n", data.motions / (now_seconds() - data.start));
+    wl_display_destroy_clients(data.display);
+    wl_display_destroy(data.display);
+    close(data.refresh_fd);
+    if (data.log && data.log != stdout)
+        fclose(data.log);
+    return 0;
+}
@@ -0,0 +1,10 @@
+#ifndef OS_COMPAT_H
+#define OS_COMPAT_H
+
+#include <sys/types.h>
+
+// Creates an unlinked, close-on-exec file of the given size under XDG_RUNTIME_DIR,
+// suitable for sharing with the compositor through wl_shm.
+int os_create_anonymous_file(off_t size);
+
+#endif
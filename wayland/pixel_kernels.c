@@ -0,0 +1,433 @@
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HAVE_X86_KERNELS 1
+#endif
+
+#include "pixel_kernels.h"
+
+// Values of enum wl_shm_format, so this file does not depend on the Wayland headers.
+#define FOURCC(a, b, c, d) ((uint32_t)(a) | ((uint32_t)(b) << 8) | ((uint32_t)(c) << 16) | ((uint32_t)(d) << 24))
+#define SHM_FORMAT_ARGB8888 0
+#define SHM_FORMAT_XRGB8888 1
+#define SHM_FORMAT_ABGR8888 FOURCC('A', 'B', '2', '4')
+#define SHM_FORMAT_XBGR8888 FOURCC('X', 'B', '2', '4')
+
+// Spans at least this big are written with non-temporal stores: the compositor reads the
+// buffer long after we are done with it, so there is no point in pulling it into our cache.
+#define STREAMING_THRESHOLD (1 << 20)
+
+static inline uint32_t swap_rb(uint32_t p)
+{
+    return (p & 0xFF00FF00) | ((p >> 16) & 0xFF) | ((p & 0xFF) << 16);
+}
+
+// (a * b) / 255, rounded, for 8 bit values.
+static inline uint32_t mul_div255(uint32_t a, uint32_t b)
+{
+    uint32_t t = a * b + 128;
+    return (t + (t >> 8)) >> 8;
+}
+
+static inline uint32_t blend_pixel(uint32_t d, uint32_t s)
+{
+    uint32_t ia = 255 - (s >> 24);
+    uint32_t out = 0;
+    int shift;
+
+    for (shift = 0; shift < 32; shift += 8)
+        out |= (((s >> shift) & 0xFF) + mul_div255((d >> shift) & 0xFF, ia)) << shift;
+    return out;
+}
+
+// Gradients step each channel in 16.16 fixed point. All variants share this setup so they
+// produce bit-identical output.
+struct gradient {
+    int32_t start[4];
+    int32_t step[4];
+};
+
+static void gradient_init(struct gradient *g, size_t count, uint32_t from, uint32_t to)
+{
+    int c;
+
+    for (c = 0; c < 4; ++c) {
+        int32_t a = (from >> (8 * c)) & 0xFF;
+        int32_t b = (to >> (8 * c)) & 0xFF;
+        g->start[c] = (a << 16) + 0x8000;
+        g->step[c] = count > 1 ? (int32_t)(((int64_t)(b - a) << 16) / (int64_t)(count - 1)) : 0;
+    }
+}
+
+static inline uint32_t gradient_pixel(const struct gradient *g, size_t i)
+{
+    uint32_t out = 0;
+    int c;
+
+    for (c = 0; c < 4; ++c)
+        out |= (uint32_t)((g->start[c] + g->step[c] * (int32_t)i) >> 16) << (8 * c);
+    return out;
+}
+
+/* Portable fallback */
+
+static void fill_solid_scalar(uint32_t *dst, size_t count, uint32_t color)
+{
+    size_t i;
+
+    for (i = 0; i < count; ++i)
+        dst[i] = color;
+}
+
+static void fill_gradient_scalar(uint32_t *dst, size_t count, uint32_t from, uint32_t to)
+{
+    struct gradient g;
+    size_t i;
+
+    gradient_init(&g, count, from, to);
+    for (i = 0; i < count; ++i)
+        dst[i] = gradient_pixel(&g, i);
+}
+
+static void blend_over_scalar(uint32_t *dst, const uint32_t *src, size_t count)
+{
+    size_t i;
+
+    for (i = 0; i < count; ++i) {
+        uint32_t s = src[i];
+        uint32_t a = s >> 24;
+        if (a == 0xFF)
+            dst[i] = s;
+        else if (a || s)
+            dst[i] = blend_pixel(dst[i], s);
+    }
+}
+
+static void swizzle_scalar(uint32_t *dst, const uint32_t *src, size_t count, int rb, uint32_t or_mask)
+{
+    size_t i;
+
+    if (rb) {
+        for (i = 0; i < count; ++i)
+            dst[i] = swap_rb(src[i]) | or_mask;
+    } else {
+        for (i = 0; i < count; ++i)
+            dst[i] = src[i] | or_mask;
+    }
+}
+
+static const struct pixel_kernels scalar_kernels = {
+    "scalar",
+    fill_solid_scalar,
+    fill_gradient_scalar,
+    blend_over_scalar,
+    swizzle_scalar,
+};
+
+#ifdef HAVE_X86_KERNELS
+
+/* SSE2 */
+
+__attribute__((target("sse2")))
+static void fill_solid_sse2(uint32_t *dst, size_t count, uint32_t color)
+{
+    __m128i v = _mm_set1_epi32(color);
+    size_t i = 0;
+
+    if (count * 4 >= STREAMING_THRESHOLD) {
+        for (; i < count && ((uintptr_t)(dst + i) & 15); ++i)
+            dst[i] = color;
+        for (; i + 16 <= count; i += 16) {
+            _mm_stream_si128((__m128i *)(dst + i), v);
+            _mm_stream_si128((__m128i *)(dst + i + 4), v);
+            _mm_stream_si128((__m128i *)(dst + i + 8), v);
+            _mm_stream_si128((__m128i *)(dst + i + 12), v);
+        }
+        _mm_sfence();
+    }
+
+    for (; i + 4 <= count; i += 4)
+        _mm_storeu_si128((__m128i *)(dst + i), v);
+    for (; i < count; ++i)
+        dst[i] = color;
+}
+
+__attribute__((target("sse2")))
+static void fill_gradient_sse2(uint32_t *dst, size_t count, uint32_t from, uint32_t to)
+{
+    struct gradient g;
+    __m128i step, step4, v0, v1, v2, v3;
+    size_t i = 0;
+
+    gradient_init(&g, count, from, to);
+    step = _mm_loadu_si128((const __m128i *)g.step);
+    step4 = _mm_slli_epi32(step, 2);
+    v0 = _mm_loadu_si128((const __m128i *)g.start);
+    v1 = _mm_add_epi32(v0, step);
+    v2 = _mm_add_epi32(v1, step);
+    v3 = _mm_add_epi32(v2, step);
+
+    for (; i + 4 <= count; i += 4) {
+        __m128i lo = _mm_packs_epi32(_mm_srai_epi32(v0, 16), _mm_srai_epi32(v1, 16));
+        __m128i hi = _mm_packs_epi32(_mm_srai_epi32(v2, 16), _mm_srai_epi32(v3, 16));
+        _mm_storeu_si128((__m128i *)(dst + i), _mm_packus_epi16(lo, hi));
+        v0 = _mm_add_epi32(v0, step4);
+        v1 = _mm_add_epi32(v1, step4);
+        v2 = _mm_add_epi32(v2, step4);
+        v3 = _mm_add_epi32(v3, step4);
+    }
+    for (; i < count; ++i)
+        dst[i] = gradient_pixel(&g, i);
+}
+
+// Blends the 16 bit channels of two pixels: s + d * (255 - sa) / 255.
+__attribute__((target("sse2")))
+static inline __m128i blend_epi16_sse2(__m128i d, __m128i s)
+{
+    __m128i ia = _mm_shufflehi_epi16(_mm_shufflelo_epi16(s, 0xFF), 0xFF);
+    __m128i t;
+
+    ia = _mm_xor_si128(ia, _mm_set1_epi16(0xFF));
+    t = _mm_add_epi16(_mm_mullo_epi16(d, ia), _mm_set1_epi16(128));
+    t = _mm_srli_epi16(_mm_add_epi16(t, _mm_srli_epi16(t, 8)), 8);
+    return _mm_add_epi16(s, t);
+}
+
+__attribute__((target("sse2")))
+static void blend_over_sse2(uint32_t *dst, const uint32_t *src, size_t count)
+{
+    __m128i zero = _mm_setzero_si128();
+    size_t i = 0;
+
+    for (; i + 4 <= count; i += 4) {
+        __m128i s = _mm_loadu_si128((const __m128i *)(src + i));
+        __m128i d = _mm_loadu_si128((const __m128i *)(dst + i));
+        __m128i lo = blend_epi16_sse2(_mm_unpacklo_epi8(d, zero), _mm_unpacklo_epi8(s, zero));
+        __m128i hi = blend_epi16_sse2(_mm_unpackhi_epi8(d, zero), _mm_unpackhi_epi8(s, zero));
+        _mm_storeu_si128((__m128i *)(dst + i), _mm_packus_epi16(lo, hi));
+    }
+    blend_over_scalar(dst + i, src + i, count - i);
+}
+
+__attribute__((target("sse2")))
+static void swizzle_sse2(uint32_t *dst, const uint32_t *src, size_t count, int rb, uint32_t or_mask)
+{
+    __m128i mask = _mm_set1_epi32(or_mask);
+    __m128i ga = _mm_set1_epi32(0xFF00FF00);
+    __m128i low = _mm_set1_epi32(0xFF);
+    size_t i = 0;
+
+    for (; i + 4 <= count; i += 4) {
+        __m128i p = _mm_loadu_si128((const __m128i *)(src + i));
+        if (rb) {
+            __m128i r = _mm_and_si128(_mm_srli_epi32(p, 16), low);
+            __m128i b = _mm_slli_epi32(_mm_and_si128(p, low), 16);
+            p = _mm_or_si128(_mm_and_si128(p, ga), _mm_or_si128(r, b));
+        }
+        _mm_storeu_si128((__m128i *)(dst + i), _mm_or_si128(p, mask));
+    }
+    swizzle_scalar(dst + i, src + i, count - i, rb, or_mask);
+}
+
+static const struct pixel_kernels sse2_kernels = {
+    "sse2",
+    fill_solid_sse2,
+    fill_gradient_sse2,
+    blend_over_sse2,
+    swizzle_sse2,
+};
+
+/* AVX2 */
+
+__attribute__((target("avx2")))
+static void fill_solid_avx2(uint32_t *dst, size_t count, uint32_t color)
+{
+    __m256i v = _mm256_set1_epi32(color);
+    size_t i = 0;
+
+    if (count * 4 >= STREAMING_THRESHOLD) {
+        for (; i < count && ((uintptr_t)(dst + i) & 31); ++i)
+            dst[i] = color;
+        for (; i + 32 <= count; i += 32) {
+            _mm256_stream_si256((__m256i *)(dst + i), v);
+            _mm256_stream_si256((__m256i *)(dst + i + 8), v);
+            _mm256_stream_si256((__m256i *)(dst + i + 16), v);
+            _mm256_stream_si256((__m256i *)(dst + i + 24), v);
+        }
+        _mm_sfence();
+    }
+
+    for (; i + 8 <= count; i += 8)
+        _mm256_storeu_si256((__m256i *)(dst + i), v);
+    for (; i < count; ++i)
+        dst[i] = color;
+}
+
+__attribute__((target("avx2")))
+static void fill_gradient_avx2(uint32_t *dst, size_t count, uint32_t from, uint32_t to)
+{
+    struct gradient g;
+    __m128i step, start;
+    __m256i step8, v0, v1, v2, v3;
+    size_t i = 0;
+
+    gradient_init(&g, count, from, to);
+    step = _mm_loadu_si128((const __m128i *)g.step);
+    start = _mm_loadu_si128((const __m128i *)g.start);
+
+    // Lane k of vN holds pixel N + 4k, so the in-lane packs below emit pixels in order.
+    v0 = _mm256_set_m128i(_mm_add_epi32(start, _mm_slli_epi32(step, 2)), start);
+    v1 = _mm256_add_epi32(v0, _mm256_broadcastsi128_si256(step));
+    v2 = _mm256_add_epi32(v1, _mm256_broadcastsi128_si256(step));
+    v3 = _mm256_add_epi32(v2, _mm256_broadcastsi128_si256(step));
+    step8 = _mm256_broadcastsi128_si256(_mm_slli_epi32(step, 3));
+
+    for (; i + 8 <= count; i += 8) {
+        __m256i lo = _mm256_packs_epi32(_mm256_srai_epi32(v0, 16), _mm256_srai_epi32(v1, 16));
+        __m256i hi = _mm256_packs_epi32(_mm256_srai_epi32(v2, 16), _mm256_srai_epi32(v3, 16));
+        _mm256_storeu_si256((__m256i *)(dst + i), _mm256_packus_epi16(lo, hi));
+        v0 = _mm256_add_epi32(v0, step8);
+        v1 = _mm256_add_epi32(v1, step8);
+        v2 = _mm256_add_epi32(v2, step8);
+        v3 = _mm256_add_epi32(v3, step8);
+    }
+    for (; i < count; ++i)
+        dst[i] = gradient_pixel(&g, i);
+}
+
+__attribute__((target("avx2")))
+static inline __m256i blend_epi16_avx2(__m256i d, __m256i s)
+{
+    __m256i ia = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(s, 0xFF), 0xFF);
+    __m256i t;
+
+    ia = _mm256_xor_si256(ia, _mm256_set1_epi16(0xFF));
+    t = _mm256_add_epi16(_mm256_mullo_epi16(d, ia), _mm256_set1_epi16(128));
+    t = _mm256_srli_epi16(_mm256_add_epi16(t, _mm256_srli_epi16(t, 8)), 8);
+    return _mm256_add_epi16(s, t);
+}
+
+__attribute__((target("avx2")))
+static void blend_over_avx2(uint32_t *dst, const uint32_t *src, size_t count)
+{
+    __m256i zero = _mm256_setzero_si256();
+    size_t i = 0;
+
+    for (; i + 8 <= count; i += 8) {
+        __m256i s = _mm256_loadu_si256((const __m256i *)(src + i));
+        __m256i d = _mm256_loadu_si256((const __m256i *)(dst + i));
+        __m256i lo = blend_epi16_avx2(_mm256_unpacklo_epi8(d, zero), _mm256_unpacklo_epi8(s, zero));
+        __m256i hi = blend_epi16_avx2(_mm256_unpackhi_epi8(d, zero), _mm256_unpackhi_epi8(s, zero));
+        _mm256_storeu_si256((__m256i *)(dst + i), _mm256_packus_epi16(lo, hi));
+    }
+    blend_over_scalar(dst + i, src + i, count - i);
+}
+
+__attribute__((target("avx2")))
+static void swizzle_avx2(uint32_t *dst, const uint32_t *src, size_t count, int rb, uint32_t or_mask)
+{
+    __m256i mask = _mm256_set1_epi32(or_mask);
+    __m256i shuffle = rb
+        ? _mm256_setr_epi8(2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15,
+                           2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15)
+        : _mm256_setr_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15,
+                           0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+    size_t i = 0;
+
+    for (; i + 8 <= count; i += 8) {
+        __m256i p = _mm256_loadu_si256((const __m256i *)(src + i));
+        p = _mm256_shuffle_epi8(p, shuffle);
+        _mm256_storeu_si256((__m256i *)(dst + i), _mm256_or_si256(p, mask));
+    }
+    swizzle_scalar(dst + i, src + i, count - i, rb, or_mask);
+}
+
+static const struct pixel_kernels avx2_kernels = {
+    "avx2",
+    fill_solid_avx2,
+    fill_gradient_avx2,
+    blend_over_avx2,
+    swizzle_avx2,
+};
+
+#endif
+
+const struct pixel_kernels *pixel_kernels_get_variant(const char *name)
+{
+    if (!strcmp(name, "scalar"))
+        return &scalar_kernels;
+#ifdef HAVE_X86_KERNELS
+    __builtin_cpu_init();
+    if (!strcmp(name, "sse2") && __builtin_cpu_supports("sse2"))
+        return &sse2_kernels;
+    if (!strcmp(name, "avx2") && __builtin_cpu_supports("avx2"))
+        return &avx2_kernels;
+#endif
+    return NULL;
+}
+
+const struct pixel_kernels *pixel_kernels_get()
+{
+    static const struct pixel_kernels *kernels;
+    const char *forced;
+
+    if (kernels)
+        return kernels;
+
+    forced = getenv("PIXEL_KERNELS");
+    if (forced)
+        kernels = pixel_kernels_get_variant(forced);
+    if (!kernels)
+        kernels = pixel_kernels_get_variant("avx2");
+    if (!kernels)
+        kernels = pixel_kernels_get_variant("sse2");
+    if (!kernels)
+        kernels = &scalar_kernels;
+    return kernels;
+}
+
+int pixel_format_supported(uint32_t format)
+{
+    return format == SHM_FORMAT_ARGB8888 || format == SHM_FORMAT_XRGB8888
+        || format == SHM_FORMAT_ABGR8888 || format == SHM_FORMAT_XBGR8888;
+}
+
+static int format_is_bgr(uint32_t format)
+{
+    return format == SHM_FORMAT_ABGR8888 || format == SHM_FORMAT_XBGR8888;
+}
+
+static int format_has_alpha(uint32_t format)
+{
+    return format == SHM_FORMAT_ARGB8888 || format == SHM_FORMAT_ABGR8888;
+}
+
+int pixel_convert(const struct pixel_kernels *kernels, uint32_t *dst, uint32_t dst_format,
+                  const uint32_t *src, uint32_t src_format, size_t count)
+{
+    int rb;
+    uint32_t or_mask;
+
+    if (!pixel_format_supported(dst_format) || !pixel_format_supported(src_format))
+        return -1;
+
+    // Only the channel order and the meaning of the top byte differ between these formats.
+    rb = format_is_bgr(dst_format) != format_is_bgr(src_format);
+    or_mask = format_has_alpha(dst_format) && !format_has_alpha(src_format) ? 0xFF000000 : 0;
+
+    if (!rb && !or_mask) {
+        if (dst != src)
+            memmove(dst, src, count * 4);
+        return 0;
+    }
+
+    kernels->swizzle(dst, src, count, rb, or_mask);
+    return 0;
+}
+
+uint32_t pixel_color_from_argb(uint32_t argb, uint32_t format)
+{
+    return format_is_bgr(format) ? swap_rb(argb) : argb;
+}
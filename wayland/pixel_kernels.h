@@ -0,0 +1,41 @@
+#ifndef PIXEL_KERNELS_H
+#define PIXEL_KERNELS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Span kernels over 32 bits per pixel data. SHM buffers in this project are tightly packed
+// (stride == width * 4), so a whole buffer, or a run of full rows, is a single span.
+//
+// Colors are always given in the format of the destination buffer.
+struct pixel_kernels {
+    const char *name;
+
+    void (*fill_solid)(uint32_t *dst, size_t count, uint32_t color);
+    // Linear per-channel interpolation from `from` (first pixel) to `to` (last pixel).
+    void (*fill_gradient)(uint32_t *dst, size_t count, uint32_t from, uint32_t to);
+    // Porter-Duff "over" of premultiplied `src` onto `dst`, both in the same channel order.
+    void (*blend_over)(uint32_t *dst, const uint32_t *src, size_t count);
+    // dst = src | or_mask, with bytes 0 and 2 swapped first when `swap_rb` is set.
+    void (*swizzle)(uint32_t *dst, const uint32_t *src, size_t count, int swap_rb, uint32_t or_mask);
+};
+
+// Returns the fastest variant the CPU supports. Setting PIXEL_KERNELS=scalar|sse2|avx2 in the
+// environment forces a variant, if supported.
+const struct pixel_kernels *pixel_kernels_get();
+
+// Returns the named variant, or NULL if unknown or unsupported by this CPU.
+const struct pixel_kernels *pixel_kernels_get_variant(const char *name);
+
+// Returns 1 if pixel_convert() can handle the format.
+int pixel_format_supported(uint32_t wl_shm_format);
+
+// Converts `count` pixels between two 32 bits per pixel wl_shm formats. Returns -1 if one
+// of them is not supported.
+int pixel_convert(const struct pixel_kernels *kernels, uint32_t *dst, uint32_t dst_format,
+                  const uint32_t *src, uint32_t src_format, size_t count);
+
+// Converts a single ARGB8888 color to the given format.
+uint32_t pixel_color_from_argb(uint32_t argb, uint32_t wl_shm_format);
+
+#endif
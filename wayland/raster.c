@@ -0,0 +1,425 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "raster.h"
+
+static int min(int a, int b)
+{
+    return a < b ? a : b;
+}
+
+static int max(int a, int b)
+{
+    return a > b ? a : b;
+}
+
+static int floor_div(int a, int b)
+{
+    return a >= 0 ? a / b : -((-a + b - 1) / b);
+}
+
+void raster_init(struct raster *raster, struct thread_pool *pool)
+{
+    memset(raster, 0, sizeof(*raster));
+    raster->pool = pool;
+    raster->kernels = pixel_kernels_get();
+}
+
+void raster_finish(struct raster *raster)
+{
+    int i;
+
+    for (i = 0; i < raster->bin_capacity; ++i)
+        free(raster->bins[i].commands);
+    free(raster->bins);
+    free(raster->active_tiles);
+    free(raster->commands);
+    memset(raster, 0, sizeof(*raster));
+}
+
+void raster_begin(struct raster *raster, const struct raster_target *target, int clip_x, int clip_y, int clip_width, int clip_height)
+{
+    raster->target = *target;
+    raster->clip_x0 = max(clip_x, 0);
+    raster->clip_y0 = max(clip_y, 0);
+    raster->clip_x1 = min(clip_x + clip_width, target->width);
+    raster->clip_y1 = min(clip_y + clip_height, target->height);
+    raster->command_count = 0;
+}
+
+// Returns a new command with its bounding box clipped, or NULL if nothing of it is visible.
+static struct raster_command *add_command(struct raster *raster, enum raster_command_type type, int x0, int y0, int x1, int y1)
+{
+    struct raster_command *command;
+
+    x0 = max(x0, raster->clip_x0);
+    y0 = max(y0, raster->clip_y0);
+    x1 = min(x1, raster->clip_x1);
+    y1 = min(y1, raster->clip_y1);
+    if (x0 >= x1 || y0 >= y1)
+        return NULL;
+
+    if (raster->command_count == raster->command_capacity) {
+        int capacity = raster->command_capacity ? 2 * raster->command_capacity : 256;
+        struct raster_command *commands = realloc(raster->commands, capacity * sizeof(*commands));
+        if (!commands) {
+            fprintf(stderr, "Failed to grow the raster command list\n");
+            return NULL;
+        }
+        raster->commands = commands;
+        raster->command_capacity = capacity;
+    }
+
+    command = &raster->commands[raster->command_count++];
+    command->type = type;
+    command->x0 = x0;
+    command->y0 = y0;
+    command->x1 = x1;
+    command->y1 = y1;
+    return command;
+}
+
+void raster_fill_rect(struct raster *raster, int x, int y, int width, int height, uint32_t color)
+{
+    struct raster_command *command = add_command(raster, RASTER_RECT, x, y, x + width, y + height);
+
+    if (command)
+        command->rect.color = color;
+}
+
+void raster_fill_triangle(struct raster *raster, const float x[3], const float y[3], const uint32_t color[3])
+{
+    struct raster_command *command;
+    float area;
+    int i, k;
+
+    area = (x[1] - x[0]) * (y[2] - y[0]) - (y[1] - y[0]) * (x[2] - x[0]);
+    if (area == 0)
+        return;
+
+    command = add_command(raster, RASTER_TRIANGLE,
+                          (int)floorf(fminf(x[0], fminf(x[1], x[2]))), (int)floorf(fminf(y[0], fminf(y[1], y[2]))),
+                          (int)ceilf(fmaxf(x[0], fmaxf(x[1], x[2]))), (int)ceilf(fmaxf(y[0], fmaxf(y[1], y[2]))));
+    if (!command)
+        return;
+
+    // Edge i is the one facing vertex i, so its function is vertex i's barycentric coordinate.
+    for (i = 0; i < 3; ++i) {
+        int j = (i + 1) % 3;
+        int l = (i + 2) % 3;
+        float a = (y[j] - y[l]) / area;
+        float b = (x[l] - x[j]) / area;
+
+        command->triangle.a[i] = a;
+        command->triangle.b[i] = b;
+        command->triangle.c[i] = -(a * x[j] + b * y[j]);
+        command->triangle.inverse_a[i] = a ? 1 / a : 0;
+        // Top-left rule with y down: the inside is to the right of left edges, below top ones.
+        command->triangle.inclusive[i] = a > 0 || (a == 0 && b > 0);
+    }
+
+    command->triangle.opaque = 1;
+    for (k = 0; k < 4; ++k) {
+        command->triangle.color_a[k] = 0;
+        command->triangle.color_b[k] = 0;
+        command->triangle.color_c[k] = 0;
+        for (i = 0; i < 3; ++i) {
+            float channel = (color[i] >> (8 * k)) & 0xFF;
+            command->triangle.color_a[k] += command->triangle.a[i] * channel;
+            command->triangle.color_b[k] += command->triangle.b[i] * channel;
+            command->triangle.color_c[k] += command->triangle.c[i] * channel;
+        }
+    }
+    for (i = 0; i < 3; ++i)
+        command->triangle.opaque &= color[i] >> 24 == 0xFF;
+}
+
+void raster_draw_texture(struct raster *raster, int x, int y, int width, int height, const struct raster_texture *texture)
+{
+    struct raster_command *command;
+
+    if (width <= 0 || height <= 0)
+        return;
+
+    command = add_command(raster, RASTER_TEXTURED_QUAD, x, y, x + width, y + height);
+    if (!command)
+        return;
+
+    command->quad.x = x;
+    command->quad.y = y;
+    command->quad.width = width;
+    command->quad.height = height;
+    command->quad.texture = texture;
+}
+
+// Writes a span of source pixels, blending it unless it is known to be opaque.
+static void write_span(struct raster *raster, uint32_t *dst, const uint32_t *src, int count, int opaque)
+{
+    if (opaque)
+        memcpy(dst, src, count * sizeof(*dst));
+    else
+        raster->kernels->blend_over(dst, src, count);
+}
+
+static void shade_rect(struct raster *raster, const struct raster_command *command, int x0, int y0, int x1, int y1)
+{
+    uint32_t color = command->rect.color;
+    uint32_t span[RASTER_TILE_SIZE];
+    int y;
+
+    if (color >> 24 == 0xFF) {
+        for (y = y0; y < y1; ++y)
+            raster->kernels->fill_solid(raster->target.pixels + (size_t)y * raster->target.stride + x0, x1 - x0, color);
+        return;
+    }
+
+    raster->kernels->fill_solid(span, x1 - x0, color);
+    for (y = y0; y < y1; ++y)
+        raster->kernels->blend_over(raster->target.pixels + (size_t)y * raster->target.stride + x0, span, x1 - x0);
+}
+
+static int inside_edge(const struct raster_command *command, int i, float w)
+{
+    return w > 0 || (w == 0 && command->triangle.inclusive[i]);
+}
+
+static int inside_edge_at(const struct raster_command *command, int i, int x, float k)
+{
+    return inside_edge(command, i, command->triangle.a[i] * (x + 0.5f) + k);
+}
+
+// Finds the covered pixels [*start, *end) of row y, within [x0, x1). Triangles are convex, so
+// they are contiguous, and each edge bounds them on one side.
+static void triangle_span(const struct raster_command *command, int y, int x0, int x1, int *start, int *end)
+{
+    float py = y + 0.5f;
+    int i;
+
+    *start = x0;
+    *end = x1;
+    for (i = 0; i < 3 && *start < *end; ++i) {
+        float a = command->triangle.a[i];
+        float k = command->triangle.b[i] * py + command->triangle.c[i];
+        float crossing;
+        int x;
+
+        if (!a) {
+            if (!inside_edge(command, i, k))
+                *end = *start;
+            continue;
+        }
+
+        // Where the edge crosses the row, in pixel indices, clamped so the conversion can't overflow.
+        crossing = -k * command->triangle.inverse_a[i] - 0.5f;
+        crossing = crossing < x0 - 1 ? x0 - 1 : crossing > x1 + 1 ? x1 + 1 : crossing;
+        x = (int)crossing;
+
+        // The estimate is off by a pixel at most; settle it with the exact test, so neighbouring
+        // triangles agree on the pixels of the edge they share.
+        if (a > 0) {
+            while (x > *start && inside_edge_at(command, i, x - 1, k))
+                --x;
+            while (x < *end && !inside_edge_at(command, i, x, k))
+                ++x;
+            *start = x > *start ? x : *start;
+        } else {
+            ++x;
+            while (x < *end && inside_edge_at(command, i, x, k))
+                ++x;
+            while (x > *start && !inside_edge_at(command, i, x - 1, k))
+                --x;
+            *end = x < *end ? x : *end;
+        }
+    }
+}
+
+static void shade_triangle(struct raster *raster, const struct raster_command *command, int x0, int y0, int x1, int y1)
+{
+    uint32_t span[RASTER_TILE_SIZE];
+    // Pixels are little endian, channel k is byte k.
+    uint8_t *bytes = (uint8_t *)span;
+    int x, y, k, start, end;
+
+    for (y = y0; y < y1; ++y) {
+        float py = y + 0.5f;
+
+        triangle_span(command, y, x0, x1, &start, &end);
+        if (start >= end)
+            continue;
+
+        // One channel at a time, in 16.16 fixed point: simple enough loops for the compiler to vectorize.
+        for (k = 0; k < 4; ++k) {
+            float first = command->triangle.color_a[k] * (start + 0.5f) + command->triangle.color_b[k] * py + command->triangle.color_c[k];
+            int32_t value = (int32_t)(first * 65536) + 0x8000;
+            int32_t step = (int32_t)(command->triangle.color_a[k] * 65536);
+
+            for (x = 0; x < end - start; ++x) {
+                int32_t channel = (value + x * step) >> 16;
+                bytes[4 * x + k] = channel < 0 ? 0 : channel > 255 ? 255 : channel;
+            }
+        }
+        write_span(raster, raster->target.pixels + (size_t)y * raster->target.stride + start, span, end - start, command->triangle.opaque);
+    }
+}
+
+static void shade_textured_quad(struct raster *raster, const struct raster_command *command, int x0, int y0, int x1, int y1)
+{
+    const struct raster_texture *texture = command->quad.texture;
+    uint32_t span[RASTER_TILE_SIZE];
+    // 16.16 fixed point texel steps, sampling at pixel centers.
+    int64_t u_step = ((int64_t)texture->width << 16) / command->quad.width;
+    int64_t v_step = ((int64_t)texture->height << 16) / command->quad.height;
+    int x, y;
+
+    for (y = y0; y < y1; ++y) {
+        int64_t v = (v_step >> 1) + (y - command->quad.y) * v_step;
+        const uint32_t *row = texture->pixels + (size_t)(v >> 16) * texture->stride;
+        int64_t u = (u_step >> 1) + (x0 - command->quad.x) * u_step;
+
+        for (x = x0; x < x1; ++x, u += u_step)
+            span[x - x0] = row[u >> 16];
+        write_span(raster, raster->target.pixels + (size_t)y * raster->target.stride + x0, span, x1 - x0, texture->opaque);
+    }
+}
+
+static int tile_x0(const struct raster *raster)
+{
+    return floor_div(raster->clip_x0, RASTER_TILE_SIZE);
+}
+
+static int tile_y0(const struct raster *raster)
+{
+    return floor_div(raster->clip_y0, RASTER_TILE_SIZE);
+}
+
+static void shade_tile(void *d, int task)
+{
+    struct raster *raster = d;
+    int index = raster->active_tiles[task];
+    const struct raster_bin *bin = &raster->bins[index];
+    int tx = index % raster->tiles_x + tile_x0(raster);
+    int ty = index / raster->tiles_x + tile_y0(raster);
+    int tile_left = max(tx * RASTER_TILE_SIZE, raster->clip_x0);
+    int tile_top = max(ty * RASTER_TILE_SIZE, raster->clip_y0);
+    int tile_right = min((tx + 1) * RASTER_TILE_SIZE, raster->clip_x1);
+    int tile_bottom = min((ty + 1) * RASTER_TILE_SIZE, raster->clip_y1);
+    int i;
+
+    for (i = 0; i < bin->count; ++i) {
+        const struct raster_command *command = &raster->commands[bin->commands[i]];
+        int x0 = max(command->x0, tile_left);
+        int y0 = max(command->y0, tile_top);
+        int x1 = min(command->x1, tile_right);
+        int y1 = min(command->y1, tile_bottom);
+
+        switch (command->type) {
+        case RASTER_RECT:
+            shade_rect(raster, command, x0, y0, x1, y1);
+            break;
+        case RASTER_TRIANGLE:
+            shade_triangle(raster, command, x0, y0, x1, y1);
+            break;
+        case RASTER_TEXTURED_QUAD:
+            shade_textured_quad(raster, command, x0, y0, x1, y1);
+            break;
+        }
+    }
+}
+
+// Whether some of the tile may be inside the triangle: false once a whole edge rejects all four corners.
+static int triangle_overlaps_tile(const struct raster_command *command, int left, int top, int right, int bottom)
+{
+    int i;
+
+    for (i = 0; i < 3; ++i) {
+        float a = command->triangle.a[i];
+        float b = command->triangle.b[i];
+        // The corner furthest inside this edge.
+        float x = a > 0 ? right - 0.5f : left + 0.5f;
+        float y = b > 0 ? bottom - 0.5f : top + 0.5f;
+
+        if (!inside_edge(command, i, a * x + b * y + command->triangle.c[i]))
+            return 0;
+    }
+    return 1;
+}
+
+static void bin_command(struct raster *raster, int index)
+{
+    const struct raster_command *command = &raster->commands[index];
+    int tx0 = floor_div(command->x0, RASTER_TILE_SIZE) - tile_x0(raster);
+    int ty0 = floor_div(command->y0, RASTER_TILE_SIZE) - tile_y0(raster);
+    int tx1 = floor_div(command->x1 - 1, RASTER_TILE_SIZE) - tile_x0(raster);
+    int ty1 = floor_div(command->y1 - 1, RASTER_TILE_SIZE) - tile_y0(raster);
+    int tx, ty;
+
+    for (ty = ty0; ty <= ty1; ++ty) {
+        for (tx = tx0; tx <= tx1; ++tx) {
+            struct raster_bin *bin = &raster->bins[ty * raster->tiles_x + tx];
+
+            if (command->type == RASTER_TRIANGLE) {
+                int left = (tx + tile_x0(raster)) * RASTER_TILE_SIZE;
+                int top = (ty + tile_y0(raster)) * RASTER_TILE_SIZE;
+                if (!triangle_overlaps_tile(command, left, top, left + RASTER_TILE_SIZE, top + RASTER_TILE_SIZE))
+                    continue;
+            }
+
+            if (bin->count == bin->capacity) {
+                int capacity = bin->capacity ? 2 * bin->capacity : 16;
+                int *commands = realloc(bin->commands, capacity * sizeof(*commands));
+                if (!commands) {
+                    fprintf(stderr, "Failed to grow a raster tile bin\n");
+                    continue;
+                }
+                bin->commands = commands;
+                bin->capacity = capacity;
+            }
+            bin->commands[bin->count++] = index;
+            raster->stats.binned++;
+        }
+    }
+}
+
+void raster_end(struct raster *raster)
+{
+    int tile_count, active, i;
+
+    raster->stats.frames++;
+    raster->stats.commands += raster->command_count;
+    if (!raster->command_count)
+        return;
+
+    raster->tiles_x = floor_div(raster->clip_x1 - 1, RASTER_TILE_SIZE) - tile_x0(raster) + 1;
+    raster->tiles_y = floor_div(raster->clip_y1 - 1, RASTER_TILE_SIZE) - tile_y0(raster) + 1;
+    tile_count = raster->tiles_x * raster->tiles_y;
+    if (tile_count > raster->bin_capacity) {
+        struct raster_bin *bins = realloc(raster->bins, tile_count * sizeof(*bins));
+        int *active_tiles = bins ? realloc(raster->active_tiles, tile_count * sizeof(*active_tiles)) : NULL;
+        if (bins) {
+            memset(bins + raster->bin_capacity, 0, (tile_count - raster->bin_capacity) * sizeof(*bins));
+            raster->bins = bins;
+        }
+        if (!active_tiles) {
+            fprintf(stderr, "Failed to allocate %d raster tile bins\n", tile_count);
+            return;
+        }
+        raster->active_tiles = active_tiles;
+        raster->bin_capacity = tile_count;
+    }
+    for (i = 0; i < tile_count; ++i)
+        raster->bins[i].count = 0;
+
+    for (i = 0; i < raster->command_count; ++i)
+        bin_command(raster, i);
+
+    active = 0;
+    for (i = 0; i < tile_count; ++i) {
+        if (raster->bins[i].count)
+            raster->active_tiles[active++] = i;
+    }
+
+    raster->stats.tiles += active;
+    thread_pool_run(raster->pool, active, shade_tile, raster);
+}
@@ -0,0 +1,120 @@
+#ifndef RASTER_H
+#define RASTER_H
+
+#include <stdint.h>
+
+#include "pixel_kernels.h"
+#include "thread_pool.h"
+
+#define RASTER_TILE_SIZE 64
+
+// Colors are premultiplied, in the destination's channel order with alpha in the top byte, so
+// every 32 bits per pixel wl_shm format works. Alpha below 0xFF blends over what is underneath.
+
+struct raster_target {
+    uint32_t *pixels;
+    int width;
+    int height;
+    // In pixels.
+    int stride;
+};
+
+struct raster_texture {
+    const uint32_t *pixels;
+    int width;
+    int height;
+    int stride;
+    // Skips blending when every texel is known to be opaque.
+    int opaque;
+};
+
+enum raster_command_type {
+    RASTER_RECT,
+    RASTER_TRIANGLE,
+    RASTER_TEXTURED_QUAD,
+};
+
+struct raster_command {
+    enum raster_command_type type;
+    // Bounding box, [x0, x1) x [y0, y1), clipped to the frame's clip rectangle.
+    int x0, y0, x1, y1;
+    union {
+        struct {
+            uint32_t color;
+        } rect;
+        struct {
+            // Edge functions w = a * x + b * y + c, oriented positive inside and scaled so the
+            // three sum to 1, i.e. they are the barycentric coordinates. Channel k of the color
+            // is then color_a[k] * x + color_b[k] * y + color_c[k].
+            float a[3], b[3], c[3];
+            // 1 / a, or 0 for horizontal edges.
+            float inverse_a[3];
+            // Whether a pixel center right on the edge is inside.
+            int inclusive[3];
+            float color_a[4], color_b[4], color_c[4];
+            int opaque;
+        } triangle;
+        struct {
+            // Destination before clipping.
+            int x, y, width, height;
+            const struct raster_texture *texture;
+        } quad;
+    };
+};
+
+// Commands overlapping one tile, in submission order.
+struct raster_bin {
+    int *commands;
+    int count;
+    int capacity;
+};
+
+struct raster_stats {
+    unsigned frames;
+    unsigned long commands;
+    // Command and tile pairs shaded, the binning overhead shows as this over `commands`.
+    unsigned long binned;
+    unsigned long tiles;
+};
+
+// Tile based rasterizer. A frame records commands between raster_begin() and raster_end(); the
+// end bins them into RASTER_TILE_SIZE tiles and shades every tile on the thread pool, each tile
+// drawing its commands in order. Tiles never share pixels, so no locking is needed and the
+// result is the same whatever the thread count.
+struct raster {
+    struct thread_pool *pool;
+    const struct pixel_kernels *kernels;
+
+    struct raster_target target;
+    int clip_x0, clip_y0, clip_x1, clip_y1;
+
+    struct raster_command *commands;
+    int command_count;
+    int command_capacity;
+
+    int tiles_x;
+    int tiles_y;
+    struct raster_bin *bins;
+    int bin_capacity;
+    // Indices of the bins with commands in them, the tasks handed to the pool.
+    int *active_tiles;
+
+    struct raster_stats stats;
+};
+
+void raster_init(struct raster *raster, struct thread_pool *pool);
+void raster_finish(struct raster *raster);
+
+// Starts recording a frame that only touches the clip rectangle of the target.
+void raster_begin(struct raster *raster, const struct raster_target *target, int clip_x, int clip_y, int clip_width, int clip_height);
+// Draws the frame into the target, and returns once all tiles are done.
+void raster_end(struct raster *raster);
+
+void raster_fill_rect(struct raster *raster, int x, int y, int width, int height, uint32_t color);
+// Gouraud shaded triangle, either winding. Pixels are covered when their center is inside, with
+// a top-left rule so triangles sharing an edge don't blend twice over it.
+void raster_fill_triangle(struct raster *raster, const float x[3], const float y[3], const uint32_t color[3]);
+// Nearest neighbour scaled texture. The texture must stay alive until raster_end().
+void raster_draw_texture(struct raster *raster, int x, int y, int width, int height, const struct raster_texture *texture);
+
+#endif
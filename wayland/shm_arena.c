@@ -0,0 +1,196 @@
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "os_compat.h"
+#include "shm_arena.h"
+
+// Default huge page size on x86-64 and arm64; hugetlbfs files must be a multiple of it.
+static const size_t HUGE_PAGE_SIZE = 2 * 1024 * 1024;
+
+static size_t round_up(size_t value, size_t alignment)
+{
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+static int create_memfd(size_t size, int hugepages)
+{
+#ifdef MFD_ALLOW_SEALING
+    unsigned flags = MFD_CLOEXEC | MFD_ALLOW_SEALING;
+    int fd;
+
+#ifdef MFD_HUGETLB
+    if (hugepages)
+        flags |= MFD_HUGETLB;
+#endif
+    fd = memfd_create("shm-arena", flags);
+    if (fd < 0)
+        return -1;
+
+    if (ftruncate(fd, size) < 0) {
+        close(fd);
+        return -1;
+    }
+
+    // Not every file system takes every seal, and a missing seal is no reason to fail.
+    fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL);
+    return fd;
+#else
+    errno = ENOSYS;
+    return -1;
+#endif
+}
+
+int shm_arena_init(struct shm_arena *arena, size_t size, int flags)
+{
+    memset(arena, 0, sizeof(*arena));
+    arena->fd = -1;
+    arena->alignment = sysconf(_SC_PAGESIZE);
+
+    if (flags & SHM_ARENA_HUGEPAGES) {
+        // Fails when no huge pages are reserved, which is the default almost everywhere.
+        arena->size = round_up(size, HUGE_PAGE_SIZE);
+        arena->fd = create_memfd(arena->size, 1);
+        if (arena->fd >= 0) {
+            arena->data = mmap(0, arena->size, PROT_READ | PROT_WRITE, MAP_SHARED, arena->fd, 0);
+            if (arena->data == MAP_FAILED) {
+                arena->data = NULL;
+                close(arena->fd);
+                arena->fd = -1;
+            } else
+                arena->hugepages = 1;
+        }
+    }
+
+    if (!arena->data) {
+        arena->size = round_up(size, arena->alignment);
+        arena->fd = create_memfd(arena->size, 0);
+        // Kernels older than 3.17 have no memfd.
+        if (arena->fd < 0)
+            arena->fd = os_create_anonymous_file(arena->size);
+        if (arena->fd < 0) {
+            fprintf(stderr, "Failed to create file with %zu bytes: %m\n", arena->size);
+            return -1;
+        }
+
+        arena->data = mmap(0, arena->size, PROT_READ | PROT_WRITE, MAP_SHARED, arena->fd, 0);
+        if (arena->data == MAP_FAILED) {
+            fprintf(stderr, "mmap failed: %m\n");
+            arena->data = NULL;
+            shm_arena_finish(arena);
+            return -1;
+        }
+#ifdef MADV_HUGEPAGE
+        // Transparent huge pages for shmem, when the system allows them.
+        if (flags & SHM_ARENA_HUGEPAGES)
+            madvise(arena->data, arena->size, MADV_HUGEPAGE);
+#endif
+    }
+
+    arena->free_capacity = 16;
+    arena->free_blocks = malloc(arena->free_capacity * sizeof(*arena->free_blocks));
+    if (!arena->free_blocks) {
+        shm_arena_finish(arena);
+        return -1;
+    }
+    arena->free_blocks[0].offset = 0;
+    arena->free_blocks[0].size = arena->size;
+    arena->free_count = 1;
+    return 0;
+}
+
+void shm_arena_finish(struct shm_arena *arena)
+{
+    if (arena->data)
+        munmap(arena->data, arena->size);
+    if (arena->fd >= 0)
+        close(arena->fd);
+    free(arena->free_blocks);
+    memset(arena, 0, sizeof(*arena));
+    arena->fd = -1;
+}
+
+long shm_arena_alloc(struct shm_arena *arena, size_t size)
+{
+    size_t offset;
+    int i;
+
+    size = round_up(size, arena->alignment);
+
+    // First fit: buffers are few and long lived, so fragmentation matters less than speed.
+    for (i = 0; i < arena->free_count; ++i) {
+        if (arena->free_blocks[i].size >= size)
+            break;
+    }
+    if (i == arena->free_count) {
+        arena->stats.failures++;
+        return -1;
+    }
+
+    offset = arena->free_blocks[i].offset;
+    arena->free_blocks[i].offset += size;
+    arena->free_blocks[i].size -= size;
+    if (!arena->free_blocks[i].size) {
+        memmove(&arena->free_blocks[i], &arena->free_blocks[i + 1], (arena->free_count - i - 1) * sizeof(*arena->free_blocks));
+        arena->free_count--;
+    }
+
+    arena->stats.allocations++;
+    arena->stats.in_use += size;
+    if (arena->stats.in_use > arena->stats.peak)
+        arena->stats.peak = arena->stats.in_use;
+    return offset;
+}
+
+void shm_arena_free(struct shm_arena *arena, size_t offset, size_t size)
+{
+    struct shm_arena_block *blocks;
+    int i;
+
+    size = round_up(size, arena->alignment);
+    arena->stats.frees++;
+    arena->stats.in_use -= size;
+
+    for (i = 0; i < arena->free_count; ++i) {
+        if (arena->free_blocks[i].offset > offset)
+            break;
+    }
+
+    // Merge with the free ranges right before and after, if they touch.
+    blocks = arena->free_blocks;
+    if (i > 0 && blocks[i - 1].offset + blocks[i - 1].size == offset) {
+        blocks[i - 1].size += size;
+        if (i < arena->free_count && offset + size == blocks[i].offset) {
+            blocks[i - 1].size += blocks[i].size;
+            memmove(&blocks[i], &blocks[i + 1], (arena->free_count - i - 1) * sizeof(*blocks));
+            arena->free_count--;
+        }
+        return;
+    }
+    if (i < arena->free_count && offset + size == blocks[i].offset) {
+        blocks[i].offset = offset;
+        blocks[i].size += size;
+        return;
+    }
+
+    if (arena->free_count == arena->free_capacity) {
+        blocks = realloc(arena->free_blocks, 2 * arena->free_capacity * sizeof(*blocks));
+        if (!blocks) {
+            // Leaks the range, which is better than corrupting the list.
+            fprintf(stderr, "Failed to grow the arena free list\n");
+            return;
+        }
+        arena->free_blocks = blocks;
+        arena->free_capacity *= 2;
+    }
+    memmove(&blocks[i + 1], &blocks[i], (arena->free_count - i) * sizeof(*blocks));
+    blocks[i].offset = offset;
+    blocks[i].size = size;
+    arena->free_count++;
+}
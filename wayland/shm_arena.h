@@ -0,0 +1,70 @@
+#ifndef SHM_ARENA_H
+#define SHM_ARENA_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+struct wl_buffer;
+struct wl_shm;
+struct wl_shm_pool;
+
+// Back the arena with huge pages when the system has some reserved, plain pages otherwise.
+#define SHM_ARENA_HUGEPAGES 0x1
+
+struct shm_arena_block {
+    size_t offset;
+    size_t size;
+};
+
+struct shm_arena_stats {
+    unsigned allocations;
+    unsigned frees;
+    unsigned failures;
+    size_t in_use;
+    size_t peak;
+};
+
+// One shared memory file, mapped once, that many buffers of any size are carved out of. Freed
+// ranges go back to a free list, sorted by offset and merged with their neighbours, so buffers
+// recreated at the same size reuse memory that is already faulted in.
+//
+// The file is a sealed memfd when the kernel has them: it can never shrink under the compositor's
+// feet, which would make it crash on SIGBUS.
+struct shm_arena {
+    int fd;
+    char *data;
+    size_t size;
+    size_t alignment;
+    int hugepages;
+    struct shm_arena_block *free_blocks;
+    int free_count;
+    int free_capacity;
+    struct shm_arena_stats stats;
+    // The single wl_shm_pool shared by every buffer, once shm_arena_create_pool() was called.
+    struct wl_shm_pool *pool;
+};
+
+struct shm_arena_buffer {
+    struct wl_buffer *buffer;
+    void *data;
+    size_t offset;
+    size_t size;
+};
+
+// Creates an arena of at least `size` bytes. Returns -1 on failure.
+int shm_arena_init(struct shm_arena *arena, size_t size, int flags);
+void shm_arena_finish(struct shm_arena *arena);
+
+// Reserves `size` bytes and returns their offset in the arena, or -1 if no free range is large enough.
+long shm_arena_alloc(struct shm_arena *arena, size_t size);
+void shm_arena_free(struct shm_arena *arena, size_t offset, size_t size);
+
+// Wayland side, in shm_arena_wayland.c. The pool must be destroyed before the arena.
+void shm_arena_create_pool(struct shm_arena *arena, struct wl_shm *shm);
+void shm_arena_destroy_pool(struct shm_arena *arena);
+// The caller adds its wl_buffer listener. Returns -1 if the arena is full.
+int shm_arena_create_buffer(struct shm_arena *arena, struct shm_arena_buffer *buffer,
+                            int width, int height, int stride, uint32_t format);
+void shm_arena_destroy_buffer(struct shm_arena *arena, struct shm_arena_buffer *buffer);
+
+#endif
@@ -0,0 +1,42 @@
+#include <wayland-client.h>
+
+#include "shm_arena.h"
+
+void shm_arena_create_pool(struct shm_arena *arena, struct wl_shm *shm)
+{
+    arena->pool = wl_shm_create_pool(shm, arena->fd, arena->size);
+}
+
+void shm_arena_destroy_pool(struct shm_arena *arena)
+{
+    if (arena->pool)
+        wl_shm_pool_destroy(arena->pool);
+    arena->pool = NULL;
+}
+
+int shm_arena_create_buffer(struct shm_arena *arena, struct shm_arena_buffer *buffer,
+                            int width, int height, int stride, uint32_t format)
+{
+    long offset;
+
+    buffer->size = (size_t)stride * height;
+    offset = shm_arena_alloc(arena, buffer->size);
+    if (offset < 0)
+        return -1;
+
+    buffer->offset = offset;
+    buffer->data = arena->data + offset;
+    buffer->buffer = wl_shm_pool_create_buffer(arena->pool, offset, width, height, stride, format);
+    return 0;
+}
+
+void shm_arena_destroy_buffer(struct shm_arena *arena, struct shm_arena_buffer *buffer)
+{
+    if (!buffer->buffer)
+        return;
+
+    wl_buffer_destroy(buffer->buffer);
+    shm_arena_free(arena, buffer->offset, buffer->size);
+    buffer->buffer = NULL;
+    buffer->data = NULL;
+}
@@ -0,0 +1,255 @@
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "os_compat.h"
+#include "shm_swapchain.h"
+
+static void buffer_release(void *d, struct wl_buffer *wl_buffer)
+{
+    struct shm_swapchain_buffer *buffer = d;
+    buffer->busy = 0;
+}
+
+static const struct wl_buffer_listener buffer_listener = { buffer_release };
+
+static double now_seconds()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Grows the buffer's file, mapping and pool to hold at least `size` bytes.
+static int grow_buffer(struct shm_swapchain *chain, struct shm_swapchain_buffer *buffer, int size)
+{
+    // 1.5x growth: a drag growing the window a few pixels per frame only reallocates a
+    // handful of times.
+    int capacity = buffer->capacity + buffer->capacity / 2;
+    void *data;
+
+    if (capacity < size)
+        capacity = size;
+
+    if (ftruncate(buffer->fd, capacity) < 0) {
+        fprintf(stderr, "Failed to grow file to %d bytes: %m\n", capacity);
+        return -1;
+    }
+
+    data = mmap(0, capacity, PROT_READ | PROT_WRITE, MAP_SHARED, buffer->fd, 0);
+    if (data == MAP_FAILED) {
+        fprintf(stderr, "mmap failed: %m\n");
+        return -1;
+    }
+    munmap(buffer->data, buffer->capacity);
+    buffer->data = data;
+
+    wl_shm_pool_resize(buffer->pool, capacity);
+    buffer->capacity = capacity;
+    chain->stats.reallocations++;
+    return 0;
+}
+
+static int create_arena_buffer(struct shm_swapchain *chain, struct shm_swapchain_buffer *buffer)
+{
+    if (shm_arena_create_buffer(chain->arena, &buffer->arena_buffer, chain->width, chain->height, chain->stride, chain->format) < 0) {
+        fprintf(stderr, "SHM arena is full\n");
+        return -1;
+    }
+
+    buffer->buffer = buffer->arena_buffer.buffer;
+    buffer->data = buffer->arena_buffer.data;
+    wl_buffer_add_listener(buffer->buffer, &buffer_listener, buffer);
+    return 0;
+}
+
+// Recreates the wl_buffer at the swapchain's current size. The buffer must not be busy.
+static int resize_buffer(struct shm_swapchain *chain, struct shm_swapchain_buffer *buffer)
+{
+    int size = chain->stride * chain->height;
+
+    if (chain->arena) {
+        // Freeing first lets a shrinking buffer stay where it is.
+        shm_arena_destroy_buffer(chain->arena, &buffer->arena_buffer);
+        buffer->buffer = NULL;
+        if (create_arena_buffer(chain, buffer) < 0)
+            return -1;
+    } else {
+        if (size > buffer->capacity && grow_buffer(chain, buffer, size) < 0)
+            return -1;
+
+        wl_buffer_destroy(buffer->buffer);
+        buffer->buffer = wl_shm_pool_create_buffer(buffer->pool, 0, chain->width, chain->height, chain->stride, chain->format);
+        wl_buffer_add_listener(buffer->buffer, &buffer_listener, buffer);
+    }
+    buffer->width = chain->width;
+    buffer->height = chain->height;
+    // The old contents don't match the new size.
+    buffer->frame = 0;
+    chain->stats.resizes++;
+    return 0;
+}
+
+static int create_buffer(struct shm_swapchain *chain, struct shm_swapchain_buffer *buffer)
+{
+    int size = chain->stride * chain->height;
+
+    buffer->width = chain->width;
+    buffer->height = chain->height;
+    buffer->busy = 0;
+    buffer->frame = 0;
+    if (chain->arena)
+        return create_arena_buffer(chain, buffer);
+
+    buffer->fd = os_create_anonymous_file(size);
+    if (buffer->fd < 0) {
+        fprintf(stderr, "Failed to create file with %d bytes: %m\n", size);
+        return -1;
+    }
+
+    buffer->data = mmap(0, size, PROT_READ | PROT_WRITE, MAP_SHARED, buffer->fd, 0);
+    if (buffer->data == MAP_FAILED) {
+        fprintf(stderr, "mmap failed: %m\n");
+        buffer->data = NULL;
+        return -1;
+    }
+    buffer->capacity = size;
+
+    buffer->pool = wl_shm_create_pool(chain->shm, buffer->fd, size);
+    buffer->buffer = wl_shm_pool_create_buffer(buffer->pool, 0, chain->width, chain->height, chain->stride, chain->format);
+    wl_buffer_add_listener(buffer->buffer, &buffer_listener, buffer);
+    return 0;
+}
+
+int shm_swapchain_init(struct shm_swapchain *chain, struct wl_display *display, struct wl_shm *shm,
+                       struct shm_arena *arena, int width, int height, uint32_t format, int count)
+{
+    int i;
+
+    if (count < 2 || count > SHM_SWAPCHAIN_MAX_BUFFERS) {
+        fprintf(stderr, "Swapchain needs between 2 and %d buffers, got %d\n", SHM_SWAPCHAIN_MAX_BUFFERS, count);
+        return -1;
+    }
+
+    memset(chain, 0, sizeof(*chain));
+    chain->display = display;
+    chain->shm = shm;
+    chain->arena = arena;
+    chain->width = width;
+    chain->height = height;
+    chain->stride = width * 4;
+    chain->format = format;
+    chain->count = count;
+    for (i = 0; i < count; ++i)
+        chain->buffers[i].fd = -1;
+
+    for (i = 0; i < count; ++i) {
+        if (create_buffer(chain, &chain->buffers[i]) < 0) {
+            shm_swapchain_finish(chain);
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+void shm_swapchain_finish(struct shm_swapchain *chain)
+{
+    int i;
+
+    for (i = 0; i < chain->count; ++i) {
+        struct shm_swapchain_buffer *buffer = &chain->buffers[i];
+        if (chain->arena) {
+            shm_arena_destroy_buffer(chain->arena, &buffer->arena_buffer);
+            buffer->buffer = NULL;
+            buffer->data = NULL;
+        }
+        if (buffer->buffer)
+            wl_buffer_destroy(buffer->buffer);
+        if (buffer->pool)
+            wl_shm_pool_destroy(buffer->pool);
+        if (buffer->data)
+            munmap(buffer->data, buffer->capacity);
+        if (buffer->fd >= 0)
+            close(buffer->fd);
+        memset(buffer, 0, sizeof(*buffer));
+        buffer->fd = -1;
+    }
+}
+
+void shm_swapchain_resize(struct shm_swapchain *chain, int width, int height)
+{
+    chain->width = width;
+    chain->height = height;
+    chain->stride = width * 4;
+}
+
+// Brings a free buffer up to the swapchain's size. Returns NULL if that failed.
+static struct shm_swapchain_buffer *prepare_buffer(struct shm_swapchain *chain, struct shm_swapchain_buffer *buffer)
+{
+    if (buffer->width == chain->width && buffer->height == chain->height)
+        return buffer;
+    if (resize_buffer(chain, buffer) < 0)
+        return NULL;
+    return buffer;
+}
+
+static struct shm_swapchain_buffer *find_free_buffer(struct shm_swapchain *chain)
+{
+    int i;
+
+    for (i = 0; i < chain->count; ++i) {
+        if (!chain->buffers[i].busy)
+            return &chain->buffers[i];
+    }
+    return NULL;
+}
+
+struct shm_swapchain_buffer *shm_swapchain_acquire(struct shm_swapchain *chain, enum shm_swapchain_wait wait)
+{
+    struct shm_swapchain_buffer *buffer;
+    double start;
+
+    buffer = find_free_buffer(chain);
+    if (buffer) {
+        chain->stats.acquired++;
+        return prepare_buffer(chain, buffer);
+    }
+
+    chain->stats.stalls++;
+    if (wait == SHM_SWAPCHAIN_DROP) {
+        chain->stats.dropped++;
+        return NULL;
+    }
+
+    start = now_seconds();
+    while (!(buffer = find_free_buffer(chain))) {
+        if (wl_display_dispatch(chain->display) == -1)
+            break;
+    }
+    chain->stats.stall_seconds += now_seconds() - start;
+
+    if (!buffer) {
+        chain->stats.dropped++;
+        return NULL;
+    }
+
+    chain->stats.acquired++;
+    return prepare_buffer(chain, buffer);
+}
+
+void shm_swapchain_attach(struct shm_swapchain *chain, struct shm_swapchain_buffer *buffer, struct wl_surface *surface)
+{
+    wl_surface_attach(surface, buffer->buffer, 0, 0);
+    buffer->busy = 1;
+    buffer->frame = ++chain->frames;
+}
+
+unsigned shm_swapchain_buffer_age(const struct shm_swapchain *chain, const struct shm_swapchain_buffer *buffer)
+{
+    if (!buffer->frame)
+        return 0;
+    return chain->frames - buffer->frame + 1;
+}
@@ -0,0 +1,81 @@
+#ifndef SHM_SWAPCHAIN_H
+#define SHM_SWAPCHAIN_H
+
+#include <stdint.h>
+#include <wayland-client.h>
+
+#include "shm_arena.h"
+
+#define SHM_SWAPCHAIN_MAX_BUFFERS 8
+
+// What shm_swapchain_acquire() does when the compositor holds every buffer.
+enum shm_swapchain_wait {
+    SHM_SWAPCHAIN_BLOCK, // dispatch events until a buffer is released
+    SHM_SWAPCHAIN_DROP,  // give up and let the caller skip the frame
+};
+
+struct shm_swapchain_buffer {
+    struct wl_buffer *buffer;
+    void *data;
+    // Without an arena, each buffer keeps its own pool and the file behind it, so the backing
+    // store can grow in place. With one, `arena_buffer` is the range it got from the arena.
+    struct shm_arena_buffer arena_buffer;
+    struct wl_shm_pool *pool;
+    int fd;
+    int capacity;
+    // Size of `buffer`, which lags behind the swapchain's until the buffer is next acquired.
+    int width;
+    int height;
+    int busy;
+    // Swapchain frame at which this buffer was last attached, 0 if never.
+    uint64_t frame;
+};
+
+struct shm_swapchain_stats {
+    unsigned acquired;
+    // Acquires that found no free buffer, and how long they waited in total.
+    unsigned stalls;
+    double stall_seconds;
+    unsigned dropped;
+    // Buffers recreated at a new size, and how many of those had to grow their backing store.
+    unsigned resizes;
+    unsigned reallocations;
+};
+
+struct shm_swapchain {
+    struct wl_display *display;
+    struct wl_shm *shm;
+    int width;
+    int height;
+    int stride;
+    uint32_t format;
+    struct shm_arena *arena;
+    int count;
+    uint64_t frames;
+    struct shm_swapchain_buffer buffers[SHM_SWAPCHAIN_MAX_BUFFERS];
+    struct shm_swapchain_stats stats;
+};
+
+// Allocates `count` (2 to SHM_SWAPCHAIN_MAX_BUFFERS) buffers, from `arena` if not NULL, or each
+// from its own pool otherwise. The arena must have a pool. Returns -1 on failure.
+int shm_swapchain_init(struct shm_swapchain *chain, struct wl_display *display, struct wl_shm *shm,
+                       struct shm_arena *arena, int width, int height, uint32_t format, int count);
+void shm_swapchain_finish(struct shm_swapchain *chain);
+
+// Makes acquired buffers `width` x `height` from now on. Buffers are only resized once free, and
+// their backing store grows geometrically and never shrinks, so a resize drag reallocates rarely.
+void shm_swapchain_resize(struct shm_swapchain *chain, int width, int height);
+
+// Returns a buffer the compositor is not reading from, or NULL if the frame was dropped.
+// Must not be called from inside a Wayland event handler when blocking.
+struct shm_swapchain_buffer *shm_swapchain_acquire(struct shm_swapchain *chain, enum shm_swapchain_wait wait);
+
+// Attaches the buffer to the surface; it stays busy until the compositor releases it.
+// The caller adds damage and commits.
+void shm_swapchain_attach(struct shm_swapchain *chain, struct shm_swapchain_buffer *buffer, struct wl_surface *surface);
+
+// How many frames old the buffer contents are, with the same meaning as EGL_EXT_buffer_age:
+// 1 means it holds the last attached frame, 0 that its contents are undefined.
+unsigned shm_swapchain_buffer_age(const struct shm_swapchain *chain, const struct shm_swapchain_buffer *buffer);
+
+#endif
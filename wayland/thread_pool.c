@@ -0,0 +1,151 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "thread_pool.h"
+
+struct worker {
+    struct thread_pool *pool;
+    int index;
+};
+
+static void run_tasks(struct thread_pool *pool, int worker)
+{
+    unsigned long steals = 0;
+    int i, task;
+
+    for (i = 0; i < pool->thread_count; ++i) {
+        int victim = (worker + i) % pool->thread_count;
+        struct thread_pool_queue *queue = &pool->queues[victim];
+
+        while ((task = atomic_fetch_add_explicit(&queue->next, 1, memory_order_relaxed)) < queue->end) {
+            pool->task(pool->context, task);
+            if (victim != worker)
+                steals++;
+        }
+    }
+
+    if (steals)
+        atomic_fetch_add_explicit(&pool->steals, steals, memory_order_relaxed);
+}
+
+static void *worker_main(void *d)
+{
+    struct worker *worker = d;
+    struct thread_pool *pool = worker->pool;
+    unsigned generation = 0;
+
+    while (1) {
+        pthread_mutex_lock(&pool->mutex);
+        while (pool->generation == generation && !pool->quit)
+            pthread_cond_wait(&pool->start, &pool->mutex);
+        generation = pool->generation;
+        if (pool->quit) {
+            pthread_mutex_unlock(&pool->mutex);
+            break;
+        }
+        pthread_mutex_unlock(&pool->mutex);
+
+        run_tasks(pool, worker->index);
+
+        pthread_mutex_lock(&pool->mutex);
+        if (!--pool->running)
+            pthread_cond_signal(&pool->done);
+        pthread_mutex_unlock(&pool->mutex);
+    }
+
+    free(worker);
+    return NULL;
+}
+
+int thread_pool_init(struct thread_pool *pool, int threads)
+{
+    int i;
+
+    memset(pool, 0, sizeof(*pool));
+    if (threads <= 0)
+        threads = sysconf(_SC_NPROCESSORS_ONLN);
+    if (threads <= 0)
+        threads = 1;
+
+    pool->thread_count = threads;
+    pool->threads = calloc(threads, sizeof(*pool->threads));
+    pool->queues = aligned_alloc(64, threads * sizeof(*pool->queues));
+    if (!pool->threads || !pool->queues) {
+        free(pool->threads);
+        free(pool->queues);
+        return -1;
+    }
+    memset(pool->queues, 0, threads * sizeof(*pool->queues));
+    pthread_mutex_init(&pool->mutex, NULL);
+    pthread_cond_init(&pool->start, NULL);
+    pthread_cond_init(&pool->done, NULL);
+
+    for (i = 1; i < threads; ++i) {
+        struct worker *worker = malloc(sizeof(*worker));
+
+        if (worker) {
+            worker->pool = pool;
+            worker->index = i;
+        }
+        if (!worker || pthread_create(&pool->threads[i], NULL, worker_main, worker)) {
+            fprintf(stderr, "Failed to start worker thread %d\n", i);
+            free(worker);
+            pool->thread_count = i;
+            thread_pool_finish(pool);
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+void thread_pool_finish(struct thread_pool *pool)
+{
+    int i;
+
+    pthread_mutex_lock(&pool->mutex);
+    pool->quit = 1;
+    pthread_cond_broadcast(&pool->start);
+    pthread_mutex_unlock(&pool->mutex);
+
+    for (i = 1; i < pool->thread_count; ++i)
+        pthread_join(pool->threads[i], NULL);
+
+    pthread_cond_destroy(&pool->done);
+    pthread_cond_destroy(&pool->start);
+    pthread_mutex_destroy(&pool->mutex);
+    free(pool->threads);
+    free(pool->queues);
+    memset(pool, 0, sizeof(*pool));
+}
+
+void thread_pool_run(struct thread_pool *pool, int count, thread_pool_task task, void *context)
+{
+    int i;
+
+    pool->task = task;
+    pool->context = context;
+    for (i = 0; i < pool->thread_count; ++i) {
+        atomic_store_explicit(&pool->queues[i].next, (int)((long)count * i / pool->thread_count), memory_order_relaxed);
+        pool->queues[i].end = (int)((long)count * (i + 1) / pool->thread_count);
+    }
+
+    // The mutex publishes the batch to the workers, and their results back to us.
+    pthread_mutex_lock(&pool->mutex);
+    pool->running = pool->thread_count - 1;
+    pool->generation++;
+    pthread_cond_broadcast(&pool->start);
+    pthread_mutex_unlock(&pool->mutex);
+
+    run_tasks(pool, 0);
+
+    pthread_mutex_lock(&pool->mutex);
+    while (pool->running)
+        pthread_cond_wait(&pool->done, &pool->mutex);
+    pthread_mutex_unlock(&pool->mutex);
+
+    pool->stats.batches++;
+    pool->stats.steals = atomic_load_explicit(&pool->steals, memory_order_relaxed);
+}
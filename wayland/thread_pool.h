@@ -0,0 +1,54 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+
+typedef void (*thread_pool_task)(void *context, int task);
+
+// Tasks [next, end) not yet taken from one worker. Both the owner and thieves take tasks
+// with an atomic increment, so no lock is needed.
+struct thread_pool_queue {
+    atomic_int next;
+    int end;
+    // One queue per cache line, or workers taking tasks would contend even without stealing.
+    char padding[56];
+};
+
+struct thread_pool_stats {
+    unsigned batches;
+    // Tasks run by a worker other than the one they were handed to.
+    unsigned long steals;
+};
+
+// Fixed set of workers running batches of independent tasks. Each worker starts on a contiguous
+// range of the batch, which keeps neighbouring tiles on the same core, and steals from the
+// others once it runs out, so uneven tasks still keep every core busy.
+struct thread_pool {
+    // Including the thread calling thread_pool_run(), which is worker 0.
+    int thread_count;
+    pthread_t *threads;
+    struct thread_pool_queue *queues;
+
+    pthread_mutex_t mutex;
+    pthread_cond_t start;
+    pthread_cond_t done;
+    unsigned generation;
+    int running;
+    int quit;
+
+    thread_pool_task task;
+    void *context;
+
+    atomic_ulong steals;
+    struct thread_pool_stats stats;
+};
+
+// Starts `threads` - 1 worker threads, or one per online CPU when `threads` <= 0. Returns -1 on failure.
+int thread_pool_init(struct thread_pool *pool, int threads);
+void thread_pool_finish(struct thread_pool *pool);
+
+// Runs task(context, i) for i in [0, count) across the pool and returns once all of them ran.
+void thread_pool_run(struct thread_pool *pool, int count, thread_pool_task task, void *context);
+
+#endif